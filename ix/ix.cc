@@ -20,14 +20,23 @@ IndexRecord::IndexRecord(const IndexRecord& that) {
     }
 }
 
-IndexManager* IndexManager::_index_manager = 0;
+atomic<IndexManager*> IndexManager::_index_manager(NULL);
+mutex IndexManager::_instanceMutex;
 
 IndexManager* IndexManager::instance()
 {
-    if(!_index_manager)
-        _index_manager = new IndexManager();
-
-    return _index_manager;
+    IndexManager *instance = _index_manager.load(memory_order_acquire);
+    if (instance)
+        return instance;
+
+    // Threads racing to get here first create a single instance
+    lock_guard<mutex> lock(_instanceMutex);
+    instance = _index_manager.load(memory_order_relaxed);
+    if (!instance) {
+        instance = new IndexManager();
+        _index_manager.store(instance, memory_order_release);
+    }
+    return instance;
 }
 
 IndexManager::IndexManager()
@@ -43,22 +52,30 @@ RC IndexManager::newPage(FileHandle &fileHandle,
                          const bool isLeaf,
                          const PageNum num)
 {
-    IndexPageFooter footer;
-    footer.pageNum = fileHandle.getNumberOfPages();
-    footer.freeMemoryOffset = 0;
-    footer.numSlots = 0;
-    footer.isLeaf = isLeaf;
-    if (isLeaf)
-        footer.nextLeaf = num;
-    else 
-        footer.child = num;
-    footer.firstRID.pageNum = 0;
-    footer.firstRID.slotNum = 0;
+    PageNum pageNum;
+    return newPage(fileHandle, isLeaf, num, pageNum);
+}
 
-    unsigned char buffer[PAGE_SIZE] = {0};
-    memcpy(buffer + PAGE_SIZE - sizeof(IndexPageFooter), &footer, sizeof(IndexPageFooter));
+// Other handles on the file may append too, so the page lands wherever the
+// file ends by then. Its footer is written for the page count seen first,
+// and again if the page landed elsewhere.
+RC IndexManager::newPage(FileHandle &fileHandle,
+                         const bool isLeaf,
+                         const PageNum num,
+                         PageNum &pageNum)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
+    PageNum expected = fileHandle.getNumberOfPages();
+    initPage(fileHandle, expected, isLeaf, num, buffer);
 
-    return fileHandle.appendPage(buffer);
+    RC ret = fileHandle.appendPage(buffer, pageNum);
+    RETURN_ON_ERR(ret);
+    if (pageNum == expected)
+        return err::OK;
+
+    initPage(fileHandle, pageNum, isLeaf, num, buffer);
+    return fileHandle.writePage(pageNum, buffer);
 }
 
 RC IndexManager::initPage(FileHandle &fileHandle,
@@ -78,7 +95,8 @@ RC IndexManager::initPage(FileHandle &fileHandle,
         footer.child = num;
     footer.firstRID.pageNum = 0;
     footer.firstRID.slotNum = 0;
-    memcpy(buffer + PAGE_SIZE - sizeof(IndexPageFooter), &footer, sizeof(IndexPageFooter));
+    footer.lsn = 0;
+    memcpy(buffer + fileHandle.getPageSize() - sizeof(IndexPageFooter), &footer, sizeof(IndexPageFooter));
     return err::OK;
 }
 
@@ -87,55 +105,49 @@ RC IndexManager::newRootPage(FileHandle& fileHandle,
                              AttrType type,
                              IndexRecord& divider)
 {
-    IndexPageFooter footer;
-    footer.pageNum = fileHandle.getNumberOfPages();
-    footer.freeMemoryOffset = 0;
-    footer.numSlots = 0;
-    footer.isLeaf = false;
-
-    footer.child = num;
-
-    footer.firstRID.pageNum = 0;
-    footer.firstRID.slotNum = 0;
-
-    unsigned char buffer[PAGE_SIZE] = {0};
-    memcpy(buffer + PAGE_SIZE - sizeof(IndexPageFooter), &footer, sizeof(IndexPageFooter));
+    // The page is appended first, so that the records know where they are
+    PageNum pageNum;
+    RC ret = newPage(fileHandle, false, num, pageNum);
+    RETURN_ON_ERR(ret);
 
-    RC ret = insertInOrder(divider.key, type, divider.rid, buffer);
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
+    initPage(fileHandle, pageNum, false, num, buffer);
+    ret = insertInOrder(divider.key, type, divider.rid, buffer, pageSize);
     RETURN_ON_ERR(ret);
 
-    ret = fileHandle.appendPage(buffer);
+    ret = fileHandle.writePage(pageNum, buffer);
     RETURN_ON_ERR(ret);
 
     // Recover file header to get root page location
-    unsigned char reservedPage[PAGE_SIZE] = {0};
+    PageBuffer reservedPage(1, pageSize);
     ret = fileHandle.readPage(0, reservedPage);
     RETURN_ON_ERR(ret);
 
     // update file header, and cache root page num
-    IndexFileHeader* ixfh = (IndexFileHeader*)reservedPage;
-    ixfh->root = footer.pageNum;
-    _rootMap[fileHandle.getFileName()] = footer.pageNum;
+    IndexFileHeader* ixfh = (IndexFileHeader*)(unsigned char*)reservedPage;
+    ixfh->root = pageNum;
+    fileHandle.setRootPage(pageNum);
 
     return fileHandle.writePage(0, reservedPage);
 }
 
-RC IndexManager::createFile(const string &fileName)
+RC IndexManager::createFile(const string &fileName, unsigned pageSize)
 {
-    RC ret = _pfm.createFile(fileName);
+    RC ret = _pfm.createFile(fileName, pageSize);
     RETURN_ON_ERR(ret);
 
     IndexFileHeader ixfh;
     ixfh.root = 1;
 
     FileHandle fileHandle;
-    _pfm.openFile(fileName, fileHandle);
+    openFile(fileName, fileHandle);
     
 
     // Write reserved page with location root (initially pageNum 1)
     // Cache root page location
-    _rootMap[fileName] = 1;
-    unsigned char buffer[PAGE_SIZE] = {0};
+    fileHandle.setRootPage(1);
+    PageBuffer buffer(1, pageSize);
     memcpy(buffer, &ixfh, sizeof(IndexFileHeader));
     fileHandle.appendPage(buffer);
     
@@ -147,15 +159,41 @@ RC IndexManager::createFile(const string &fileName)
 	return err::OK;
 }
 
+// Cuts the file back to its header page and an empty root leaf, as
+// createFile leaves it, in the same time however large the tree is
+
+RC IndexManager::truncateFile(FileHandle &fileHandle)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    RC ret = fileHandle.truncate(2);
+    RETURN_ON_ERR(ret);
+
+    PageBuffer buffer(2, pageSize);
+    ret = fileHandle.readPage(0, buffer);
+    RETURN_ON_ERR(ret);
+    IndexFileHeader* ixfh = (IndexFileHeader*)(unsigned char*)buffer;
+    ixfh->root = 1;
+    fileHandle.setRootPage(1);
+    initPage(fileHandle, 1, true, 0, buffer + pageSize);
+
+    return fileHandle.writePages(0, 2, buffer);
+}
+
 RC IndexManager::destroyFile(const string &fileName)
 {
     return _pfm.destroyFile(fileName);
 }
 
 RC IndexManager::openFile(const string &fileName, 
-                          FileHandle &fileHandle)
+                          FileHandle &fileHandle,
+                          unsigned flags)
 {
-    return _pfm.openFile(fileName, fileHandle);
+    RC ret = _pfm.openFile(fileName, fileHandle, flags | OPEN_LOGGED);
+    if (ret != err::OK)
+        return ret;
+
+    // Lookups jump between pages of the tree
+    return fileHandle.advise(ACCESS_RANDOM);
 }
 
 RC IndexManager::closeFile(FileHandle &fileHandle)
@@ -163,25 +201,27 @@ RC IndexManager::closeFile(FileHandle &fileHandle)
     return _pfm.closeFile(fileHandle);
 }
 
-IndexPageFooter* IndexManager::getIXFooter(const void* buffer) 
+IndexPageFooter* IndexManager::getIXFooter(const void* buffer, unsigned pageSize) 
 {
-    return (IndexPageFooter*)((char*)buffer + PAGE_SIZE - sizeof(IndexPageFooter));
+    return (IndexPageFooter*)((char*)buffer + pageSize - sizeof(IndexPageFooter));
 }
 
 void IndexManager::writeIXSlot(void* buffer,
                                unsigned slotNum,
-                               IndexSlot* slot)
+                               IndexSlot* slot,
+                               unsigned pageSize)
 {                                              
-    unsigned offset = PAGE_SIZE;
+    unsigned offset = pageSize;
     offset -= sizeof(IndexPageFooter);
     offset -= ((slotNum + 1) * sizeof(IndexSlot));
     memcpy((char*)buffer + offset, slot, sizeof(IndexSlot));
 } 
 
 IndexSlot* IndexManager::getIXSlot(const int slotNum, 
-                                   const void* buffer)
+                                   const void* buffer,
+                                   unsigned pageSize)
 {
-    unsigned offset = PAGE_SIZE;
+    unsigned offset = pageSize;
     offset -= sizeof(IndexPageFooter);
     offset -= ((slotNum + 1) * sizeof(IndexSlot));
     return (IndexSlot*)((char*)buffer + offset);
@@ -189,7 +229,7 @@ IndexSlot* IndexManager::getIXSlot(const int slotNum,
 
 RC IndexManager::loadIXRecord(unsigned size, 
                               unsigned offset, 
-                              unsigned char* buffer, 
+                              const unsigned char* buffer, 
                               AttrType type, 
                               IndexRecord &record) {
     record.key.size = size - 2*sizeof(RID);
@@ -215,18 +255,18 @@ RC IndexManager::loadIXRecord(unsigned size,
 
 PageNum IndexManager::rootPageNum(FileHandle &fileHandle)
 {
-    string fileName = fileHandle.getFileName();
-    if (_rootMap.find(fileName) != _rootMap.end()) 
-        return _rootMap[fileName];
+    PageNum root = fileHandle.getRootPage();
+    if (root != NO_PAGE)
+        return root;
 
-    unsigned char reservedPage[PAGE_SIZE] = {0};
+    PageBuffer reservedPage(1, fileHandle.getPageSize());
     RC ret = fileHandle.readPage(0, reservedPage);
     RETURN_ON_ERR(ret);
 
     // Recover file header to get root page location
-    IndexFileHeader* ixfh = (IndexFileHeader*)reservedPage;
+    IndexFileHeader* ixfh = (IndexFileHeader*)(unsigned char*)reservedPage;
     
-    _rootMap[fileName] = ixfh->root;
+    fileHandle.setRootPage(ixfh->root);
     return ixfh->root;
 }
 
@@ -254,27 +294,29 @@ RC IndexManager::loadKeyData(const void* data,
     return err::OK;
 }
 
-RC IndexManager::loadLeafPage(FileHandle &fileHandle, 
+RC IndexManager::findLeafPage(FileHandle &fileHandle, 
                               KeyData &key, 
                               AttrType type, 
                               vector<PageNum>& parents, 
-                              unsigned char* buffer)
+                              PageGuard& page)
 {
-    // Read in root page
-    RC ret = loadRootPage(fileHandle, buffer);
+    // Pin the root page
+    RC ret = page.pin(fileHandle, rootPageNum(fileHandle));
     RETURN_ON_ERR(ret);
 
-    IndexPageFooter* footer = getIXFooter(buffer);
+    unsigned pageSize = fileHandle.getPageSize();
+    const unsigned char* buffer = (const unsigned char*) page.data();
+    IndexPageFooter* footer = getIXFooter(buffer, pageSize);
     if (footer->isLeaf) return err::OK;
 
     // Load up first record on page. Since root is not a leaf, we know there must be at least one entry
-    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer);
+    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
     IndexRecord record;
     PageNum child;
     ret = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
     RETURN_ON_ERR(ret);
 
-    // traverse tree
+    // traverse tree, pinning one page at a time
     while (not footer->isLeaf) {
         // At beginning of each iteration of this loop, record is the FIRST
         // record on the page w.r.t. the key's ordering
@@ -282,9 +324,11 @@ RC IndexManager::loadLeafPage(FileHandle &fileHandle,
 
         // Check if key belongs in a leftmost descendent of current page
         if (key.compare(record.key) < 0) {
-            ret = fileHandle.readPage(footer->child, buffer);
+            ret = page.pin(fileHandle, footer->child);
             RETURN_ON_ERR(ret);
-            slot = getIXSlot(footer->firstRID.slotNum, buffer);
+            buffer = (const unsigned char*) page.data();
+            footer = getIXFooter(buffer, pageSize);
+            slot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
             ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
             RETURN_ON_ERR(ret);
             continue;
@@ -295,7 +339,7 @@ RC IndexManager::loadLeafPage(FileHandle &fileHandle,
             // Save the current child page: it will be the correct child if we break next iteration
             child = record.rid.pageNum;
             // Update record to the next one
-            slot = getIXSlot(record.nextSlot.slotNum, buffer);
+            slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
             ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
             RETURN_ON_ERR(ret);
         }
@@ -304,21 +348,24 @@ RC IndexManager::loadLeafPage(FileHandle &fileHandle,
         if (key.compare(record.key) >= 0 && record.nextSlot.pageNum != footer->pageNum) 
             child = record.rid.pageNum;
 
-        ret = fileHandle.readPage(child, buffer);
+        ret = page.pin(fileHandle, child);
         RETURN_ON_ERR(ret);
-        slot = getIXSlot(footer->firstRID.slotNum, buffer);
+        buffer = (const unsigned char*) page.data();
+        footer = getIXFooter(buffer, pageSize);
+        slot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
         RETURN_ON_ERR(ret);
     }
     return err::OK;
 }
 
-bool IndexManager::needsToSplit(KeyData& key, IndexPageFooter* footer) {
+bool IndexManager::needsToSplit(KeyData& key, IndexPageFooter* footer, unsigned pageSize) {
     // Returns true if and only if we can insert key into current page
-    unsigned space = PAGE_SIZE - sizeof(IndexPageFooter) 
+    unsigned space = pageSize - sizeof(IndexPageFooter) 
                                - footer->numSlots*sizeof(IndexSlot) 
                                - footer->freeMemoryOffset;
-    return space < key.size + 2 * sizeof(RID);
+    // the new entry needs a slot as well as room for its record
+    return space < key.size + 2 * sizeof(RID) + sizeof(IndexSlot);
 }
 
 RC IndexManager::splitHandler(FileHandle& fileHandle, 
@@ -331,12 +378,17 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
     // buffer has page to be split
     // parents has successive ancestors of leaf page
     // bring up two new buffers
-    unsigned char lowerHalf[PAGE_SIZE] = {0};
-    unsigned char upperHalf[PAGE_SIZE] = {0};
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer lowerHalf(1, pageSize);
+    PageBuffer upperHalf(1, pageSize);
 
-    IndexPageFooter* footer = getIXFooter(buffer);
+    IndexPageFooter* footer = getIXFooter(buffer, pageSize);
 
-    PageNum upperHalfPageNum = fileHandle.getNumberOfPages();
+    // The upper half goes on a page of its own, appended now so that the
+    // links to it can be set
+    PageNum upperHalfPageNum;
+    RC ret = newPage(fileHandle, footer->isLeaf, 0, upperHalfPageNum);
+    RETURN_ON_ERR(ret);
 
     if (footer->isLeaf) { 
         // Now "nextLeaf" is the upper half
@@ -346,21 +398,21 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
         initPage(fileHandle, footer->pageNum, footer->isLeaf, footer->child, lowerHalf);
     }
 
-    // begin writing records to lowerHalf until we have written more than PAGE_SIZE/2
-    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer);
+    // begin writing records to lowerHalf until we have written more than pageSize/2
+    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
     IndexRecord record;
-    RC ret = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
+    ret = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
     RETURN_ON_ERR(ret);
     
     bool halfFull = false;
-    const unsigned totalSpace = PAGE_SIZE - sizeof(IndexPageFooter);
+    const unsigned totalSpace = pageSize - sizeof(IndexPageFooter);
     unsigned availableSpace = totalSpace;
     while (not halfFull) {
-        insertInOrder(record.key, type, record.rid, lowerHalf);
+        insertInOrder(record.key, type, record.rid, lowerHalf, pageSize);
         availableSpace -= sizeof(IndexSlot);
         availableSpace -= slot->recordSize;
         halfFull = 2 * availableSpace < totalSpace; 
-        slot = getIXSlot(record.nextSlot.slotNum, buffer);
+        slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
         RETURN_ON_ERR(ret);
     }
@@ -368,7 +420,7 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
     // Cache the middle value 
     IndexRecord divider;
     divider.key = record.key;
-    divider.rid.pageNum = fileHandle.getNumberOfPages();
+    divider.rid.pageNum = upperHalfPageNum;
 
     // Now we copy remaining entries to upperHalf
 
@@ -377,7 +429,7 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
         // ... otherwise we load next record, and set new interior node's leftmost child
         // to the child of the middle record
         initPage(fileHandle, upperHalfPageNum, footer->isLeaf, record.rid.pageNum, upperHalf);
-        slot = getIXSlot(record.nextSlot.slotNum, buffer);
+        slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
         RETURN_ON_ERR(ret);
     }else {
@@ -385,18 +437,18 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
     }
 
     while (true) {
-        insertInOrder(record.key, type, record.rid, upperHalf);
+        insertInOrder(record.key, type, record.rid, upperHalf, pageSize);
         if (record.nextSlot.pageNum != footer->pageNum) break;
-        slot = getIXSlot(record.nextSlot.slotNum, buffer);
+        slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, type, record);
         RETURN_ON_ERR(ret);
     }
 
     // Finally insert the key
     if (key.compare(divider.key) < 0) {
-        ret = insertInOrder(key, type, rid, lowerHalf);
+        ret = insertInOrder(key, type, rid, lowerHalf, pageSize);
     } else {
-        ret = insertInOrder(key, type, rid, upperHalf);
+        ret = insertInOrder(key, type, rid, upperHalf, pageSize);
     }
     RETURN_ON_ERR(ret);
 
@@ -404,13 +456,13 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
     // on upperHalf
     if (footer->isLeaf) {
         RID linkRID;
-        linkRID.pageNum = fileHandle.getNumberOfPages();
+        linkRID.pageNum = upperHalfPageNum;
         linkRID.slotNum = 0;
-        IndexPageFooter *lowerFooter = getIXFooter(lowerHalf);
-        slot = getIXSlot(lowerFooter->firstRID.slotNum, lowerHalf);
+        IndexPageFooter *lowerFooter = getIXFooter(lowerHalf, pageSize);
+        slot = getIXSlot(lowerFooter->firstRID.slotNum, lowerHalf, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, lowerHalf, type, record);
         while (record.nextSlot.pageNum == lowerFooter->pageNum) {
-            slot = getIXSlot(record.nextSlot.slotNum, lowerHalf);
+            slot = getIXSlot(record.nextSlot.slotNum, lowerHalf, pageSize);
             ret  = loadIXRecord(slot->recordSize, slot->recordOffset, lowerHalf, type, record);
         }
         memcpy(lowerHalf + slot->recordOffset + slot->recordSize - sizeof(RID), &linkRID, sizeof(RID));
@@ -420,12 +472,12 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
     // overwrite the split page
     fileHandle.writePage(footer->pageNum, lowerHalf);
     // update buffer contents 
-    memcpy(buffer, lowerHalf, sizeof(PAGE_SIZE));
+    memcpy(buffer, lowerHalf, pageSize);
     // Write upperHalf to file
-    fileHandle.appendPage(upperHalf);
+    fileHandle.writePage(upperHalfPageNum, upperHalf);
 
     // we are not fininished: we need to update ancestor nodes
-    unsigned char parentBuffer[PAGE_SIZE] = {0};
+    PageBuffer parentBuffer(1, pageSize);
     // if the split page is root, then create new root page
     if (parents.empty()) {
         ret =  newRootPage(fileHandle, footer->pageNum, type, divider);
@@ -435,15 +487,15 @@ RC IndexManager::splitHandler(FileHandle& fileHandle,
         PageNum parent = parents.back();
         parents.pop_back();
         fileHandle.readPage(parent, parentBuffer);
-        IndexPageFooter* parentFooter = getIXFooter(parentBuffer);
-        if (needsToSplit(divider.key, parentFooter)) {
+        IndexPageFooter* parentFooter = getIXFooter(parentBuffer, pageSize);
+        if (needsToSplit(divider.key, parentFooter, pageSize)) {
             // Recurse
             ret = splitHandler(fileHandle, parents, type, divider.key, divider.rid, parentBuffer);
             RETURN_ON_ERR(ret);
             // Now parent buffer has lower half of its original contents
         } else {
             // Sweet, we can just insert in the parent and we are done
-            ret = insertInOrder(divider.key, type, divider.rid, parentBuffer);
+            ret = insertInOrder(divider.key, type, divider.rid, parentBuffer, pageSize);
             RETURN_ON_ERR(ret);
             return fileHandle.writePage(parentFooter->pageNum, parentBuffer);
         }
@@ -487,14 +539,14 @@ RC IndexManager::writeRecordToBuffer(KeyData& key,
     return err::OK;
 }
 
-RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsigned char* buffer) 
+RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsigned char* buffer, unsigned pageSize) 
 {
     if (type == TypeInt && key.integer == 4946)
         cout <<"";
     
     // recover footer from page, locate first slot w.r.t. key order
-    IndexPageFooter* footer = getIXFooter(buffer);
-    IndexSlot* currSlot = getIXSlot(footer->firstRID.slotNum, buffer);
+    IndexPageFooter* footer = getIXFooter(buffer, pageSize);
+    IndexSlot* currSlot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
     IndexSlot* prevSlot;
     IndexRecord record;
     RID currRID = footer->firstRID;
@@ -515,7 +567,7 @@ RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsi
     if (footer->numSlots == 0) {
         // write record at start of free memory
         writeRecordToBuffer(key, rid, blankRID, type, footer, buffer); 
-        writeIXSlot(buffer, newRID.slotNum, &newSlot);
+        writeIXSlot(buffer, newRID.slotNum, &newSlot, pageSize);
         footer->firstRID = newRID;
         footer->numSlots++;
 
@@ -530,7 +582,7 @@ RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsi
     if (key.compare(record.key) < 0) {
         // write record at start of free memory
         writeRecordToBuffer(key, rid, currRID, type, footer, buffer); 
-        writeIXSlot(buffer, newRID.slotNum, &newSlot);
+        writeIXSlot(buffer, newRID.slotNum, &newSlot, pageSize);
         footer->firstRID = newRID;
     } else {
         // iterate through linked list, skipping dead entries
@@ -543,13 +595,13 @@ RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsi
                     // update "previous" entry to point to new record
                     memcpy(buffer + currSlot->recordOffset + currSlot->recordSize - sizeof(RID), &newRID, sizeof(RID));
                     // write new slot
-                    writeIXSlot(buffer, newRID.slotNum, &newSlot);
+                    writeIXSlot(buffer, newRID.slotNum, &newSlot, pageSize);
                     footer->numSlots++;
 
                     return err::OK;
                 }
                 prevSlot = currSlot;
-                currSlot = getIXSlot(currRID.slotNum, buffer);
+                currSlot = getIXSlot(currRID.slotNum, buffer, pageSize);
                 currRID = record.nextSlot;
                 ret  = loadIXRecord(currSlot->recordSize, currSlot->recordOffset, buffer, type, record);
                 RETURN_ON_ERR(ret);
@@ -561,7 +613,7 @@ RC IndexManager::insertInOrder(KeyData& key, AttrType type, const RID &rid, unsi
         // update "previous" entry to point to new record
         memcpy(buffer + prevSlot->recordOffset + prevSlot->recordSize - sizeof(RID), &newRID, sizeof(RID));
         // write new slot
-        writeIXSlot(buffer, newRID.slotNum, &newSlot);
+        writeIXSlot(buffer, newRID.slotNum, &newSlot, pageSize);
     }
 
 
@@ -581,25 +633,26 @@ RC IndexManager::insertEntry(FileHandle &fileHandle,
     RC ret = loadKeyData(key, attribute, key_struct);
     RETURN_ON_ERR(ret);
 
-    unsigned char buffer[PAGE_SIZE] = {0};
+    PageGuard leaf;
     vector<PageNum> parents;
-    ret = loadLeafPage(fileHandle, key_struct, attribute.type, parents, buffer);
+    ret = findLeafPage(fileHandle, key_struct, attribute.type, parents, leaf);
     RETURN_ON_ERR(ret);
 
     // Check if leaf page must be split
     // If not, insert the entry and finish.
     // Otherwise, perform cascading splits 
+    unsigned pageSize = fileHandle.getPageSize();
+    IndexPageFooter* footer = getIXFooter(leaf.data(), pageSize);
 
-    IndexPageFooter* footer = getIXFooter(buffer);
-
-    if (not needsToSplit(key_struct, footer)) {
-        // Otherwise we can just perform insertion
-        ret = insertInOrder(key_struct, attribute.type, rid, buffer);
-        RETURN_ON_ERR(ret);
-        return fileHandle.writePage(footer->pageNum, buffer);
+    if (not needsToSplit(key_struct, footer, pageSize)) {
+        // Otherwise we can just perform insertion, directly in the pinned leaf
+        return insertInOrder(key_struct, attribute.type, rid, (unsigned char*) leaf.mutableData(), pageSize);
     } else {
         // Pass control to split handler
         // Will perform cascade of splits and also insert necessary entries
+        PageBuffer buffer(1, pageSize);
+        memcpy(buffer, leaf.data(), pageSize);
+        leaf.release();
 
         return splitHandler(fileHandle, parents, attribute.type, key_struct, rid, buffer);
     }
@@ -615,16 +668,17 @@ RC IndexManager::deleteEntry(FileHandle &fileHandle,
     RC ret = loadKeyData(key, attribute, key_struct);
     RETURN_ON_ERR(ret);
 
-    unsigned char buffer[PAGE_SIZE] = {0};
+    PageGuard leaf;
     vector<PageNum> parents;
-    ret = loadLeafPage(fileHandle, key_struct, attribute.type, parents, buffer);
+    ret = findLeafPage(fileHandle, key_struct, attribute.type, parents, leaf);
     RETURN_ON_ERR(ret);
-
+    const unsigned char* buffer = (const unsigned char*) leaf.data();
+    unsigned pageSize = fileHandle.getPageSize();
 
     // Find entry on page
     // 
-    IndexPageFooter* footer = getIXFooter(buffer);
-    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer);
+    IndexPageFooter* footer = getIXFooter(buffer, pageSize);
+    IndexSlot* slot = getIXSlot(footer->firstRID.slotNum, buffer, pageSize);
     IndexRecord record;
     ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, attribute.type, record);
 
@@ -636,7 +690,7 @@ RC IndexManager::deleteEntry(FileHandle &fileHandle,
  
        // skip the dead
        do {
-           slot = getIXSlot(record.nextSlot.slotNum, buffer);
+           slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
            ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, attribute.type, record);
            RETURN_ON_ERR(ret);
         } while (slot->type == DEAD and (key_struct.compare(record.key) > 0));
@@ -647,7 +701,7 @@ RC IndexManager::deleteEntry(FileHandle &fileHandle,
     // Ensure that RID's also match 
     // If not, keep walking, but if the equality condition is broken, return an error
     while (not ridsMatch) {
-        slot = getIXSlot(record.nextSlot.slotNum, buffer);
+        slot = getIXSlot(record.nextSlot.slotNum, buffer, pageSize);
         ret  = loadIXRecord(slot->recordSize, slot->recordOffset, buffer, attribute.type, record);
         ridsMatch = record.rid.pageNum == rid.pageNum and record.rid.slotNum == rid.slotNum;
         if (key_struct.compare(record.key) != 0)
@@ -667,8 +721,9 @@ RC IndexManager::deleteEntry(FileHandle &fileHandle,
     switch (slot->type)
     {
         case ALIVE:
+            leaf.mutableData();
             slot->type = DEAD;
-            return fileHandle.writePage(footer->pageNum, buffer);
+            return err::OK;
         case DEAD:
             return err::RECORD_DELETED;
         default:
@@ -740,6 +795,7 @@ RC IX_ScanIterator::init(FileHandle &fileHandle,
     _ixfm = IndexManager::instance();
     _fileHandle = &fileHandle;
     _type = attribute.type;
+    _pageSize = fileHandle.getPageSize();
     _lowInclusive = lowKeyInclusive;
     _footer = NULL;
     _highInclusive = highKeyInclusive;
@@ -766,40 +822,43 @@ RC IX_ScanIterator::init(FileHandle &fileHandle,
 
 RC IX_ScanIterator::loadLowestRecord()
 {
-    RC ret = _ixfm->loadRootPage(*_fileHandle, _buffer);
+    RC ret = pinPage(_ixfm->rootPageNum(*_fileHandle));
     RETURN_ON_ERR(ret);
-    _footer = _ixfm->getIXFooter(_buffer);
     while (not _footer->isLeaf) {
-        ret = _fileHandle->readPage(_footer->child, _buffer);
+        ret = pinPage(_footer->child);
         RETURN_ON_ERR(ret);
     }
-    _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _buffer);
-    return _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+    _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _page.data(), _pageSize);
+    return _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
 }
 
 RC IX_ScanIterator::loadHighestRecord()
 {
-    unsigned char buffer[PAGE_SIZE] = {0};
-    RC ret = _ixfm->loadRootPage(*_fileHandle, buffer);
+    PageGuard page;
+    RC ret = page.pin(*_fileHandle, _ixfm->rootPageNum(*_fileHandle));
     RETURN_ON_ERR(ret);
-    IndexPageFooter* footer = _ixfm->getIXFooter(buffer);
-    IndexSlot* slot = _ixfm->getIXSlot(footer->firstRID.slotNum, buffer);
+    const unsigned char* buffer = (const unsigned char*) page.data();
+    IndexPageFooter* footer = _ixfm->getIXFooter(buffer, _pageSize);
+    IndexSlot* slot = _ixfm->getIXSlot(footer->firstRID.slotNum, buffer, _pageSize);
     IndexRecord record;
     ret = _ixfm->loadIXRecord(slot->recordSize, slot->recordOffset, buffer, _type, record);
     while (not footer->isLeaf) {
         while (record.nextSlot.pageNum == footer->pageNum) {
-            slot = _ixfm->getIXSlot(record.nextSlot.slotNum, buffer);
+            slot = _ixfm->getIXSlot(record.nextSlot.slotNum, buffer, _pageSize);
             ret = _ixfm->loadIXRecord(slot->recordSize, slot->recordOffset, buffer, _type, record);
             RETURN_ON_ERR(ret);
         }
         // read rightmost child
-        ret = _fileHandle->readPage(record.rid.pageNum, buffer);
-        slot =  _ixfm->getIXSlot(footer->firstRID.slotNum, buffer);
+        ret = page.pin(*_fileHandle, record.rid.pageNum);
+        RETURN_ON_ERR(ret);
+        buffer = (const unsigned char*) page.data();
+        footer = _ixfm->getIXFooter(buffer, _pageSize);
+        slot =  _ixfm->getIXSlot(footer->firstRID.slotNum, buffer, _pageSize);
         ret = _ixfm->loadIXRecord(slot->recordSize, slot->recordOffset, buffer, _type, record);
         RETURN_ON_ERR(ret);
     }
     while (record.nextSlot.pageNum == footer->pageNum) {
-        slot = _ixfm->getIXSlot(record.nextSlot.slotNum, buffer);
+        slot = _ixfm->getIXSlot(record.nextSlot.slotNum, buffer, _pageSize);
         ret = _ixfm->loadIXRecord(slot->recordSize, slot->recordOffset, buffer, _type, record);
         RETURN_ON_ERR(ret);
     }
@@ -817,12 +876,13 @@ RC IX_ScanIterator::loadFirstRecord()
 
     vector<PageNum> parents;
     
-    RC ret = _ixfm->loadLeafPage(*_fileHandle, _lowKey, _type, parents, _buffer);
+    RC ret = _ixfm->findLeafPage(*_fileHandle, _lowKey, _type, parents, _page);
     RETURN_ON_ERR(ret);
 
-    _footer = _ixfm->getIXFooter(_buffer);
-    _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _buffer);
-    ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+    _footer = _ixfm->getIXFooter(_page.data(), _pageSize);
+    prefetchNextLeaf();
+    _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _page.data(), _pageSize);
+    ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
     RETURN_ON_ERR(ret);
 
     // Find the first ALIVE entry greater than or equal to _lowKey
@@ -833,15 +893,15 @@ RC IX_ScanIterator::loadFirstRecord()
                 return err::OK;
             }
 
-            ret = _fileHandle->readPage(_nextRecord.nextSlot.pageNum, _buffer);
+            ret = pinPage(_nextRecord.nextSlot.pageNum);
             RETURN_ON_ERR(ret);
-            _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _buffer);
-            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+            _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _page.data(), _pageSize);
+            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
             RETURN_ON_ERR(ret);
             continue;
         } else {
-            _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _buffer);
-            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+            _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _page.data(), _pageSize);
+            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
             RETURN_ON_ERR(ret);
         }
     }
@@ -853,15 +913,15 @@ RC IX_ScanIterator::loadFirstRecord()
                 return err::OK;
             }
 
-            ret = _fileHandle->readPage(_nextRecord.nextSlot.pageNum, _buffer);
+            ret = pinPage(_nextRecord.nextSlot.pageNum);
             RETURN_ON_ERR(ret);
-            _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _buffer);
-            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+            _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _page.data(), _pageSize);
+            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
             RETURN_ON_ERR(ret);
             continue;
         } else {
-            _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _buffer);
-            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+            _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _page.data(), _pageSize);
+            ret  = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
             RETURN_ON_ERR(ret);
         }
     }
@@ -880,19 +940,42 @@ RC IX_ScanIterator::loadNextRecord()
         if (_footer->nextLeaf == 0) 
             return IX_EOF;
 
-        ret = _fileHandle->readPage(_footer->nextLeaf, _buffer);
+        ret = pinPage(_footer->nextLeaf);
         RETURN_ON_ERR(ret);
-        _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _buffer);
-        ret = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+        _nextSlot = _ixfm->getIXSlot(_footer->firstRID.slotNum, _page.data(), _pageSize);
+        ret = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
     } else {
-        _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _buffer);
-        ret = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, _buffer, _type, _nextRecord);
+        _nextSlot = _ixfm->getIXSlot(_nextRecord.nextSlot.slotNum, _page.data(), _pageSize);
+        ret = _ixfm->loadIXRecord(_nextSlot->recordSize, _nextSlot->recordOffset, pageData(), _type, _nextRecord);
     }
     return ret;
 }
 
+// Pins pageNum in place of the page the scan was on and refreshes the
+// footer pointer, which lives in the pinned frame.
+
+RC IX_ScanIterator::pinPage(PageNum pageNum)
+{
+    RC ret = _page.pin(*_fileHandle, pageNum);
+    if (ret != err::OK)
+        return ret;
+    _footer = _ixfm->getIXFooter(_page.data(), _pageSize);
+    prefetchNextLeaf();
+    return err::OK;
+}
+
+// The next leaf is only known once the current one is in, so leaf chain
+// walks read ahead a single leaf.
+
+void IX_ScanIterator::prefetchNextLeaf()
+{
+    if (_footer->isLeaf and _footer->nextLeaf != 0)
+        BufferPoolManager::instance()->prefetch(*_fileHandle, _footer->nextLeaf, 1);
+}
+
 RC IX_ScanIterator::close()
 {
+    _page.release();
     _ixfm = NULL;
     _footer = NULL;
     _nextSlot = NULL;
@@ -37,6 +37,7 @@ struct IndexFileHeader {
     // Leave possibility for more bookkeeping later
 };
 
+// lsn is the page LSN, so it comes last
 struct IndexPageFooter {
     unsigned pageNum;
     unsigned freeMemoryOffset;
@@ -47,6 +48,7 @@ struct IndexPageFooter {
         PageNum child;
         PageNum nextLeaf;
     };
+    LSN lsn;
 };
 
 
@@ -61,7 +63,7 @@ struct IndexSlot {
 //  getFooter(pageBuffer)
 //      Return pointer to footer of the pageBuffer
 //
-//  loadLeafPage(fileHandle, KeyData, pageNum)
+//  findLeafPage(fileHandle, KeyData, pageNum)
 //      Update pageNum to the page number of the leaf page
 //      where the key belongs. This may need some helper 
 //      functions.
@@ -95,6 +97,12 @@ class IndexManager {
                    const bool isLeaf,
                    const PageNum num);
 
+        // As above, giving the number of the new page
+        RC newPage(FileHandle &fileHandle,
+                   const bool isLeaf,
+                   const PageNum num,
+                   PageNum &pageNum);
+
         RC initPage(FileHandle &fileHandle,
                    const PageNum pageNum, 
                    const bool isLeaf,
@@ -106,25 +114,33 @@ class IndexManager {
                        AttrType type,
                        IndexRecord& divider);
 
-        RC createFile(const string &fileName);
+        // Pages of the new file are pageSize bytes
+        RC createFile(const string &fileName, unsigned pageSize = PAGE_SIZE);
 
         RC destroyFile(const string &fileName);
 
-        RC openFile(const string &fileName, FileHandle &fileHandle);
+        // Removes every entry, leaving an empty root. Fails with
+        // FILE_IN_USE while other handles are open on the file.
+        RC truncateFile(FileHandle &fileHandle);
+
+        // Index files are always opened with OPEN_LOGGED
+        RC openFile(const string &fileName, FileHandle &fileHandle, unsigned flags = OPEN_DEFAULT);
 
         RC closeFile(FileHandle &fileHandle);
 
+        // Page layout helpers. pageSize is that of the index file.
+
         // Get footer
-        IndexPageFooter* getIXFooter(const void* buffer);
+        IndexPageFooter* getIXFooter(const void* buffer, unsigned pageSize);
 
         // Write slot
-        void writeIXSlot(void* buffer, unsigned slotNum, IndexSlot* slot);
+        void writeIXSlot(void* buffer, unsigned slotNum, IndexSlot* slot, unsigned pageSize);
 
         // Get slot
-        IndexSlot* getIXSlot(const int slotNum, const void* buffer);
+        IndexSlot* getIXSlot(const int slotNum, const void* buffer, unsigned pageSize);
 
         // Load IX record into a struct
-        RC loadIXRecord(unsigned size, unsigned offset, unsigned char* buffer, AttrType type, IndexRecord &record);
+        RC loadIXRecord(unsigned size, unsigned offset, const unsigned char* buffer, AttrType type, IndexRecord &record);
 
         PageNum rootPageNum(FileHandle &fileHandle);
 
@@ -136,14 +152,15 @@ class IndexManager {
 
         RC loadHighestKey(FileHandle& fileHandle, AttrType type, KeyData& key);
         // Find the appropriate leafPage for a key to be inserted
-        RC loadLeafPage(FileHandle &fileHandle, KeyData &key, AttrType type, vector<PageNum>& parents, unsigned char* buffer);
+        // The leaf is left pinned in page
+        RC findLeafPage(FileHandle &fileHandle, KeyData &key, AttrType type, vector<PageNum>& parents, PageGuard& page);
 
-        bool needsToSplit (KeyData& key, IndexPageFooter* footer);
+        bool needsToSplit (KeyData& key, IndexPageFooter* footer, unsigned pageSize);
 
         RC splitHandler(FileHandle& fileHandle, vector<PageNum>& parents, const AttrType type, KeyData key, RID rid, unsigned char* buffer);
         RC writeRecordToBuffer(KeyData& key, const RID& rid, const RID& nextSlot, AttrType type, IndexPageFooter* footer, unsigned char* buffer);
 
-        RC insertInOrder(KeyData& key, AttrType type, const RID &rid, unsigned char* buffer);
+        RC insertInOrder(KeyData& key, AttrType type, const RID &rid, unsigned char* buffer, unsigned pageSize);
 
         // The following two functions are using the following format for the passed key value.
         //  1) data is a concatenation of values of the attributes
@@ -172,9 +189,9 @@ class IndexManager {
         ~IndexManager  ();                            // Destructor
 
     private:
-        static IndexManager *_index_manager;
+        static atomic<IndexManager*> _index_manager;
+        static mutex _instanceMutex;
         PagedFileManager& _pfm;
-        map<string, PageNum> _rootMap;
 };
 
 class IX_ScanIterator {
@@ -194,12 +211,13 @@ class IX_ScanIterator {
         IndexManager* _ixfm;
         FileHandle* _fileHandle;
         AttrType _type;
+        unsigned _pageSize;
         KeyData _lowKey;
         KeyData _highKey;
         bool _lowInclusive;
         bool _highInclusive;
-        unsigned char _buffer[PAGE_SIZE] = {0};
-        IndexPageFooter* _footer;
+        PageGuard _page;
+        IndexPageFooter* _footer;   // footer of the pinned page
 
         bool _eof;
 
@@ -211,6 +229,9 @@ class IX_ScanIterator {
         RC loadNextRecord();
         RC loadLowestRecord();
         RC loadHighestRecord();
+        RC pinPage(PageNum pageNum);
+        void prefetchNextLeaf();
+        const unsigned char* pageData() const { return (const unsigned char*) _page.data(); }
 };
 
 // print out the error message for a given return code
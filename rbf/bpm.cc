@@ -0,0 +1,915 @@
+#include "bpm.h"
+#include "log.h"
+#include "../util/errcodes.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+///////////////////////////////////
+// BufferPoolManager Implementation
+///////////////////////////////////
+
+atomic<BufferPoolManager*> BufferPoolManager::_bp_manager(NULL);
+mutex BufferPoolManager::_instanceMutex;
+
+BufferPoolManager* BufferPoolManager::instance() {
+    BufferPoolManager *instance = _bp_manager.load(memory_order_acquire);
+    if (instance)
+        return instance;
+
+    // Threads racing to get here first create a single instance
+    lock_guard<mutex> lock(_instanceMutex);
+    instance = _bp_manager.load(memory_order_relaxed);
+    if (!instance) {
+        instance = new BufferPoolManager();
+        _bp_manager.store(instance, memory_order_release);
+    }
+    return instance;
+}
+
+
+BufferPoolManager::BufferPoolManager()
+    : _clockHand(0), _readAheadWindow(DEFAULT_READ_AHEAD_WINDOW),
+      _loading(0), _stopping(false),
+      _writerInterval(DEFAULT_WRITER_INTERVAL_MS), _numDirtied(0),
+      _pagesWritten(0), _writeCalls(0) {
+    allocateFrames(DEFAULT_NUM_FRAMES);
+}
+
+
+BufferPoolManager::~BufferPoolManager() {
+    {
+        lock_guard<mutex> lock(_latch);
+        _stopping = true;
+    }
+    _requested.notify_all();
+    _dirtied.notify_all();
+    for (auto it = _readers.begin(); it != _readers.end(); ++it)
+        it->join();
+    if (_writer.joinable())
+        _writer.join();
+
+    flushAll();
+    for (auto it = _handles.begin(); it != _handles.end(); ++it) {
+        PagedFileManager::instance()->closeFile(*it->second);
+        delete it->second;
+    }
+    _handles.clear();
+
+    releaseFrames();
+    _bp_manager = NULL;
+}
+
+RC BufferPoolManager::setNumFrames(unsigned numFrames) {
+    if (numFrames == 0)
+        return err::BUFFER_POOL_EXHAUSTED;
+
+    unique_lock<mutex> lock(_latch);
+    _readQueue.clear();
+    _loaded.wait(lock, [this] { return _loading == 0; });
+    _written.wait(lock, [this] { return _writes.empty(); });
+
+    for (auto it = _frames.begin(); it != _frames.end(); ++it) {
+        if (it->pinCount > 0)
+            return err::BUFFER_FRAME_PINNED;
+    }
+
+    // Write back everything before the frames go away
+    for (auto it = _frames.begin(); it != _frames.end(); ++it) {
+        if (not it->valid)
+            continue;
+        RC ret = evictFrame(*it);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    releaseFrames();
+    return allocateFrames(numFrames);
+}
+
+// Pins the page and hands back the frame it lives in. The page is read from
+// disk if it is not already resident.
+
+RC BufferPoolManager::pinPage(FileHandle &fileHandle, PageNum pageNum,
+                              unsigned &frameNum) {
+    if (pageNum >= fileHandle.getNumberOfPages())
+        return err::FILE_PAGE_NOT_FOUND;
+
+    unique_lock<mutex> lock(_latch);
+    return lookupFrame(fileHandle, pageNum, true, frameNum, lock);
+}
+
+RC BufferPoolManager::unpinPage(unsigned frameNum) {
+    lock_guard<mutex> lock(_latch);
+    if (frameNum >= _frames.size() or _frames[frameNum].pinCount == 0)
+        return err::BUFFER_FRAME_NOT_PINNED;
+
+    _frames[frameNum].pinCount--;
+    return err::OK;
+}
+
+void BufferPoolManager::markDirty(unsigned frameNum, FileHandle &fileHandle,
+                                  LSN lsn) {
+    lock_guard<mutex> lock(_latch);
+    _frames[frameNum].dirty = true;
+    _frames[frameNum].owner = &fileHandle;
+    if (lsn != 0)
+        _frames[frameNum].lsn = lsn;
+    noteDirty();
+}
+
+RC BufferPoolManager::readPage(FileHandle &fileHandle, PageNum pageNum,
+                               void *data) {
+    if (pageNum >= fileHandle.getNumberOfPages())
+        return err::FILE_PAGE_NOT_FOUND;
+
+    unique_lock<mutex> lock(_latch);
+    unsigned frameNum;
+    RC ret = lookupFrame(fileHandle, pageNum, true, frameNum, lock);
+    if (ret != err::OK)
+        return ret;
+
+    memcpy(data, _frames[frameNum].data, _frames[frameNum].size);
+    _frames[frameNum].pinCount--;
+    return err::OK;
+}
+
+// Overwrites the cached copy of the page with data. Since the whole page is
+// replaced, a page that is not resident is not read from disk first. Clean
+// writes are used to cache pages that are already on disk.
+
+RC BufferPoolManager::writePage(FileHandle &fileHandle, PageNum pageNum,
+                                const void *data, bool dirty, LSN lsn) {
+    if (pageNum >= fileHandle.getNumberOfPages())
+        return err::FILE_PAGE_NOT_FOUND;
+
+    unique_lock<mutex> lock(_latch);
+    unsigned frameNum;
+    RC ret = lookupFrame(fileHandle, pageNum, false, frameNum, lock);
+    if (ret != err::OK)
+        return ret;
+
+    Frame &frame = _frames[frameNum];
+    if (frame.data != data)
+        memcpy(frame.data, data, frame.size);
+    if (dirty) {
+        frame.dirty = true;
+        frame.owner = &fileHandle;
+        noteDirty();
+    }
+    if (lsn != 0)
+        frame.lsn = lsn;
+
+    frame.pinCount--;
+    return err::OK;
+}
+
+// Copies the resident pages out of their frames and reads each run of
+// missing pages with a single vectored read.
+
+RC BufferPoolManager::readPages(FileHandle &fileHandle, PageNum first,
+                                void *const *buffers, unsigned count) {
+    vector<bool> missing(count, true);
+    {
+        unique_lock<mutex> lock(_latch);
+        waitForLoads(fileHandle.getFileName(), lock);
+        for (unsigned i = 0; i < count; i++) {
+            auto it = _pageTable.find(make_pair(fileHandle.getFileName(), first + i));
+            if (it == _pageTable.end())
+                continue;
+            memcpy(buffers[i], _frames[it->second].data, _frames[it->second].size);
+            _frames[it->second].referenced = true;
+            missing[i] = false;
+        }
+    }
+
+    unsigned i = 0;
+    while (i < count) {
+        if (not missing[i]) {
+            i++;
+            continue;
+        }
+        unsigned run = 1;
+        while (i + run < count and missing[i + run])
+            run++;
+        RC ret = fileHandle.readPagesFromDisk(first + i, buffers + i, run);
+        if (ret != err::OK)
+            return ret;
+        i += run;
+    }
+    return err::OK;
+}
+
+// Writes all pages to disk at once. Resident copies are updated and, once
+// the write is done, no longer dirty; runs the background writer copied
+// earlier are waited for, so that they cannot land on top of the new data.
+// The latch is held throughout, so no run copies the frames meanwhile. If
+// the write fails, the frames keep the new data and stay dirty.
+
+RC BufferPoolManager::writePages(FileHandle &fileHandle, PageNum first,
+                                 const void *const *buffers, unsigned count) {
+    unique_lock<mutex> lock(_latch);
+    const string &fileName = fileHandle.getFileName();
+    waitForLoads(fileName, lock);
+    waitForWrites(fileName, lock);
+    vector<unsigned> resident;
+    for (unsigned i = 0; i < count; i++) {
+        auto it = _pageTable.find(make_pair(fileName, first + i));
+        if (it == _pageTable.end())
+            continue;
+        memcpy(_frames[it->second].data, buffers[i], _frames[it->second].size);
+        resident.push_back(it->second);
+    }
+
+    RC ret = fileHandle.writePagesToDisk(first, buffers, count);
+    for (unsigned i = 0; i < resident.size(); i++) {
+        Frame &frame = _frames[resident[i]];
+        if (ret == err::OK) {
+            frame.dirty = false;
+            frame.owner = NULL;
+        } else if (not frame.dirty) {
+            frame.dirty = true;
+            frame.owner = &fileHandle;
+            noteDirty();
+        }
+    }
+    return ret;
+}
+
+void BufferPoolManager::refreshPage(FileHandle &fileHandle, PageNum pageNum,
+                                    const void *data) {
+    unique_lock<mutex> lock(_latch);
+    auto it = _pageTable.find(make_pair(fileHandle.getFileName(), pageNum));
+    if (it == _pageTable.end())
+        return;
+
+    Frame &frame = _frames[it->second];
+    _loaded.wait(lock, [&frame] { return not frame.loading; });
+    if (frame.valid)
+        memcpy(frame.data, data, frame.size);
+}
+
+// Starts the reader threads on first use, so programs that never scan
+// don't pay for them.
+
+void BufferPoolManager::prefetch(FileHandle &fileHandle, PageNum first,
+                                 unsigned count) {
+    if (fileHandle.isMapped() or count == 0)
+        return;
+
+    lock_guard<mutex> lock(_latch);
+    if (_readers.empty()) {
+        for (unsigned i = 0; i < READ_AHEAD_THREADS; i++)
+            _readers.push_back(thread(&BufferPoolManager::readAhead, this));
+    }
+
+    PageNum last = first + count;
+    if (last > fileHandle.getNumberOfPages())
+        last = fileHandle.getNumberOfPages();
+    for (PageNum pageNum = first; pageNum < last; pageNum++) {
+        if (_pageTable.count(make_pair(fileHandle.getFileName(), pageNum)))
+            continue;
+
+        bool queued = false;
+        for (auto it = _readQueue.begin(); it != _readQueue.end(); ++it)
+            queued = queued or (it->fileHandle == &fileHandle and it->pageNum == pageNum);
+        if (queued)
+            continue;
+
+        ReadRequest request = { &fileHandle, pageNum };
+        _readQueue.push_back(request);
+        _requested.notify_one();
+    }
+}
+
+void BufferPoolManager::cancelPrefetch(FileHandle &fileHandle) {
+    unique_lock<mutex> lock(_latch);
+    for (auto it = _readQueue.begin(); it != _readQueue.end(); ) {
+        if (it->fileHandle == &fileHandle)
+            it = _readQueue.erase(it);
+        else
+            ++it;
+    }
+    waitForLoads(fileHandle.getFileName(), lock);
+}
+
+void BufferPoolManager::setReadAheadWindow(unsigned numPages) {
+    lock_guard<mutex> lock(_latch);
+    _readAheadWindow = numPages;
+}
+
+// Stops the writer when ms is 0; otherwise it is started again the next
+// time a frame is dirtied.
+
+void BufferPoolManager::setWriterInterval(unsigned ms) {
+    {
+        lock_guard<mutex> lock(_latch);
+        _writerInterval = ms;
+    }
+    _dirtied.notify_all();
+    if (ms == 0 and _writer.joinable())
+        _writer.join();
+}
+
+void BufferPoolManager::getWriteStats(unsigned &numPages, unsigned &numWrites) {
+    lock_guard<mutex> lock(_latch);
+    numPages = _pagesWritten;
+    numWrites = _writeCalls;
+}
+
+// Writes made by the background writer while the latch was dropped are
+// waited for on both ends, so every page dirty on entry is on disk on
+// return.
+
+RC BufferPoolManager::flushFile(FileHandle &fileHandle) {
+    unique_lock<mutex> lock(_latch);
+    const string &fileName = fileHandle.getFileName();
+    waitForLoads(fileName, lock);
+    waitForWrites(fileName, lock);
+
+    RC ret = writeRuns(&fileName, &fileHandle, false, lock);
+    waitForWrites(fileName, lock);
+    return ret;
+}
+
+RC BufferPoolManager::flushAll() {
+    unique_lock<mutex> lock(_latch);
+    RC ret = writeRuns(NULL, NULL, false, lock);
+    _written.wait(lock, [this] { return _writes.empty(); });
+    return ret;
+}
+
+// Hands the dirty frames of a closing handle to the pool's own handle for
+// the file, opening it if needed. If that fails, the frames are written
+// back right away instead.
+
+RC BufferPoolManager::handOver(FileHandle &fileHandle) {
+    unique_lock<mutex> lock(_latch);
+    const string &fileName = fileHandle.getFileName();
+    waitForLoads(fileName, lock);
+    waitForWrites(fileName, lock);
+
+    bool dirty = false;
+    auto first = _pageTable.lower_bound(make_pair(fileName, (PageNum) 0));
+    for (auto it = first; it != _pageTable.end() and it->first.first == fileName; ++it)
+        dirty = dirty or _frames[it->second].dirty;
+    if (not dirty)
+        return err::OK;
+
+    auto handle = _handles.find(fileName);
+    if (handle == _handles.end()) {
+        FileHandle *own = new FileHandle();
+        if (PagedFileManager::instance()->openFile(fileName, *own) != err::OK) {
+            delete own;
+            RC ret = writeRuns(&fileName, &fileHandle, false, lock);
+            waitForWrites(fileName, lock);
+            return ret;
+        }
+        handle = _handles.insert(make_pair(fileName, own)).first;
+    }
+
+    for (auto it = first; it != _pageTable.end() and it->first.first == fileName; ++it) {
+        Frame &frame = _frames[it->second];
+        if (frame.owner == &fileHandle)
+            frame.owner = handle->second;
+    }
+    noteDirty();
+    return err::OK;
+}
+
+// Forgets every page of fileName. Used when the file is destroyed or
+// recreated, so stale pages are never handed out for a new file. The pool's
+// own handle for the file is closed.
+
+void BufferPoolManager::discardFile(const string &fileName) {
+    FileHandle *handle = NULL;
+    {
+        unique_lock<mutex> lock(_latch);
+        waitForLoads(fileName, lock);
+        waitForWrites(fileName, lock);
+
+        auto it = _pageTable.lower_bound(make_pair(fileName, (PageNum) 0));
+        while (it != _pageTable.end() and it->first.first == fileName) {
+            Frame &frame = _frames[it->second];
+            frame.valid = false;
+            frame.dirty = false;
+            frame.owner = NULL;
+            it = _pageTable.erase(it);
+        }
+
+        auto own = _handles.find(fileName);
+        if (own != _handles.end()) {
+            handle = own->second;
+            _handles.erase(own);
+        }
+    }
+
+    if (handle != NULL) {
+        PagedFileManager::instance()->closeFile(*handle);
+        delete handle;
+    }
+}
+
+// Forgets the pages of a file that is being truncated to first pages.
+// Dirty ones are dropped too, since their pages no longer exist.
+
+RC BufferPoolManager::discardPages(FileHandle &fileHandle, PageNum first) {
+    unique_lock<mutex> lock(_latch);
+    const string &fileName = fileHandle.getFileName();
+    waitForLoads(fileName, lock);
+    waitForWrites(fileName, lock);
+
+    auto begin = _pageTable.lower_bound(make_pair(fileName, first));
+    for (auto it = begin; it != _pageTable.end() and it->first.first == fileName; ++it) {
+        if (_frames[it->second].pinCount > 0)
+            return err::BUFFER_FRAME_PINNED;
+    }
+    for (auto it = begin; it != _pageTable.end() and it->first.first == fileName; ) {
+        Frame &frame = _frames[it->second];
+        frame.valid = false;
+        frame.dirty = false;
+        frame.owner = NULL;
+        it = _pageTable.erase(it);
+    }
+    return err::OK;
+}
+
+bool BufferPoolManager::hasHandle(const string &fileName) {
+    lock_guard<mutex> lock(_latch);
+    return _handles.count(fileName) > 0;
+}
+
+RC BufferPoolManager::allocateFrames(unsigned numFrames) {
+    _frames.resize(numFrames);
+    for (auto it = _frames.begin(); it != _frames.end(); ++it) {
+        it->data = (char*) PageBuffer::allocate();
+        if (it->data == NULL)
+            return err::OUT_OF_MEMORY;
+        it->pageNum = 0;
+        it->owner = NULL;
+        it->pinCount = 0;
+        it->dirty = false;
+        it->referenced = false;
+        it->valid = false;
+        it->loading = false;
+        it->lsn = 0;
+        it->size = PAGE_SIZE;
+    }
+    _clockHand = 0;
+    return err::OK;
+}
+
+void BufferPoolManager::releaseFrames() {
+    for (auto it = _frames.begin(); it != _frames.end(); ++it)
+        free(it->data);
+    _frames.clear();
+    _pageTable.clear();
+}
+
+// Sweeps the clock hand over the frames until it finds one that is free, or
+// unpinned and not referenced since the last sweep.
+
+RC BufferPoolManager::findVictim(unsigned &frameNum) {
+    unsigned numFrames = _frames.size();
+    for (unsigned i = 0; i < 2 * numFrames; i++) {
+        Frame &frame = _frames[_clockHand];
+        frameNum = _clockHand;
+        _clockHand = (_clockHand + 1) % numFrames;
+
+        if (frame.pinCount > 0)
+            continue;
+        if (not frame.valid)
+            return err::OK;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        return evictFrame(frame);
+    }
+    return err::BUFFER_POOL_EXHAUSTED;
+}
+
+// Gives a free frame room for a page of size bytes
+RC BufferPoolManager::resizeFrame(Frame &frame, unsigned size) {
+    if (frame.size == size)
+        return err::OK;
+
+    char *data = (char*) PageBuffer::allocate(1, size);
+    if (data == NULL)
+        return err::OUT_OF_MEMORY;
+    free(frame.data);
+    frame.data = data;
+    frame.size = size;
+    return err::OK;
+}
+
+RC BufferPoolManager::evictFrame(Frame &frame) {
+    if (frame.dirty) {
+        RC ret = writeBack(frame, *frame.owner);
+        if (ret != err::OK)
+            return ret;
+    }
+    _pageTable.erase(make_pair(frame.fileName, frame.pageNum));
+    frame.valid = false;
+    frame.dirty = false;
+    frame.owner = NULL;
+    frame.lsn = 0;
+    return err::OK;
+}
+
+// Writes a dirty frame to disk, once the log holds its last change
+RC BufferPoolManager::writeBack(Frame &frame, FileHandle &fileHandle) {
+    if (frame.lsn != 0) {
+        RC ret = LogManager::instance()->flush(frame.lsn);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    RC ret = fileHandle.writePageToDisk(frame.pageNum, frame.data);
+    if (ret != err::OK)
+        return ret;
+    frame.dirty = false;
+    frame.lsn = 0;
+    _pagesWritten++;
+    _writeCalls++;
+    return err::OK;
+}
+
+// Finds the frame holding the page, or claims a new one for it. If load is
+// set, a newly claimed frame is filled from disk. The frame is returned
+// pinned. A page still being prefetched is waited for; so is a frame, when
+// every frame is pinned but some are only pinned by background loads.
+
+RC BufferPoolManager::lookupFrame(FileHandle &fileHandle, PageNum pageNum,
+                                  bool load, unsigned &frameNum,
+                                  unique_lock<mutex> &lock) {
+    pair<string, PageNum> key(fileHandle.getFileName(), pageNum);
+    auto it = _pageTable.find(key);
+    if (it != _pageTable.end()) {
+        frameNum = it->second;
+        Frame &frame = _frames[frameNum];
+        frame.pinCount++;
+        frame.referenced = true;
+        _loaded.wait(lock, [&frame] { return not frame.loading; });
+        if (frame.valid)
+            return err::OK;
+
+        // The background load failed; load the page here instead
+        frame.pinCount--;
+    }
+
+    RC ret;
+    while ((ret = findVictim(frameNum)) == err::BUFFER_POOL_EXHAUSTED and _loading > 0)
+        _loaded.wait(lock);
+    if (ret != err::OK)
+        return ret;
+
+    Frame &frame = _frames[frameNum];
+    ret = resizeFrame(frame, fileHandle.getPageSize());
+    if (ret != err::OK)
+        return ret;
+    if (load) {
+        ret = fileHandle.readPageFromDisk(pageNum, frame.data);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    frame.fileName = key.first;
+    frame.pageNum = pageNum;
+    frame.owner = NULL;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame.valid = true;
+    frame.lsn = 0;
+    _pageTable[key] = frameNum;
+    return err::OK;
+}
+
+void BufferPoolManager::waitForWrites(const string &fileName,
+                                      unique_lock<mutex> &lock) {
+    _written.wait(lock, [this, &fileName] { return _writes.count(fileName) == 0; });
+}
+
+// Counts a newly dirtied frame, starting the background writer if it is
+// not running, and waking it once a quarter of the pool is dirty.
+
+void BufferPoolManager::noteDirty() {
+    if (_writerInterval == 0 or _stopping)
+        return;
+    if (not _writer.joinable())
+        _writer = thread(&BufferPoolManager::writeBehind, this);
+    if (++_numDirtied >= max((size_t) 1, _frames.size() / 4))
+        _dirtied.notify_one();
+}
+
+// Writes back the dirty pages of fileName, or of every file if fileName is
+// NULL, in file and page order. Adjacent pages written through the same
+// handle form a run, which takes one call to write; owner, if given,
+// replaces the handles the frames were dirtied through. The background
+// writer leaves pinned pages alone, as they are likely still changing.
+//
+// The latch is dropped while a run is written, so the page table is
+// searched afresh for each run, starting after the previous one.
+
+RC BufferPoolManager::writeRuns(const string *fileName, FileHandle *owner,
+                                bool background, unique_lock<mutex> &lock) {
+    pair<string, PageNum> next(fileName ? *fileName : string(), 0);
+    while (true) {
+        WriteRun run;
+        run.owner = NULL;
+        run.first = 0;
+        run.lsn = 0;
+
+        auto it = _pageTable.lower_bound(next);
+        for ( ; it != _pageTable.end(); ++it) {
+            if (fileName != NULL and it->first.first != *fileName)
+                break;
+
+            Frame &frame = _frames[it->second];
+            FileHandle *handle = owner ? owner : frame.owner;
+            bool eligible = frame.dirty and handle != NULL
+                            and not (background and frame.pinCount > 0);
+            if (run.frames.empty()) {
+                if (eligible) {
+                    run.owner = handle;
+                    run.first = it->first.second;
+                    run.frames.push_back(it->second);
+                }
+                continue;
+            }
+
+            bool adjacent = it->first.first == _frames[run.frames[0]].fileName
+                            and it->first.second == run.first + run.frames.size();
+            if (not eligible or not adjacent or handle != run.owner
+                    or run.frames.size() >= WRITER_MAX_RUN)
+                break;
+            run.frames.push_back(it->second);
+        }
+
+        if (run.frames.empty())
+            return err::OK;
+
+        next = make_pair(_frames[run.frames[0]].fileName,
+                         run.first + (PageNum) run.frames.size());
+        RC ret = writeRun(run, lock);
+        if (ret != err::OK)
+            return ret;
+    }
+}
+
+// Copies the run out of its frames, which are clean from then on, and
+// writes the copy with the latch dropped, once the log holds every change
+// in it. If the write fails, the pages are marked dirty again.
+
+RC BufferPoolManager::writeRun(WriteRun &run, unique_lock<mutex> &lock) {
+    unsigned count = run.frames.size();
+    string fileName = _frames[run.frames[0]].fileName;
+    unsigned pageSize = _frames[run.frames[0]].size;
+    PageBuffer copy(count, pageSize);
+    vector<const void*> buffers(count);
+    for (unsigned i = 0; i < count; i++) {
+        Frame &frame = _frames[run.frames[i]];
+        buffers[i] = (const unsigned char*) copy + (size_t) pageSize * i;
+        memcpy((void*) buffers[i], frame.data, pageSize);
+        run.lsn = max(run.lsn, frame.lsn);
+        frame.dirty = false;
+        frame.lsn = 0;
+    }
+    _writes[fileName]++;
+    lock.unlock();
+
+    RC ret = err::OK;
+    if (run.lsn != 0)
+        ret = LogManager::instance()->flush(run.lsn);
+    if (ret == err::OK)
+        ret = run.owner->writePagesToDisk(run.first, buffers.data(), count);
+
+    lock.lock();
+    if (--_writes[fileName] == 0)
+        _writes.erase(fileName);
+    if (ret == err::OK) {
+        _pagesWritten += count;
+        _writeCalls++;
+    } else {
+        for (unsigned i = 0; i < count; i++) {
+            auto it = _pageTable.find(make_pair(fileName, run.first + i));
+            if (it == _pageTable.end())
+                continue;
+            Frame &frame = _frames[it->second];
+            if (not frame.dirty) {
+                frame.dirty = true;
+                frame.owner = run.owner;
+            }
+            frame.lsn = max(frame.lsn, run.lsn);
+        }
+    }
+    _written.notify_all();
+    return ret;
+}
+
+void BufferPoolManager::waitForLoads(const string &fileName,
+                                     unique_lock<mutex> &lock) {
+    _loaded.wait(lock, [this, &fileName] {
+        for (auto it = _frames.begin(); it != _frames.end(); ++it) {
+            if (it->loading and it->fileName == fileName)
+                return false;
+        }
+        return true;
+    });
+}
+
+// Body of the reader threads. Each request gets a free frame, which stays
+// pinned while the page is read outside the latch. A quarter of the pool
+// at most is tied up by background loads at any time; requests beyond that
+// are dropped, as are requests for which no frame is free.
+
+void BufferPoolManager::readAhead() {
+    unique_lock<mutex> lock(_latch);
+    while (true) {
+        _requested.wait(lock, [this] { return _stopping or not _readQueue.empty(); });
+        if (_stopping)
+            return;
+
+        ReadRequest request = _readQueue.front();
+        _readQueue.pop_front();
+
+        FileHandle &fileHandle = *request.fileHandle;
+        pair<string, PageNum> key(fileHandle.getFileName(), request.pageNum);
+        if (_pageTable.count(key) or _loading >= max((size_t) 1, _frames.size() / 4))
+            continue;
+
+        unsigned frameNum;
+        if (findVictim(frameNum) != err::OK)
+            continue;
+
+        Frame &frame = _frames[frameNum];
+        if (resizeFrame(frame, fileHandle.getPageSize()) != err::OK)
+            continue;
+        frame.fileName = key.first;
+        frame.pageNum = request.pageNum;
+        frame.owner = NULL;
+        frame.pinCount = 1;
+        frame.dirty = false;
+        frame.referenced = true;
+        frame.valid = true;
+        frame.loading = true;
+        frame.lsn = 0;
+        _pageTable[key] = frameNum;
+        _loading++;
+
+        lock.unlock();
+        RC ret = fileHandle.readPageFromDisk(request.pageNum, frame.data);
+        lock.lock();
+
+        frame.loading = false;
+        frame.pinCount--;
+        _loading--;
+        if (ret != err::OK) {
+            _pageTable.erase(key);
+            frame.valid = false;
+        }
+        _loaded.notify_all();
+    }
+}
+
+// Body of the background writer. It makes a pass every _writerInterval
+// milliseconds, or as soon as enough frames were dirtied. Failed writes
+// leave their pages dirty for a later pass, or for whoever flushes them.
+
+void BufferPoolManager::writeBehind() {
+    unique_lock<mutex> lock(_latch);
+    while (true) {
+        _dirtied.wait_for(lock, chrono::milliseconds(_writerInterval), [this] {
+            return _stopping or _writerInterval == 0
+                   or _numDirtied >= max((size_t) 1, _frames.size() / 4); });
+        if (_stopping or _writerInterval == 0)
+            return;
+
+        _numDirtied = 0;
+        writeRuns(NULL, NULL, true, lock);
+    }
+}
+
+///////////////////////////
+// PageGuard Implementation
+///////////////////////////
+
+PageGuard::PageGuard()
+    : _fileHandle(NULL), _pageNum(0), _frameNum(0), _mapped(NULL),
+      _pinned(false), _dirty(false)
+{
+}
+
+
+PageGuard::~PageGuard() {
+    release();
+}
+
+// Pins pageNum of the file open in fileHandle, releasing whatever page the
+// guard held before.
+
+RC PageGuard::pin(FileHandle &fileHandle, PageNum pageNum) {
+    release();
+
+    if (fileHandle.isMapped()) {
+        if (pageNum >= fileHandle.getNumberOfPages())
+            return err::FILE_PAGE_NOT_FOUND;
+        _mapped = fileHandle.mappedPage(pageNum);
+    } else {
+        RC ret = BufferPoolManager::instance()->pinPage(fileHandle, pageNum, _frameNum);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    _fileHandle = &fileHandle;
+    _pageNum = pageNum;
+    _pinned = true;
+    _dirty = false;
+    fileHandle.readPageCounter++;
+    return err::OK;
+}
+
+// A page changed through the guard of a logged handle is logged as the
+// guard lets go of it. Mapped pages can reach the file at any time, so
+// their log record is made durable right away. The handle's sync policy
+// then applies to the change.
+
+void PageGuard::release() {
+    if (not _pinned)
+        return;
+
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    LSN lsn = 0;
+    if (_dirty and _fileHandle->isLogged()) {
+        char *page = _mapped ? _mapped : bpm->getFrameData(_frameNum);
+        if (_fileHandle->logPage(_pageNum, page, lsn) == err::OK and _mapped != NULL)
+            LogManager::instance()->flush(lsn);
+    }
+
+    if (_mapped != NULL) {
+        if (_dirty)
+            bpm->refreshPage(*_fileHandle, _pageNum, _mapped);
+        _mapped = NULL;
+    } else {
+        // Marked again even if mutableData did: a flush may have written
+        // the frame back, and cleaned it, while it was still changing
+        if (_dirty)
+            bpm->markDirty(_frameNum, *_fileHandle, lsn);
+        bpm->unpinPage(_frameNum);
+    }
+    // The change counts as an operation for the handle's sync policy
+    if (_dirty)
+        _fileHandle->applySyncPolicy();
+    _fileHandle = NULL;
+    _pinned = false;
+}
+
+const char* PageGuard::data() const {
+    if (_mapped != NULL)
+        return _mapped;
+    return BufferPoolManager::instance()->getFrameData(_frameNum);
+}
+
+// Returns a writable pointer to the page. The page is marked dirty, so it
+// is written back to disk later on.
+
+char* PageGuard::mutableData() {
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    if (not _dirty) {
+        if (_mapped == NULL)
+            bpm->markDirty(_frameNum, *_fileHandle);
+        _fileHandle->writePageCounter++;
+        _dirty = true;
+    }
+    if (_mapped != NULL)
+        return _mapped;
+    return bpm->getFrameData(_frameNum);
+}
+
+////////////////////////////
+// PageBuffer Implementation
+////////////////////////////
+
+PageBuffer::PageBuffer(unsigned numPages, unsigned pageSize) {
+    _data = allocate(numPages, pageSize);
+}
+
+
+PageBuffer::~PageBuffer() {
+    free(_data);
+}
+
+// Returns numPages zeroed pages of pageSize bytes, PAGE_SIZE aligned, to be
+// released with free(), or NULL if out of memory
+
+unsigned char* PageBuffer::allocate(unsigned numPages, unsigned pageSize) {
+    void *data = NULL;
+    size_t size = (size_t) pageSize * numPages;
+    if (posix_memalign(&data, PAGE_SIZE, size) != 0)
+        return NULL;
+    memset(data, 0, size);
+    return (unsigned char*) data;
+}
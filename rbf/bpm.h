@@ -0,0 +1,271 @@
+#ifndef _bpm_h_
+#define _bpm_h_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "pfm.h"
+
+using namespace std;
+
+#define DEFAULT_NUM_FRAMES 1024
+#define DEFAULT_READ_AHEAD_WINDOW 8
+#define READ_AHEAD_THREADS 2
+// The background writer runs this often, or sooner once a quarter of the
+// pool was dirtied since its last pass
+#define DEFAULT_WRITER_INTERVAL_MS 100
+// Longest run of adjacent pages written back with a single call
+#define WRITER_MAX_RUN 64
+
+
+// The BufferPoolManager (BPM) keeps recently used pages of paged files in a
+// fixed number of in-memory frames. Every FileHandle read and write goes
+// through the BPM, so repeated accesses to the same page are served from
+// memory instead of the disk.
+//
+// A client pins a page to get access to the frame holding it, and unpins it
+// when done. Only unpinned frames can be replaced; replacement follows the
+// clock (second chance) policy. Modified frames are marked dirty and are
+// written back when they are replaced or when their file is closed.
+//
+// Files may differ in page size. A frame takes the page size of the page
+// it holds, and is reallocated when it is claimed for a page of another
+// size.
+//
+// Pages can also be prefetched: a small pool of reader threads loads them
+// into free frames in the background, so a sequential reader finds the next
+// pages already resident. Pinning a page that is still being loaded waits
+// for the load to finish. All pool state is guarded by one latch.
+//
+// Frames of logged files remember the LSN of their last change. The log is
+// made durable up to that LSN before the frame is written back.
+//
+// A background writer thread cleans dirty frames ahead of replacement, so
+// that neither replacement nor closing a file has to wait for the disk.
+// It goes through the dirty pages in file and page order and writes each
+// run of adjacent pages with one vectored write, from a copy taken under
+// the latch. Closing a logged handle leaves its dirty frames to the writer:
+// the log already holds their changes, so the pool opens a handle of its
+// own to write them back with.
+
+class BufferPoolManager {
+  public:
+    // Access to the _bp_manager instance
+    static BufferPoolManager* instance();
+
+    // Resize the pool. Fails if any frame is pinned; dirty frames are
+    // written back before the pool is rebuilt.
+    RC setNumFrames(unsigned numFrames);
+    unsigned getNumFrames() const { return _frames.size(); }
+
+    // Pin page pageNum of the file open in fileHandle, reading it from disk
+    // if it is not resident. frameNum identifies the frame until the
+    // matching call to unpinPage.
+    RC pinPage(FileHandle &fileHandle, PageNum pageNum, unsigned &frameNum);
+    RC unpinPage(unsigned frameNum);
+
+    // Mark a pinned frame as modified. fileHandle is used to write the
+    // frame back to disk; lsn is the log record of the change, if any.
+    void markDirty(unsigned frameNum, FileHandle &fileHandle, LSN lsn = 0);
+    char* getFrameData(unsigned frameNum) { return _frames[frameNum].data; }
+
+    // Copy a page out of / into the pool
+    RC readPage(FileHandle &fileHandle, PageNum pageNum, void *data);
+    RC writePage(FileHandle &fileHandle, PageNum pageNum, const void *data,
+                 bool dirty, LSN lsn = 0);
+
+    // Multi-page transfers. Resident pages are copied from, or updated in,
+    // their frames; the rest go straight to disk with vectored I/O and are
+    // not brought into the pool.
+    RC readPages(FileHandle &fileHandle, PageNum first, void *const *buffers,
+                 unsigned count);
+    RC writePages(FileHandle &fileHandle, PageNum first,
+                  const void *const *buffers, unsigned count);
+
+    // Update the cached copy of a page, if there is one, after the page was
+    // written through a mapped handle
+    void refreshPage(FileHandle &fileHandle, PageNum pageNum, const void *data);
+
+    // Queue pages [first, first + count) of the file to be loaded in the
+    // background. Pages that are resident, queued or past the end of the
+    // file are skipped.
+    void prefetch(FileHandle &fileHandle, PageNum first, unsigned count);
+    // Drop queued prefetches of the file and wait for those in progress
+    void cancelPrefetch(FileHandle &fileHandle);
+
+    // Number of pages sequential readers keep in flight ahead of them; 0
+    // turns read-ahead off
+    void setReadAheadWindow(unsigned numPages);
+    unsigned getReadAheadWindow() const { return _readAheadWindow; }
+
+    // Milliseconds between passes of the background writer; 0 stops it
+    void setWriterInterval(unsigned ms);
+    unsigned getWriterInterval() const { return _writerInterval; }
+    // Pages written back so far, and the number of writes they took
+    void getWriteStats(unsigned &numPages, unsigned &numWrites);
+
+    // Write back every dirty frame of the file open in fileHandle
+    RC flushFile(FileHandle &fileHandle);
+    // Write back every dirty frame
+    RC flushAll();
+    // Called by a closing logged handle: its dirty frames stay in the pool,
+    // to be written back later through a handle owned by the pool
+    RC handOver(FileHandle &fileHandle);
+    // Drop every frame of fileName without writing it back
+    void discardFile(const string &fileName);
+    // Drop the frames of pages from first on, as the file is truncated.
+    // Fails if one of them is pinned.
+    RC discardPages(FileHandle &fileHandle, PageNum first);
+    // Whether the pool holds a handle of its own on fileName
+    bool hasHandle(const string &fileName);
+
+  protected:
+    BufferPoolManager();
+    ~BufferPoolManager();
+
+  private:
+    struct Frame {
+        string fileName;
+        PageNum pageNum;
+        FileHandle *owner;  // handle used to write the frame back
+        unsigned pinCount;
+        bool dirty;
+        bool referenced;    // second chance bit for the clock
+        bool valid;
+        bool loading;       // being read by a read-ahead thread
+        LSN lsn;            // log record of the last change, 0 if none
+        unsigned size;      // bytes in data, the page size of the file
+        char *data;
+    };
+
+    struct ReadRequest {
+        FileHandle *fileHandle;
+        PageNum pageNum;
+    };
+
+    // Adjacent dirty pages of one file, copied out for writing back
+    struct WriteRun {
+        FileHandle *owner;
+        PageNum first;
+        vector<unsigned> frames;
+        LSN lsn;            // highest LSN among the pages
+    };
+
+    static atomic<BufferPoolManager*> _bp_manager;
+    static mutex _instanceMutex;
+    vector<Frame> _frames;
+    map<pair<string, PageNum>, unsigned> _pageTable;
+    unsigned _clockHand;
+
+    mutex _latch;
+    condition_variable _loaded;     // a background load finished
+    condition_variable _requested;  // a prefetch was queued
+    deque<ReadRequest> _readQueue;
+    vector<thread> _readers;
+    unsigned _readAheadWindow;
+    unsigned _loading;              // background loads in progress
+    bool _stopping;
+
+    thread _writer;
+    condition_variable _dirtied;    // wakes the background writer
+    condition_variable _written;    // a write-back outside the latch ended
+    unsigned _writerInterval;
+    unsigned _numDirtied;           // frames dirtied since the writer's last pass
+    map<string, unsigned> _writes;  // write-backs in progress, per file
+    map<string, FileHandle*> _handles;  // the pool's own handles
+    unsigned _pagesWritten;
+    unsigned _writeCalls;
+
+    // The helpers below expect the latch to be held
+    RC allocateFrames(unsigned numFrames);
+    void releaseFrames();
+    RC findVictim(unsigned &frameNum);
+    RC resizeFrame(Frame &frame, unsigned size);
+    RC evictFrame(Frame &frame);
+    RC writeBack(Frame &frame, FileHandle &fileHandle);
+    RC lookupFrame(FileHandle &fileHandle, PageNum pageNum, bool load,
+                   unsigned &frameNum, unique_lock<mutex> &lock);
+    void waitForLoads(const string &fileName, unique_lock<mutex> &lock);
+    void waitForWrites(const string &fileName, unique_lock<mutex> &lock);
+    void noteDirty();
+    RC writeRuns(const string *fileName, FileHandle *owner, bool background,
+                 unique_lock<mutex> &lock);
+    RC writeRun(WriteRun &run, unique_lock<mutex> &lock);
+    void readAhead();
+    void writeBehind();
+};
+
+
+// A PageGuard keeps one page pinned in the buffer pool and gives direct
+// access to the frame holding it, so callers can work on a page without
+// copying it out. Asking for mutable access marks the page dirty. The page
+// is unpinned when the guard is released, re-pinned or destroyed.
+//
+// Pages of a file opened with OPEN_MMAP are not brought into the pool; the
+// guard points straight into the mapping instead.
+//
+//  PageGuard page;
+//  RC ret = page.pin(fileHandle, pageNum);
+//  const char* data = page.data();
+
+class PageGuard {
+  public:
+    PageGuard();
+    ~PageGuard();
+
+    RC pin(FileHandle &fileHandle, PageNum pageNum);
+    void release();
+
+    bool isPinned() const { return _pinned; }
+    PageNum getPageNum() const { return _pageNum; }
+
+    const char* data() const;
+    char* mutableData();
+
+  private:
+    PageGuard(const PageGuard&);
+    PageGuard& operator=(const PageGuard&);
+
+    FileHandle *_fileHandle;
+    PageNum _pageNum;
+    unsigned _frameNum;
+    char *_mapped;      // page in the file mapping, if the file is mapped
+    bool _pinned;
+    bool _dirty;
+};
+
+
+// A PageBuffer is a zeroed, PAGE_SIZE aligned block of one or more pages on
+// the heap, for working copies of pages. Pages are PAGE_SIZE bytes unless
+// told otherwise. Aligned buffers can be handed to a file opened with
+// OPEN_DIRECT as they are.
+//
+//  PageBuffer buffer;
+//  RC ret = fileHandle.readPage(pageNum, buffer);
+
+class PageBuffer {
+  public:
+    explicit PageBuffer(unsigned numPages = 1, unsigned pageSize = PAGE_SIZE);
+    ~PageBuffer();
+
+    operator unsigned char*() { return _data; }
+    operator const unsigned char*() const { return _data; }
+
+    static unsigned char* allocate(unsigned numPages = 1,
+                                   unsigned pageSize = PAGE_SIZE);
+    static bool isAligned(const void *data) {
+        return ((size_t) data) % PAGE_SIZE == 0; }
+
+  private:
+    PageBuffer(const PageBuffer&);
+    PageBuffer& operator=(const PageBuffer&);
+
+    unsigned char *_data;
+};
+
+#endif
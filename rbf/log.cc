@@ -0,0 +1,533 @@
+#include "log.h"
+#include "bpm.h"
+#include "../util/errcodes.h"
+
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// FNV-1a, to tell complete records from ones torn by a crash
+static unsigned checksum(const char *data, size_t size, unsigned hash = 2166136261u) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool preadAll(int fd, void *data, size_t size, off_t offset) {
+    char *buf = (char*) data;
+    while (size > 0) {
+        ssize_t n = pread(fd, buf, size, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool pwriteAll(int fd, const void *data, size_t size, off_t offset) {
+    const char *buf = (const char*) data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, buf, size, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// Reads the record at offset into header, fileName and image, which has
+// room for MAX_PAGE_SIZE bytes, and moves offset past it. Fails at the end of the log, and at a record that was
+// only partly written.
+
+static bool readRecord(int fd, LSN baseLSN, off_t &offset, LogRecordHeader &header,
+                       string &fileName, PageBuffer &image) {
+    if (not preadAll(fd, &header, sizeof(header), offset))
+        return false;
+    if (header.type < LOG_PAGE or header.type > LOG_TRUNCATE or header.nameLength > PATH_MAX)
+        return false;
+
+    size_t imageSize = header.type == LOG_PAGE ? header.imageSize : 0;
+    if (imageSize > 0 and not PagedFileManager::isValidPageSize(imageSize))
+        return false;
+    off_t end = offset + sizeof(header) + header.nameLength + imageSize;
+    if (header.lsn != baseLSN + (end - LOG_HEADER_SIZE))
+        return false;
+
+    fileName.resize(header.nameLength);
+    if (not preadAll(fd, &fileName[0], header.nameLength, offset + sizeof(header)))
+        return false;
+    if (imageSize > 0 and not preadAll(fd, image, imageSize, end - imageSize))
+        return false;
+
+    unsigned sum = checksum(fileName.data(), fileName.size());
+    sum = checksum((const char*) (const unsigned char*) image, imageSize, sum);
+    if (sum != header.checksum)
+        return false;
+
+    offset = end;
+    return true;
+}
+
+////////////////////////////
+// LogManager Implementation
+////////////////////////////
+
+atomic<LogManager*> LogManager::_log_manager(NULL);
+mutex LogManager::_instanceMutex;
+
+LogManager* LogManager::instance() {
+    LogManager *instance = _log_manager.load(memory_order_acquire);
+    if (instance)
+        return instance;
+
+    // Threads racing to get here first create a single instance
+    lock_guard<mutex> lock(_instanceMutex);
+    instance = _log_manager.load(memory_order_relaxed);
+    if (!instance) {
+        instance = new LogManager();
+        _log_manager.store(instance, memory_order_release);
+    }
+    return instance;
+}
+
+
+LogManager::LogManager()
+    : _fd(-1), _baseLSN(0), _nextLSN(0), _flushedLSN(0), _flushing(false),
+      _numSyncs(0), _stopping(false),
+      _checkpointInterval(DEFAULT_CHECKPOINT_INTERVAL_MS),
+      _checkpointSize(DEFAULT_CHECKPOINT_SIZE) {
+}
+
+
+LogManager::~LogManager() {
+    close();
+    _log_manager = NULL;
+}
+
+RC LogManager::open(const string &logName) {
+    if (isOpen())
+        return err::FILE_HANDLE_ALREADY_INITIALIZED;
+
+    int fd = ::open(logName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return err::FILE_COULD_NOT_OPEN;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return err::FILE_COULD_NOT_OPEN;
+    }
+
+    // A new log starts at LSN 0
+    LSN baseLSN = 0;
+    if (st.st_size > 0) {
+        char header[LOG_HEADER_SIZE];
+        if (not preadAll(fd, header, LOG_HEADER_SIZE, 0)
+                or memcmp(header, LOG_SIGNATURE, LOG_SIGNATURE_SIZE) != 0) {
+            ::close(fd);
+            return err::LOG_CORRUPT;
+        }
+        memcpy(&baseLSN, header + LOG_SIGNATURE_SIZE, sizeof(LSN));
+    }
+
+    _logName = logName;
+    _baseLSN = baseLSN;
+    _buffer.clear();
+
+    // Files are only opened for logging once the log is open, so the pages
+    // written during recovery are not logged again
+    _fd = fd;
+    RC ret = recover();
+    if (ret != err::OK) {
+        ::close(_fd);
+        _fd = -1;
+        return ret;
+    }
+
+    startCheckpointer();
+    return err::OK;
+}
+
+RC LogManager::close() {
+    if (not isOpen())
+        return err::OK;
+
+    stopCheckpointer();
+    RC ret = commit();
+    ::close(_fd);
+    _fd = -1;
+    return ret;
+}
+
+RC LogManager::logPage(const string &fileName, PageNum pageNum, void *data,
+                       unsigned pageSize, LSN &lsn) {
+    return append(LOG_PAGE, fileName, pageNum, data, pageSize, lsn);
+}
+
+RC LogManager::logFile(LogRecordType type, const string &fileName) {
+    LSN lsn;
+    return append(type, fileName, 0, NULL, 0, lsn);
+}
+
+RC LogManager::logTruncate(const string &fileName, PageNum numPages) {
+    LSN lsn;
+    RC ret = append(LOG_TRUNCATE, fileName, numPages, NULL, 0, lsn);
+    if (ret != err::OK)
+        return ret;
+    return flush(lsn);
+}
+
+// Adds a record to the buffer. A page image is stamped with the record's
+// LSN before it is copied in.
+
+RC LogManager::append(LogRecordType type, const string &fileName,
+                      PageNum pageNum, void *data, unsigned imageSize, LSN &lsn) {
+    size_t size = sizeof(LogRecordHeader) + fileName.size() + imageSize;
+
+    unique_lock<mutex> lock(_mutex);
+    if (not isOpen())
+        return err::LOG_NOT_OPEN;
+
+    LogRecordHeader header;
+    header.lsn = _nextLSN + size;
+    header.type = type;
+    header.nameLength = fileName.size();
+    header.pageNum = pageNum;
+    header.imageSize = imageSize;
+    if (data)
+        memcpy((char*) data + PAGE_LSN_OFFSET(imageSize), &header.lsn, sizeof(LSN));
+    header.checksum = checksum(fileName.data(), fileName.size());
+    header.checksum = checksum((const char*) data, imageSize, header.checksum);
+
+    _buffer.append((const char*) &header, sizeof(header));
+    _buffer.append(fileName);
+    _buffer.append((const char*) data, imageSize);
+    _nextLSN = header.lsn;
+    lsn = header.lsn;
+    if (type == LOG_PAGE or type == LOG_TRUNCATE)
+        _changedFiles.insert(fileName);
+    if (_nextLSN - _baseLSN >= _checkpointSize)
+        _checkpointDue.notify_one();
+
+    bool full = _buffer.size() >= LOG_BUFFER_SIZE;
+    lock.unlock();
+    return full ? flush(lsn) : err::OK;
+}
+
+// The first caller to find the log short of its LSN becomes the leader: it
+// takes the whole buffer, and writes and syncs it without holding the
+// mutex. Callers arriving meanwhile wait for it to finish, and then either
+// find their records durable or lead the next round with everything
+// buffered in the meantime.
+
+RC LogManager::flush(LSN lsn) {
+    unique_lock<mutex> lock(_mutex);
+    if (lsn > _nextLSN)
+        lsn = _nextLSN;
+
+    while (_flushedLSN < lsn) {
+        if (_flushing) {
+            _flushed.wait(lock);
+            continue;
+        }
+
+        _flushing = true;
+        string pending;
+        pending.swap(_buffer);
+        LSN start = _flushedLSN;
+        LSN end = _nextLSN;
+        lock.unlock();
+
+        off_t offset = LOG_HEADER_SIZE + (off_t) (start - _baseLSN);
+        bool ok = pwriteAll(_fd, pending.data(), pending.size(), offset)
+                  and fdatasync(_fd) == 0;
+
+        lock.lock();
+        _flushing = false;
+        _numSyncs++;
+        if (ok)
+            _flushedLSN = end;
+        else
+            _buffer.insert(0, pending);
+        _flushed.notify_all();
+        if (not ok)
+            return err::LOG_WRITE_FAILED;
+    }
+    return err::OK;
+}
+
+RC LogManager::commit() {
+    LSN lsn;
+    {
+        lock_guard<mutex> lock(_mutex);
+        lsn = _nextLSN;
+    }
+    return flush(lsn);
+}
+
+// The checkpoint covers everything logged up to its start. The files
+// changed up to then are synced one by one through a descriptor of their
+// own; files destroyed since don't need it.
+
+RC LogManager::checkpoint() {
+    lock_guard<mutex> checkpointLock(_checkpointMutex);
+    LSN lsn;
+    set<string> files;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (not isOpen())
+            return err::LOG_NOT_OPEN;
+        lsn = _nextLSN;
+        files.swap(_changedFiles);
+    }
+
+    RC ret = flush(lsn);
+    if (ret == err::OK)
+        ret = BufferPoolManager::instance()->flushAll();
+    PagedFileManager *pfm = PagedFileManager::instance();
+    for (auto it = files.begin(); ret == err::OK and it != files.end(); ++it)
+        ret = pfm->syncFile(*it);
+
+    if (ret != err::OK) {
+        lock_guard<mutex> lock(_mutex);
+        _changedFiles.insert(files.begin(), files.end());
+        return ret;
+    }
+    return cut(lsn);
+}
+
+void LogManager::setCheckpointInterval(unsigned ms) {
+    stopCheckpointer();
+    {
+        lock_guard<mutex> lock(_mutex);
+        _checkpointInterval = ms;
+    }
+    startCheckpointer();
+}
+
+void LogManager::setCheckpointSize(size_t bytes) {
+    lock_guard<mutex> lock(_mutex);
+    _checkpointSize = bytes;
+    _checkpointDue.notify_one();
+}
+
+LSN LogManager::getFlushedLSN() {
+    lock_guard<mutex> lock(_mutex);
+    return _flushedLSN;
+}
+
+LSN LogManager::getBaseLSN() {
+    lock_guard<mutex> lock(_mutex);
+    return _baseLSN;
+}
+
+unsigned LogManager::getNumSyncs() {
+    lock_guard<mutex> lock(_mutex);
+    return _numSyncs;
+}
+
+// Redo happens in two passes. The first finds, for every file, the last
+// time it was created or destroyed; records before that belong to an
+// older file of the same name. The second pass writes back every page
+// image whose page on disk has an older LSN, and cuts files down again
+// where they were truncated, dropping the pages written back before. The
+// files are synced before the log is emptied.
+
+RC LogManager::recover() {
+    map<string, LSN> barriers;
+    LogRecordHeader header;
+    string fileName;
+    PageBuffer image(1, MAX_PAGE_SIZE);
+
+    off_t offset = LOG_HEADER_SIZE;
+    while (readRecord(_fd, _baseLSN, offset, header, fileName, image)) {
+        if (header.type == LOG_CREATE or header.type == LOG_DESTROY)
+            barriers[fileName] = header.lsn;
+    }
+    LSN endLSN = _baseLSN + (offset - LOG_HEADER_SIZE);
+
+    RC ret = err::OK;
+    map<string, FileHandle*> handles;
+    offset = LOG_HEADER_SIZE;
+    while (ret == err::OK and readRecord(_fd, _baseLSN, offset, header, fileName, image)) {
+        if (header.type == LOG_CREATE or header.type == LOG_DESTROY
+                or header.lsn <= barriers[fileName])
+            continue;
+        ret = redo(header, fileName, (const char*) (const unsigned char*) image, handles);
+    }
+
+    PagedFileManager *pfm = PagedFileManager::instance();
+    for (auto it = handles.begin(); it != handles.end(); ++it) {
+        if (it->second == NULL)
+            continue;
+        if (ret == err::OK)
+            ret = it->second->sync();
+        pfm->closeFile(*it->second);
+        delete it->second;
+    }
+    if (ret != err::OK)
+        return ret;
+
+    return reset(endLSN);
+}
+
+RC LogManager::redo(const LogRecordHeader &header, const string &fileName,
+                    const char *image, map<string, FileHandle*> &handles) {
+    // Files that are gone were removed after the record was logged. Any
+    // other file that does not open fails recovery, so that the log, and
+    // its records for the file, are kept.
+    auto it = handles.find(fileName);
+    if (it == handles.end()) {
+        FileHandle *fileHandle = new FileHandle();
+        RC ret = PagedFileManager::instance()->openFile(fileName, *fileHandle);
+        if (ret != err::OK) {
+            delete fileHandle;
+            if (ret != err::FILE_NOT_FOUND)
+                return ret;
+            fileHandle = NULL;
+        }
+        it = handles.insert(make_pair(fileName, fileHandle)).first;
+    }
+    FileHandle *fileHandle = it->second;
+    if (fileHandle == NULL)
+        return err::OK;
+
+    if (header.type == LOG_TRUNCATE) {
+        if (header.pageNum >= fileHandle->getNumberOfPages())
+            return err::OK;
+        return fileHandle->truncate(header.pageNum);
+    }
+
+    // Records of an older file of another page size sit before a barrier
+    unsigned pageSize = fileHandle->getPageSize();
+    if (header.imageSize != pageSize)
+        return err::LOG_CORRUPT;
+
+    RC ret;
+    if (header.pageNum < fileHandle->getNumberOfPages()) {
+        PageBuffer page(1, pageSize);
+        ret = fileHandle->readPage(header.pageNum, page);
+        if (ret != err::OK)
+            return ret;
+
+        LSN pageLSN;
+        memcpy(&pageLSN, page + PAGE_LSN_OFFSET(pageSize), sizeof(LSN));
+        if (pageLSN >= header.lsn)
+            return err::OK;
+        return fileHandle->writePage(header.pageNum, image);
+    }
+
+    // The page was appended after the file last reached the disk
+    PageBuffer empty(1, pageSize);
+    while (fileHandle->getNumberOfPages() < header.pageNum) {
+        ret = fileHandle->appendPage(empty);
+        if (ret != err::OK)
+            return ret;
+    }
+    return fileHandle->appendPage(image);
+}
+
+// Empties the log. LSNs carry on from baseLSN, so they keep growing across
+// resets.
+
+RC LogManager::reset(LSN baseLSN) {
+    char header[LOG_HEADER_SIZE] = LOG_SIGNATURE;
+    memcpy(header + LOG_SIGNATURE_SIZE, &baseLSN, sizeof(LSN));
+    if (ftruncate(_fd, 0) != 0
+            or not pwriteAll(_fd, header, LOG_HEADER_SIZE, 0)
+            or fdatasync(_fd) != 0)
+        return err::LOG_WRITE_FAILED;
+
+    lock_guard<mutex> lock(_mutex);
+    _baseLSN = baseLSN;
+    _nextLSN = baseLSN;
+    _flushedLSN = baseLSN;
+    _buffer.clear();
+    return err::OK;
+}
+
+// Drops the records before baseLSN. The records after it that are already
+// durable are copied to a new log, which then replaces the old one, so a
+// crash at any point leaves one complete log behind. Records still
+// buffered keep their LSNs and are written to the new log later.
+
+RC LogManager::cut(LSN baseLSN) {
+    unique_lock<mutex> lock(_mutex);
+    _flushed.wait(lock, [this] { return not _flushing; });
+
+    string tail(_flushedLSN - baseLSN, '\0');
+    if (not preadAll(_fd, &tail[0], tail.size(), LOG_HEADER_SIZE + (off_t) (baseLSN - _baseLSN)))
+        return err::LOG_CORRUPT;
+
+    char header[LOG_HEADER_SIZE] = LOG_SIGNATURE;
+    memcpy(header + LOG_SIGNATURE_SIZE, &baseLSN, sizeof(LSN));
+    string tmpName = _logName + ".tmp";
+    int fd = ::open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return err::LOG_WRITE_FAILED;
+    if (not pwriteAll(fd, header, LOG_HEADER_SIZE, 0)
+            or not pwriteAll(fd, tail.data(), tail.size(), LOG_HEADER_SIZE)
+            or fdatasync(fd) != 0
+            or rename(tmpName.c_str(), _logName.c_str()) != 0) {
+        ::close(fd);
+        unlink(tmpName.c_str());
+        return err::LOG_WRITE_FAILED;
+    }
+
+    ::close(_fd);
+    _fd = fd;
+    _baseLSN = baseLSN;
+    return err::OK;
+}
+
+void LogManager::startCheckpointer() {
+    lock_guard<mutex> lock(_mutex);
+    if (isOpen() and _checkpointInterval > 0 and not _checkpointer.joinable())
+        _checkpointer = thread(&LogManager::checkpointLoop, this);
+}
+
+void LogManager::stopCheckpointer() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _checkpointDue.notify_all();
+    if (_checkpointer.joinable())
+        _checkpointer.join();
+
+    lock_guard<mutex> lock(_mutex);
+    _stopping = false;
+}
+
+// Body of the checkpointer thread. A checkpoint that failed is retried at
+// the next interval, rather than as soon as the log is found too large.
+
+void LogManager::checkpointLoop() {
+    unique_lock<mutex> lock(_mutex);
+    bool failed = false;
+    while (true) {
+        _checkpointDue.wait_for(lock, chrono::milliseconds(_checkpointInterval), [this, failed] {
+            return _stopping or (not failed and _nextLSN - _baseLSN >= _checkpointSize); });
+        if (_stopping)
+            return;
+        if (_nextLSN == _baseLSN)
+            continue;
+
+        lock.unlock();
+        failed = checkpoint() != err::OK;
+        lock.lock();
+    }
+}
@@ -0,0 +1,145 @@
+#ifndef _log_h_
+#define _log_h_
+
+#include <string>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "pfm.h"
+
+using namespace std;
+
+#define LOG_SIGNATURE "PAGELOG"
+#define LOG_SIGNATURE_SIZE 8
+// Signature and the LSN the log starts at
+#define LOG_HEADER_SIZE (LOG_SIGNATURE_SIZE + sizeof(LSN))
+
+// Buffered log records are written out once they pass this size, even if
+// nobody asked for them to be durable yet
+#define LOG_BUFFER_SIZE (256 * PAGE_SIZE)
+
+// A checkpoint is taken this often, or as soon as the log grows past
+// DEFAULT_CHECKPOINT_SIZE bytes, whichever comes first
+#define DEFAULT_CHECKPOINT_INTERVAL_MS 10000
+#define DEFAULT_CHECKPOINT_SIZE (64 * 1024 * 1024)
+
+enum LogRecordType { LOG_PAGE = 1, LOG_CREATE, LOG_DESTROY, LOG_TRUNCATE };
+
+// Every log record starts with this header. LOG_PAGE records are followed
+// by the file name and the page image, the others by the file name only.
+// pageNum of a LOG_TRUNCATE record is the number of pages the file kept.
+struct LogRecordHeader {
+    LSN lsn;            // log position just past the end of the record
+    unsigned type;
+    unsigned nameLength;
+    PageNum pageNum;
+    unsigned imageSize; // page size of the file, 0 if there is no image
+    unsigned checksum;  // of everything after the header
+};
+
+
+// The LogManager keeps a write-ahead log of page changes. Files opened with
+// OPEN_LOGGED log an image of every page they change, stamped with the
+// record's LSN, before the page can reach the file: the buffer pool makes
+// the log durable up to a page's LSN before writing the page back. Pages
+// are redone from the log when it is opened again after a crash.
+//
+// Records are buffered in memory and made durable by flush or commit.
+// Callers that flush at the same time share a single write and sync: one
+// of them writes out everything buffered so far while the others wait for
+// it.
+//
+// A checkpoint writes back every dirty page, syncs the files that were
+// logged, and cuts the log down to the records logged since, which bounds
+// the work left for recovery. While the log is open, a checkpointer thread
+// takes one periodically, and whenever the log grows too large.
+//
+//  LogManager *log = LogManager::instance();
+//  RC ret = log->open("db.log");   // redoes whatever the log holds
+//  ...
+//  ret = log->commit();            // changes so far survive a crash
+
+class LogManager {
+  public:
+    // Access to the _log_manager instance
+    static LogManager* instance();
+
+    // Opens the log, creating it if needed, and redoes every page change in
+    // it. The log is then emptied, and new changes are logged from then on.
+    RC open(const string &logName);
+    RC close();
+    bool isOpen() const { return _fd >= 0; }
+
+    // Stamps data, an image of page pageNum of fileName, with the LSN of a
+    // new log record holding it. Pages of the file are pageSize bytes.
+    RC logPage(const string &fileName, PageNum pageNum, void *data,
+               unsigned pageSize, LSN &lsn);
+    // Records that fileName was created or destroyed. Earlier records for
+    // the file are not redone.
+    RC logFile(LogRecordType type, const string &fileName);
+    // Records that fileName was cut down to numPages pages, and makes the
+    // record durable: the file must not lose its pages before that.
+    RC logTruncate(const string &fileName, PageNum numPages);
+
+    // Makes the log durable up to lsn
+    RC flush(LSN lsn);
+    // Makes everything logged so far durable
+    RC commit();
+
+    // Makes every change logged so far durable in its file, and drops the
+    // log records that hold it
+    RC checkpoint();
+    // Milliseconds between checkpoints; 0 leaves checkpoints to the caller
+    void setCheckpointInterval(unsigned ms);
+    // Log size, in bytes, that brings the next checkpoint forward
+    void setCheckpointSize(size_t bytes);
+
+    LSN getFlushedLSN();
+    // LSN the log starts at, which is that of the last checkpoint
+    LSN getBaseLSN();
+    // Number of times the log was synced, for measuring group commit
+    unsigned getNumSyncs();
+
+  protected:
+    LogManager();
+    ~LogManager();
+
+  private:
+    static atomic<LogManager*> _log_manager;
+    static mutex _instanceMutex;
+
+    int _fd;
+    string _logName;
+    LSN _baseLSN;       // LSN of the first byte after the header
+    LSN _nextLSN;       // end of the last record logged
+    LSN _flushedLSN;    // end of the durable part of the log
+    string _buffer;     // records past _flushedLSN not written out yet
+    bool _flushing;     // a caller is writing out the buffer
+    unsigned _numSyncs;
+    mutex _mutex;
+    condition_variable _flushed;
+
+    set<string> _changedFiles;  // files logged since the last checkpoint
+    mutex _checkpointMutex;     // one checkpoint at a time
+    thread _checkpointer;
+    condition_variable _checkpointDue;
+    bool _stopping;
+    unsigned _checkpointInterval;
+    size_t _checkpointSize;
+
+    RC append(LogRecordType type, const string &fileName, PageNum pageNum,
+              void *data, unsigned imageSize, LSN &lsn);
+    RC recover();
+    RC redo(const LogRecordHeader &header, const string &fileName,
+            const char *image, map<string, FileHandle*> &handles);
+    RC reset(LSN baseLSN);
+    RC cut(LSN baseLSN);
+    void startCheckpointer();
+    void stopCheckpointer();
+    void checkpointLoop();
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "lz.h"
+
+#include <cstring>
+#include <cstdint>
+
+#define LZ_HASH_BITS 12
+
+static inline unsigned hash4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes what is left of a length that did not fit its nibble
+static inline bool putLength(unsigned char *&out, unsigned char *end, size_t length) {
+    while (length >= 255) {
+        if (out == end)
+            return false;
+        *out++ = 255;
+        length -= 255;
+    }
+    if (out == end)
+        return false;
+    *out++ = (unsigned char) length;
+    return true;
+}
+
+static inline bool getLength(const unsigned char *&in, const unsigned char *end, size_t &length) {
+    unsigned char byte;
+    do {
+        if (in == end)
+            return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Writes a sequence of literals, followed by a match unless matchLength is
+// 0. Returns false if dst runs out of room.
+static bool putSequence(unsigned char *&out, unsigned char *end,
+                        const unsigned char *literals, size_t numLiterals,
+                        size_t offset, size_t matchLength) {
+    if (out == end)
+        return false;
+    unsigned char *token = out++;
+    *token = (numLiterals < 15 ? numLiterals : 15) << 4;
+    if (numLiterals >= 15 and not putLength(out, end, numLiterals - 15))
+        return false;
+    if ((size_t) (end - out) < numLiterals)
+        return false;
+    memcpy(out, literals, numLiterals);
+    out += numLiterals;
+
+    if (matchLength == 0)
+        return true;
+    if (end - out < 2)
+        return false;
+    *out++ = offset & 0xFF;
+    *out++ = offset >> 8;
+    size_t length = matchLength - LZ_MIN_MATCH;
+    *token |= length < 15 ? length : 15;
+    if (length >= 15 and not putLength(out, end, length - 15))
+        return false;
+    return true;
+}
+
+size_t lzCompress(const void *src, size_t srcSize, void *dst, size_t dstCapacity) {
+    const unsigned char *in = (const unsigned char*) src;
+    unsigned char *out = (unsigned char*) dst;
+    unsigned char *end = out + dstCapacity;
+
+    // Last position each hash was seen at, plus one; 0 for none
+    size_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= srcSize) {
+        unsigned h = hash4(in + pos);
+        size_t candidate = table[h];
+        table[h] = pos + 1;
+        if (candidate == 0 or pos + 1 - candidate > LZ_MAX_OFFSET
+                or memcmp(in + candidate - 1, in + pos, LZ_MIN_MATCH) != 0) {
+            pos++;
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < srcSize and in[match + length] == in[pos + length])
+            length++;
+        if (not putSequence(out, end, in + anchor, pos - anchor, pos - match, length))
+            return 0;
+        pos += length;
+        anchor = pos;
+    }
+
+    if (not putSequence(out, end, in + anchor, srcSize - anchor, 0, 0))
+        return 0;
+    return out - (unsigned char*) dst;
+}
+
+bool lzDecompress(const void *src, size_t srcSize, void *dst, size_t dstSize) {
+    const unsigned char *in = (const unsigned char*) src;
+    const unsigned char *inEnd = in + srcSize;
+    unsigned char *out = (unsigned char*) dst;
+    unsigned char *outEnd = out + dstSize;
+
+    while (in < inEnd) {
+        unsigned char token = *in++;
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 and not getLength(in, inEnd, numLiterals))
+            return false;
+        if ((size_t) (inEnd - in) < numLiterals or (size_t) (outEnd - out) < numLiterals)
+            return false;
+        memcpy(out, in, numLiterals);
+        in += numLiterals;
+        out += numLiterals;
+
+        // The last sequence has no match
+        if (in == inEnd)
+            break;
+        if (inEnd - in < 2)
+            return false;
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 and not getLength(in, inEnd, length))
+            return false;
+        length += LZ_MIN_MATCH;
+        if (offset == 0 or offset > (size_t) (out - (unsigned char*) dst)
+                or (size_t) (outEnd - out) < length)
+            return false;
+
+        // Byte by byte, since the match may overlap what it produces
+        const unsigned char *match = out - offset;
+        for (size_t i = 0; i < length; i++)
+            out[i] = match[i];
+        out += length;
+    }
+    return out == outEnd;
+}
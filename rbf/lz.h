@@ -0,0 +1,33 @@
+#ifndef _lz_h_
+#define _lz_h_
+
+#include <cstddef>
+
+// A small LZ77 codec for the pages of compressed files. It favours speed
+// over ratio: matches are found through a single hash table probe.
+//
+// Compressed data is a run of sequences, each a token byte, the literal
+// bytes, then a match:
+//
+//  token       high 4 bits: number of literals, low 4 bits: match length
+//              minus LZ_MIN_MATCH. 15 means the length goes on in the
+//              bytes that follow, each adding up to 255.
+//  literals    copied as they are
+//  offset      2 bytes, little endian: how far back the match starts
+//
+// The last sequence ends after its literals, and has no match. Matches may
+// overlap the bytes they produce, so a run of equal bytes takes a few bytes.
+
+#define LZ_MIN_MATCH 4
+// Matches reach at most this far back, so inputs are up to MAX_PAGE_SIZE
+#define LZ_MAX_OFFSET 65535
+
+// Compresses srcSize bytes from src into dst. Returns the compressed size,
+// or 0 if it would be more than dstCapacity.
+size_t lzCompress(const void *src, size_t srcSize, void *dst, size_t dstCapacity);
+
+// Decompresses srcSize bytes from src, which must come out as exactly
+// dstSize bytes. Returns false on corrupt input.
+bool lzDecompress(const void *src, size_t srcSize, void *dst, size_t dstSize);
+
+#endif
@@ -1,49 +1,467 @@
 #include "pfm.h"
+#include "bpm.h"
+#include "log.h"
+#include "lz.h"
 #include "../util/errcodes.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+
+// pread/pwrite may transfer less than asked for, and may be interrupted by
+// a signal. These keep going until the whole range is done.
+
+static bool preadFull(int fd, void *data, size_t size, off_t offset) {
+    char *buf = (char*) data;
+    while (size > 0) {
+        ssize_t n = pread(fd, buf, size, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+static bool pwriteFull(int fd, const void *data, size_t size, off_t offset) {
+    const char *buf = (const char*) data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, buf, size, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// The vectored versions also cope with more buffers than one call takes.
+// iov is consumed in the process.
+
+static bool preadvFull(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t n = preadv(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        offset += n;
+        while (iovcnt > 0 and (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static bool pwritevFull(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t n = pwritev(fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX, offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        offset += n;
+        while (iovcnt > 0 and (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+static unsigned long long nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Writes c as a JSON object
+static void writeCounters(ostream &out, const IOCounters &c) {
+    out << "{\"ops\": " << c.ops << ", \"pages\": " << c.pages
+        << ", \"bytes\": " << c.bytes << ", \"total_us\": " << c.totalNs / 1000
+        << ", \"latency_us\": {";
+    bool first = true;
+    for (unsigned i = 0; i < IO_LATENCY_BUCKETS; i++) {
+        if (c.latency[i] == 0)
+            continue;
+        // Buckets are keyed by the bound they stay under
+        out << (first ? "" : ", ") << '"';
+        if (i + 1 == IO_LATENCY_BUCKETS)
+            out << "inf";
+        else
+            out << (1ull << i);
+        out << "\": " << c.latency[i];
+        first = false;
+    }
+    out << "}}";
+}
+
+static void writeString(ostream &out, const string &str) {
+    out << '"';
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char ch = str[i];
+        if (ch == '"' or ch == '\\') {
+            out << '\\' << ch;
+        } else if (ch < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            out << escaped;
+        } else {
+            out << ch;
+        }
+    }
+    out << '"';
+}
+
+static const char* ioOpNames[IO_NUM_OPS] = { "read", "write", "append", "sync" };
+
+// Checks the signature at the start of an open paged file or tablespace
+static bool hasSignature(int fd, const char *expected = SIGNATURE) {
+    char signature[SIGNATURE_SIZE];
+    if (not preadFull(fd, signature, SIGNATURE_SIZE, 0))
+        return false;
+    return memcmp(signature, expected, SIGNATURE_SIZE) == 0;
+}
+
+// Writes the page map back if it changed. A map that outgrew its place
+// moves to the end of the file, with room to double.
+
+static RC writePageMap(int fd, PageMap &pageMap) {
+    lock_guard<mutex> lock(pageMap.latch);
+    if (not pageMap.dirty)
+        return 0;
+
+    unsigned count = pageMap.slots.size();
+    if (count > pageMap.mapCapacity) {
+        pageMap.mapCapacity = 2 * count;
+        pageMap.mapOffset = pageMap.end;
+        pageMap.end += (off_t) pageMap.mapCapacity * sizeof(PageSlot);
+    }
+    if (not pwriteFull(fd, pageMap.slots.data(), count * sizeof(PageSlot), pageMap.mapOffset))
+        return err::FILE_CORRUPT;
+
+    // The header points at the map only once the map is complete
+    char fields[sizeof(unsigned long long) + 2 * sizeof(unsigned)];
+    unsigned long long offset = pageMap.mapOffset;
+    memcpy(fields, &offset, sizeof(offset));
+    memcpy(fields + sizeof(offset), &count, sizeof(unsigned));
+    memcpy(fields + sizeof(offset) + sizeof(unsigned), &pageMap.mapCapacity, sizeof(unsigned));
+    if (not pwriteFull(fd, fields, sizeof(fields), PAGE_MAP_OFFSET))
+        return err::FILE_CORRUPT;
+
+    pageMap.dirty = false;
+    return 0;
+}
+
+// The segment directory lists each segment as its name length, page count
+// and number of extents, followed by the name and the extents. The free
+// extents come last. Callers hold the tablespace's latch.
+
+static void putUnsigned(string &out, unsigned value) {
+    out.append((const char*) &value, sizeof(unsigned));
+}
+
+static bool getUnsigned(const string &in, size_t &pos, unsigned &value) {
+    if (in.size() - pos < sizeof(unsigned))
+        return false;
+    memcpy(&value, in.data() + pos, sizeof(unsigned));
+    pos += sizeof(unsigned);
+    return true;
+}
+
+static bool getExtents(const string &in, size_t &pos, unsigned count, vector<Extent> &extents) {
+    extents.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+        if (not getUnsigned(in, pos, extents[i].start) or not getUnsigned(in, pos, extents[i].length))
+            return false;
+    }
+    return true;
+}
+
+static RC readDirectory(Tablespace &space) {
+    // Page count, page size, then the directory's pages and size
+    unsigned fields[5];
+    if (not preadFull(space.fd, fields, sizeof(fields), PAGE_COUNT_OFFSET))
+        return err::FILE_CORRUPT;
+    space.numPages = fields[0];
+    space.pageSize = fields[1];
+    space.directory.start = fields[2];
+    space.directory.length = fields[3];
+    unsigned size = fields[4];
+    if (not PagedFileManager::isValidPageSize(space.pageSize)
+            or size > (size_t) space.directory.length * space.pageSize)
+        return err::FILE_CORRUPT;
+
+    string in(size, '\0');
+    off_t offset = FILE_HEADER_SIZE + (off_t) space.pageSize * space.directory.start;
+    if (size > 0 and not preadFull(space.fd, &in[0], size, offset))
+        return err::FILE_CORRUPT;
+
+    size_t pos = 0;
+    unsigned numSegments = 0, numFree = 0;
+    if (size > 0 and not getUnsigned(in, pos, numSegments))
+        return err::FILE_CORRUPT;
+    for (unsigned i = 0; i < numSegments; i++) {
+        unsigned nameLength, numExtents;
+        Segment segment;
+        if (not getUnsigned(in, pos, nameLength) or not getUnsigned(in, pos, segment.pageCount)
+                or not getUnsigned(in, pos, numExtents) or in.size() - pos < nameLength)
+            return err::FILE_CORRUPT;
+        string name = in.substr(pos, nameLength);
+        pos += nameLength;
+        if (not getExtents(in, pos, numExtents, segment.extents))
+            return err::FILE_CORRUPT;
+        space.segments[name] = segment;
+    }
+    if (size > 0 and (not getUnsigned(in, pos, numFree)
+                      or not getExtents(in, pos, numFree, space.freeExtents)))
+        return err::FILE_CORRUPT;
+    return 0;
+}
+
+// Takes length pages for a segment or the directory, from the first free
+// extent large enough, or else from the end of the tablespace
+static Extent allocateExtent(Tablespace &space, unsigned length) {
+    for (auto it = space.freeExtents.begin(); it != space.freeExtents.end(); ++it) {
+        if (it->length < length)
+            continue;
+        Extent extent = { it->start, length };
+        it->start += length;
+        it->length -= length;
+        if (it->length == 0)
+            space.freeExtents.erase(it);
+        space.dirty = true;
+        return extent;
+    }
+
+    Extent extent = { space.numPages, length };
+    space.numPages += length;
+    space.dirty = true;
+    // Best effort, as for extents of plain files
+    fallocate(space.fd, 0, FILE_HEADER_SIZE + (off_t) space.pageSize * extent.start,
+              (off_t) space.pageSize * length);
+    return extent;
+}
+
+// Writes the directory back if it changed. A directory that outgrew its
+// pages moves to new ones, with room to double.
+
+static RC writeDirectory(Tablespace &space) {
+    if (not space.dirty)
+        return 0;
+
+    // The old pages are only given up once the header no longer points at
+    // them; their extent is then recorded by the next write
+    Extent retired = { 0, 0 };
+    string out;
+    while (true) {
+        out.clear();
+        putUnsigned(out, space.segments.size());
+        for (auto it = space.segments.begin(); it != space.segments.end(); ++it) {
+            putUnsigned(out, it->first.size());
+            putUnsigned(out, it->second.pageCount);
+            putUnsigned(out, it->second.extents.size());
+            out.append(it->first);
+            for (auto ext = it->second.extents.begin(); ext != it->second.extents.end(); ++ext) {
+                putUnsigned(out, ext->start);
+                putUnsigned(out, ext->length);
+            }
+        }
+        putUnsigned(out, space.freeExtents.size());
+        for (auto ext = space.freeExtents.begin(); ext != space.freeExtents.end(); ++ext) {
+            putUnsigned(out, ext->start);
+            putUnsigned(out, ext->length);
+        }
+        if (out.size() <= (size_t) space.directory.length * space.pageSize)
+            break;
+        // Allocating may change the free extents, so serialize again
+        unsigned pages = (2 * out.size() + space.pageSize - 1) / space.pageSize;
+        if (space.directory.length > 0)
+            retired = space.directory;
+        space.directory = allocateExtent(space, pages);
+    }
+
+    off_t offset = FILE_HEADER_SIZE + (off_t) space.pageSize * space.directory.start;
+    if (not pwriteFull(space.fd, out.data(), out.size(), offset))
+        return err::FILE_CORRUPT;
+
+    // The header points at the directory only once it is complete
+    unsigned fields[5] = { space.numPages, space.pageSize, space.directory.start,
+                           space.directory.length, (unsigned) out.size() };
+    if (not pwriteFull(space.fd, fields, sizeof(fields), PAGE_COUNT_OFFSET))
+        return err::FILE_CORRUPT;
+
+    space.dirty = false;
+    if (retired.length > 0) {
+        space.freeExtents.push_back(retired);
+        space.dirty = true;
+    }
+    return 0;
+}
+
+Tablespace::~Tablespace() {
+    if (fd >= 0) {
+        lock_guard<mutex> lock(latch);
+        writeDirectory(*this);
+        close(fd);
+    }
+}
+
+/////////////////////////
+// IOStats Implementation
+/////////////////////////
+
+void IOStats::record(IOOp op, unsigned pages, size_t bytes, unsigned long long ns) {
+    Counters &c = _counters[op];
+    unsigned bucket = 0;
+    for (unsigned long long us = ns / 1000; us > 0 and bucket + 1 < IO_LATENCY_BUCKETS; us >>= 1)
+        bucket++;
+
+    c.ops.fetch_add(1, memory_order_relaxed);
+    c.pages.fetch_add(pages, memory_order_relaxed);
+    c.bytes.fetch_add(bytes, memory_order_relaxed);
+    c.totalNs.fetch_add(ns, memory_order_relaxed);
+    c.latency[bucket].fetch_add(1, memory_order_relaxed);
+}
+
+// Counters are read one at a time, so a snapshot taken while I/O is going
+// on may be off by the operations in progress
+void IOStats::get(IOOp op, IOCounters &counters) const {
+    const Counters &c = _counters[op];
+    counters.ops = c.ops.load(memory_order_relaxed);
+    counters.pages = c.pages.load(memory_order_relaxed);
+    counters.bytes = c.bytes.load(memory_order_relaxed);
+    counters.totalNs = c.totalNs.load(memory_order_relaxed);
+    for (unsigned i = 0; i < IO_LATENCY_BUCKETS; i++)
+        counters.latency[i] = c.latency[i].load(memory_order_relaxed);
+}
+
+void IOStats::reset() {
+    for (unsigned op = 0; op < IO_NUM_OPS; op++) {
+        Counters &c = _counters[op];
+        c.ops = 0;
+        c.pages = 0;
+        c.bytes = 0;
+        c.totalNs = 0;
+        for (unsigned i = 0; i < IO_LATENCY_BUCKETS; i++)
+            c.latency[i] = 0;
+    }
+}
 
 //////////////////////////////////
 // PagedFileManager Implementation
 //////////////////////////////////
 
-PagedFileManager* PagedFileManager::_pf_manager = 0;
+atomic<PagedFileManager*> PagedFileManager::_pf_manager(NULL);
+mutex PagedFileManager::_instanceMutex;
 
 PagedFileManager* PagedFileManager::instance() {
-    if(!_pf_manager)
-        _pf_manager = new PagedFileManager();
-
-    return _pf_manager;
+    PagedFileManager *pfm = _pf_manager.load(memory_order_acquire);
+    if (pfm)
+        return pfm;
+
+    // Threads racing to get here first create a single instance
+    lock_guard<mutex> lock(_instanceMutex);
+    pfm = _pf_manager.load(memory_order_relaxed);
+    if (!pfm) {
+        pfm = new PagedFileManager();
+        _pf_manager.store(pfm, memory_order_release);
+    }
+    return pfm;
 }
 
 
-PagedFileManager::PagedFileManager() {
+PagedFileManager::PagedFileManager()
+    : _numOpenFiles(0), _maxOpenFiles(DEFAULT_MAX_OPEN_FILES), _useClock(0),
+      _extentPages(DEFAULT_EXTENT_PAGES), _syncPolicy(SYNC_NONE),
+      _syncInterval(DEFAULT_SYNC_INTERVAL_MS), _stopping(false) {
 }
 
 
+// Descriptors still used by open handles are left to the handles; they
+// close them when they find the file unknown to the PFM.
+
 PagedFileManager::~PagedFileManager() {
-    if (_pf_manager)
-        _pf_manager = NULL;
+    {
+        lock_guard<mutex> lock(_syncMutex);
+        _stopping = true;
+    }
+    _syncDue.notify_all();
+    if (_syncer.joinable())
+        _syncer.join();
+
+    for (unsigned i = 0; i < FILE_TABLE_SHARDS; i++) {
+        map<string, FileEntry> &files = _fileShards[i].files;
+        for (auto it = files.begin(); it != files.end(); ++it) {
+            if (it->second.fd >= 0 and it->second.handleCount == 0)
+                close(it->second.fd);
+        }
+    }
+    _pf_manager = NULL;
 }
 
 // Creates an empty paged-file called fileName. The file must not already
 // already exist. This method does not create any pages in the file.
 
-RC PagedFileManager::createFile(const string &fileName) {
+RC PagedFileManager::createFile(const string &fileName, unsigned pageSize, unsigned flags) {
+    if (not isValidPageSize(pageSize))
+        return err::FILE_INVALID_PAGE_SIZE;
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    if (space)
+        return createSegment(*space, fileName, pageSize, flags);
     if (fileExists(fileName))
         return err::FILE_ALREADY_EXISTS;
-    FILE *file;
-    file = fopen(fileName.c_str(), "wb");
-    if (file == NULL)
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
         return err::FILE_COULD_NOT_OPEN; 
 
-    if (fputs(SIGNATURE, file) == EOF)
+    // The page count, and the page map of a compressed file, start out empty
+    char header[FILE_HEADER_SIZE] = SIGNATURE;
+    memcpy(header + PAGE_SIZE_OFFSET, &pageSize, sizeof(unsigned));
+    memcpy(header + FILE_FLAGS_OFFSET, &flags, sizeof(unsigned));
+    if (not pwriteFull(fd, header, FILE_HEADER_SIZE, 0)) {
+        close(fd);
         return err::FILE_CORRUPT; 
-
-    fclose(file);
-
+    }
+
+    close(fd);
+
+    // Pages, descriptors, statistics and page maps kept under this name
+    // belong to an older file. The pool lets go of its handle first, so the
+    // descriptor can be dropped.
+    BufferPoolManager::instance()->discardFile(fileName);
+    dropFile(fileName);
+    dropFileStats(fileName);
+    dropPageMap(fileName);
+
+    // Log records for an older file of this name must not be redone on it
+    LogManager *log = LogManager::instance();
+    if (log->isOpen())
+        return log->logFile(LOG_CREATE, fileName);
     return 0;
 }
 
@@ -51,29 +469,45 @@ RC PagedFileManager::createFile(const string &fileName) {
 // must have been created with createFile.
 
 RC PagedFileManager::destroyFile(const string &fileName) {
-    FILE *file;
-    char signature[SIGNATURE_SIZE + 1];
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    if (space)
+        return destroySegment(*space, fileName);
+
     if (not fileExists(fileName))
         return err::FILE_COULD_NOT_DELETE;
 
-    file = fopen(fileName.c_str(), "rb");
-    if (file == NULL)
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
         return err::FILE_COULD_NOT_OPEN; 
-    fgets(signature, SIGNATURE_SIZE + 1, file);
 
-    if (strcmp(signature, SIGNATURE) != 0)
-        return err::FILE_CORRUPT;
-
-    if (fclose(file) == EOF)
+    bool valid = hasSignature(fd);
+    if (close(fd) != 0)
         return err::FILE_CORRUPT; // Error closing file
 
-    if (handleCount.find(fileName) != handleCount.end()
-        and handleCount[fileName] > 0)
-        return err::FILE_COULD_NOT_DELETE;
+    if (not valid)
+        return err::FILE_CORRUPT;
+
+    // The buffer pool's own handle does not keep the file open
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    unsigned poolHandles = bpm->hasHandle(fileName) ? 1 : 0;
+    {
+        FileShard &shard = shardOf(fileName);
+        lock_guard<mutex> lock(shard.latch);
+        auto it = shard.files.find(fileName);
+        if (it != shard.files.end() and it->second.handleCount > poolHandles)
+            return err::FILE_COULD_NOT_DELETE;
+    }
     
+    bpm->discardFile(fileName);
+    dropFile(fileName);
     if (remove(fileName.c_str()) != 0)
         return err::FILE_COULD_NOT_DELETE;
+    dropFileStats(fileName);
+    dropPageMap(fileName);
 
+    LogManager *log = LogManager::instance();
+    if (log->isOpen())
+        return log->logFile(LOG_DESTROY, fileName);
     return 0;
 }
 
@@ -87,52 +521,636 @@ RC PagedFileManager::destroyFile(const string &fileName) {
 // openFile creates a new instance of the open file. Opening a file more
 // than once for writing is not prevented, but behavior is undefined.
 // Opening a file more than once for reading is no problem.
+//
+// flags is a combination of OpenFlags.
 
-RC PagedFileManager::openFile(const string &fileName, FileHandle &fileHandle) {
+RC PagedFileManager::openFile(const string &fileName, FileHandle &fileHandle,
+                              unsigned flags) {
     // fileHandle must not be handle for some open file
     if (fileHandle.hasFile())
         return err::FILE_HANDLE_ALREADY_INITIALIZED;
 
-    if (not fileExists(fileName))
-        return err::FILE_NOT_FOUND;
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    if (space)
+        return openSegment(space, fileName, fileHandle, flags);
 
-    FILE *file;
-    char signature[SIGNATURE_SIZE + 1];
-    file = fopen(fileName.c_str(), "rb+");
-    if (file == NULL)
-        return err::FILE_COULD_NOT_OPEN; 
-    fgets(signature, SIGNATURE_SIZE + 1, file);
-
-    // must be created by PFM
-    if (strcmp(signature, SIGNATURE) != 0)
-        return err::FILE_CORRUPT;
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+        return err::FILE_NOT_FOUND;
 
-    if (handleCount.find(fileName) != handleCount.end())
-        handleCount[fileName] += 1;
-    else
-        handleCount[fileName] = 1;
+    // The shard stays latched while the file is opened, so that a
+    // descriptor is only opened once for the cache
+    FileShard &shard = shardOf(fileName);
+    unique_lock<mutex> lock(shard.latch);
+    auto it = shard.files.find(fileName);
+    if (it == shard.files.end()) {
+        FileEntry entry = { -1, 0, 0, 0, 0, make_shared<FileInfo>() };
+        it = shard.files.insert(make_pair(fileName, entry)).first;
+    }
+    FileEntry &entry = it->second;
+
+    // A cached descriptor of a file that has since been replaced on disk
+    // is useless
+    bool stale = entry.fd >= 0 and (entry.dev != st.st_dev or entry.ino != st.st_ino);
+    if (stale and entry.handleCount == 0) {
+        close(entry.fd);
+        entry.fd = -1;
+        entry.info = make_shared<FileInfo>();
+        _numOpenFiles--;
+        stale = false;
+    }
+
+    bool shared = not (flags & OPEN_DIRECT) and not stale;
+    int fd = entry.fd;
+    if (not shared or fd < 0) {
+        fd = open(fileName.c_str(), O_RDWR);
+        if (fd < 0) {
+            if (entry.fd < 0 and entry.handleCount == 0)
+                shard.files.erase(it);
+            return err::FILE_COULD_NOT_OPEN; 
+        }
+
+        // must be created by PFM
+        if (not hasSignature(fd)) {
+            close(fd);
+            if (entry.fd < 0 and entry.handleCount == 0)
+                shard.files.erase(it);
+            return err::FILE_CORRUPT;
+        }
+
+        if (shared) {
+            entry.fd = fd;
+            entry.dev = st.st_dev;
+            entry.ino = st.st_ino;
+            _numOpenFiles++;
+        }
+    }
+
+    entry.handleCount++;
+    entry.lastUsed = ++_useClock;
+    fileHandle._info = entry.info;
+    lock.unlock();
+    closeIdleFiles();
 
     fileHandle.fileName = fileName;
-    return fileHandle.loadFile(file);
+    fileHandle._ioStats = getFileStats(fileName);
+    fileHandle._syncPolicy = getSyncPolicy(fileName);
+    RC ret = fileHandle.loadFile(fd);
+    if (ret == err::OK and (fileHandle._fileFlags & CREATE_COMPRESSED)) {
+        ret = loadPageMap(fileHandle);
+        flags &= ~(OPEN_MMAP | OPEN_DIRECT);
+    }
+    if (ret == err::OK and (flags & OPEN_MMAP))
+        ret = fileHandle.mapFile();
+    if (ret == err::OK and (flags & OPEN_DIRECT))
+        ret = fileHandle.enableDirectIO();
+    if (ret == err::OK and (flags & OPEN_LOGGED))
+        fileHandle._logged = LogManager::instance()->isOpen();
+    if (ret != err::OK)
+        closeFile(fileHandle);
+    return ret;
 }
 
 // Closes the open file referred to by fileHandle. The file should have been
 // opened by a call to openFile. All of the file's pages are written to disk
-// when the file is closed.
+// when the file is closed, except for those of a logged file, which the
+// buffer pool writes back in the background. The handle is closed even if
+// writing them fails, and the failure is returned.
 
 RC PagedFileManager::closeFile(FileHandle &fileHandle) {
     if (not fileHandle.hasFile())
         return err::FILE_HANDLE_NOT_INITIALIZED;
 
-    handleCount[fileHandle.fileName] -= 1;
+    return fileHandle.unloadFile();
+}
+
+void PagedFileManager::setMaxOpenFiles(unsigned maxOpenFiles) {
+    _maxOpenFiles = maxOpenFiles;
+    closeIdleFiles();
+}
+
+// Called by a FileHandle as it lets go of its descriptor. Descriptors of
+// their own are closed; shared ones stay cached.
+
+void PagedFileManager::releaseFile(FileHandle &fileHandle) {
+    if (fileHandle.isSegment()) {
+        lock_guard<mutex> lock(fileHandle._tablespace->latch);
+        fileHandle._segment->handleCount--;
+        return;
+    }
+
+    FileShard &shard = shardOf(fileHandle.fileName);
+    {
+        lock_guard<mutex> lock(shard.latch);
+        auto it = shard.files.find(fileHandle.fileName);
+        if (it == shard.files.end()) {
+            close(fileHandle._fd);
+            return;
+        }
+
+        FileEntry &entry = it->second;
+        if (fileHandle._fd != entry.fd)
+            close(fileHandle._fd);
+        entry.handleCount--;
+        entry.lastUsed = ++_useClock;
+
+        if (entry.fd < 0 and entry.handleCount == 0) {
+            shard.files.erase(it);
+            return;
+        }
+    }
+    closeIdleFiles();
+}
+
+// Whether handles other than fileHandle, and the buffer pool's own, are
+// open on the file of fileHandle
+
+bool PagedFileManager::hasOtherHandles(const FileHandle &fileHandle) {
+    unsigned handles = 1;
+    if (BufferPoolManager::instance()->hasHandle(fileHandle.fileName))
+        handles++;
+    if (fileHandle.isSegment()) {
+        lock_guard<mutex> lock(fileHandle._tablespace->latch);
+        return fileHandle._segment->handleCount > handles;
+    }
+
+    FileShard &shard = shardOf(fileHandle.fileName);
+    lock_guard<mutex> lock(shard.latch);
+    auto it = shard.files.find(fileHandle.fileName);
+    return it != shard.files.end() and it->second.handleCount > handles;
+}
+
+// Forgets fileName, closing its cached descriptor, unless handles still
+// use it. Handles opened from then on get a FileInfo of their own either
+// way.
+
+void PagedFileManager::dropFile(const string &fileName) {
+    FileShard &shard = shardOf(fileName);
+    lock_guard<mutex> lock(shard.latch);
+    auto it = shard.files.find(fileName);
+    if (it == shard.files.end())
+        return;
+    if (it->second.handleCount > 0) {
+        it->second.info = make_shared<FileInfo>();
+        return;
+    }
+
+    if (it->second.fd >= 0) {
+        close(it->second.fd);
+        _numOpenFiles--;
+    }
+    shard.files.erase(it);
+}
+
+PagedFileManager::FileShard &PagedFileManager::shardOf(const string &fileName) {
+    return _fileShards[hash<string>()(fileName) % FILE_TABLE_SHARDS];
+}
+
+// Closes idle descriptors, least recently used first, until at most
+// _maxOpenFiles of them remain. Must be called without the latch of any
+// shard held.
+
+void PagedFileManager::closeIdleFiles() {
+    // There cannot be more idle descriptors than open ones, so this only
+    // has to look at every shard once the bound is in reach
+    if (_numOpenFiles <= _maxOpenFiles)
+        return;
+
+    unique_lock<mutex> locks[FILE_TABLE_SHARDS];
+    for (unsigned i = 0; i < FILE_TABLE_SHARDS; i++)
+        locks[i] = unique_lock<mutex>(_fileShards[i].latch);
+
+    while (true) {
+        unsigned numIdle = 0;
+        FileShard *victimShard = NULL;
+        map<string, FileEntry>::iterator victim;
+        for (unsigned i = 0; i < FILE_TABLE_SHARDS; i++) {
+            map<string, FileEntry> &files = _fileShards[i].files;
+            for (auto it = files.begin(); it != files.end(); ++it) {
+                if (it->second.fd < 0 or it->second.handleCount > 0)
+                    continue;
+                numIdle++;
+                if (not victimShard or it->second.lastUsed < victim->second.lastUsed) {
+                    victimShard = &_fileShards[i];
+                    victim = it;
+                }
+            }
+        }
+        if (numIdle <= _maxOpenFiles)
+            return;
+
+        close(victim->second.fd);
+        _numOpenFiles--;
+        victimShard->files.erase(victim);
+    }
+}
+
+RC PagedFileManager::getIOStats(const string &fileName, IOOp op, IOCounters &counters) {
+    lock_guard<mutex> lock(_ioStatsMutex);
+    auto it = _ioStats.find(fileName);
+    if (it == _ioStats.end())
+        return err::FILE_NOT_FOUND;
+    it->second->get(op, counters);
+    return 0;
+}
+
+void PagedFileManager::getTotalIOStats(IOOp op, IOCounters &counters) {
+    memset(&counters, 0, sizeof(counters));
+    lock_guard<mutex> lock(_ioStatsMutex);
+    for (auto it = _ioStats.begin(); it != _ioStats.end(); ++it) {
+        IOCounters file;
+        it->second->get(op, file);
+        counters.ops += file.ops;
+        counters.pages += file.pages;
+        counters.bytes += file.bytes;
+        counters.totalNs += file.totalNs;
+        for (unsigned i = 0; i < IO_LATENCY_BUCKETS; i++)
+            counters.latency[i] += file.latency[i];
+    }
+}
+
+void PagedFileManager::resetIOStats() {
+    lock_guard<mutex> lock(_ioStatsMutex);
+    for (auto it = _ioStats.begin(); it != _ioStats.end(); ++it)
+        it->second->reset();
+}
+
+//  {"files": {"<name>": {"read": {...}, "write": {...}, ...}, ...},
+//   "total": {"read": {...}, ...}}
+//
+// where each operation is
+//
+//  {"ops": 12, "pages": 40, "bytes": 163840, "total_us": 310,
+//   "latency_us": {"16": 9, "32": 3}}
+//
+// latency_us only lists the buckets that are not empty.
+
+void PagedFileManager::dumpIOStats(ostream &out) {
+    map<string, shared_ptr<IOStats> > files;
+    {
+        lock_guard<mutex> lock(_ioStatsMutex);
+        files = _ioStats;
+    }
+
+    out << "{\"files\": {";
+    for (auto it = files.begin(); it != files.end(); ++it) {
+        out << (it == files.begin() ? "" : ", ");
+        writeString(out, it->first);
+        out << ": {";
+        for (unsigned op = 0; op < IO_NUM_OPS; op++) {
+            IOCounters counters;
+            it->second->get((IOOp) op, counters);
+            out << (op ? ", " : "") << '"' << ioOpNames[op] << "\": ";
+            writeCounters(out, counters);
+        }
+        out << "}";
+    }
+    out << "}, \"total\": {";
+    for (unsigned op = 0; op < IO_NUM_OPS; op++) {
+        IOCounters counters;
+        getTotalIOStats((IOOp) op, counters);
+        out << (op ? ", " : "") << '"' << ioOpNames[op] << "\": ";
+        writeCounters(out, counters);
+    }
+    out << "}}" << endl;
+}
+
+void PagedFileManager::recordIO(const string &fileName, IOOp op, unsigned pages,
+                                size_t bytes, unsigned long long ns) {
+    getFileStats(fileName)->record(op, pages, bytes, ns);
+}
+
+// Returns the statistics of fileName, starting them if there are none
+shared_ptr<IOStats> PagedFileManager::getFileStats(const string &fileName) {
+    lock_guard<mutex> lock(_ioStatsMutex);
+    shared_ptr<IOStats> &stats = _ioStats[fileName];
+    if (not stats)
+        stats = make_shared<IOStats>();
+    return stats;
+}
+
+// Handles still open on the file keep recording into the dropped
+// statistics, which then go away with the last of them
+void PagedFileManager::dropFileStats(const string &fileName) {
+    lock_guard<mutex> lock(_ioStatsMutex);
+    _ioStats.erase(fileName);
+}
+
+// Gives fileHandle the page map of its file. The first handle to open the
+// file reads it in; the others share it.
+
+RC PagedFileManager::loadPageMap(FileHandle &fileHandle) {
+    lock_guard<mutex> lock(_pageMapsMutex);
+    shared_ptr<PageMap> pageMap = _pageMaps[fileHandle.fileName].lock();
+    if (not pageMap) {
+        pageMap = make_shared<PageMap>();
+        RC ret = fileHandle.readPageMap(*pageMap);
+        if (ret != err::OK) {
+            _pageMaps.erase(fileHandle.fileName);
+            return ret;
+        }
+        _pageMaps[fileHandle.fileName] = pageMap;
+
+        // Pages appended since the map was last written are lost
+        if (fileHandle._pageCounter > pageMap->slots.size()) {
+            fileHandle._pageCounter = pageMap->slots.size();
+            lock_guard<mutex> infoLock(fileHandle._info->latch);
+            fileHandle._info->pageCount = fileHandle._pageCounter;
+        }
+    }
+    fileHandle._pageMap = pageMap;
+    return 0;
+}
+
+// Handles still open on the file keep the map they have
+void PagedFileManager::dropPageMap(const string &fileName) {
+    lock_guard<mutex> lock(_pageMapsMutex);
+    _pageMaps.erase(fileName);
+}
+
+// Syncs the file or segment fileName, along with the page map or segment
+// directory that says where its pages are. Files that are gone are taken
+// to have been removed since they were written.
+
+RC PagedFileManager::syncFile(const string &fileName) {
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    int fd = -1;
+    if (space) {
+        lock_guard<mutex> lock(space->latch);
+        if (space->segments.count(fileName) == 0)
+            return 0;
+        RC ret = writeDirectory(*space);
+        if (ret != err::OK)
+            return ret;
+    } else {
+        fd = open(fileName.c_str(), O_RDWR);
+        if (fd < 0)
+            return 0;
+        shared_ptr<PageMap> pageMap;
+        {
+            lock_guard<mutex> lock(_pageMapsMutex);
+            auto it = _pageMaps.find(fileName);
+            if (it != _pageMaps.end())
+                pageMap = it->second.lock();
+        }
+        if (pageMap and writePageMap(fd, *pageMap) != err::OK) {
+            close(fd);
+            return err::FILE_CORRUPT;
+        }
+    }
+
+    unsigned long long start = nowNs();
+    bool synced = fdatasync(space ? space->fd : fd) == 0;
+    if (fd >= 0)
+        close(fd);
+    if (not synced)
+        return err::FILE_CORRUPT;
+    recordIO(fileName, IO_SYNC, 0, 0, nowNs() - start);
+    return 0;
+}
+
+void PagedFileManager::setSyncPolicy(const string &fileName, SyncPolicy policy) {
+    lock_guard<mutex> lock(_syncMutex);
+    _filePolicies[fileName] = policy;
+}
+
+SyncPolicy PagedFileManager::getSyncPolicy(const string &fileName) {
+    lock_guard<mutex> lock(_syncMutex);
+    auto it = _filePolicies.find(fileName);
+    return it != _filePolicies.end() ? it->second : _syncPolicy.load();
+}
+
+// Stops the syncer when ms is 0; otherwise it is started again the next
+// time a SYNC_GROUP handle has changes.
+
+void PagedFileManager::setSyncInterval(unsigned ms) {
+    {
+        lock_guard<mutex> lock(_syncMutex);
+        _syncInterval = ms;
+        if (ms > 0 and not _unsynced.empty() and not _syncer.joinable())
+            _syncer = thread(&PagedFileManager::syncLoop, this);
+    }
+    _syncDue.notify_all();
+    if (ms == 0 and _syncer.joinable())
+        _syncer.join();
+}
+
+// Called by a SYNC_GROUP handle on its first change since it was last
+// synced
+
+void PagedFileManager::scheduleSync(FileHandle &fileHandle) {
+    lock_guard<mutex> lock(_syncMutex);
+    _unsynced.insert(&fileHandle);
+    if (_syncInterval > 0 and not _stopping and not _syncer.joinable())
+        _syncer = thread(&PagedFileManager::syncLoop, this);
+}
+
+// Called by a closing handle, which then syncs itself if need be. A sync
+// the syncer is doing on it is waited for.
+
+void PagedFileManager::cancelSync(FileHandle &fileHandle) {
+    unique_lock<mutex> lock(_syncMutex);
+    _unsynced.erase(&fileHandle);
+    _syncDone.wait(lock, [this, &fileHandle] { return _syncing.count(&fileHandle) == 0; });
+}
+
+// Every interval, the syncer takes the handles with changes and syncs each
+// once, without holding the mutex, so that handles can keep changing and
+// scheduling meanwhile. Handles that fail to sync are tried again next
+// time.
+
+void PagedFileManager::syncLoop() {
+    unique_lock<mutex> lock(_syncMutex);
+    while (true) {
+        _syncDue.wait_for(lock, chrono::milliseconds(_syncInterval), [this] {
+            return _stopping or _syncInterval == 0; });
+        if (_stopping or _syncInterval == 0)
+            return;
+
+        _syncing.swap(_unsynced);
+        lock.unlock();
+        vector<FileHandle*> failed;
+        for (auto it = _syncing.begin(); it != _syncing.end(); ++it) {
+            if ((*it)->sync() != err::OK)
+                failed.push_back(*it);
+        }
+        lock.lock();
+        _unsynced.insert(failed.begin(), failed.end());
+        _syncing.clear();
+        _syncDone.notify_all();
+    }
+}
+
+// Creates an empty tablespace called fileName, without using it
+RC PagedFileManager::createTablespace(const string &fileName, unsigned pageSize) {
+    if (not isValidPageSize(pageSize))
+        return err::FILE_INVALID_PAGE_SIZE;
+    struct stat st;
+    if (stat(fileName.c_str(), &st) == 0)
+        return err::FILE_ALREADY_EXISTS;
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return err::FILE_COULD_NOT_OPEN;
+
+    // No pages and no directory yet
+    char header[FILE_HEADER_SIZE] = TABLESPACE_SIGNATURE;
+    memcpy(header + PAGE_SIZE_OFFSET, &pageSize, sizeof(unsigned));
+    bool written = pwriteFull(fd, header, FILE_HEADER_SIZE, 0);
+    close(fd);
+    return written ? err::OK : err::FILE_CORRUPT;
+}
+
+// Files are created, opened and destroyed in fileName from now on. Files
+// already open are not affected, but should be closed first: the buffer
+// pool opens files of its own by name.
+
+RC PagedFileManager::useTablespace(const string &fileName) {
+    RC ret = closeTablespace();
+    if (ret != err::OK)
+        return ret;
+
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0)
+        return err::FILE_NOT_FOUND;
+    shared_ptr<Tablespace> space = make_shared<Tablespace>();
+    space->fileName = fileName;
+    space->fd = open(fileName.c_str(), O_RDWR);
+    if (space->fd < 0)
+        return err::FILE_COULD_NOT_OPEN;
+    if (not hasSignature(space->fd, TABLESPACE_SIGNATURE))
+        return err::FILE_CORRUPT;
+    ret = readDirectory(*space);
+    if (ret != err::OK)
+        return ret;
 
-    fileHandle.unloadFile();
+    atomic_store(&_tablespace, space);
+    return 0;
+}
+
+RC PagedFileManager::closeTablespace() {
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    if (not space)
+        return 0;
+
+    // The pool writes back everything and lets go of its own handles. It
+    // opens segments while holding its latch, so it is not called while
+    // the tablespace's latch is held.
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    RC ret = bpm->flushAll();
+    if (ret != err::OK)
+        return ret;
+    vector<pair<string, unsigned> > segments;
+    {
+        lock_guard<mutex> lock(space->latch);
+        for (auto it = space->segments.begin(); it != space->segments.end(); ++it)
+            segments.push_back(make_pair(it->first, it->second.handleCount));
+    }
+    for (auto it = segments.begin(); it != segments.end(); ++it) {
+        if (it->second > (bpm->hasHandle(it->first) ? 1u : 0u))
+            return err::FILE_IN_USE;
+    }
+    for (auto it = segments.begin(); it != segments.end(); ++it)
+        bpm->discardFile(it->first);
+
+    atomic_store(&_tablespace, shared_ptr<Tablespace>());
+    lock_guard<mutex> lock(space->latch);
+    return writeDirectory(*space);
+}
 
+// The segment versions of createFile, destroyFile and openFile
+
+RC PagedFileManager::createSegment(Tablespace &space, const string &fileName,
+                                   unsigned pageSize, unsigned flags) {
+    if (pageSize != space.pageSize)
+        return err::FILE_INVALID_PAGE_SIZE;
+    if (flags & CREATE_COMPRESSED)
+        return err::FEATURE_NOT_YET_IMPLEMENTED;
+    {
+        lock_guard<mutex> lock(space.latch);
+        if (space.segments.count(fileName) > 0)
+            return err::FILE_ALREADY_EXISTS;
+        space.segments[fileName] = Segment();
+        space.dirty = true;
+        RC ret = writeDirectory(space);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    BufferPoolManager::instance()->discardFile(fileName);
+    dropFileStats(fileName);
+    LogManager *log = LogManager::instance();
+    if (log->isOpen())
+        return log->logFile(LOG_CREATE, fileName);
     return 0;
 }
 
-// Checks if a file already exists.
+RC PagedFileManager::destroySegment(Tablespace &space, const string &fileName) {
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    unsigned poolHandles = bpm->hasHandle(fileName) ? 1 : 0;
+    {
+        lock_guard<mutex> lock(space.latch);
+        auto it = space.segments.find(fileName);
+        if (it == space.segments.end() or it->second.handleCount > poolHandles)
+            return err::FILE_COULD_NOT_DELETE;
+    }
+
+    bpm->discardFile(fileName);
+    {
+        lock_guard<mutex> lock(space.latch);
+        auto it = space.segments.find(fileName);
+        if (it == space.segments.end())
+            return err::FILE_COULD_NOT_DELETE;
+        // The extents are reused by segments created or grown later
+        vector<Extent> &extents = it->second.extents;
+        space.freeExtents.insert(space.freeExtents.end(), extents.begin(), extents.end());
+        space.segments.erase(it);
+        space.dirty = true;
+        RC ret = writeDirectory(space);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    dropFileStats(fileName);
+    LogManager *log = LogManager::instance();
+    if (log->isOpen())
+        return log->logFile(LOG_DESTROY, fileName);
+    return 0;
+}
+
+RC PagedFileManager::openSegment(const shared_ptr<Tablespace> &space, const string &fileName,
+                                 FileHandle &fileHandle, unsigned flags) {
+    Segment *segment;
+    {
+        lock_guard<mutex> lock(space->latch);
+        auto it = space->segments.find(fileName);
+        if (it == space->segments.end())
+            return err::FILE_NOT_FOUND;
+        segment = &it->second;
+        segment->handleCount++;
+    }
+
+    fileHandle.fileName = fileName;
+    fileHandle._tablespace = space;
+    fileHandle._segment = segment;
+    fileHandle._ioStats = getFileStats(fileName);
+    fileHandle._syncPolicy = getSyncPolicy(fileName);
+    fileHandle._info = segment->info;
+    RC ret = fileHandle.loadFile(space->fd);
+    if (ret == err::OK and (flags & OPEN_LOGGED))
+        fileHandle._logged = LogManager::instance()->isOpen();
+    if (ret != err::OK)
+        closeFile(fileHandle);
+    return ret;
+}
+
+// Checks if a file, or a segment of the tablespace in use, already exists.
 bool PagedFileManager::fileExists(const string &fileName) {
+    shared_ptr<Tablespace> space = atomic_load(&_tablespace);
+    if (space) {
+        lock_guard<mutex> lock(space->latch);
+        return space->segments.count(fileName) > 0;
+    }
+
     struct stat buffer;
 
     if(stat(fileName.c_str(), &buffer) == 0) 
@@ -151,6 +1169,7 @@ FileHandle::FileHandle()
 	writePageCounter = 0;
 	appendPageCounter = 0;
     _pageCounter = 0;
+    _unsynced = false;
 }
 
 
@@ -163,32 +1182,73 @@ FileHandle::~FileHandle() {
 // exist. 
 
 RC FileHandle::readPage(PageNum pageNum, void *data) {
-    if (pageNum >= _pageCounter) // note: pages are zero-indexed
-        return err::FILE_PAGE_NOT_FOUND;
+    RC ret = checkPages(pageNum, 1);
+    if (ret != err::OK)
+        return ret;
 
-    if (fseek(_file, SIGNATURE_SIZE + PAGE_SIZE * pageNum, SEEK_SET) != 0)
-        return err::FILE_SEEK_FAILED;
+    if (isMapped()) {
+        memcpy(data, mappedPage(pageNum), _pageSize);
+        readPageCounter++;
+        return 0;
+    }
 
-    if (fread(data, PAGE_SIZE, 1, _file) != 1)
-        return err::FILE_CORRUPT;
+    ret = BufferPoolManager::instance()->readPage(*this, pageNum, data);
+    if (ret != err::OK)
+        return ret;
 
     readPageCounter++;
     return 0;
 }
 
 // Writes the given data into the page specified by pageNum. The page must
-// exist.
+// exist. The write lands in the buffer pool and reaches the disk when the
+// page is replaced or the file is closed, or when the sync policy says.
 
 RC FileHandle::writePage(PageNum pageNum, const void *data)
 {
-    if (pageNum >= _pageCounter) // note: pages are zero-indexed
-        return err::FILE_PAGE_NOT_FOUND;
-
-    if (fseek(_file, SIGNATURE_SIZE + PAGE_SIZE * pageNum, SEEK_SET) != 0)
-        return err::FILE_SEEK_FAILED;
+    RC ret = writeOnePage(pageNum, data);
+    if (ret != err::OK)
+        return ret;
+    return applySyncPolicy();
+}
 
-    if (fwrite(data, PAGE_SIZE, 1, _file) != 1)
-        return err::FILE_CORRUPT;
+RC FileHandle::writeOnePage(PageNum pageNum, const void *data)
+{
+    RC ret = checkPages(pageNum, 1);
+    if (ret != err::OK)
+        return ret;
+
+    // A logged page is written as a stamped copy, after its log record. The
+    // copy is aligned, in case the file uses direct I/O.
+    PageBuffer stamped(_logged ? 1 : 0, _pageSize);
+    LSN lsn = 0;
+    if (_logged) {
+        if (stamped == NULL)
+            return err::OUT_OF_MEMORY;
+        memcpy(stamped, data, _pageSize);
+        ret = logPage(pageNum, stamped, lsn);
+        if (ret != err::OK)
+            return ret;
+        data = stamped;
+    }
+
+    if (isMapped()) {
+        // The kernel may write a mapped page back at any time
+        if (_logged) {
+            ret = LogManager::instance()->flush(lsn);
+            if (ret != err::OK)
+                return ret;
+        }
+        memcpy(mappedPage(pageNum), data, _pageSize);
+        writePageCounter++;
+        // Keep any copy cached for other handles of the file up to date
+        BufferPoolManager::instance()->refreshPage(*this, pageNum, data);
+        return 0;
+    }
+
+    ret = BufferPoolManager::instance()->writePage(*this, pageNum, data, true, lsn);
+    if (ret != err::OK)
+        return ret;
 
     writePageCounter++;
     return 0;
@@ -199,25 +1259,352 @@ RC FileHandle::writePage(PageNum pageNum, const void *data)
 
 RC FileHandle::appendPage(const void *data)
 {
-    if (fseek(_file, SIGNATURE_SIZE + _pageCounter * PAGE_SIZE, SEEK_SET) != 0)
-        return err::FILE_SEEK_FAILED;
+    PageNum pageNum;
+    return appendPage(data, pageNum);
+}
 
-    if (fwrite(data, PAGE_SIZE, 1, _file) != 1)
-        return err::FILE_CORRUPT;
+// Other handles on the file may append at the same time, so the page goes
+// wherever the file ends when it is claimed; pageNum says where.
+
+RC FileHandle::appendPage(const void *data, PageNum &pageNum)
+{
+    pageNum = claimPages(1);
+    RC ret = reserveExtent(pageNum + 1);
+    if (ret == err::OK)
+        ret = appendOnePage(pageNum, data);
+    if (ret != err::OK) {
+        releasePages(pageNum, 1);
+        return ret;
+    }
+    return applySyncPolicy();
+}
+
+// Appends a page at pageNum, which this handle claimed and made room for
+
+RC FileHandle::appendOnePage(PageNum pageNum, const void *data)
+{
+    PageBuffer stamped(_logged ? 1 : 0, _pageSize);
+    LSN lsn = 0;
+    RC ret;
+    if (_logged) {
+        if (stamped == NULL)
+            return err::OUT_OF_MEMORY;
+        memcpy(stamped, data, _pageSize);
+        ret = logPage(pageNum, stamped, lsn);
+        if (ret != err::OK)
+            return ret;
+        data = stamped;
+
+        // The page waits in the pool for its log record to be durable
+        if (not isMapped()) {
+            appendPageCounter++;
+            ret = writePageCount();
+            if (ret != err::OK)
+                return ret;
+            return BufferPoolManager::instance()->writePage(*this, pageNum, data, true, lsn);
+        }
+        ret = LogManager::instance()->flush(lsn);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    ret = writePageToDisk(pageNum, data, IO_APPEND);
+    if (ret != err::OK)
+        return ret;
 
-    _pageCounter++;
     appendPageCounter++;
+    ret = writePageCount();
+    if (ret != err::OK)
+        return ret;
+
+    // Grow the mapping once the file outgrows the reserved address space
+    if (isMapped() and FILE_HEADER_SIZE + (size_t) _pageSize * _pageCounter > _mapSize)
+        return mapFile();
+    if (isMapped())
+        return 0;
+
+    // The new page is likely to be used right away, so keep a clean copy
+    return BufferPoolManager::instance()->writePage(*this, pageNum, data, false);
+}
+
+
+RC FileHandle::readPages(PageNum first, unsigned count, void *data)
+{
+    vector<void*> buffers(count);
+    for (unsigned i = 0; i < count; i++)
+        buffers[i] = (char*) data + (size_t) _pageSize * i;
+    return readPages(first, buffers);
+}
+
+RC FileHandle::writePages(PageNum first, unsigned count, const void *data)
+{
+    vector<const void*> buffers(count);
+    for (unsigned i = 0; i < count; i++)
+        buffers[i] = (const char*) data + (size_t) _pageSize * i;
+    return writePages(first, buffers);
+}
+
+RC FileHandle::readPages(PageNum first, const vector<void*> &buffers)
+{
+    unsigned count = buffers.size();
+    RC ret = checkPages(first, count);
+    if (ret != err::OK)
+        return ret;
+
+    if (isMapped()) {
+        for (unsigned i = 0; i < count; i++)
+            memcpy(buffers[i], mappedPage(first + i), _pageSize);
+        readPageCounter += count;
+        return 0;
+    }
+
+    ret = BufferPoolManager::instance()->readPages(*this, first, buffers.data(), count);
+    if (ret != err::OK)
+        return ret;
+
+    readPageCounter += count;
     return 0;
 }
 
+RC FileHandle::writePages(PageNum first, const vector<const void*> &buffers)
+{
+    unsigned count = buffers.size();
+    RC ret = checkPages(first, count);
+    if (ret != err::OK)
+        return ret;
+
+    // Logged pages go through the pool one at a time, each after its log
+    // record
+    if (_logged) {
+        for (unsigned i = 0; i < count; i++) {
+            ret = writeOnePage(first + i, buffers[i]);
+            if (ret != err::OK)
+                return ret;
+        }
+        return applySyncPolicy();
+    }
+
+    if (isMapped()) {
+        BufferPoolManager *bpm = BufferPoolManager::instance();
+        for (unsigned i = 0; i < count; i++) {
+            memcpy(mappedPage(first + i), buffers[i], _pageSize);
+            bpm->refreshPage(*this, first + i, buffers[i]);
+        }
+        writePageCounter += count;
+        return applySyncPolicy();
+    }
+
+    ret = BufferPoolManager::instance()->writePages(*this, first, buffers.data(), count);
+    if (ret != err::OK)
+        return ret;
+
+    writePageCounter += count;
+    return applySyncPolicy();
+}
+
+// Appended pages are not cached: bulk appends would only push more useful
+// pages out of the pool.
+
+RC FileHandle::appendPages(unsigned count, const void *data)
+{
+    PageNum first;
+    return appendPages(count, data, first);
+}
+
+RC FileHandle::appendPages(unsigned count, const void *data, PageNum &first)
+{
+    first = claimPages(count);
+    RC ret = reserveExtent(first + count);
+    if (ret != err::OK) {
+        releasePages(first, count);
+        return ret;
+    }
+
+    if (_logged) {
+        for (unsigned i = 0; i < count; i++) {
+            ret = appendOnePage(first + i, (const char*) data + (size_t) _pageSize * i);
+            if (ret != err::OK) {
+                releasePages(first + i, count - i);
+                return ret;
+            }
+        }
+        return applySyncPolicy();
+    }
+
+    vector<const void*> buffers(count);
+    for (unsigned i = 0; i < count; i++)
+        buffers[i] = (const char*) data + (size_t) _pageSize * i;
+
+    ret = writePagesToDisk(first, buffers.data(), count, IO_APPEND);
+    if (ret != err::OK) {
+        releasePages(first, count);
+        return ret;
+    }
+
+    appendPageCounter += count;
+    ret = writePageCount();
+    if (ret != err::OK)
+        return ret;
+
+    if (isMapped() and FILE_HEADER_SIZE + (size_t) _pageSize * _pageCounter > _mapSize) {
+        ret = mapFile();
+        if (ret != err::OK)
+            return ret;
+    }
+    return applySyncPolicy();
+}
+
+// The pool lets go of the pages first, so that a pinned page stops the
+// truncation before anything is lost. A logged file then logs it, so
+// that recovery does not bring the pages back. The page count goes down
+// before the file does: a header counting pages the file no longer has
+// would not open.
+
+RC FileHandle::truncate(unsigned numPages)
+{
+    if (not hasFile())
+        return err::FILE_HANDLE_NOT_INITIALIZED;
+    if (numPages > getNumberOfPages())
+        return err::FILE_PAGE_NOT_FOUND;
+    if (PagedFileManager::instance()->hasOtherHandles(*this))
+        return err::FILE_IN_USE;
+
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    bpm->cancelPrefetch(*this);
+    RC ret = bpm->discardPages(*this, numPages);
+    if (ret != err::OK)
+        return ret;
+    if (_logged) {
+        ret = LogManager::instance()->logTruncate(fileName, numPages);
+        if (ret != err::OK)
+            return ret;
+    }
+
+    setPageCount(numPages);
+    ret = writePageCount();
+    if (ret != err::OK)
+        return ret;
+    if (isSegment()) {
+        ret = truncateSegment(numPages);
+    } else if (isCompressed()) {
+        ret = truncateCompressed(numPages);
+    } else {
+        // A mapping may reach past the new end, but no page there is used
+        // until the file has grown back over it
+        if (ftruncate(_fd, FILE_HEADER_SIZE + (off_t) _pageSize * numPages) != 0)
+            return err::FILE_COULD_NOT_TRUNCATE;
+        _allocatedPages = numPages;
+        lock_guard<mutex> lock(_info->latch);
+        _info->allocatedPages = numPages;
+    }
+    if (ret != err::OK)
+        return ret;
+    return applySyncPolicy();
+}
+
+// Counts the pages appended through every handle on the file, not just
+// this one
 
 unsigned FileHandle::getNumberOfPages()
 {
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        return _segment->pageCount;
+    }
+    if (_info) {
+        lock_guard<mutex> lock(_info->latch);
+        return _info->pageCount;
+    }
     return _pageCounter;
 }
 
+// Checks that the count pages from first exist. A mapping that does not
+// reach pages other handles appended is grown to take them in.
+
+RC FileHandle::checkPages(PageNum first, unsigned count)
+{
+    unsigned numPages = getNumberOfPages();
+    if (first >= numPages or count > numPages - first) // note: pages are zero-indexed
+        return err::FILE_PAGE_NOT_FOUND;
+    if (not isMapped() or numPages <= _pageCounter)
+        return 0;
+
+    _pageCounter = numPages;
+    if (FILE_HEADER_SIZE + (size_t) _pageSize * _pageCounter > _mapSize)
+        return mapFile();
+    return 0;
+}
+
+RC FileHandle::advise(AccessPattern pattern)
+{
+    if (not hasFile())
+        return err::FILE_HANDLE_NOT_INITIALIZED;
+
+    if (isMapped()) {
+        int advice = MADV_NORMAL;
+        if (pattern == ACCESS_SEQUENTIAL)
+            advice = MADV_SEQUENTIAL;
+        else if (pattern == ACCESS_RANDOM)
+            advice = MADV_RANDOM;
+        madvise(_map, _mapSize, advice);
+    } else {
+        int advice = POSIX_FADV_NORMAL;
+        if (pattern == ACCESS_SEQUENTIAL)
+            advice = POSIX_FADV_SEQUENTIAL;
+        else if (pattern == ACCESS_RANDOM)
+            advice = POSIX_FADV_RANDOM;
+        posix_fadvise(_fd, 0, 0, advice);
+    }
+    return 0;
+}
+
+RC FileHandle::sync()
+{
+    if (not hasFile())
+        return err::FILE_HANDLE_NOT_INITIALIZED;
+
+    // Cleared first, so that changes made meanwhile are synced next time
+    _unsynced = false;
+    RC ret = BufferPoolManager::instance()->flushFile(*this);
+    if (ret != err::OK)
+        return ret;
+    if (isCompressed()) {
+        ret = writePageMap(_fd, *_pageMap);
+        if (ret != err::OK)
+            return ret;
+    }
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        ret = writeDirectory(*_tablespace);
+        if (ret != err::OK)
+            return ret;
+    }
+    unsigned long long start = nowNs();
+    if (isMapped() and msync(_map, FILE_HEADER_SIZE + (size_t) _pageSize * _pageCounter, MS_SYNC) != 0)
+        return err::FILE_CORRUPT;
+    if (fdatasync(_fd) != 0)
+        return err::FILE_CORRUPT;
+    recordIO(IO_SYNC, 0, 0, start);
+    return 0;
+}
+
 // Loads the current counter variables into the three given parameters.
 
+RC FileHandle::applySyncPolicy() {
+    switch (_syncPolicy) {
+        case SYNC_PER_OPERATION:
+            return sync();
+        case SYNC_GROUP:
+            // Only the first change since the last sync schedules one
+            if (not _unsynced.exchange(true))
+                PagedFileManager::instance()->scheduleSync(*this);
+            return 0;
+        default:
+            _unsynced = true;
+            return 0;
+    }
+}
+
 RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount) {
     readPageCount = readPageCounter;
     writePageCount = writePageCounter;
@@ -225,27 +1612,646 @@ RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePage
     return 0;
 }
 
-RC FileHandle::loadFile(FILE *file) {
-    _file = file;
-    updatePageCounter();
-    return 0;
+RC FileHandle::loadFile(int fd) {
+    _fd = fd;
+    return updatePageCounter();
 }
 
-RC FileHandle::unloadFile() {
-    if (_file)
-        fclose(_file);
+// Lets go of the file, writing back what is left of it. The handle is
+// reset even when a write fails; the first failure is returned.
 
-    _file = NULL;
-    return 0;
+RC FileHandle::unloadFile() {
+    RC ret = err::OK;
+    if (_fd >= 0) {
+        // Changes the policy wants durable by now are synced first
+        PagedFileManager::instance()->cancelSync(*this);
+        if (_syncPolicy != SYNC_NONE and _unsynced)
+            ret = sync();
+
+        // The log protects the dirty pages of a logged file, so they can be
+        // written back later
+        BufferPoolManager *bpm = BufferPoolManager::instance();
+        bpm->cancelPrefetch(*this);
+        RC written;
+        if (_logged and not isMapped() and not _direct)
+            written = bpm->handOver(*this);
+        else
+            written = bpm->flushFile(*this);
+        if (ret == err::OK)
+            ret = written;
+        if (isCompressed()) {
+            written = writePageMap(_fd, *_pageMap);
+            if (ret == err::OK)
+                ret = written;
+        }
+        if (isSegment()) {
+            lock_guard<mutex> lock(_tablespace->latch);
+            written = writeDirectory(*_tablespace);
+            if (ret == err::OK)
+                ret = written;
+        }
+        unmapFile();
+        PagedFileManager::instance()->releaseFile(*this);
+    }
+
+    _fd = -1;
+    _direct = false;
+    _logged = false;
+    _allocatedPages = 0;
+    _pageSize = PAGE_SIZE;
+    _fileFlags = CREATE_DEFAULT;
+    _syncPolicy = SYNC_NONE;
+    _unsynced = false;
+    _ioStats.reset();
+    _info.reset();
+    _pageMap.reset();
+    _tablespace.reset();
+    _segment = NULL;
+    return ret;
 }
 
 RC FileHandle::updatePageCounter() {
     if (not hasFile())
         return err::FILE_HANDLE_NOT_INITIALIZED;
 
-    if (fseek(_file, 0, SEEK_END) != 0)
+    // Segments keep theirs in the directory
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        _pageSize = _tablespace->pageSize;
+        _pageCounter = _segment->pageCount;
+        return 0;
+    }
+
+    // The header is only read by the first handle since the PFM took up
+    // the file
+    lock_guard<mutex> lock(_info->latch);
+    FileInfo &info = *_info;
+    if (not info.loaded) {
+        struct stat st;
+        if (fstat(_fd, &st) != 0)
+            return err::FILE_SEEK_FAILED;
+
+        // Read the header through an aligned buffer, in case the descriptor
+        // is used for direct I/O
+        PageBuffer header;
+        if (not preadFull(_fd, header, FILE_HEADER_SIZE, 0))
+            return err::FILE_CORRUPT;
+        memcpy(&info.pageCount, header + PAGE_COUNT_OFFSET, sizeof(unsigned));
+        memcpy(&info.pageSize, header + PAGE_SIZE_OFFSET, sizeof(unsigned));
+        memcpy(&info.flags, header + FILE_FLAGS_OFFSET, sizeof(unsigned));
+        if (info.pageSize == 0)
+            info.pageSize = PAGE_SIZE;
+        if (not PagedFileManager::isValidPageSize(info.pageSize))
+            return err::FILE_CORRUPT;
+
+        // Don't count the header page. Compressed pages take whatever room
+        // they need; see readPageMap.
+        info.allocatedPages = 0;
+        if (st.st_size > FILE_HEADER_SIZE)
+            info.allocatedPages = (st.st_size - FILE_HEADER_SIZE) / info.pageSize;
+        if (not (info.flags & CREATE_COMPRESSED) and info.pageCount > info.allocatedPages)
+            return err::FILE_CORRUPT;
+        info.loaded = true;
+    }
+
+    _pageCounter = info.pageCount;
+    _pageSize = info.pageSize;
+    _fileFlags = info.flags;
+    _allocatedPages = info.flags & CREATE_COMPRESSED ? 0 : info.allocatedPages;
+    return 0;
+}
+
+// Makes sure the file has room for its first numPages pages, preallocating
+// whole extents. File systems that cannot preallocate get the file made
+// longer without blocks.
+
+RC FileHandle::reserveExtent(unsigned numPages) {
+    if (isSegment())
+        return reserveSegmentExtent(numPages);
+    if (isCompressed() or numPages <= _allocatedPages)
+        return 0;
+
+    unsigned extent = PagedFileManager::instance()->getExtentSize();
+    unsigned target = (numPages + extent - 1) / extent * extent;
+    off_t offset = FILE_HEADER_SIZE + (off_t) _pageSize * _allocatedPages;
+    off_t length = (off_t) _pageSize * (target - _allocatedPages);
+    if (fallocate(_fd, 0, offset, length) != 0) {
+        if (errno != EOPNOTSUPP)
+            return err::FILE_COULD_NOT_EXTEND;
+
+        // The file is still made long enough, without blocks, so that a
+        // page count written before the pages stays within it
+        struct stat st;
+        if (fstat(_fd, &st) != 0)
+            return err::FILE_COULD_NOT_EXTEND;
+        if (st.st_size < offset + length and ftruncate(_fd, offset + length) != 0)
+            return err::FILE_COULD_NOT_EXTEND;
+    }
+
+    _allocatedPages = target;
+    lock_guard<mutex> lock(_info->latch);
+    _info->allocatedPages = target;
+    return 0;
+}
+
+// Segments grow by extents that double the room they have, up to the
+// PFM's extent size. An extent that lands right after the segment's last
+// one extends it.
+
+RC FileHandle::reserveSegmentExtent(unsigned numPages) {
+    lock_guard<mutex> lock(_tablespace->latch);
+    vector<Extent> &extents = _segment->extents;
+    unsigned reserved = 0;
+    for (auto it = extents.begin(); it != extents.end(); ++it)
+        reserved += it->length;
+
+    unsigned maxExtent = PagedFileManager::instance()->getExtentSize();
+    while (reserved < numPages) {
+        unsigned length = reserved > SEGMENT_MIN_EXTENT ? reserved : SEGMENT_MIN_EXTENT;
+        if (length > maxExtent)
+            length = maxExtent;
+        Extent extent = allocateExtent(*_tablespace, length);
+        if (not extents.empty() and extents.back().start + extents.back().length == extent.start)
+            extents.back().length += length;
+        else
+            extents.push_back(extent);
+        reserved += length;
+    }
+    return 0;
+}
+
+// The slots of the pages that go are given up, and the page map moves to
+// the end of what is left, so the file can be cut right after it
+
+RC FileHandle::truncateCompressed(unsigned numPages) {
+    {
+        lock_guard<mutex> lock(_pageMap->latch);
+        PageMap &pageMap = *_pageMap;
+        pageMap.slots.resize(numPages);
+        pageMap.end = FILE_HEADER_SIZE;
+        for (auto it = pageMap.slots.begin(); it != pageMap.slots.end(); ++it) {
+            if ((off_t) (it->offset + it->capacity) > pageMap.end)
+                pageMap.end = it->offset + it->capacity;
+        }
+        pageMap.mapOffset = pageMap.end;
+        pageMap.mapCapacity = 0;
+        pageMap.dirty = true;
+    }
+
+    RC ret = writePageMap(_fd, *_pageMap);
+    if (ret != err::OK)
+        return ret;
+    lock_guard<mutex> lock(_pageMap->latch);
+    if (ftruncate(_fd, _pageMap->end) != 0)
+        return err::FILE_COULD_NOT_TRUNCATE;
+    return 0;
+}
+
+// A segment keeps the extents holding its remaining pages, and at least
+// SEGMENT_MIN_EXTENT pages, splitting the last one if need be. The rest
+// go to the tablespace's free extents; the tablespace itself does not
+// shrink.
+
+RC FileHandle::truncateSegment(unsigned numPages) {
+    lock_guard<mutex> lock(_tablespace->latch);
+    vector<Extent> &extents = _segment->extents;
+    vector<Extent> &freeExtents = _tablespace->freeExtents;
+    unsigned keep = numPages > SEGMENT_MIN_EXTENT ? numPages : SEGMENT_MIN_EXTENT;
+    unsigned kept = 0;
+    size_t i = 0;
+    for (; i < extents.size() and kept < keep; i++) {
+        if (extents[i].length > keep - kept) {
+            Extent tail = { extents[i].start + (keep - kept), extents[i].length - (keep - kept) };
+            freeExtents.push_back(tail);
+            extents[i].length = keep - kept;
+        }
+        kept += extents[i].length;
+    }
+    freeExtents.insert(freeExtents.end(), extents.begin() + i, extents.end());
+    extents.resize(i);
+    _tablespace->dirty = true;
+    return writeDirectory(*_tablespace);
+}
+
+// Finds where page first is stored, and how many of the count pages from
+// there on follow it in the file
+
+unsigned FileHandle::locatePages(PageNum first, unsigned count, off_t &offset) {
+    if (not isSegment()) {
+        offset = FILE_HEADER_SIZE + (off_t) _pageSize * first;
+        return count;
+    }
+
+    lock_guard<mutex> lock(_tablespace->latch);
+    const vector<Extent> &extents = _segment->extents;
+    for (auto it = extents.begin(); it != extents.end(); ++it) {
+        if (first < it->length) {
+            offset = FILE_HEADER_SIZE + (off_t) _pageSize * (it->start + first);
+            return count < it->length - first ? count : it->length - first;
+        }
+        first -= it->length;
+    }
+    return 0;
+}
+
+RC FileHandle::logPage(PageNum pageNum, void *data, LSN &lsn) {
+    return LogManager::instance()->logPage(fileName, pageNum, data, _pageSize, lsn);
+}
+
+// Takes count pages at the end of the file for this handle to append, and
+// returns the first. The count is the one shared by every handle on the
+// file, so that handles appending at once each get pages of their own.
+
+PageNum FileHandle::claimPages(unsigned count) {
+    PageNum first;
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        first = _segment->pageCount;
+        _segment->pageCount += count;
+        _tablespace->dirty = true;
+    } else {
+        lock_guard<mutex> lock(_info->latch);
+        first = _info->pageCount;
+        _info->pageCount += count;
+    }
+    if (_pageCounter < first + count)
+        _pageCounter = first + count;
+    return first;
+}
+
+// Gives back pages claimed for an append that failed, unless other handles
+// have claimed pages after them since
+
+void FileHandle::releasePages(PageNum first, unsigned count) {
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        if (_segment->pageCount == first + count)
+            _segment->pageCount = first;
+    } else {
+        lock_guard<mutex> lock(_info->latch);
+        if (_info->pageCount == first + count)
+            _info->pageCount = first;
+    }
+    if (_pageCounter == first + count)
+        _pageCounter = first;
+}
+
+void FileHandle::setPageCount(unsigned numPages) {
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        _segment->pageCount = numPages;
+        _tablespace->dirty = true;
+    } else {
+        lock_guard<mutex> lock(_info->latch);
+        _info->pageCount = numPages;
+    }
+    _pageCounter = numPages;
+}
+
+// Stores the file's page count in the header, so that it survives the
+// handles and is seen by handles opened later. It is written under the
+// file's latch, so that a count written by one handle never lands after a
+// larger one written by another.
+
+RC FileHandle::writePageCount() {
+    if (isSegment()) {
+        lock_guard<mutex> lock(_tablespace->latch);
+        _tablespace->dirty = true;
+        return 0;
+    }
+
+    lock_guard<mutex> lock(_info->latch);
+    unsigned pageCount = _info->pageCount;
+    if (not _direct) {
+        if (not pwriteFull(_fd, &pageCount, sizeof(unsigned), PAGE_COUNT_OFFSET))
+            return err::FILE_CORRUPT;
+        return 0;
+    }
+
+    // Direct I/O only moves whole aligned pages
+    PageBuffer header;
+    if (not preadFull(_fd, header, FILE_HEADER_SIZE, 0))
+        return err::FILE_CORRUPT;
+    memcpy(header + PAGE_COUNT_OFFSET, &pageCount, sizeof(unsigned));
+    if (not pwriteFull(_fd, header, FILE_HEADER_SIZE, 0))
+        return err::FILE_CORRUPT;
+    return 0;
+}
+
+// With O_DIRECT, buffers must be aligned. Pool frames and PageBuffers
+// always are; anything else goes through an aligned bounce buffer.
+
+RC FileHandle::readPageFromDisk(PageNum pageNum, void *data) {
+    if (isCompressed())
+        return readCompressed(pageNum, &data, 1);
+
+    off_t offset;
+    if (locatePages(pageNum, 1, offset) == 0)
+        return err::FILE_PAGE_NOT_FOUND;
+    if (_direct and not PageBuffer::isAligned(data)) {
+        PageBuffer bounce(1, _pageSize);
+        RC ret = readPageFromDisk(pageNum, bounce);
+        if (ret == err::OK)
+            memcpy(data, bounce, _pageSize);
+        return ret;
+    }
+
+    unsigned long long start = nowNs();
+    if (not preadFull(_fd, data, _pageSize, offset))
+        return err::FILE_CORRUPT;
+
+    recordIO(IO_READ, 1, _pageSize, start);
+    return 0;
+}
+
+RC FileHandle::writePageToDisk(PageNum pageNum, const void *data, IOOp op) {
+    if (isCompressed())
+        return writeCompressed(pageNum, &data, 1, op);
+
+    off_t offset;
+    if (locatePages(pageNum, 1, offset) == 0)
+        return err::FILE_PAGE_NOT_FOUND;
+    if (_direct and not PageBuffer::isAligned(data)) {
+        PageBuffer bounce(1, _pageSize);
+        memcpy(bounce, data, _pageSize);
+        return writePageToDisk(pageNum, bounce, op);
+    }
+
+    unsigned long long start = nowNs();
+    if (not pwriteFull(_fd, data, _pageSize, offset))
+        return err::FILE_CORRUPT;
+
+    recordIO(op, 1, _pageSize, start);
+    return 0;
+}
+
+// Moves count pages at once with preadv/pwritev. Direct handles need every
+// buffer aligned for that; otherwise they go page by page through the
+// bounce buffer.
+
+RC FileHandle::readPagesFromDisk(PageNum first, void *const *buffers, unsigned count) {
+    if (isCompressed())
+        return readCompressed(first, buffers, count);
+
+    bool aligned = true;
+    for (unsigned i = 0; i < count; i++)
+        aligned = aligned and PageBuffer::isAligned(buffers[i]);
+
+    if (_direct and not aligned) {
+        for (unsigned i = 0; i < count; i++) {
+            RC ret = readPageFromDisk(first + i, buffers[i]);
+            if (ret != err::OK)
+                return ret;
+        }
+        return 0;
+    }
+
+    vector<struct iovec> iov(count);
+    for (unsigned i = 0; i < count; i++) {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = _pageSize;
+    }
+    for (unsigned done = 0; done < count; ) {
+        off_t offset;
+        unsigned run = locatePages(first + done, count - done, offset);
+        if (run == 0)
+            return err::FILE_PAGE_NOT_FOUND;
+        unsigned long long start = nowNs();
+        if (not preadvFull(_fd, iov.data() + done, run, offset))
+            return err::FILE_CORRUPT;
+        recordIO(IO_READ, run, (size_t) _pageSize * run, start);
+        done += run;
+    }
+    return 0;
+}
+
+RC FileHandle::writePagesToDisk(PageNum first, const void *const *buffers, unsigned count,
+                                IOOp op) {
+    if (isCompressed())
+        return writeCompressed(first, buffers, count, op);
+
+    bool aligned = true;
+    for (unsigned i = 0; i < count; i++)
+        aligned = aligned and PageBuffer::isAligned(buffers[i]);
+
+    if (_direct and not aligned) {
+        for (unsigned i = 0; i < count; i++) {
+            RC ret = writePageToDisk(first + i, buffers[i], op);
+            if (ret != err::OK)
+                return ret;
+        }
+        return 0;
+    }
+
+    vector<struct iovec> iov(count);
+    for (unsigned i = 0; i < count; i++) {
+        iov[i].iov_base = (void*) buffers[i];
+        iov[i].iov_len = _pageSize;
+    }
+    for (unsigned done = 0; done < count; ) {
+        off_t offset;
+        unsigned run = locatePages(first + done, count - done, offset);
+        if (run == 0)
+            return err::FILE_PAGE_NOT_FOUND;
+        unsigned long long start = nowNs();
+        if (not pwritevFull(_fd, iov.data() + done, run, offset))
+            return err::FILE_CORRUPT;
+        recordIO(op, run, (size_t) _pageSize * run, start);
+        done += run;
+    }
+    return 0;
+}
+
+void FileHandle::recordIO(IOOp op, unsigned count, size_t bytes, unsigned long long start) {
+    if (_ioStats)
+        _ioStats->record(op, count, bytes, nowNs() - start);
+}
+
+// Pages stored one after the other are read with a single pread, and then
+// decompressed one by one.
+
+RC FileHandle::readCompressed(PageNum first, void *const *buffers, unsigned count) {
+    vector<PageSlot> slots(count);
+    {
+        lock_guard<mutex> lock(_pageMap->latch);
+        if (first + count > _pageMap->slots.size())
+            return err::FILE_PAGE_NOT_FOUND;
+        copy(_pageMap->slots.begin() + first, _pageMap->slots.begin() + first + count,
+             slots.begin());
+    }
+
+    vector<char> packed;
+    for (unsigned i = 0; i < count; ) {
+        unsigned end = i + 1;
+        while (end < count and slots[end].offset == slots[end - 1].offset + slots[end - 1].capacity)
+            end++;
+
+        size_t size = slots[end - 1].offset + slots[end - 1].length - slots[i].offset;
+        packed.resize(size);
+        unsigned long long start = nowNs();
+        if (not preadFull(_fd, packed.data(), size, slots[i].offset))
+            return err::FILE_CORRUPT;
+        recordIO(IO_READ, end - i, size, start);
+
+        for (unsigned j = i; j < end; j++) {
+            const char *page = packed.data() + (slots[j].offset - slots[i].offset);
+            if (slots[j].length == _pageSize)
+                memcpy(buffers[j], page, _pageSize);
+            else if (not lzDecompress(page, slots[j].length, buffers[j], _pageSize))
+                return err::FILE_CORRUPT;
+        }
+        i = end;
+    }
+    return 0;
+}
+
+// Pages that still fit their slot are written in place. The others get new
+// slots together at the end of the file, and are written there with a
+// single pwrite.
+
+RC FileHandle::writeCompressed(PageNum first, const void *const *buffers, unsigned count,
+                               IOOp op) {
+    vector<char> packed((size_t) _pageSize * count);
+    vector<unsigned> lengths(count);
+    for (unsigned i = 0; i < count; i++) {
+        char *page = packed.data() + (size_t) _pageSize * i;
+        lengths[i] = lzCompress(buffers[i], _pageSize, page, _pageSize - 1);
+        if (lengths[i] == 0) {
+            memcpy(page, buffers[i], _pageSize);
+            lengths[i] = _pageSize;
+        }
+    }
+
+    vector<PageSlot> slots(count);
+    off_t movedOffset;
+    size_t movedSize = 0;
+    {
+        lock_guard<mutex> lock(_pageMap->latch);
+        PageMap &pageMap = *_pageMap;
+        if (pageMap.slots.size() < first + count)
+            pageMap.slots.resize(first + count, PageSlot());
+        movedOffset = pageMap.end;
+        for (unsigned i = 0; i < count; i++) {
+            PageSlot &slot = pageMap.slots[first + i];
+            if (lengths[i] > slot.capacity) {
+                slot.offset = pageMap.end;
+                slot.capacity = (lengths[i] + PAGE_SLOT_ALIGN - 1) / PAGE_SLOT_ALIGN * PAGE_SLOT_ALIGN;
+                pageMap.end += slot.capacity;
+                movedSize += slot.capacity;
+            }
+            slot.length = lengths[i];
+            slots[i] = slot;
+        }
+        pageMap.dirty = true;
+    }
+
+    vector<char> moved(movedSize);
+    unsigned numMoved = 0;
+    for (unsigned i = 0; i < count; i++) {
+        const char *page = packed.data() + (size_t) _pageSize * i;
+        if ((off_t) slots[i].offset >= movedOffset) {
+            memcpy(moved.data() + (slots[i].offset - movedOffset), page, lengths[i]);
+            numMoved++;
+            continue;
+        }
+
+        unsigned long long start = nowNs();
+        if (not pwriteFull(_fd, page, lengths[i], slots[i].offset))
+            return err::FILE_CORRUPT;
+        recordIO(op, 1, lengths[i], start);
+    }
+
+    if (numMoved > 0) {
+        unsigned long long start = nowNs();
+        if (not pwriteFull(_fd, moved.data(), movedSize, movedOffset))
+            return err::FILE_CORRUPT;
+        recordIO(op, numMoved, movedSize, start);
+    }
+    return 0;
+}
+
+// The page map is stored as an array of PageSlots, at the offset the header
+// gives. Files created compressed start without one.
+
+RC FileHandle::readPageMap(PageMap &pageMap) {
+    char fields[sizeof(unsigned long long) + 2 * sizeof(unsigned)];
+    if (not preadFull(_fd, fields, sizeof(fields), PAGE_MAP_OFFSET))
+        return err::FILE_CORRUPT;
+    unsigned long long offset;
+    unsigned count;
+    memcpy(&offset, fields, sizeof(offset));
+    memcpy(&count, fields + sizeof(offset), sizeof(unsigned));
+    memcpy(&pageMap.mapCapacity, fields + sizeof(offset) + sizeof(unsigned), sizeof(unsigned));
+    pageMap.mapOffset = offset;
+    if (count > pageMap.mapCapacity)
+        return err::FILE_CORRUPT;
+
+    pageMap.slots.resize(count);
+    if (count > 0 and not preadFull(_fd, pageMap.slots.data(), count * sizeof(PageSlot), offset))
+        return err::FILE_CORRUPT;
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0)
         return err::FILE_SEEK_FAILED;
+    // New slots go past everything already reserved, which may run past
+    // the end of the file
+    unsigned long long end = offset + (unsigned long long) pageMap.mapCapacity * sizeof(PageSlot);
+    if (end < (unsigned long long) st.st_size)
+        end = st.st_size;
+    if (end < FILE_HEADER_SIZE)
+        end = FILE_HEADER_SIZE;
+    for (auto it = pageMap.slots.begin(); it != pageMap.slots.end(); ++it) {
+        if (it->length > it->capacity or it->length > _pageSize
+                or it->offset + it->length > (unsigned long long) st.st_size)
+            return err::FILE_CORRUPT;
+        if (it->offset + it->capacity > end)
+            end = it->offset + it->capacity;
+    }
+    pageMap.end = end;
+    return 0;
+}
+
+// Maps the file, reserving room for it to double in size. If the file is
+// already mapped, the old mapping is retired rather than unmapped.
+
+RC FileHandle::mapFile() {
+    size_t fileSize = FILE_HEADER_SIZE + (size_t) _pageSize * _pageCounter;
+    size_t mapSize = 2 * fileSize;
+    if (mapSize < MMAP_MIN_RESERVE)
+        mapSize = MMAP_MIN_RESERVE;
+
+    void *map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED)
+        return err::FILE_MAP_FAILED;
+
+    if (_map != NULL)
+        _retiredMaps.push_back(make_pair(_map, _mapSize));
+    _map = (char*) map;
+    _mapSize = mapSize;
+    return 0;
+}
+
+RC FileHandle::unmapFile() {
+    for (auto it = _retiredMaps.begin(); it != _retiredMaps.end(); ++it)
+        munmap(it->first, it->second);
+    _retiredMaps.clear();
+
+    if (_map != NULL)
+        munmap(_map, _mapSize);
+    _map = NULL;
+    _mapSize = 0;
+    return 0;
+}
+
+// Switches the descriptor to O_DIRECT. File systems without direct I/O
+// support (tmpfs, for one) refuse it, in which case the handle quietly
+// stays buffered; isDirect tells the two apart.
+
+RC FileHandle::enableDirectIO() {
+    int flags = fcntl(_fd, F_GETFL);
+    if (flags < 0)
+        return err::FILE_COULD_NOT_OPEN;
 
-    _pageCounter = ftell(_file) / PAGE_SIZE;
+    _direct = fcntl(_fd, F_SETFL, flags | O_DIRECT) == 0;
     return 0;
 }
@@ -4,42 +4,400 @@
 typedef int RC;
 typedef char byte;
 typedef unsigned PageNum;
+typedef unsigned long long LSN;
 
+// Page size of files created without one. Each file records its own page
+// size, a power of two between MIN_PAGE_SIZE and MAX_PAGE_SIZE.
 #define PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
 #define SIGNATURE "PAGEFILE"
 #define SIGNATURE_SIZE 8
+
+// The signature sits at the start of a header page of its own, so that
+// every data page starts at a PAGE_SIZE aligned file offset. The header
+// page is PAGE_SIZE bytes whatever the file's page size.
+#define FILE_HEADER_SIZE PAGE_SIZE
+
+// After the signature, the header holds the number of pages in use. The
+// file itself may be longer, since it grows a whole extent at a time.
+#define PAGE_COUNT_OFFSET SIGNATURE_SIZE
+// Then comes the page size. Files from before page sizes were recorded
+// have 0 there, and use PAGE_SIZE.
+#define PAGE_SIZE_OFFSET (PAGE_COUNT_OFFSET + sizeof(unsigned))
+// Then the CreateFlags the file was created with
+#define FILE_FLAGS_OFFSET (PAGE_SIZE_OFFSET + sizeof(unsigned))
+// Compressed files then hold the file offset of their page map, the number
+// of pages in it and the number it has room for
+#define PAGE_MAP_OFFSET (FILE_FLAGS_OFFSET + sizeof(unsigned))
+
+// Tablespaces start with a header page of their own, with this signature
+// and the page size at PAGE_SIZE_OFFSET. The number of pages in use sits
+// at PAGE_COUNT_OFFSET, and is followed by the first page of the segment
+// directory, the number of pages set aside for it and its size in bytes.
+#define TABLESPACE_SIGNATURE "PAGESPCE"
+#define DIRECTORY_OFFSET (PAGE_SIZE_OFFSET + sizeof(unsigned))
+
+// Segments start with an extent of this many pages. Each further extent
+// is as large as the segment so far, up to the PFM's extent size.
+#define SEGMENT_MIN_EXTENT 8
+
+// A page number that stands for no page
+#define NO_PAGE UINT_MAX
+
+// Pages of compressed files are stored in slots rounded up to this many
+// bytes, which leaves them some room to grow in place
+#define PAGE_SLOT_ALIGN 128
+
+// Default number of pages preallocated each time a file runs out of room
+#define DEFAULT_EXTENT_PAGES 256
+
+// Pages of logged files end with the LSN of the last log record that
+// changed them
+#define PAGE_LSN_OFFSET(pageSize) ((pageSize) - sizeof(LSN))
+
+// Mapped files reserve address space for at least this many bytes, so that
+// a growing file does not have to be remapped on every append
+#define MMAP_MIN_RESERVE (256 * PAGE_SIZE)
+
+// Default time between the syncs of files with the SYNC_GROUP policy
+#define DEFAULT_SYNC_INTERVAL_MS 50
+
+// Default bound on the descriptors PagedFileManager keeps open for files
+// that no FileHandle is using
+#define DEFAULT_MAX_OPEN_FILES 64
+
+// Shards of the table of files PagedFileManager keeps, each behind a latch
+// of its own, so that threads opening different files rarely wait for
+// each other
+#define FILE_TABLE_SHARDS 16
         
 #include <string>
 #include <map>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <condition_variable>
+#include <ostream>
 #include <climits>
+#include <cstddef>
+#include <sys/types.h>
 using namespace std;
 
 class FileHandle;
+class BufferPoolManager;
+class PageGuard;
+
+// Flags for PagedFileManager::createFile
+//  CREATE_COMPRESSED compress every page on its way to the disk, and store
+//                    it wherever it fits, keeping a map of where each page
+//                    went. Handles still see whole pages. Meant for files
+//                    that are mostly appended to and scanned: pages that
+//                    outgrow their slot move to the end of the file, and
+//                    the space they leave is not reused. The file cannot be
+//                    mapped or accessed directly, so OPEN_MMAP and
+//                    OPEN_DIRECT are ignored for it.
+enum CreateFlags { CREATE_DEFAULT = 0, CREATE_COMPRESSED = 1 };
+
+// Flags for PagedFileManager::openFile
+//  OPEN_MMAP   map the whole file into memory. Pages are read and written
+//              in place in the mapping, bypassing the buffer pool, and the
+//              kernel page cache does the caching. Meant for read-mostly
+//              files.
+//  OPEN_DIRECT do disk I/O with O_DIRECT, bypassing the kernel page cache,
+//              so pages are only cached once, in the buffer pool. Falls
+//              back to buffered I/O where the file system does not support
+//              it.
+//  OPEN_LOGGED log every page change in the write-ahead log (see
+//              LogManager) before it can reach the file. The file's pages
+//              must leave their last sizeof(LSN) bytes for the page LSN.
+//              Has no effect while no log is open.
+enum OpenFlags { OPEN_DEFAULT = 0, OPEN_MMAP = 1, OPEN_DIRECT = 2, OPEN_LOGGED = 4 };
+
+// When changes made through a FileHandle are made durable, on top of
+// explicit calls to FileHandle::sync. Logged changes are durable once
+// their log records are, whatever the policy.
+//  SYNC_NONE           only on request. For bulk loads that can be
+//                      redone from scratch.
+//  SYNC_ON_CLOSE       when the handle is closed
+//  SYNC_PER_OPERATION  before every write, append or truncate returns
+//  SYNC_GROUP          by a background syncer, every sync interval, with
+//                      one fdatasync per file for all the changes made in
+//                      the meantime, and when the handle is closed. A
+//                      crash loses at most an interval's worth of changes.
+enum SyncPolicy { SYNC_NONE = 0, SYNC_ON_CLOSE, SYNC_PER_OPERATION, SYNC_GROUP };
+
+// Access pattern hints for FileHandle::advise
+enum AccessPattern { ACCESS_NORMAL = 0, ACCESS_SEQUENTIAL, ACCESS_RANDOM };
+
+// Kinds of disk I/O counted in IOStats
+enum IOOp { IO_READ = 0, IO_WRITE, IO_APPEND, IO_SYNC, IO_NUM_OPS };
+
+// Latency histograms have a bucket per power of two microseconds: bucket 0
+// counts operations that took under 1us, bucket i those that took
+// [2^(i-1), 2^i) us. The last bucket also takes anything slower.
+#define IO_LATENCY_BUCKETS 24
+
+// A snapshot of the I/O of one kind done on a file
+struct IOCounters {
+    unsigned long long ops;
+    unsigned long long pages;
+    unsigned long long bytes;
+    unsigned long long totalNs;
+    unsigned long long latency[IO_LATENCY_BUCKETS];
+};
+
+// Running I/O statistics of a file, shared by every handle open on it.
+// Counters are atomic, so handles used by other threads (the buffer pool's
+// reader and writer threads, for one) record into them without locking.
+
+class IOStats {
+  public:
+    IOStats() { reset(); }
+
+    void record(IOOp op, unsigned pages, size_t bytes, unsigned long long ns);
+    void get(IOOp op, IOCounters &counters) const;
+    void reset();
+
+  private:
+    struct Counters {
+        atomic<unsigned long long> ops;
+        atomic<unsigned long long> pages;
+        atomic<unsigned long long> bytes;
+        atomic<unsigned long long> totalNs;
+        atomic<unsigned long long> latency[IO_LATENCY_BUCKETS];
+    };
+
+    Counters _counters[IO_NUM_OPS];
+};
 
 
 // The PagedFileManager (PFM) class handles the creation, deletion, opening, 
 // and closing of paged files. The PFM provides facilities for higher-level
 // client components to perform file I/O in terms of pages.
+//
+// The PFM caches one descriptor per file, shared by all FileHandles open on
+// it, and keeps it open after the last handle closes. Reopening the file
+// then skips the open and signature check, and the header is taken from
+// the file's FileInfo instead of being read again. Idle descriptors beyond
+// a bound are closed, least recently used first. Handles opened with
+// OPEN_DIRECT get a descriptor of their own, since O_DIRECT is a
+// descriptor flag.
+
+// Where a page of a compressed file is stored
+struct PageSlot {
+    unsigned long long offset;
+    unsigned length;    // compressed size, or the page size for a page
+                        // that did not compress
+    unsigned capacity;  // bytes reserved at offset
+};
+
+// The page map of a compressed file, shared by the handles open on it. It
+// is written to the file on sync and as each handle closes.
+struct PageMap {
+    mutex latch;
+    vector<PageSlot> slots;
+    off_t end = 0;              // end of the space in use
+    off_t mapOffset = 0;        // where the map is stored in the file
+    unsigned mapCapacity = 0;   // slots that fit there
+    bool dirty = false;
+};
+
+
+// What is known about a file, shared by every handle open on it. The PFM
+// keeps it for as long as it caches the file's descriptor, and for a
+// segment as long as the tablespace is in use, so reopening the file
+// takes the header from here instead of reading it. The layers above
+// cache what they would otherwise read off a page on every open; it is
+// forgotten along with the rest when the file is destroyed or created
+// anew.
+struct FileInfo {
+    mutex latch;
+    bool loaded = false;            // the fields below hold the header
+    unsigned pageCount = 0;
+    unsigned pageSize = PAGE_SIZE;
+    unsigned flags = CREATE_DEFAULT;
+    unsigned allocatedPages = 0;    // pages the file has room for on disk
+    atomic<PageNum> rootPage{NO_PAGE};  // root of an index
+    atomic<PageNum> spaceHint{NO_PAGE}; // map page last found with room
+                                        // for a record
+};
+
+
+// A run of pages of a tablespace
+struct Extent {
+    PageNum start;
+    unsigned length;
+};
+
+// A file stored in a tablespace. Its pages fill its extents in order.
+struct Segment {
+    unsigned pageCount = 0;
+    vector<Extent> extents;
+    unsigned handleCount = 0;   // FileHandles open on the segment
+    shared_ptr<FileInfo> info = make_shared<FileInfo>();
+};
+
+// A tablespace and its segment directory, shared by the PFM and every
+// handle open on one of its segments. The directory is written back to
+// the file when segments are created or destroyed, on sync and as each
+// handle closes.
+struct Tablespace {
+    mutex latch;
+    string fileName;
+    int fd = -1;
+    unsigned pageSize = PAGE_SIZE;
+    PageNum numPages = 0;           // pages in use, after the header page
+    map<string, Segment> segments;
+    vector<Extent> freeExtents;     // left behind by destroyed segments
+    Extent directory = { 0, 0 };    // pages the directory is stored in
+    bool dirty = false;
+
+    ~Tablespace();
+};
+
 
 class PagedFileManager {
   public:
-    // Access to the _pf_manager instance
+    // Access to the _pf_manager instance. Safe to call from many threads
+    // at once; the instance is only created once.
     static PagedFileManager* instance();
 
-    // Public interface
-    RC createFile(const string &fileName);
+    // Public interface. Pages of the new file are pageSize bytes; see
+    // isValidPageSize. flags is a combination of CreateFlags.
+    RC createFile(const string &fileName, unsigned pageSize = PAGE_SIZE,
+                  unsigned flags = CREATE_DEFAULT);
     RC destroyFile(const string &fileName);
-    RC openFile(const string &fileName, FileHandle &fileHandle);
+    RC openFile(const string &fileName, FileHandle &fileHandle,
+                unsigned flags = OPEN_DEFAULT);
     RC closeFile(FileHandle &fileHandle);
+    bool fileExists(const string &fileName);
+    // Makes everything written to fileName durable without a handle
+    RC syncFile(const string &fileName);
+
+    // A tablespace is a single physical file holding many files, called
+    // segments, each in extents of its own. While one is in use, files are
+    // created, opened and destroyed as its segments, which saves a
+    // descriptor and an open per file and keeps related files close
+    // together. Segments use the tablespace's page size, and cannot be
+    // compressed, mapped or accessed directly: OPEN_MMAP and OPEN_DIRECT
+    // are ignored for them.
+    RC createTablespace(const string &fileName, unsigned pageSize = PAGE_SIZE);
+    RC useTablespace(const string &fileName);
+    // Goes back to plain files. Fails with FILE_IN_USE while segments are
+    // open.
+    RC closeTablespace();
+    bool inTablespace() const { return atomic_load(&_tablespace) != NULL; }
+
+    // Sync policy of the handles opened from now on, unless one is set for
+    // their file
+    void setSyncPolicy(SyncPolicy policy) { _syncPolicy = policy; }
+    SyncPolicy getSyncPolicy() const { return _syncPolicy; }
+    void setSyncPolicy(const string &fileName, SyncPolicy policy);
+    SyncPolicy getSyncPolicy(const string &fileName);
+    // Milliseconds between the syncs of SYNC_GROUP handles. 0 stops the
+    // syncer, leaving their changes to be synced as they close.
+    void setSyncInterval(unsigned ms);
+    unsigned getSyncInterval() const { return _syncInterval; }
+
+    // Bound on cached descriptors that are not in use
+    void setMaxOpenFiles(unsigned maxOpenFiles);
+    unsigned getNumOpenFiles() const { return _numOpenFiles; }
+
+    // Number of pages files grow by when an append runs past the space
+    // allocated to them; 1 grows them a page at a time
+    void setExtentSize(unsigned numPages) { _extentPages = numPages ? numPages : 1; }
+    unsigned getExtentSize() const { return _extentPages; }
+
+    static bool isValidPageSize(unsigned pageSize) {
+        return pageSize >= MIN_PAGE_SIZE and pageSize <= MAX_PAGE_SIZE
+               and (pageSize & (pageSize - 1)) == 0; }
+
+    // Disk I/O statistics, per file. They outlive the handles of the file
+    // and are dropped when it is destroyed or created anew.
+    RC getIOStats(const string &fileName, IOOp op, IOCounters &counters);
+    // Sum over every file
+    void getTotalIOStats(IOOp op, IOCounters &counters);
+    void resetIOStats();
+    // Writes the statistics of every file, and their sum, as a JSON object
+    void dumpIOStats(ostream &out);
+    // Counts I/O done on fileName without a FileHandle
+    void recordIO(const string &fileName, IOOp op, unsigned pages, size_t bytes,
+                  unsigned long long ns);
 
   protected:
     PagedFileManager();
     ~PagedFileManager();
 
   private:
-    static PagedFileManager *_pf_manager;
-    map<string,int> handleCount;
-    bool fileExists(const string &fileName);
+    friend FileHandle;
+
+    struct FileEntry {
+        int fd;                 // cached descriptor, -1 if none
+        dev_t dev;              // identity of the file fd refers to
+        ino_t ino;
+        unsigned handleCount;   // FileHandles open on the file
+        unsigned long lastUsed; // for LRU eviction of idle descriptors
+        shared_ptr<FileInfo> info;
+    };
+
+    struct FileShard {
+        mutex latch;
+        map<string, FileEntry> files;
+    };
+
+    static atomic<PagedFileManager*> _pf_manager;
+    static mutex _instanceMutex;
+    // Files by name, spread over the shards by the hash of their name.
+    // Latches of several shards are taken in the order of the shards.
+    FileShard _fileShards[FILE_TABLE_SHARDS];
+    atomic<unsigned> _numOpenFiles;
+    atomic<unsigned> _maxOpenFiles;
+    atomic<unsigned long> _useClock;
+    atomic<unsigned> _extentPages;
+    // Kept apart from the file table, whose entries go with the
+    // descriptors. The log's checkpointer records into it from a thread of
+    // its own.
+    map<string, shared_ptr<IOStats> > _ioStats;
+    mutex _ioStatsMutex;
+    // Page maps of the compressed files that are open. The pool opens its
+    // own handles from its threads.
+    map<string, weak_ptr<PageMap> > _pageMaps;
+    mutex _pageMapsMutex;
+    // The tablespace in use, if any. The log's checkpointer looks at it.
+    shared_ptr<Tablespace> _tablespace;
+    // Sync policies, and the SYNC_GROUP handles with changes to sync
+    atomic<SyncPolicy> _syncPolicy;
+    map<string, SyncPolicy> _filePolicies;
+    mutex _syncMutex;
+    set<FileHandle*> _unsynced;
+    set<FileHandle*> _syncing;      // being synced by the syncer
+    thread _syncer;
+    condition_variable _syncDue;
+    condition_variable _syncDone;
+    unsigned _syncInterval;
+    bool _stopping;
+
+    FileShard &shardOf(const string &fileName);
+    void releaseFile(FileHandle &fileHandle);
+    bool hasOtherHandles(const FileHandle &fileHandle);
+    void dropFile(const string &fileName);
+    void closeIdleFiles();
+    shared_ptr<IOStats> getFileStats(const string &fileName);
+    void dropFileStats(const string &fileName);
+    RC loadPageMap(FileHandle &fileHandle);
+    void dropPageMap(const string &fileName);
+    void scheduleSync(FileHandle &fileHandle);
+    void cancelSync(FileHandle &fileHandle);
+    void syncLoop();
+    RC createSegment(Tablespace &space, const string &fileName, unsigned pageSize,
+                     unsigned flags);
+    RC destroySegment(Tablespace &space, const string &fileName);
+    RC openSegment(const shared_ptr<Tablespace> &space, const string &fileName,
+                   FileHandle &fileHandle, unsigned flags);
 };
 
 
@@ -48,16 +406,47 @@ class PagedFileManager {
 // class and passes it to the PagedFileManager::openFile method.
 //
 // Each FileHandle instance keeps track of the number of reads, writes, and
-// appended pages.
+// appended pages. Reads and writes are served by the BufferPoolManager,
+// which only goes to disk on a miss or when writing back a dirty page. The
+// disk I/O itself is timed and counted in the file's IOStats, whichever
+// handle does it. Pages accessed in a mapping are not.
+//
+// Disk I/O uses positional pread/pwrite on a file descriptor, so there is
+// no shared file position and no stdio buffer between the pool and the disk.
+// A handle opened with OPEN_MMAP reads and writes pages in a shared mapping
+// of the file instead. A handle opened with OPEN_DIRECT only transfers
+// PAGE_SIZE aligned buffers, bouncing unaligned ones through a PageBuffer.
+//
+// Appends are served from extents preallocated with fallocate, so the file
+// is extended once per extent rather than once per page. The number of
+// pages in use and the page size are kept in the header page, and in the
+// FileInfo shared with the other handles of the file. Buffers passed to a
+// handle hold getPageSize() bytes per page.
+//
+// Pages of a compressed file are compressed and decompressed on their way
+// to and from the disk, below the buffer pool. Pages written one after
+// the other, as appended pages are, end up next to each other in the file
+// and are read back with a single pread.
+//
+// A handle on a segment of a tablespace does its I/O on the tablespace's
+// descriptor, finding each page through the segment's extents. Pages that
+// are next to each other in the segment but not in the tablespace take
+// one system call per extent.
+//
+// A logged handle stamps and logs every page it changes first. Its appended
+// pages go to the buffer pool, like its writes, so that they too only reach
+// the file after their log records.
 
 class FileHandle {
   public:
-    // let PFM be friend
+    // let PFM, BPM and PageGuard be friends
     friend PagedFileManager;
+    friend BufferPoolManager;
+    friend PageGuard;
     // variables to keep counter for each operation
-	unsigned readPageCounter;
-	unsigned writePageCounter;
-	unsigned appendPageCounter;
+	atomic<unsigned> readPageCounter;
+	atomic<unsigned> writePageCounter;
+	atomic<unsigned> appendPageCounter;
 	
     FileHandle();
     ~FileHandle();
@@ -65,24 +454,108 @@ class FileHandle {
     RC readPage(PageNum pageNum, void *data);
     RC writePage(PageNum pageNum, const void *data);
     RC appendPage(const void *data);
+    // As above, also giving the number of the appended page
+    RC appendPage(const void *data, PageNum &pageNum);
+    // Multi-page versions of the above. They move count contiguous pages
+    // starting at first, with as few system calls as possible; data holds
+    // count * getPageSize() bytes. Pages in the buffer pool are served from, or
+    // kept in step with, their frames.
+    RC readPages(PageNum first, unsigned count, void *data);
+    RC writePages(PageNum first, unsigned count, const void *data);
+    RC appendPages(unsigned count, const void *data);
+    RC appendPages(unsigned count, const void *data, PageNum &first);
+    // Cuts the file down to its first numPages pages, in the same time
+    // however many pages go. Their frames are dropped from the buffer pool,
+    // dirty or not. Fails with FILE_IN_USE while other handles are open on
+    // the file, and with BUFFER_FRAME_PINNED while a page that would go is
+    // pinned.
+    RC truncate(unsigned numPages);
+    // Scatter/gather versions, with one buffer per page
+    RC readPages(PageNum first, const vector<void*> &buffers);
+    RC writePages(PageNum first, const vector<const void*> &buffers);
     unsigned getNumberOfPages();
+    unsigned getPageSize() const { return _pageSize; }
+    // Tell the kernel how the file is about to be accessed. This is only a
+    // hint; it never fails.
+    RC advise(AccessPattern pattern);
+    // Write back the file's dirty pages and wait for them to reach the disk
+    RC sync();
+    // See SyncPolicy. Handles start with the PFM's policy for the file.
+    void setSyncPolicy(SyncPolicy policy) { _syncPolicy = policy; }
+    SyncPolicy getSyncPolicy() const { return _syncPolicy; }
     RC collectCounterValues(unsigned &readPageCount, 
                             unsigned &writePageCount, 
                             unsigned &appendPageCount);
 
-    bool hasFile() const { return _file != NULL; }
-    FILE* getFile() { return _file; }
-    RC loadFile(FILE* file);
+    bool hasFile() const { return _fd >= 0; }
+    int getFd() const { return _fd; }
+    bool isMapped() const { return _map != NULL; }
+    bool isDirect() const { return _direct; }
+    bool isLogged() const { return _logged; }
+    bool isCompressed() const { return _pageMap != NULL; }
+    bool isSegment() const { return _segment != NULL; }
+    RC loadFile(int fd);
     RC unloadFile();
     RC updatePageCounter();
-    string getFileName() { return fileName; }
+    const string& getFileName() const { return fileName; }
+    // Kept in the file's FileInfo for the layers above, across handles
+    PageNum getRootPage() const { return _info ? _info->rootPage.load() : NO_PAGE; }
+    void setRootPage(PageNum pageNum) { if (_info) _info->rootPage = pageNum; }
+    PageNum getSpaceHint() const { return _info ? _info->spaceHint.load() : NO_PAGE; }
+    void setSpaceHint(PageNum pageNum) { if (_info) _info->spaceHint = pageNum; }
     bool operator== (const FileHandle& that) const { 
-                        return this->_file == that._file; }
+                        return this->_fd == that._fd; }
 
   private:
-    FILE *_file = NULL;
+    RC writeOnePage(PageNum pageNum, const void *data);
+    RC appendOnePage(PageNum pageNum, const void *data);
+    RC checkPages(PageNum first, unsigned count);
+    RC applySyncPolicy();
+    RC readPageFromDisk(PageNum pageNum, void *data);
+    RC writePageToDisk(PageNum pageNum, const void *data, IOOp op = IO_WRITE);
+    RC readPagesFromDisk(PageNum first, void *const *buffers, unsigned count);
+    RC writePagesToDisk(PageNum first, const void *const *buffers, unsigned count,
+                        IOOp op = IO_WRITE);
+    RC readCompressed(PageNum first, void *const *buffers, unsigned count);
+    RC writeCompressed(PageNum first, const void *const *buffers, unsigned count, IOOp op);
+    RC readPageMap(PageMap &pageMap);
+    RC reserveSegmentExtent(unsigned numPages);
+    RC truncateCompressed(unsigned numPages);
+    RC truncateSegment(unsigned numPages);
+    unsigned locatePages(PageNum first, unsigned count, off_t &offset);
+    void recordIO(IOOp op, unsigned count, size_t bytes, unsigned long long start);
+    RC mapFile();
+    RC unmapFile();
+    RC enableDirectIO();
+    RC reserveExtent(unsigned numPages);
+    PageNum claimPages(unsigned count);
+    void releasePages(PageNum first, unsigned count);
+    void setPageCount(unsigned numPages);
+    RC writePageCount();
+    RC logPage(PageNum pageNum, void *data, LSN &lsn);
+    char* mappedPage(PageNum pageNum) const {
+        return _map + FILE_HEADER_SIZE + (size_t) _pageSize * pageNum; }
+
+    int _fd = -1;
+    bool _direct = false;
+    bool _logged = false;
+    char *_map = NULL;
+    size_t _mapSize = 0;
+    // Mappings replaced by a remap stay valid until the file is closed,
+    // since pinned pages may still point into them
+    vector<pair<char*, size_t> > _retiredMaps;
     string fileName;
     unsigned _pageCounter;
+    unsigned _pageSize = PAGE_SIZE;
+    unsigned _allocatedPages = 0;   // pages the file has room for on disk
+    unsigned _fileFlags = CREATE_DEFAULT;
+    SyncPolicy _syncPolicy = SYNC_NONE;
+    atomic<bool> _unsynced;         // changed since the last sync
+    shared_ptr<IOStats> _ioStats;
+    shared_ptr<FileInfo> _info;
+    shared_ptr<PageMap> _pageMap;   // only for compressed files
+    shared_ptr<Tablespace> _tablespace;
+    Segment *_segment = NULL;       // only for segments of _tablespace
 }; 
 
 #endif
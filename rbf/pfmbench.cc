@@ -0,0 +1,152 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "pfm.h"
+#include "../util/errcodes.h"
+
+using namespace std;
+
+// Stresses the PagedFileManager from many threads at once, to show how it
+// scales with them. Every thread works on files picked at random:
+//
+//  open/close  opens a file, looks at its page count and closes it again
+//  read        reads random pages through handles it keeps open
+//
+//  ./pfmbench [maxThreads] [opsPerThread] [numFiles]
+
+static const unsigned benchPages = 32;
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static string benchFile(unsigned i) {
+    char name[32];
+    snprintf(name, sizeof(name), "pfmbench_file%u", i);
+    return name;
+}
+
+static RC createFiles(PagedFileManager *pfm, unsigned numFiles) {
+    unsigned char page[PAGE_SIZE];
+    for (unsigned i = 0; i < numFiles; i++) {
+        remove(benchFile(i).c_str());
+        RC ret = pfm->createFile(benchFile(i));
+        RETURN_ON_ERR(ret);
+
+        FileHandle fileHandle;
+        ret = pfm->openFile(benchFile(i), fileHandle);
+        RETURN_ON_ERR(ret);
+        for (unsigned j = 0; j < benchPages; j++) {
+            memset(page, i + j, PAGE_SIZE);
+            ret = fileHandle.appendPage(page);
+            RETURN_ON_ERR(ret);
+        }
+        ret = pfm->closeFile(fileHandle);
+        RETURN_ON_ERR(ret);
+    }
+    return 0;
+}
+
+static void openClose(PagedFileManager *pfm, unsigned seed, unsigned numOps,
+                      unsigned numFiles, atomic<unsigned> &failures) {
+    mt19937 random(seed);
+    for (unsigned i = 0; i < numOps; i++) {
+        FileHandle fileHandle;
+        if (pfm->openFile(benchFile(random() % numFiles), fileHandle) != err::OK) {
+            failures++;
+            continue;
+        }
+        if (fileHandle.getNumberOfPages() != benchPages)
+            failures++;
+        pfm->closeFile(fileHandle);
+    }
+}
+
+static void readPages(PagedFileManager *pfm, unsigned seed, unsigned numOps,
+                      unsigned numFiles, atomic<unsigned> &failures) {
+    mt19937 random(seed);
+    vector<FileHandle> handles(numFiles);
+    for (unsigned i = 0; i < numFiles; i++) {
+        if (pfm->openFile(benchFile(i), handles[i]) != err::OK)
+            failures++;
+    }
+
+    unsigned char page[PAGE_SIZE];
+    for (unsigned i = 0; i < numOps; i++) {
+        unsigned file = random() % numFiles;
+        PageNum pageNum = random() % benchPages;
+        if (handles[file].readPage(pageNum, page) != err::OK
+                or page[0] != (unsigned char) (file + pageNum))
+            failures++;
+    }
+
+    for (unsigned i = 0; i < numFiles; i++)
+        pfm->closeFile(handles[i]);
+}
+
+typedef void (*Workload)(PagedFileManager *, unsigned, unsigned, unsigned, atomic<unsigned> &);
+
+// Runs workload on numThreads threads, and returns the operations done per
+// second, or a negative number if any of them failed
+static double run(Workload workload, unsigned numThreads, unsigned opsPerThread,
+                  unsigned numFiles) {
+    PagedFileManager *pfm = PagedFileManager::instance();
+    atomic<unsigned> failures(0);
+    vector<thread> threads;
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < numThreads; i++)
+        threads.push_back(thread(workload, pfm, i + 1, opsPerThread, numFiles, ref(failures)));
+    for (unsigned i = 0; i < numThreads; i++)
+        threads[i].join();
+    double ms = elapsedMs(start);
+
+    if (failures > 0)
+        return -1;
+    return (double) numThreads * opsPerThread / (ms / 1000);
+}
+
+int main(int argc, char **argv) {
+    unsigned maxThreads = argc > 1 ? atoi(argv[1]) : thread::hardware_concurrency();
+    unsigned opsPerThread = argc > 2 ? atoi(argv[2]) : 50000;
+    unsigned numFiles = argc > 3 ? atoi(argv[3]) : 32;
+    if (maxThreads == 0)
+        maxThreads = 1;
+    if (numFiles == 0)
+        numFiles = 1;
+
+    PagedFileManager *pfm = PagedFileManager::instance();
+    if (createFiles(pfm, numFiles) != err::OK)
+        return 1;
+
+    const char *names[] = { "open/close", "read" };
+    Workload workloads[] = { openClose, readPages };
+    printf("%u files of %u pages, %u operations per thread\n", numFiles, benchPages,
+           opsPerThread);
+    for (unsigned w = 0; w < 2; w++) {
+        double base = 0;
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+            double rate = run(workloads[w], numThreads, opsPerThread, numFiles);
+            if (rate < 0) {
+                printf("%s failed with %u threads\n", names[w], numThreads);
+                return 1;
+            }
+            if (numThreads == 1)
+                base = rate;
+            printf("%-10s %3u threads %12.0f ops/s  %6.2fx\n", names[w], numThreads,
+                   rate, rate / base);
+        }
+    }
+
+    for (unsigned i = 0; i < numFiles; i++)
+        pfm->destroyFile(benchFile(i));
+    return 0;
+}
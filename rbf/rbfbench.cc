@@ -0,0 +1,137 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "pfm.h"
+#include "bpm.h"
+#include "rbfm.h"
+#include "../util/errcodes.h"
+
+using namespace std;
+
+// Times loading a file, then compares the buffer pool (pread/pwrite) path
+// against OPEN_DIRECT and OPEN_MMAP on a full table scan and on random
+// record lookups. This is done for files with 4K, 16K and 64K pages, or
+// only for pageSize if it is given.
+//
+//  ./rbfbench [numRecords] [numLookups] [pageSize]
+
+static const string benchFile = "rbfbench_file";
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static vector<Attribute> benchDescriptor() {
+    Attribute id;   id.name = "id";     id.type = TypeInt;      id.length = 4;
+    Attribute val;  val.name = "val";   val.type = TypeReal;    val.length = 4;
+    Attribute name; name.name = "name"; name.type = TypeVarChar; name.length = 64;
+    vector<Attribute> descriptor;
+    descriptor.push_back(id);
+    descriptor.push_back(val);
+    descriptor.push_back(name);
+    return descriptor;
+}
+
+static RC loadFile(RecordBasedFileManager *rbfm, unsigned numRecords,
+                   unsigned pageSize, vector<RID> &rids) {
+    vector<Attribute> descriptor = benchDescriptor();
+    remove(benchFile.c_str());
+    RC ret = rbfm->createFile(benchFile, pageSize);
+    RETURN_ON_ERR(ret);
+
+    FileHandle fileHandle;
+    ret = rbfm->openFile(benchFile, fileHandle);
+    RETURN_ON_ERR(ret);
+
+    char record[128];
+    for (unsigned i = 0; i < numRecords; i++) {
+        int id = i;
+        float val = i * 0.5f;
+        unsigned len = 20 + i % 40;
+        memcpy(record, &id, sizeof(int));
+        memcpy(record + 4, &val, sizeof(float));
+        memcpy(record + 8, &len, sizeof(unsigned));
+        memset(record + 12, 'a' + i % 26, len);
+
+        RID rid;
+        ret = rbfm->insertRecord(fileHandle, descriptor, record, rid);
+        RETURN_ON_ERR(ret);
+        rids.push_back(rid);
+    }
+    return rbfm->closeFile(fileHandle);
+}
+
+static RC runBench(RecordBasedFileManager *rbfm, const char *label, unsigned flags,
+                   const vector<RID> &rids, unsigned numLookups) {
+    vector<Attribute> descriptor = benchDescriptor();
+    vector<string> names;
+    names.push_back("id");
+
+    FileHandle fileHandle;
+    RC ret = rbfm->openFile(benchFile, fileHandle, flags);
+    RETURN_ON_ERR(ret);
+
+    RID rid;
+    char data[128];
+    unsigned count = 0;
+    auto start = chrono::steady_clock::now();
+    RBFM_ScanIterator scanner;
+    ret = rbfm->scan(fileHandle, descriptor, "", NO_OP, NULL, names, scanner);
+    RETURN_ON_ERR(ret);
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    double scanMs = elapsedMs(start);
+
+    srand(1);
+    start = chrono::steady_clock::now();
+    for (unsigned i = 0; i < numLookups; i++) {
+        ret = rbfm->readRecord(fileHandle, descriptor, rids[rand() % rids.size()], data);
+        RETURN_ON_ERR(ret);
+    }
+    double lookupMs = elapsedMs(start);
+
+    printf("%-8s scan %u records: %8.2f ms   %u lookups: %8.2f ms\n",
+           label, count, scanMs, numLookups, lookupMs);
+    return rbfm->closeFile(fileHandle);
+}
+
+int main(int argc, char **argv) {
+    unsigned numRecords = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned numLookups = argc > 2 ? atoi(argv[2]) : 200000;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+    vector<unsigned> pageSizes;
+    if (argc > 3) {
+        pageSizes.push_back(atoi(argv[3]));
+    } else {
+        pageSizes.push_back(4096);
+        pageSizes.push_back(16384);
+        pageSizes.push_back(65536);
+    }
+
+    for (unsigned i = 0; i < pageSizes.size(); i++) {
+        printf("page size %u\n", pageSizes[i]);
+        vector<RID> rids;
+        auto start = chrono::steady_clock::now();
+        if (loadFile(rbfm, numRecords, pageSizes[i], rids) != err::OK)
+            return 1;
+        printf("load     %u records: %8.2f ms\n", numRecords, elapsedMs(start));
+
+        // Run each mode twice; the first run warms the page cache
+        for (int run = 0; run < 2; run++) {
+            runBench(rbfm, "pool", OPEN_DEFAULT, rids, numLookups);
+            runBench(rbfm, "direct", OPEN_DIRECT, rids, numLookups);
+            runBench(rbfm, "mmap", OPEN_MMAP, rids, numLookups);
+        }
+        printf("\n");
+    }
+
+    remove(benchFile.c_str());
+    return 0;
+}
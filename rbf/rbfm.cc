@@ -2,19 +2,29 @@
 #include "../util/errcodes.h"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
-RecordBasedFileManager* RecordBasedFileManager::_rbf_manager = 0;
+atomic<RecordBasedFileManager*> RecordBasedFileManager::_rbf_manager(NULL);
+mutex RecordBasedFileManager::_instanceMutex;
 
 RecordBasedFileManager* RecordBasedFileManager::instance()
 {
-    if(!_rbf_manager)
-        _rbf_manager = new RecordBasedFileManager();
-
-    return _rbf_manager;
+    RecordBasedFileManager *instance = _rbf_manager.load(memory_order_acquire);
+    if (instance)
+        return instance;
+
+    // Threads racing to get here first create a single instance
+    lock_guard<mutex> lock(_instanceMutex);
+    instance = _rbf_manager.load(memory_order_relaxed);
+    if (!instance) {
+        instance = new RecordBasedFileManager();
+        _rbf_manager.store(instance, memory_order_release);
+    }
+    return instance;
 }
 
 RecordBasedFileManager::RecordBasedFileManager()
-    : _pfm(*(PagedFileManager::instance())) 
+    : _pfm(*(PagedFileManager::instance())), _tombstoneHops(0)
 {
 }
 
@@ -24,10 +34,10 @@ RecordBasedFileManager::~RecordBasedFileManager()
 }
 
 
-RC RecordBasedFileManager::createFile(const string &fileName) 
+RC RecordBasedFileManager::createFile(const string &fileName, unsigned pageSize, unsigned flags) 
 {
     // Request new file from PFM
-    RC ret = _pfm.createFile(fileName);
+    RC ret = _pfm.createFile(fileName, pageSize, flags);
     if (ret != err::OK) {
         return ret;
     }
@@ -37,17 +47,12 @@ RC RecordBasedFileManager::createFile(const string &fileName)
     if (ret != err::OK)
         return ret;
 
-    // Create index for page 0
-    PageIndex index;
-    index.pageNum = 0;
-    index.freeMemoryOffset = 0;
-    index.numSlots = 0;
-
-    // Write the index at the end of a blank page
-    unsigned char buffer[PAGE_SIZE] = {0};
-    writePageIndex(buffer, &index);
+    // Page 0 is the free-space map, page 1 the first (empty) data page
+    PageBuffer buffer(2, pageSize);
+    initMapPage(buffer, 0, 2, pageSize);
+    initDataPage(buffer + pageSize, 1, pageSize);
     // Flush buffer
-    fileHandle.appendPage(buffer);
+    fileHandle.appendPages(2, buffer);
 
     // Drop file handle
     return _pfm.closeFile(fileHandle);
@@ -59,9 +64,10 @@ RC RecordBasedFileManager::destroyFile(const string &fileName)
 }
 
 RC RecordBasedFileManager::openFile(const string &fileName, 
-                                    FileHandle &fileHandle) 
+                                    FileHandle &fileHandle,
+                                    unsigned flags) 
 {
-    return _pfm.openFile(fileName, fileHandle);
+    return _pfm.openFile(fileName, fileHandle, flags | OPEN_LOGGED);
 }
 
 RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) 
@@ -69,116 +75,479 @@ RC RecordBasedFileManager::closeFile(FileHandle &fileHandle)
     return _pfm.closeFile(fileHandle);
 }
 
-PageIndex* RecordBasedFileManager::getPageIndex(void* buffer)
+PageIndex* RecordBasedFileManager::getPageIndex(void* buffer, unsigned pageSize)
 {
-    return (PageIndex*)((char*)buffer + PAGE_SIZE - sizeof(PageIndex));
+    return (PageIndex*)((char*)buffer + pageSize - sizeof(PageIndex));
+}
+
+const PageIndex* RecordBasedFileManager::getPageIndex(const void* buffer, unsigned pageSize)
+{
+    return (const PageIndex*)((const char*)buffer + pageSize - sizeof(PageIndex));
 }
 
 void RecordBasedFileManager::writePageIndex(void* buffer, 
-                                            PageIndex* index) 
+                                            PageIndex* index,
+                                            unsigned pageSize) 
 {
-    unsigned offset = PAGE_SIZE - sizeof(PageIndex);
+    unsigned offset = pageSize - sizeof(PageIndex);
     memcpy((char*)buffer + offset, index, sizeof(PageIndex));
 }
 
 PageIndexEntry* RecordBasedFileManager::getPageIndexEntry(void* buffer, 
-                                                        unsigned slotNum)
+                                                        unsigned slotNum,
+                                                        unsigned pageSize)
 {
-    unsigned offset = PAGE_SIZE;
+    unsigned offset = pageSize;
     offset -= sizeof(PageIndex);
     offset -= ((slotNum + 1) * sizeof(PageIndexEntry));
     return (PageIndexEntry*)((char*)buffer + offset);
 }
 
+const PageIndexEntry* RecordBasedFileManager::getPageIndexEntry(const void* buffer, 
+                                                              unsigned slotNum,
+                                                              unsigned pageSize)
+{
+    unsigned offset = pageSize;
+    offset -= sizeof(PageIndex);
+    offset -= ((slotNum + 1) * sizeof(PageIndexEntry));
+    return (const PageIndexEntry*)((const char*)buffer + offset);
+}
+
 void RecordBasedFileManager::writePageIndexEntry(void* buffer, 
                                                  unsigned slotNum, 
-                                                 PageIndexEntry* entry)
+                                                 PageIndexEntry* entry,
+                                                 unsigned pageSize)
 {
-    unsigned offset = PAGE_SIZE;
+    unsigned offset = pageSize;
     offset -= sizeof(PageIndex);
     offset -= ((slotNum + 1) * sizeof(PageIndexEntry));
     memcpy((char*)buffer + offset, entry, sizeof(PageIndexEntry));
 }
 
-unsigned RecordBasedFileManager::freeSpaceSize(void* pageData) 
+unsigned RecordBasedFileManager::freeSpaceSize(const void* pageData, unsigned pageSize) 
 {
     // Read page index, compute number of bytes between
     // freeMemoryOffset and slots/index data.
     PageIndex index;
-    memcpy((void *) &index, (unsigned char *) pageData + PAGE_SIZE - sizeof(PageIndex),
+    memcpy((void *) &index, (const unsigned char *) pageData + pageSize - sizeof(PageIndex),
             sizeof(PageIndex));
-    unsigned space = PAGE_SIZE - sizeof(PageIndex) 
+    unsigned space = pageSize - sizeof(PageIndex) 
                                - index.numSlots*sizeof(PageIndexEntry) 
                                - index.freeMemoryOffset;
     return space;
 }
 
-// Stores pageNum with the number of the first page that has enought
-// space to store numbytes of data
+unsigned RecordBasedFileManager::usableSpaceSize(const void* pageData, unsigned pageSize)
+{
+    const PageIndex* index = getPageIndex(pageData, pageSize);
+    unsigned used = sizeof(PageIndex) + index->numSlots * sizeof(PageIndexEntry);
+    for (unsigned slot = 0; slot < index->numSlots; slot++) {
+        const PageIndexEntry* entry = getPageIndexEntry(pageData, slot, pageSize);
+        if (entry->type == ALIVE || entry->type == ANCHOR)
+            used += entry->recordSize;
+    }
+    return pageSize - used;
+}
+
+unsigned char RecordBasedFileManager::freeSpaceBucket(unsigned numbytes, unsigned pageSize)
+{
+    return min(numbytes / FSM_BUCKET_SIZE(pageSize), (unsigned) FSM_MAX_BUCKET);
+}
+
+void RecordBasedFileManager::initMapPage(unsigned char* buffer,
+                                         PageNum mapPage,
+                                         unsigned numPages,
+                                         unsigned pageSize)
+{
+    // Every existing data page in the map's range starts out empty
+    memset(buffer, 0, pageSize);
+    unsigned char empty = freeSpaceBucket(pageSize - sizeof(PageIndex), pageSize);
+    for (PageNum page = mapPage + 1; page < numPages && not isMapPage(page, pageSize); page++)
+        buffer[page - mapPage - 1] = empty;
+}
+
+void RecordBasedFileManager::initDataPage(unsigned char* buffer,
+                                          PageNum pageNum,
+                                          unsigned pageSize)
+{
+    PageIndex index;
+    index.pageNum = pageNum;
+    index.freeMemoryOffset = 0;
+    index.numSlots = 0;
+    index.freeSlot = 0;
+    index.lsn = 0;
+
+    // Write the index at the end of a blank page
+    memset(buffer, 0, pageSize);
+    writePageIndex(buffer, &index, pageSize);
+}
+
+// Stores pageNum with the number of a page that has enough space to store
+// numbytes of data. Only the map page that last had room, and the one
+// covering the end of the file, are consulted before new pages are appended.
 RC RecordBasedFileManager::findSpace(FileHandle &fileHandle, 
                                      unsigned numbytes,
                                      PageNum& pageNum) 
 {
     RC ret;
-    bool pageFound = false;
-    unsigned char buffer[PAGE_SIZE] = {0};
-    for (pageNum = 0; pageNum < fileHandle.getNumberOfPages(); pageNum++) {
-        ret = fileHandle.readPage(pageNum, buffer);
-        if (ret != 0)
+    unsigned pageSize = fileHandle.getPageSize();
+    // Pages whose bucket is at least this large have room for numbytes
+    unsigned bucketSize = FSM_BUCKET_SIZE(pageSize);
+    unsigned needed = max(1u, (numbytes + bucketSize - 1) / bucketSize);
+    unsigned numPages = fileHandle.getNumberOfPages();
+    if (needed <= FSM_MAX_BUCKET && numPages > 0) {
+        PageNum lastMap = mapPageOf(numPages - 1, pageSize);
+        PageNum hint = lastMap;
+        PageNum cached = fileHandle.getSpaceHint();
+        if (cached < lastMap)
+            hint = cached;
+
+        ret = searchMap(fileHandle, hint, needed, pageNum);
+        if (ret != err::OK)
             return ret;
-        if (freeSpaceSize(buffer) >= numbytes) {
-            pageFound = true;
+        if (pageNum == 0 && hint != lastMap) {
+            ret = searchMap(fileHandle, lastMap, needed, pageNum);
+            if (ret != err::OK)
+                return ret;
+        }
+        // Page 0 is a map page, so it doubles as "nothing found"
+        if (pageNum != 0) {
+            fileHandle.setSpaceHint(mapPageOf(pageNum, pageSize));
+            return err::OK;
+        }
+    }
+
+    unsigned requiredPages = 1 + ((numbytes - 1) / pageSize);
+    ret = appendDataPages(fileHandle, requiredPages, pageNum);
+    if (ret != err::OK)
+        return ret;
+    fileHandle.setSpaceHint(mapPageOf(pageNum, pageSize));
+    return err::OK;
+}
+
+// Stores in pageNum the first data page covered by mapPage whose bucket is
+// at least bucket, or 0 if there is none
+RC RecordBasedFileManager::searchMap(FileHandle &fileHandle,
+                                     PageNum mapPage,
+                                     unsigned char bucket,
+                                     PageNum& pageNum)
+{
+    PageGuard page;
+    RC ret = page.pin(fileHandle, mapPage);
+    if (ret != err::OK)
+        return ret;
+
+    const unsigned char* entries = (const unsigned char*) page.data();
+    unsigned count = min(fileHandle.getNumberOfPages() - mapPage - 1,
+                         (unsigned) FSM_PAGES_PER_MAP(fileHandle.getPageSize()));
+    pageNum = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (entries[i] >= bucket) {
+            pageNum = mapPage + 1 + i;
             break;
         }
     }
-    if (not pageFound) {
-        unsigned requiredPages = 1 + ((numbytes - 1) / PAGE_SIZE);
-        for (unsigned i = 0; i < requiredPages; i++) {
-            memset(buffer, 0, PAGE_SIZE); // unnecessary?
-            PageIndex index;
-            index.pageNum = pageNum + i;
-            index.freeMemoryOffset = 0;
-            index.numSlots = 0;
-
-            // Write the index at the end of a blank page
-            memcpy(buffer + PAGE_SIZE - sizeof(PageIndex), &index,
-                   sizeof(PageIndex));
-            ret = fileHandle.appendPage(buffer);
-            if (ret != 0)
+    return err::OK;
+}
+
+// Number of pages from first that hold numPages pages other than map pages,
+// map pages in between included
+static unsigned pagesSpanned(PageNum first, unsigned numPages, unsigned pageSize)
+{
+    unsigned span = 0;
+    while (numPages > 0) {
+        if (not RecordBasedFileManager::isMapPage(first + span, pageSize))
+            numPages--;
+        span++;
+    }
+    return span;
+}
+
+// Lays out count pages from first in batch: map pages where the maps go,
+// and empty data pages in between. Returns how many are data pages.
+unsigned RecordBasedFileManager::initPages(unsigned char* batch,
+                                           PageNum first,
+                                           unsigned count,
+                                           unsigned pageSize)
+{
+    unsigned numData = 0;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned char* page = batch + pageSize * i;
+        if (isMapPage(first + i, pageSize)) {
+            initMapPage(page, first + i, first + i + 1, pageSize);
+        } else {
+            initDataPage(page, first + i, pageSize);
+            numData++;
+        }
+    }
+    return numData;
+}
+
+// Marks the data pages among the count pages from first with bucket
+RC RecordBasedFileManager::setFreeSpace(FileHandle &fileHandle,
+                                        PageNum first,
+                                        unsigned count,
+                                        unsigned char bucket)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    for (PageNum page = first; page < first + count; page++) {
+        if (isMapPage(page, pageSize))
+            continue;
+        RC ret = setFreeSpace(fileHandle, page, bucket);
+        if (ret != err::OK)
+            return ret;
+    }
+    return err::OK;
+}
+
+// Appends numPages empty data pages, plus a map page in front of any data
+// page that starts a new map's range. pageNum is set to the first data page.
+// Other handles may append at the same time, so each batch is laid out for
+// where the file ends, and again if it lands elsewhere.
+RC RecordBasedFileManager::appendDataPages(FileHandle &fileHandle,
+                                           unsigned numPages,
+                                           PageNum& pageNum)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer batch(RBFM_IO_BATCH, pageSize);
+    unsigned char empty = freeSpaceBucket(pageSize - sizeof(PageIndex), pageSize);
+    pageNum = 0;
+    while (numPages > 0) {
+        PageNum expected = fileHandle.getNumberOfPages();
+        unsigned count = min(pagesSpanned(expected, numPages, pageSize), (unsigned) RBFM_IO_BATCH);
+        unsigned numData = initPages(batch, expected, count, pageSize);
+
+        PageNum first;
+        RC ret = fileHandle.appendPages(count, batch, first);
+        if (ret != err::OK)
+            return ret;
+        if (first != expected) {
+            numData = initPages(batch, first, count, pageSize);
+            ret = fileHandle.writePages(first, count, batch);
+            if (ret != err::OK)
                 return ret;
         }
+
+        // Now that the pages exist, mark them empty in the map
+        ret = setFreeSpace(fileHandle, first, count, empty);
+        if (ret != err::OK)
+            return ret;
+        if (pageNum == 0 && numData > 0)
+            pageNum = isMapPage(first, pageSize) ? first + 1 : first;
+        numPages -= min(numData, numPages);
     }
     return err::OK;
 }
 
+RC RecordBasedFileManager::updateFreeSpace(FileHandle &fileHandle,
+                                           PageNum pageNum,
+                                           const void* pageData)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    return setFreeSpace(fileHandle, pageNum,
+                        freeSpaceBucket(usableSpaceSize(pageData, pageSize), pageSize));
+}
+
+RC RecordBasedFileManager::setFreeSpace(FileHandle &fileHandle,
+                                        PageNum pageNum,
+                                        unsigned char bucket)
+{
+    PageNum mapPage = mapPageOf(pageNum, fileHandle.getPageSize());
+    PageGuard page;
+    RC ret = page.pin(fileHandle, mapPage);
+    if (ret != err::OK)
+        return ret;
+
+    // Only dirty the map page when the bucket actually changes
+    unsigned slot = pageNum - mapPage - 1;
+    unsigned char old = page.data()[slot];
+    if (old == bucket)
+        return err::OK;
+    page.mutableData()[slot] = bucket;
+
+    // Point the next search at space that was just freed
+    if (bucket > old)
+        fileHandle.setSpaceHint(mapPage);
+    return err::OK;
+}
+
+// Writes a data page back and records its free space in the map
+RC RecordBasedFileManager::writeDataPage(FileHandle &fileHandle,
+                                         PageNum pageNum,
+                                         const void* pageData)
+{
+    RC ret = fileHandle.writePage(pageNum, pageData);
+    if (ret != err::OK)
+        return ret;
+    return updateFreeSpace(fileHandle, pageNum, pageData);
+}
+
 RC RecordBasedFileManager::prepareRecord(const vector<Attribute> &recordDescriptor,
                                          const void* data,
-                                         unsigned*& offsets,
-                                         unsigned& recLength,
-                                         unsigned& offsetFieldsSize)
+                                         vector<char> &record,
+                                         unsigned &flags)
 {
-    offsetFieldsSize = sizeof(unsigned) * recordDescriptor.size();
-    recLength = offsetFieldsSize;
-    unsigned offsetIndex = 0;
+    // Find where each attribute starts in data, and how long the record
+    // is in the compact format
+    vector<unsigned> dataOffsets(recordDescriptor.size());
     unsigned dataOffset = 0;
+    unsigned numFixed = 0;
+    unsigned numVar = 0;
+    unsigned varLength = 0;
+    for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+        unsigned attrSize = Attribute::size(recordDescriptor[i].type, (char *)data + dataOffset);
+        if (attrSize == 0)
+            return err::ATTRIBUTE_INVALID_TYPE;
+        dataOffsets[i] = dataOffset;
+        dataOffset += attrSize;
+        if (recordDescriptor[i].type == TypeVarChar) {
+            numVar++;
+            varLength += attrSize - sizeof(unsigned);
+        } else {
+            numFixed++;
+        }
+    }
 
-    offsets = (unsigned*) malloc(offsetFieldsSize);
+    unsigned recLength = numFixed * sizeof(unsigned) + numVar * sizeof(unsigned short) + varLength;
+    if (recLength > COMPACT_RECORD_MAX) {
+        unsigned offsetFieldsSize = sizeof(unsigned) * recordDescriptor.size();
+        record.resize(offsetFieldsSize + dataOffset);
+        for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+            unsigned offset = offsetFieldsSize + dataOffsets[i];
+            memcpy(record.data() + i * sizeof(unsigned), &offset, sizeof(unsigned));
+        }
+        memcpy(record.data() + offsetFieldsSize, data, dataOffset);
+        flags = 0;
+        return err::OK;
+    }
 
-    // Determine offsets for each field 
-    for (auto it = recordDescriptor.begin(); it != recordDescriptor.end(); ++it) {
-        offsets[offsetIndex++] = recLength;
-        Attribute attr = *it;
-        unsigned attrSize = Attribute::size(attr.type, (char *)data + dataOffset);
-        if (attrSize == 0) {
-            free(offsets);
-            return err::ATTRIBUTE_INVALID_TYPE;
+    record.resize(recLength);
+    char* fixed = record.data();
+    char* ends = fixed + numFixed * sizeof(unsigned);
+    unsigned short varOffset = numFixed * sizeof(unsigned) + numVar * sizeof(unsigned short);
+    for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+        const char* value = (const char*) data + dataOffsets[i];
+        if (recordDescriptor[i].type != TypeVarChar) {
+            memcpy(fixed, value, sizeof(unsigned));
+            fixed += sizeof(unsigned);
+            continue;
         }
-        recLength += attrSize;
-        dataOffset += attrSize;
+        unsigned length;
+        memcpy(&length, value, sizeof(unsigned));
+        memcpy(record.data() + varOffset, value + sizeof(unsigned), length);
+        varOffset += length;
+        memcpy(ends, &varOffset, sizeof(unsigned short));
+        ends += sizeof(unsigned short);
     }
+    flags = ENTRY_COMPACT;
     return err::OK;
 }
 
+void RecordBasedFileManager::locateAttribute(const vector<Attribute> &recordDescriptor,
+                                             const char* record,
+                                             unsigned flags,
+                                             unsigned attrIndex,
+                                             const char*& value,
+                                             unsigned &length)
+{
+    bool isVarChar = recordDescriptor[attrIndex].type == TypeVarChar;
+    if (not (flags & ENTRY_COMPACT)) {
+        unsigned offset;
+        memcpy(&offset, record + attrIndex * sizeof(unsigned), sizeof(unsigned));
+        value = record + offset;
+        length = sizeof(unsigned);
+        if (isVarChar) {
+            memcpy(&length, value, sizeof(unsigned));
+            value += sizeof(unsigned);
+        }
+        return;
+    }
+
+    // Count the fixed-width and varchar attributes, and those of each kind
+    // before this one
+    unsigned numFixed = 0, numVar = 0, fixedBefore = 0, varBefore = 0;
+    for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+        bool var = recordDescriptor[i].type == TypeVarChar;
+        if (i == attrIndex) {
+            fixedBefore = numFixed;
+            varBefore = numVar;
+        }
+        var ? numVar++ : numFixed++;
+    }
+    if (not isVarChar) {
+        value = record + fixedBefore * sizeof(unsigned);
+        length = sizeof(unsigned);
+        return;
+    }
+
+    const char* ends = record + numFixed * sizeof(unsigned);
+    unsigned short start = numFixed * sizeof(unsigned) + numVar * sizeof(unsigned short);
+    unsigned short end;
+    if (varBefore > 0)
+        memcpy(&start, ends + (varBefore - 1) * sizeof(unsigned short), sizeof(unsigned short));
+    memcpy(&end, ends + varBefore * sizeof(unsigned short), sizeof(unsigned short));
+    value = record + start;
+    length = end - start;
+}
+
+unsigned RecordBasedFileManager::copyAttribute(const vector<Attribute> &recordDescriptor,
+                                               const char* record,
+                                               unsigned flags,
+                                               unsigned attrIndex,
+                                               char* dest)
+{
+    const char* value;
+    unsigned length;
+    locateAttribute(recordDescriptor, record, flags, attrIndex, value, length);
+    if (recordDescriptor[attrIndex].type != TypeVarChar) {
+        memcpy(dest, value, length);
+        return length;
+    }
+    memcpy(dest, &length, sizeof(unsigned));
+    memcpy(dest + sizeof(unsigned), value, length);
+    return sizeof(unsigned) + length;
+}
+
+void RecordBasedFileManager::decodeRecord(const vector<Attribute> &recordDescriptor,
+                                          const char* record,
+                                          unsigned recLength,
+                                          unsigned flags,
+                                          void* data)
+{
+    if (not (flags & ENTRY_COMPACT)) {
+        unsigned fieldOffset = recordDescriptor.size() * sizeof(unsigned);
+        memcpy(data, record + fieldOffset, recLength - fieldOffset);
+        return;
+    }
+
+    unsigned numFixed = 0, numVar = 0;
+    for (unsigned i = 0; i < recordDescriptor.size(); i++)
+        recordDescriptor[i].type == TypeVarChar ? numVar++ : numFixed++;
+
+    // Walk the fixed-width attributes, the varchar ends and the varchars
+    // side by side
+    const char* fixed = record;
+    const char* ends = record + numFixed * sizeof(unsigned);
+    unsigned short varOffset = numFixed * sizeof(unsigned) + numVar * sizeof(unsigned short);
+    char* dest = (char*) data;
+    for (unsigned i = 0; i < recordDescriptor.size(); i++) {
+        if (recordDescriptor[i].type != TypeVarChar) {
+            memcpy(dest, fixed, sizeof(unsigned));
+            fixed += sizeof(unsigned);
+            dest += sizeof(unsigned);
+            continue;
+        }
+        unsigned short end;
+        memcpy(&end, ends, sizeof(unsigned short));
+        ends += sizeof(unsigned short);
+        unsigned length = end - varOffset;
+        memcpy(dest, &length, sizeof(unsigned));
+        memcpy(dest + sizeof(unsigned), record + varOffset, length);
+        dest += sizeof(unsigned) + length;
+        varOffset = end;
+    }
+}
+
 RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, 
                                         const vector<Attribute> &recordDescriptor, 
                                         const void* data, 
@@ -188,56 +557,329 @@ RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle,
     // determined by findSpace
     PageNum pageNum;
     RC ret = 0;
-    unsigned offsetFieldsSize = 0;
-    unsigned recLength = 0;
-    unsigned* offsets = NULL;
+    vector<char> record;
+    unsigned flags;
+    ret = prepareRecord(recordDescriptor, data, record, flags);
+    if (ret != err::OK)
+        return ret;
+    vector<char> stored;
+    ret = layoutRecord(fileHandle, record, stored, flags);
+    if (ret != err::OK)
+        return ret;
 
-    prepareRecord(recordDescriptor, data, offsets, recLength, offsetFieldsSize);
-    ret = findSpace(fileHandle, recLength + sizeof(PageIndexEntry), pageNum);
-    if (ret != 0) {
-        free(offsets);
+    ret = findSpace(fileHandle, stored.size() + sizeof(PageIndexEntry), pageNum);
+    if (ret != 0)
         return ret;
-    }
 
     // Read in the page specified by pageNum
-    unsigned char buffer[PAGE_SIZE] = {0};
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
     ret = fileHandle.readPage(pageNum, buffer);
-    if (ret != 0) {
-        free(offsets);
+    if (ret != 0)
         return ret;
-    }
 
-    // Copy the index
-    PageIndex* index = getPageIndex(buffer);
- 
-    // Now we write the record at the start of free memeory
-    memcpy(buffer + index->freeMemoryOffset, offsets, offsetFieldsSize);
-    memcpy(buffer + index->freeMemoryOffset + offsetFieldsSize, data, recLength - offsetFieldsSize);
+    // Store the record, in a slot left by a deleted one if there is any
+    unsigned slotNum = placeRecord(buffer, pageSize, ALIVE, stored.data(), stored.size(), flags);
+
+    // Write page
+    ret = writeDataPage(fileHandle, pageNum, buffer);
+    if (ret != 0)
+        return ret;
+
+    // Once the write is committed, store the RID information and return
+    rid.pageNum = pageNum;
+    rid.slotNum = slotNum;
+
+    return err::OK;
+}
 
-    free(offsets);
+// Stores a record laid out by layoutRecord on the data page in buffer, in
+// its first DEAD slot if it has one, and returns the slot. The page is
+// compacted first if its free space is in pieces; the caller makes sure
+// there is enough of it.
+unsigned RecordBasedFileManager::placeRecord(unsigned char* buffer,
+                                             unsigned pageSize,
+                                             PageIndexEntryType type,
+                                             const char* record,
+                                             unsigned recLength,
+                                             unsigned flags)
+{
+    unsigned slotNum = reserveSlot(buffer, pageSize, type, recLength);
+    PageIndexEntry* entry = getPageIndexEntry(buffer, slotNum, pageSize);
+    entry->flags = flags;
+    memcpy(buffer + entry->recordOffset, record, recLength);
+    return slotNum;
+}
 
-    // Prepare a new index entry to prepend to the list of entries
+// Sets aside recLength bytes and a slot for a record, as placeRecord does,
+// leaving the caller to copy the record in
+unsigned RecordBasedFileManager::reserveSlot(unsigned char* buffer,
+                                             unsigned pageSize,
+                                             PageIndexEntryType type,
+                                             unsigned recLength)
+{
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    unsigned slotNum = min(index->freeSlot, index->numSlots);
+    while (slotNum < index->numSlots && getPageIndexEntry(buffer, slotNum, pageSize)->type != DEAD)
+        slotNum++;
+
+    unsigned needed = recLength;
+    if (slotNum == index->numSlots)
+        needed += sizeof(PageIndexEntry);
+    if (freeSpaceSize(buffer, pageSize) < needed)
+        compactPage(buffer, pageSize);
+
+    // The record goes at the start of free memory
     PageIndexEntry entry;
-    entry.type = ALIVE;
+    entry.type = type;
+    entry.flags = 0;
     entry.recordSize = recLength;
     entry.recordOffset = index->freeMemoryOffset;
-    
-    // Copy index entry to list.
-    writePageIndexEntry(buffer, index->numSlots, &entry); 
+    writePageIndexEntry(buffer, slotNum, &entry, pageSize);
 
-    // Update index information and write it back to page
-    index->numSlots++;
+    if (slotNum == index->numSlots)
+        index->numSlots++;
     index->freeMemoryOffset += recLength;
- 
-    // Write page
-    ret = fileHandle.writePage(pageNum, buffer);
-    if (ret != 0)
+    index->freeSlot = slotNum + 1;
+    return slotNum;
+}
+
+// Marks a slot DEAD, free for the next insert. Free slots at the end of the
+// directory are dropped, giving back the space of their entries.
+void RecordBasedFileManager::releaseSlot(unsigned char* buffer,
+                                         unsigned slotNum,
+                                         unsigned pageSize)
+{
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    PageIndexEntry* entry = getPageIndexEntry(buffer, slotNum, pageSize);
+    entry->recordSize = 0;
+    entry->type = DEAD;
+    entry->flags = 0;
+
+    index->freeSlot = min(index->freeSlot, slotNum);
+    while (index->numSlots > 0 && getPageIndexEntry(buffer, index->numSlots - 1, pageSize)->type == DEAD)
+        index->numSlots--;
+    index->freeSlot = min(index->freeSlot, index->numSlots);
+}
+
+// Slides the records of a data page together at its start, leaving its free
+// space in one piece. Slot numbers do not change.
+void RecordBasedFileManager::compactPage(unsigned char* buffer, unsigned pageSize)
+{
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    PageBuffer compacted(1, pageSize);
+    unsigned offset = 0;
+    for (unsigned slot = 0; slot < index->numSlots; slot++) {
+        PageIndexEntry* entry = getPageIndexEntry(buffer, slot, pageSize);
+        if (entry->type != ALIVE && entry->type != ANCHOR)
+            continue;
+        memcpy(compacted + offset, buffer + entry->recordOffset, entry->recordSize);
+        entry->recordOffset = offset;
+        offset += entry->recordSize;
+    }
+    memcpy(buffer, compacted, offset);
+    index->freeMemoryOffset = offset;
+}
+
+// Lays out a record prepared by prepareRecord as it is stored on a data
+// page. A record too large for a page has all but its head written to
+// overflow pages first, and ENTRY_OVERFLOW is added to flags.
+RC RecordBasedFileManager::layoutRecord(FileHandle &fileHandle,
+                                        vector<char> &record,
+                                        vector<char> &stored,
+                                        unsigned &flags)
+{
+    unsigned recLength = record.size();
+    unsigned pageSize = fileHandle.getPageSize();
+    if (recLength <= maxRecordSize(pageSize)) {
+        stored.swap(record);
+        return err::OK;
+    }
+
+    // The head takes what would only part fill the last overflow page,
+    // unless that is too much to go with the header
+    unsigned head = recLength % OVERFLOW_PAYLOAD(pageSize);
+    if (sizeof(OverflowHeader) + head > maxRecordSize(pageSize))
+        head = 0;
+    OverflowHeader header;
+    header.length = recLength;
+    RC ret = writeOverflow(fileHandle, record.data() + head, recLength - head, header);
+    if (ret != err::OK)
         return ret;
 
-    // Once the write is committed, store the RID information and return
-    rid.pageNum = pageNum;
-    rid.slotNum = index->numSlots - 1;
+    stored.resize(sizeof(OverflowHeader) + head);
+    memcpy(stored.data(), &header, sizeof(OverflowHeader));
+    memcpy(stored.data() + sizeof(OverflowHeader), record.data(), head);
+    flags |= ENTRY_OVERFLOW;
+    return err::OK;
+}
+
+// Number of pages from the first overflow page of a record to its last,
+// map pages in between included
+static unsigned overflowSpan(const OverflowHeader &header, unsigned pageSize)
+{
+    return pagesSpanned(header.firstPage, header.numPages, pageSize);
+}
 
+// Lays out the span pages from first in pages, as the overflow pages
+// holding length bytes from tail and any map pages in between
+void RecordBasedFileManager::initOverflowPages(unsigned char* pages,
+                                               PageNum first,
+                                               unsigned span,
+                                               const char* tail,
+                                               unsigned length,
+                                               OverflowHeader &header,
+                                               unsigned pageSize)
+{
+    unsigned payload = OVERFLOW_PAYLOAD(pageSize);
+    header.firstPage = 0;
+    for (unsigned i = 0; i < span; i++) {
+        unsigned char* page = pages + pageSize * i;
+        if (isMapPage(first + i, pageSize)) {
+            initMapPage(page, first + i, first + i + 1, pageSize);
+            continue;
+        }
+        unsigned bytes = min(length, payload);
+        memset(page, 0, pageSize);
+        memcpy(page, tail, bytes);
+        PageIndex index;
+        index.pageNum = first + i;
+        index.freeMemoryOffset = bytes;
+        index.numSlots = 0;
+        index.freeSlot = OVERFLOW_PAGE;
+        index.lsn = 0;
+        writePageIndex(page, &index, pageSize);
+        if (header.firstPage == 0)
+            header.firstPage = first + i;
+        tail += bytes;
+        length -= bytes;
+    }
+}
+
+// Appends overflow pages holding length bytes from tail, and records where
+// they are in header. They are appended in one piece, so that they read
+// back with a single call.
+RC RecordBasedFileManager::writeOverflow(FileHandle &fileHandle,
+                                         const char* tail,
+                                         unsigned length,
+                                         OverflowHeader &header)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned payload = OVERFLOW_PAYLOAD(pageSize);
+    header.numPages = (length + payload - 1) / payload;
+
+    while (true) {
+        PageNum expected = fileHandle.getNumberOfPages();
+        unsigned span = pagesSpanned(expected, header.numPages, pageSize);
+        PageBuffer pages(span, pageSize);
+        initOverflowPages(pages, expected, span, tail, length, header, pageSize);
+
+        PageNum first;
+        RC ret = fileHandle.appendPages(span, pages, first);
+        if (ret != err::OK)
+            return ret;
+
+        // Another handle appended meanwhile. The pages are laid out again
+        // where they landed, unless the map pages there leave them too few,
+        // in which case they become empty data pages and the record goes
+        // after them.
+        bool placed = first == expected;
+        if (not placed) {
+            placed = pagesSpanned(first, header.numPages, pageSize) == span;
+            if (placed)
+                initOverflowPages(pages, first, span, tail, length, header, pageSize);
+            else
+                initPages(pages, first, span, pageSize);
+            ret = fileHandle.writePages(first, span, pages);
+            if (ret != err::OK)
+                return ret;
+        }
+
+        // Overflow pages never take records. Map entries of pages cut off
+        // by a truncate may still say otherwise.
+        unsigned char bucket = placed ? 0 : freeSpaceBucket(pageSize - sizeof(PageIndex), pageSize);
+        ret = setFreeSpace(fileHandle, first, span, bucket);
+        if (ret != err::OK || placed)
+            return ret;
+    }
+}
+
+// Puts the whole of an overflowed record, whose storedLength bytes on its
+// data page are at stored, together in record. Its overflow pages are read
+// with a single call.
+RC RecordBasedFileManager::readOverflow(FileHandle &fileHandle,
+                                        const char* stored,
+                                        unsigned storedLength,
+                                        vector<char> &record)
+{
+    OverflowHeader header;
+    memcpy(&header, stored, sizeof(OverflowHeader));
+    unsigned head = storedLength - sizeof(OverflowHeader);
+    if (header.length < head)
+        return err::RECORD_CORRUPT;
+    record.resize(header.length);
+    memcpy(record.data(), stored + sizeof(OverflowHeader), head);
+
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned span = overflowSpan(header, pageSize);
+    PageBuffer pages(span, pageSize);
+    RC ret = fileHandle.readPages(header.firstPage, span, pages);
+    if (ret != err::OK)
+        return ret;
+
+    unsigned copied = head;
+    for (unsigned i = 0; i < span && copied < header.length; i++) {
+        if (isMapPage(header.firstPage + i, pageSize))
+            continue;
+        const unsigned char* page = pages + pageSize * i;
+        if (not isOverflowPage(page, pageSize))
+            return err::RECORD_CORRUPT;
+        unsigned bytes = min(header.length - copied, (unsigned) OVERFLOW_PAYLOAD(pageSize));
+        memcpy(record.data() + copied, page, bytes);
+        copied += bytes;
+    }
+    return copied == header.length ? err::OK : err::RECORD_CORRUPT;
+}
+
+// Turns the overflow pages of a record back into empty data pages
+RC RecordBasedFileManager::freeOverflow(FileHandle &fileHandle, const char* stored)
+{
+    OverflowHeader header;
+    memcpy(&header, stored, sizeof(OverflowHeader));
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned span = overflowSpan(header, pageSize);
+    PageBuffer buffer(1, pageSize);
+    for (unsigned i = 0; i < span; i++) {
+        PageNum pageNum = header.firstPage + i;
+        if (isMapPage(pageNum, pageSize))
+            continue;
+        initDataPage(buffer, pageNum, pageSize);
+        RC ret = writeDataPage(fileHandle, pageNum, buffer);
+        if (ret != err::OK)
+            return ret;
+    }
+    return err::OK;
+}
+
+// Points record at the whole of the record in entry, on page: the page
+// itself, unless it overflowed and was read into buffer
+RC RecordBasedFileManager::getRecord(FileHandle &fileHandle,
+                                     const PageIndexEntry* entry,
+                                     const char* page,
+                                     vector<char> &buffer,
+                                     const char*& record,
+                                     unsigned &recLength)
+{
+    if (not (entry->flags & ENTRY_OVERFLOW)) {
+        record = page + entry->recordOffset;
+        recLength = entry->recordSize;
+        return err::OK;
+    }
+    RC ret = readOverflow(fileHandle, page + entry->recordOffset, entry->recordSize, buffer);
+    if (ret != err::OK)
+        return ret;
+    record = buffer.data();
+    recLength = buffer.size();
     return err::OK;
 }
 
@@ -246,32 +888,128 @@ RC RecordBasedFileManager::readRecord(FileHandle &fileHandle,
                                       const RID &rid, 
                                       void* data) 
 {
-    // Read in the page specified by pageNum
-    unsigned char buffer[PAGE_SIZE] = {0};
-    RC ret = fileHandle.readPage(rid.pageNum, buffer);
-    if (ret != 0) 
+    PageGuard page;
+    const PageIndexEntry* entry;
+    RC ret = pinRecord(fileHandle, rid, page, entry);
+    if (ret != err::OK)
         return ret;
 
-    PageIndex* index = getPageIndex(buffer);
-    if (rid.slotNum >= index->numSlots) 
+    vector<char> buffer;
+    const char* record;
+    unsigned recLength;
+    ret = getRecord(fileHandle, entry, page.data(), buffer, record, recLength);
+    if (ret != err::OK)
+        return ret;
+
+    decodeRecord(recordDescriptor, record, recLength, entry->flags, data);
+    return err::OK;
+}
+
+// Pins the page holding the record at rid, following its tombstone if it
+// has one, and points entry at the record's slot. A chain of tombstones,
+// which older versions left when a moved record moved again, is collapsed
+// on the way so that the next access takes a single hop.
+RC RecordBasedFileManager::pinRecord(FileHandle &fileHandle,
+                                     const RID &rid,
+                                     PageGuard &page,
+                                     const PageIndexEntry*& entry)
+{
+    // Free-space map pages hold no records, and have no slot directory to
+    // read one from
+    unsigned pageSize = fileHandle.getPageSize();
+    if (isMapPage(rid.pageNum, pageSize))
         return err::RECORD_DELETED;
 
-    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum);
+    RC ret = page.pin(fileHandle, rid.pageNum);
+    if (ret != err::OK)
+        return ret;
 
-    switch (entry->type)
-    {
-        case ALIVE: 
-        case ANCHOR: 
-            {
-            int fieldOffset = recordDescriptor.size() * sizeof(unsigned);
-            memcpy(data, buffer + entry->recordOffset + fieldOffset, entry->recordSize - fieldOffset);
-            return err::OK;
-            }
-        case DEAD:
-            return err::RECORD_DELETED;
-        case TOMBSTONE:
-            return readRecord(fileHandle, recordDescriptor, entry->tombstoneRID, data);
+    if (rid.slotNum >= getPageIndex(page.data(), pageSize)->numSlots)
+        return err::RECORD_DELETED;
+    entry = getPageIndexEntry(page.data(), rid.slotNum, pageSize);
+
+    // A RID that leads straight to an ANCHOR is stale: the slot was freed
+    // and reused for a record moved here
+    if (entry->type == DEAD || entry->type == ANCHOR)
+        return err::RECORD_DELETED;
+    if (entry->type == ALIVE)
+        return err::OK;
+
+    RID anchor = entry->tombstoneRID;
+    if (isMapPage(anchor.pageNum, pageSize))
+        return err::RECORD_CORRUPT;
+    _tombstoneHops++;
+    ret = page.pin(fileHandle, anchor.pageNum);
+    if (ret != err::OK)
+        return ret;
+    if (anchor.slotNum >= getPageIndex(page.data(), pageSize)->numSlots)
+        return err::RECORD_CORRUPT;
+    entry = getPageIndexEntry(page.data(), anchor.slotNum, pageSize);
+
+    if (entry->type == TOMBSTONE) {
+        page.release();
+        ret = collapseChain(fileHandle, rid, anchor);
+        if (ret != err::OK)
+            return ret;
+        ret = page.pin(fileHandle, anchor.pageNum);
+        if (ret != err::OK)
+            return ret;
+        entry = getPageIndexEntry(page.data(), anchor.slotNum, pageSize);
     }
+    if (entry->type != ANCHOR)
+        return err::RECORD_CORRUPT;
+    return err::OK;
+}
+
+// Points the tombstone at rid, which leads to the tombstone at anchor, at
+// the end of the chain, and frees the tombstones in between. anchor is set
+// to where the record is.
+RC RecordBasedFileManager::collapseChain(FileHandle &fileHandle,
+                                         const RID &rid,
+                                         RID &anchor)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    vector<RID> chain;
+    RID next = anchor;
+    while (true) {
+        for (auto it = chain.begin(); it != chain.end(); ++it) {
+            if (it->pageNum == next.pageNum && it->slotNum == next.slotNum)
+                return err::RECORD_CORRUPT;
+        }
+        if (next.pageNum == rid.pageNum && next.slotNum == rid.slotNum)
+            return err::RECORD_CORRUPT;
+
+        PageGuard page;
+        RC ret = page.pin(fileHandle, next.pageNum);
+        if (ret != err::OK)
+            return ret;
+        if (next.slotNum >= getPageIndex(page.data(), pageSize)->numSlots)
+            return err::RECORD_CORRUPT;
+        const PageIndexEntry* entry = getPageIndexEntry(page.data(), next.slotNum, pageSize);
+        if (entry->type == ANCHOR)
+            break;
+        if (entry->type != TOMBSTONE)
+            return err::RECORD_CORRUPT;
+        chain.push_back(next);
+        next = entry->tombstoneRID;
+        _tombstoneHops++;
+    }
+
+    RC ret = setTombstone(fileHandle, rid, next);
+    if (ret != err::OK)
+        return ret;
+    PageBuffer buffer(1, pageSize);
+    for (auto it = chain.begin(); it != chain.end(); ++it) {
+        ret = fileHandle.readPage(it->pageNum, buffer);
+        if (ret != err::OK)
+            return ret;
+        releaseSlot(buffer, it->slotNum, pageSize);
+        ret = writeDataPage(fileHandle, it->pageNum, buffer);
+        if (ret != err::OK)
+            return ret;
+    }
+    anchor = next;
+    return err::OK;
 }
 
 RC RecordBasedFileManager::deleteRID(FileHandle& fileHandle,
@@ -289,28 +1027,31 @@ RC RecordBasedFileManager::deleteRID(FileHandle& fileHandle,
         //entry->recordSize = 0;
         //entry->type = DEAD;
     //}
-    entry->recordSize = 0;
-    entry->type = DEAD;
-    return fileHandle.writePage(rid.pageNum, buffer);
+    // Overflow pages are freed once nothing points at them
+    vector<char> stored;
+    if (entry->flags & ENTRY_OVERFLOW)
+        stored.assign(buffer + entry->recordOffset, buffer + entry->recordOffset + entry->recordSize);
+    releaseSlot(buffer, rid.slotNum, fileHandle.getPageSize());
+    RC ret = writeDataPage(fileHandle, rid.pageNum, buffer);
+    if (ret != err::OK || stored.empty())
+        return ret;
+    return freeOverflow(fileHandle, stored.data());
 }
 
 RC RecordBasedFileManager::deleteRecords(FileHandle &fileHandle) 
 {
-    // Iterate over pages in file and replace each page
-    // with an empty page
-    unsigned char buffer[PAGE_SIZE] = {0};
-    PageIndex* index = getPageIndex(buffer);
-    index->freeMemoryOffset = 0;
-    index->numSlots = 0;
-    unsigned numPages = fileHandle.getNumberOfPages();
-    RC ret = 0;
-    for (unsigned pageNum = 0; pageNum < numPages; pageNum++) {
-        index->pageNum = pageNum;
-        ret = fileHandle.writePage(pageNum, buffer);
-        if (ret != 0)
-            return ret;
-    }
-    return err::OK;
+    // Cut the file back to what createFile leaves: the map page and one
+    // empty data page. This takes the same time however large the file is.
+    unsigned pageSize = fileHandle.getPageSize();
+    RC ret = fileHandle.truncate(2);
+    if (ret != err::OK)
+        return ret;
+    fileHandle.setSpaceHint(NO_PAGE);
+
+    PageBuffer buffer(2, pageSize);
+    initMapPage(buffer, 0, 2, pageSize);
+    initDataPage(buffer + pageSize, 1, pageSize);
+    return fileHandle.writePages(0, 2, buffer);
 }
 
 
@@ -318,13 +1059,29 @@ RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle,
                                         const vector<Attribute> &recordDescriptor, 
                                         const RID &rid)
 {
-    unsigned char buffer[PAGE_SIZE] = {0};
+    return deleteRecord(fileHandle, recordDescriptor, rid, false);
+}
+
+RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle, 
+                                        const vector<Attribute> &recordDescriptor, 
+                                        const RID &rid,
+                                        bool forwarded)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    if (isMapPage(rid.pageNum, pageSize))
+        return forwarded ? err::RECORD_CORRUPT : err::RECORD_DELETED;
+
+    PageBuffer buffer(1, pageSize);
     RC ret = fileHandle.readPage(rid.pageNum, buffer);
     if (ret != err::OK)
         return ret;
 
-    PageIndex* index = getPageIndex(buffer);
-    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum);
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    if (rid.slotNum >= index->numSlots) 
+        return err::RECORD_DELETED;
+    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum, pageSize);
+    if (entry->type == ANCHOR && not forwarded)
+        return err::RECORD_DELETED;
 
     switch (entry->type)
     {
@@ -336,9 +1093,21 @@ RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle,
             return err::RECORD_DELETED;
         case TOMBSTONE:
             // recursively delete tombstones
-            ret = deleteRecord(fileHandle, recordDescriptor, entry->tombstoneRID);
+            _tombstoneHops++;
+            RID anchor = entry->tombstoneRID;
+            ret = deleteRecord(fileHandle, recordDescriptor, anchor, true);
             if (ret != err::OK) 
                 return ret;
+
+            // Freeing an anchor on this page wrote the page, so the copy
+            // read above is stale
+            if (anchor.pageNum == rid.pageNum) {
+                ret = fileHandle.readPage(rid.pageNum, buffer);
+                if (ret != err::OK)
+                    return ret;
+                index = getPageIndex(buffer, pageSize);
+                entry = getPageIndexEntry(buffer, rid.slotNum, pageSize);
+            }
             return deleteRID(fileHandle, index, entry, buffer, rid);
             
     }
@@ -351,103 +1120,172 @@ RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle,
                 const void* data, 
                 const RID &rid)
 {
-    RC ret = 0;
-    unsigned offsetFieldsSize = 0;
-    unsigned recLength = 0;
-    unsigned* offsets = NULL;
+    return updateRecord(fileHandle, recordDescriptor, data, rid, NULL);
+}
 
-    prepareRecord(recordDescriptor, data, offsets, recLength, offsetFieldsSize);
-    
+RC RecordBasedFileManager::updateRecord(FileHandle &fileHandle, 
+                const vector<Attribute> &recordDescriptor,
+                const void* data, 
+                const RID &rid,
+                const RID* tombstone)
+{
     // Read in the page specified by the RID
-    unsigned char buffer[PAGE_SIZE] = {0};
-    ret = fileHandle.readPage(rid.pageNum, buffer);
+    unsigned pageSize = fileHandle.getPageSize();
+    if (isMapPage(rid.pageNum, pageSize))
+        return err::RECORD_DELETED;
+    PageBuffer buffer(1, pageSize);
+    RC ret = fileHandle.readPage(rid.pageNum, buffer);
     if (ret != 0) 
         return ret;
 
-    PageIndex* index = getPageIndex(buffer);
+    PageIndex* index = getPageIndex(buffer, pageSize);
     if (rid.slotNum >= index->numSlots) 
         return err::RECORD_DELETED;
 
-    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum);
+    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum, pageSize);
 
     // First off, check to make sure that the record is not dead
-    if (entry->type == DEAD)
+    if (entry->type == DEAD || (entry->type == ANCHOR && tombstone == NULL))
         return err::RECORD_DELETED;
 
     // Next, check if it is a tombstone. If so, make recursive call
-    if (entry->type == TOMBSTONE)
-        return updateRecord(fileHandle, recordDescriptor, data, entry->tombstoneRID);
-
-    // Otherwise, check if we can update in place
-    if (rid.slotNum == index->numSlots - 1) {
-        // If this is the last record, and there is enough freespace to keep the updated record
-        // in the page, then we do so
-        unsigned freespace = freeSpaceSize(buffer);
-        if (recLength - entry->recordSize <= freespace) {
-            entry->recordSize = recLength;
-            index->freeMemoryOffset = entry->recordOffset + entry->recordSize;
-            memcpy(buffer + entry->recordOffset, offsets, offsetFieldsSize);
-            memcpy(buffer + entry->recordOffset + offsetFieldsSize, data, recLength - offsetFieldsSize);
-            return fileHandle.writePage(rid.pageNum, buffer);
-        }
-    } 
+    if (entry->type == TOMBSTONE) {
+        _tombstoneHops++;
+        if (tombstone == NULL)
+            return updateRecord(fileHandle, recordDescriptor, data, entry->tombstoneRID, &rid);
+
+        // A chain left by an older version is collapsed first, so that the
+        // record is updated where its first tombstone points
+        RID anchor = rid;
+        ret = collapseChain(fileHandle, *tombstone, anchor);
+        if (ret != err::OK)
+            return ret;
+        return updateRecord(fileHandle, recordDescriptor, data, anchor, tombstone);
+    }
+
+    vector<char> record;
+    unsigned flags;
+    ret = prepareRecord(recordDescriptor, data, record, flags);
+    if (ret != err::OK)
+        return ret;
+    vector<char> stored;
+    ret = layoutRecord(fileHandle, record, stored, flags);
+    if (ret != err::OK)
+        return ret;
+    unsigned recLength = stored.size();
+
+    // The overflow pages of the old version go once the new one is in
+    vector<char> oldStored;
+    if (entry->flags & ENTRY_OVERFLOW)
+        oldStored.assign(buffer + entry->recordOffset, buffer + entry->recordOffset + entry->recordSize);
 
-    // In this case, it is not the last record, but if it is small enough we can use the same location
     if (recLength <= entry->recordSize) {
+        // If it is small enough we can use the same location
+        entry->recordSize = recLength;
+        entry->flags = flags;
+        memcpy(buffer + entry->recordOffset, stored.data(), recLength);
+        ret = writeDataPage(fileHandle, rid.pageNum, buffer);
+    } else if (recLength <= entry->recordSize + usableSpaceSize(buffer, pageSize)) {
+        // Otherwise the record stays on its page if the page has room for
+        // it once compacted, its old copy left out
+        entry->recordSize = 0;
+        if (freeSpaceSize(buffer, pageSize) < recLength)
+            compactPage(buffer, pageSize);
         entry->recordSize = recLength;
-        memcpy(buffer + entry->recordOffset, offsets, offsetFieldsSize);
-        memcpy(buffer + entry->recordOffset + offsetFieldsSize, data, recLength - offsetFieldsSize);
-        return fileHandle.writePage(rid.pageNum, buffer);
+        entry->recordOffset = index->freeMemoryOffset;
+        entry->flags = flags;
+        index->freeMemoryOffset += recLength;
+        memcpy(buffer + entry->recordOffset, stored.data(), recLength);
+        ret = writeDataPage(fileHandle, rid.pageNum, buffer);
+    } else {
+        // There is no way to update in place, so we must store updated
+        // record in new page and leave a tombstone
+        ret = moveRecord(fileHandle, rid, tombstone, buffer, stored, flags);
     }
-    // There is no way to update in place, so we must store updated record in new page and
-    // leave a tombstone
+
+    if (ret == err::OK && not oldStored.empty())
+        ret = freeOverflow(fileHandle, oldStored.data());
+    return ret;
+}
+
+// Moves the record at rid, whose page is in buffer, to another page as the
+// anchor of a tombstone. tombstone is the RID that led to rid, if any.
+RC RecordBasedFileManager::moveRecord(FileHandle &fileHandle,
+                                      const RID &rid,
+                                      const RID* tombstone,
+                                      unsigned char* buffer,
+                                      const vector<char> &stored,
+                                      unsigned flags)
+{
+    unsigned pageSize = fileHandle.getPageSize();
     PageNum pageNum;
-    unsigned char newBuffer[PAGE_SIZE] = {0};
-    ret = findSpace(fileHandle, recLength + sizeof(PageIndexEntry), pageNum);
-    if (ret != 0) {
-        free(offsets);
+    RC ret = findSpace(fileHandle, stored.size() + sizeof(PageIndexEntry), pageNum);
+    if (ret != 0)
         return ret;
-    }
 
     // Read in the page specified by pageNum
+    PageBuffer newBuffer(1, pageSize);
     ret = fileHandle.readPage(pageNum, newBuffer);
-    if (ret != 0) {
-        free(offsets);
-        return ret;
-    }
-
-    // Copy the index
-    PageIndex* newIndex = getPageIndex(newBuffer);
- 
-    // Now we write the record at the start of free memeory
-    memcpy(newBuffer + newIndex->freeMemoryOffset, offsets, offsetFieldsSize);
-    memcpy(newBuffer + newIndex->freeMemoryOffset + offsetFieldsSize, data, recLength - offsetFieldsSize);
-    free(offsets);
-
-    // Prepare a new index entry to prepend to the list of entries
-    PageIndexEntry newEntry;
-    newEntry.type = ANCHOR;
-    newEntry.recordSize = recLength;
-    newEntry.recordOffset = newIndex->freeMemoryOffset;
-    
-    // Copy index entry to list.
-    writePageIndexEntry(newBuffer, newIndex->numSlots, &newEntry); 
-
-    // Update index information and write it back to page
-    newIndex->numSlots++;
-    newIndex->freeMemoryOffset += recLength;
- 
+    if (ret != 0)
+        return ret;
+
+    // Store the record there as an anchor for the tombstone
+    unsigned slotNum = placeRecord(newBuffer, pageSize, ANCHOR, stored.data(), stored.size(), flags);
+
     // Write page
-    ret = fileHandle.writePage(pageNum, newBuffer);
+    ret = writeDataPage(fileHandle, pageNum, newBuffer);
     if (ret != 0)
         return ret;
 
+    // An anchor that has to move again is freed, and its tombstone pointed
+    // at the new copy, so a record is never more than one hop from its RID
+    if (tombstone != NULL) {
+        RID anchor;
+        anchor.pageNum = pageNum;
+        anchor.slotNum = slotNum;
+
+        // A tombstone on the anchor's own page is changed in buffer, which
+        // is written last and would undo a change made on disk
+        if (tombstone->pageNum == rid.pageNum) {
+            PageIndexEntry* entry = getPageIndexEntry(buffer, tombstone->slotNum, pageSize);
+            if (entry->type != TOMBSTONE)
+                return err::RECORD_CORRUPT;
+            entry->tombstoneRID = anchor;
+        } else {
+            ret = setTombstone(fileHandle, *tombstone, anchor);
+            if (ret != err::OK)
+                return ret;
+        }
+        releaseSlot(buffer, rid.slotNum, pageSize);
+        return writeDataPage(fileHandle, rid.pageNum, buffer);
+    }
+
     // After writing, update entry to be a tombstone
+    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum, pageSize);
     entry->type = TOMBSTONE;
+    entry->flags = 0;
     entry->tombstoneRID.pageNum = pageNum;
-    entry->tombstoneRID.slotNum = newIndex->numSlots - 1;
+    entry->tombstoneRID.slotNum = slotNum;
 
-    return fileHandle.writePage(rid.pageNum, buffer);
+    return writeDataPage(fileHandle, rid.pageNum, buffer);
+}
+
+// Points the tombstone at rid to a record's new anchor
+RC RecordBasedFileManager::setTombstone(FileHandle &fileHandle,
+                                        const RID &rid,
+                                        const RID &anchor)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
+    RC ret = fileHandle.readPage(rid.pageNum, buffer);
+    if (ret != err::OK)
+        return ret;
+
+    PageIndexEntry* entry = getPageIndexEntry(buffer, rid.slotNum, pageSize);
+    if (entry->type != TOMBSTONE)
+        return err::RECORD_CORRUPT;
+    entry->tombstoneRID = anchor;
+    return writeDataPage(fileHandle, rid.pageNum, buffer);
 }
 
 RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle, 
@@ -456,53 +1294,44 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle,
                  const string &attributeName, 
                  void* data)
 {
-    // Pull the page into memory - O(1)
-    unsigned char buffer[PAGE_SIZE] = {0};
-    RC ret = fileHandle.readPage(rid.pageNum, buffer);
+    // Pin the page holding the record, one hop away at most
+    PageGuard page;
+    const PageIndexEntry* indexEntry;
+    RC ret = pinRecord(fileHandle, rid, page, indexEntry);
     if (ret != err::OK)
     {
         return ret;
     }
 
     // Find the attribute index sought after by the caller
-    int attrIndex = 0; 
-    Attribute attr;
+    unsigned attrIndex = 0; 
     for (vector<Attribute>::const_iterator itr = recordDescriptor.begin(); itr != recordDescriptor.end(); itr++)
     {
         if (itr->name == attributeName)
         {
-            attr = *itr;
             break;
         }
         attrIndex++;
     }
+    if (attrIndex == recordDescriptor.size())
+    {
+        return err::ATTRIBUTE_NOT_FOUND;
+    }
 
-    PageIndexEntry* indexEntry = (PageIndexEntry*)(buffer + PAGE_SIZE - sizeof(PageIndex) - ((rid.slotNum + 1) * sizeof(PageIndexEntry)));
-
-    unsigned char* recBuffer = (unsigned char*)malloc(indexEntry->recordSize);
-    memcpy(recBuffer, buffer + indexEntry->recordOffset, indexEntry->recordSize);
-
-    // Determine the offset of the attribute sought after
-    unsigned offset = 0;
-    memcpy(&offset, recBuffer + (attrIndex * sizeof(unsigned)), sizeof(unsigned));
-
-    // Now read the data into the caller's buffer
-    switch (attr.type)
+    // The record is read in place, straight out of the pinned frame,
+    // unless it overflowed
+    vector<char> buffer;
+    const char* recBuffer;
+    unsigned recLength;
+    ret = getRecord(fileHandle, indexEntry, page.data(), buffer, recBuffer, recLength);
+    if (ret != err::OK)
     {
-        case TypeInt:
-        case TypeReal:
-            memcpy(data, recBuffer + offset, sizeof(unsigned));
-            break;
-        case TypeVarChar:
-            int dataLen = 0;
-            memcpy(&dataLen, recBuffer + offset, sizeof(unsigned));
-            memcpy(data, &dataLen, sizeof(unsigned));
-            memcpy((char*)data + sizeof(unsigned), recBuffer + offset + sizeof(unsigned), dataLen);
-            break;
+        return ret;
     }
 
-    // Free up the memory
-    free(recBuffer);
+    // Now read the data into the caller's buffer
+    copyAttribute(recordDescriptor, recBuffer, indexEntry->flags, attrIndex, (char*)data);
+
     return err::OK;
 }
 
@@ -510,69 +1339,23 @@ RC RecordBasedFileManager::reorganizePage(FileHandle &fileHandle,
                                           const vector<Attribute> &recordDescriptor, 
                                           const unsigned pageNumber)
 {
-    unsigned char buffer[PAGE_SIZE] = {0};
+    // Free-space map pages hold no records
+    unsigned pageSize = fileHandle.getPageSize();
+    if (isMapPage(pageNumber, pageSize))
+        return err::PAGE_CANNOT_BE_ORGANIZED;
+
+    PageBuffer buffer(1, pageSize);
     RC ret = fileHandle.readPage(pageNumber, buffer);
     if (ret != err::OK)
         return ret;
 
-    if (pageNumber == 3) {
-        ret = 0;
-    }
-
     // Get index to determine number of slots
-    PageIndex* index = getPageIndex(buffer);
-    PageIndex newIndex;
-    newIndex.numSlots = index->numSlots;
-    newIndex.pageNum = index->pageNum;
-    newIndex.freeMemoryOffset = index->freeMemoryOffset;
-
+    PageIndex* index = getPageIndex(buffer, pageSize);
     if (index->numSlots == 0)
         return err::OK; // Should this be an error?
 
-    // indexEntryList[i] = i^th from the last PageIndexEntry (0^th from last is last)
-    PageIndexEntry* indexEntryList = new PageIndexEntry[index->numSlots];
-    unsigned offset = PAGE_SIZE - sizeof(PageIndex) - (index->numSlots * sizeof(PageIndexEntry));
-    memcpy(indexEntryList, buffer + offset, index->numSlots * sizeof(PageIndexEntry));
- 
-    // Find first ALIVE index entry
-    int entryIndex;
-    for (entryIndex = index->numSlots - 1; entryIndex >= 0; entryIndex--) {
-        if (indexEntryList[entryIndex].type == ALIVE || indexEntryList[entryIndex].type == ANCHOR)
-            break;
-    }
-
-    if (entryIndex == -1) {
-        // All index entries are tombstones or dead.
-        // Therefore, we can reset the freeMemoryOffset to 0, all relevant info
-        // on the page is contained within the slot entry.
-        index->freeMemoryOffset = 0;
-        return fileHandle.writePage(pageNumber, buffer);
-    }
-
-    unsigned char newBuffer[PAGE_SIZE] = {0};
-    offset = 0;
-    for ( ; ; ) {
-        // Copy old record, update its recordOffset
-        memcpy(newBuffer + offset, buffer + indexEntryList[entryIndex].recordOffset, indexEntryList[entryIndex].recordSize);
-        indexEntryList[entryIndex].recordOffset = offset;
-        offset += indexEntryList[entryIndex].recordSize;
-        entryIndex -= 1;
-        while (entryIndex >= 0) {
-            if (indexEntryList[entryIndex].type == ALIVE || indexEntryList[entryIndex].type == ANCHOR)
-                break;
-            entryIndex -= 1;
-        }
-        if (entryIndex == -1)
-            break;
-    }
-    // Update freeMemoryOffset for new page
-    newIndex.freeMemoryOffset = offset;
-    writePageIndex(newBuffer, &newIndex);
-    // Copy the updated PageIndexEntry's to new page
-    offset = PAGE_SIZE - sizeof(PageIndex) - (newIndex.numSlots * sizeof(PageIndexEntry));
-    memcpy(newBuffer + offset, indexEntryList, newIndex.numSlots * sizeof(PageIndexEntry));
-    // Finally, write the compacted page to disk
-    return fileHandle.writePage(pageNumber, newBuffer);
+    compactPage(buffer, pageSize);
+    return writeDataPage(fileHandle, pageNumber, buffer);
 }
 
 // scan returns an iterator to allow the caller to go through the results one by one. 
@@ -590,8 +1373,325 @@ RC RecordBasedFileManager::scan(FileHandle &fileHandle,
 RC RecordBasedFileManager::reorganizeFile(FileHandle &fileHandle, 
                                           const vector<Attribute> &recordDescriptor) 
 {
-    return -1;
+    ReorganizeCursor cursor;
+    vector<RIDMove> moves;
+    while (not cursor.done()) {
+        moves.clear();
+        RC ret = reorganizeFile(fileHandle, recordDescriptor, cursor, RBFM_REORGANIZE_BATCH, moves);
+        if (ret != err::OK)
+            return ret;
+    }
+    return err::OK;
+}
+
+// Turns moves from first on into one move per record, from the RID it had
+// before the batch to the one it ends up with
+static void foldMoves(vector<RIDMove> &moves, size_t first)
+{
+    map<pair<unsigned, unsigned>, size_t> movedTo;
+    vector<RIDMove> folded;
+    for (size_t i = first; i < moves.size(); i++) {
+        const RIDMove &move = moves[i];
+        auto it = movedTo.find(make_pair(move.from.pageNum, move.from.slotNum));
+        size_t pos = folded.size();
+        if (it != movedTo.end()) {
+            pos = it->second;
+            folded[pos].to = move.to;
+            movedTo.erase(it);
+        } else {
+            folded.push_back(move);
+        }
+        movedTo[make_pair(move.to.pageNum, move.to.slotNum)] = pos;
+    }
+    moves.resize(first);
+    moves.insert(moves.end(), folded.begin(), folded.end());
+}
+
+RC RecordBasedFileManager::reorganizeFile(FileHandle &fileHandle,
+                                          const vector<Attribute> &recordDescriptor,
+                                          ReorganizeCursor &cursor,
+                                          unsigned numPages,
+                                          vector<RIDMove> &moves)
+{
+    RC ret = err::OK;
+    unsigned pageSize = fileHandle.getPageSize();
+    size_t first = moves.size();
+    while (numPages > 0 && not cursor.done()) {
+        PageNum pageCount = fileHandle.getNumberOfPages();
+        if (cursor.phase == ReorganizeCursor::COLLAPSE) {
+            // Bring records back to the page of their RID, or failing that
+            // give them the RID of where they are
+            if (cursor.pageNum >= pageCount) {
+                cursor.phase = ReorganizeCursor::PACK;
+                cursor.pageNum = pageCount - 1;
+                continue;
+            }
+            if (not isMapPage(cursor.pageNum, pageSize)) {
+                ret = collapsePage(fileHandle, cursor.pageNum, moves);
+                if (ret != err::OK)
+                    break;
+                numPages--;
+            }
+            cursor.pageNum++;
+            continue;
+        }
+
+        // Empty the last pages into the free space of earlier ones, until
+        // a page cannot be emptied. The first data page, with nowhere to
+        // empty into, still has its records take its lowest slots.
+        bool emptied = true;
+        if (not isMapPage(cursor.pageNum, pageSize)) {
+            ret = packPage(fileHandle, cursor.pageNum, moves, emptied);
+            if (ret != err::OK)
+                break;
+            numPages--;
+        }
+        if (emptied && cursor.pageNum > 1)
+            cursor.pageNum--;
+        else
+            cursor.phase = ReorganizeCursor::DONE;
+    }
+    foldMoves(moves, first);
+    if (ret != err::OK)
+        return ret;
+
+    // Give the pages emptied so far back to the file system
+    if (cursor.phase != ReorganizeCursor::COLLAPSE) {
+        ret = truncateEmptyPages(fileHandle);
+        if (ret != err::OK)
+            return ret;
+        cursor.pageNum = min(cursor.pageNum, fileHandle.getNumberOfPages() - 1);
+    }
+    return err::OK;
+}
+
+// Resolves the tombstones on a page. A record whose tombstone's page has
+// room for it again is moved back there; any other stays where it is and
+// takes the RID of its anchor.
+RC RecordBasedFileManager::collapsePage(FileHandle &fileHandle,
+                                        PageNum pageNum,
+                                        vector<RIDMove> &moves)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
+    RC ret = fileHandle.readPage(pageNum, buffer);
+    if (ret != err::OK)
+        return ret;
+
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    bool dirty = false;
+    for (unsigned slot = 0; slot < index->numSlots; slot++) {
+        PageIndexEntry* entry = getPageIndexEntry(buffer, slot, pageSize);
+        if (entry->type != TOMBSTONE)
+            continue;
+        RID rid = { pageNum, slot };
+        RID anchor = entry->tombstoneRID;
+
+        // An anchor on the same page just takes over the tombstone's slot
+        if (anchor.pageNum == pageNum) {
+            PageIndexEntry* anchorEntry = getPageIndexEntry(buffer, anchor.slotNum, pageSize);
+            if (anchor.slotNum >= index->numSlots || anchorEntry->type != ANCHOR)
+                continue;
+            entry->type = ALIVE;
+            entry->flags = anchorEntry->flags;
+            entry->recordSize = anchorEntry->recordSize;
+            entry->recordOffset = anchorEntry->recordOffset;
+            releaseSlot(buffer, anchor.slotNum, pageSize);
+            dirty = true;
+            continue;
+        }
+
+        PageBuffer anchorBuffer(1, pageSize);
+        ret = fileHandle.readPage(anchor.pageNum, anchorBuffer);
+        if (ret != err::OK)
+            return ret;
+        // Tombstones chained by older versions are left alone
+        const PageIndex* anchorIndex = getPageIndex(anchorBuffer, pageSize);
+        PageIndexEntry* anchorEntry = getPageIndexEntry(anchorBuffer, anchor.slotNum, pageSize);
+        if (anchor.slotNum >= anchorIndex->numSlots || anchorEntry->type != ANCHOR)
+            continue;
+
+        unsigned recordSize = anchorEntry->recordSize;
+        if (recordSize <= usableSpaceSize(buffer, pageSize)) {
+            if (freeSpaceSize(buffer, pageSize) < recordSize)
+                compactPage(buffer, pageSize);
+            entry->type = ALIVE;
+            entry->flags = anchorEntry->flags;
+            entry->recordSize = recordSize;
+            entry->recordOffset = index->freeMemoryOffset;
+            memcpy(buffer + index->freeMemoryOffset, anchorBuffer + anchorEntry->recordOffset, recordSize);
+            index->freeMemoryOffset += recordSize;
+
+            // The record is home before the anchor goes
+            ret = writeDataPage(fileHandle, pageNum, buffer);
+            if (ret != err::OK)
+                return ret;
+            releaseSlot(anchorBuffer, anchor.slotNum, pageSize);
+            ret = writeDataPage(fileHandle, anchor.pageNum, anchorBuffer);
+        } else {
+            // The anchor is made a record of its own before the tombstone goes
+            anchorEntry->type = ALIVE;
+            ret = writeDataPage(fileHandle, anchor.pageNum, anchorBuffer);
+            if (ret != err::OK)
+                return ret;
+            releaseSlot(buffer, slot, pageSize);
+            ret = writeDataPage(fileHandle, pageNum, buffer);
+            RIDMove move = { rid, anchor };
+            moves.push_back(move);
+        }
+        if (ret != err::OK)
+            return ret;
+        dirty = false;
+    }
+    if (dirty)
+        return writeDataPage(fileHandle, pageNum, buffer);
+    return err::OK;
+}
+
+// Moves the records on a page to earlier pages with room for them. emptied
+// is set if that left the page without any, as it is for an overflow page;
+// an anchor, which only its tombstone can move, or a record with no room
+// for it keeps it from that. Records that stay take the lowest free slots
+// of the page instead, which shrinks its directory.
+RC RecordBasedFileManager::packPage(FileHandle &fileHandle,
+                                    PageNum pageNum,
+                                    vector<RIDMove> &moves,
+                                    bool &emptied)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    PageBuffer buffer(1, pageSize);
+    RC ret = fileHandle.readPage(pageNum, buffer);
+    if (ret != err::OK)
+        return ret;
+
+    PageIndex* index = getPageIndex(buffer, pageSize);
+    bool dirty = false;
+    for (unsigned slot = 0; slot < index->numSlots && ret == err::OK; slot++) {
+        PageIndexEntry* entry = getPageIndexEntry(buffer, slot, pageSize);
+        RID rid = { pageNum, slot };
+        if (entry->type == DEAD || entry->type == ANCHOR)
+            continue;
+
+        if (entry->type == TOMBSTONE) {
+            // A tombstone made since the collapse: its anchor takes the RID
+            RID anchor = entry->tombstoneRID;
+            if (anchor.pageNum == pageNum)
+                continue;
+            PageBuffer anchorBuffer(1, pageSize);
+            ret = fileHandle.readPage(anchor.pageNum, anchorBuffer);
+            if (ret != err::OK)
+                break;
+            const PageIndex* anchorIndex = getPageIndex(anchorBuffer, pageSize);
+            PageIndexEntry* anchorEntry = getPageIndexEntry(anchorBuffer, anchor.slotNum, pageSize);
+            if (anchor.slotNum >= anchorIndex->numSlots || anchorEntry->type != ANCHOR)
+                continue;
+            anchorEntry->type = ALIVE;
+            ret = writeDataPage(fileHandle, anchor.pageNum, anchorBuffer);
+            if (ret != err::OK)
+                break;
+            releaseSlot(buffer, slot, pageSize);
+            dirty = true;
+            RIDMove move = { rid, anchor };
+            moves.push_back(move);
+            continue;
+        }
 
+        PageNum destPage;
+        ret = findSpaceBelow(fileHandle, pageNum, entry->recordSize + sizeof(PageIndexEntry), destPage);
+        if (ret != err::OK)
+            break;
+        if (destPage == 0) {
+            // The record stays, in the first free slot before its own
+            unsigned destSlot = min(index->freeSlot, slot);
+            while (destSlot < slot && getPageIndexEntry(buffer, destSlot, pageSize)->type != DEAD)
+                destSlot++;
+            if (destSlot == slot)
+                continue;
+            writePageIndexEntry(buffer, destSlot, entry, pageSize);
+            index->freeSlot = destSlot + 1;
+            releaseSlot(buffer, slot, pageSize);
+            dirty = true;
+            RIDMove move = { rid, { pageNum, destSlot } };
+            moves.push_back(move);
+            continue;
+        }
+
+        PageBuffer destBuffer(1, pageSize);
+        ret = fileHandle.readPage(destPage, destBuffer);
+        if (ret != err::OK)
+            break;
+        unsigned destSlot = placeRecord(destBuffer, pageSize, ALIVE, (const char*) (buffer + entry->recordOffset),
+                                        entry->recordSize, entry->flags);
+        ret = writeDataPage(fileHandle, destPage, destBuffer);
+        if (ret != err::OK)
+            break;
+        releaseSlot(buffer, slot, pageSize);
+        dirty = true;
+        RIDMove move = { rid, { destPage, destSlot } };
+        moves.push_back(move);
+    }
+
+    // The copies are written before the page that loses the records
+    if (dirty) {
+        RC writeRet = writeDataPage(fileHandle, pageNum, buffer);
+        if (ret == err::OK)
+            ret = writeRet;
+    }
+    emptied = index->numSlots == 0;
+    return ret;
+}
+
+// Stores in pageNum a data page before limit with room for numbytes, or 0
+// if there is none
+RC RecordBasedFileManager::findSpaceBelow(FileHandle &fileHandle,
+                                          PageNum limit,
+                                          unsigned numbytes,
+                                          PageNum& pageNum)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned bucketSize = FSM_BUCKET_SIZE(pageSize);
+    unsigned needed = max(1u, (numbytes + bucketSize - 1) / bucketSize);
+    pageNum = 0;
+    if (needed > FSM_MAX_BUCKET)
+        return err::OK;
+    for (PageNum mapPage = 0; mapPage < limit; mapPage += FSM_PAGES_PER_MAP(pageSize) + 1) {
+        RC ret = searchMap(fileHandle, mapPage, needed, pageNum);
+        if (ret != err::OK)
+            return ret;
+        if (pageNum != 0) {
+            if (pageNum >= limit)
+                pageNum = 0;
+            return err::OK;
+        }
+    }
+    return err::OK;
+}
+
+// Cuts off the empty data pages, and the map pages among them, at the end
+// of the file, up to the last page holding a record or part of one. The pages stay while other handles are open on the file.
+RC RecordBasedFileManager::truncateEmptyPages(FileHandle &fileHandle)
+{
+    unsigned pageSize = fileHandle.getPageSize();
+    unsigned pageCount = fileHandle.getNumberOfPages();
+    unsigned numPages = pageCount;
+    while (numPages > 2) {
+        if (not isMapPage(numPages - 1, pageSize)) {
+            PageGuard page;
+            RC ret = page.pin(fileHandle, numPages - 1);
+            if (ret != err::OK)
+                return ret;
+            if (getPageIndex(page.data(), pageSize)->numSlots > 0 || isOverflowPage(page.data(), pageSize))
+                break;
+        }
+        numPages--;
+    }
+    if (numPages == pageCount)
+        return err::OK;
+
+    RC ret = fileHandle.truncate(numPages);
+    if (ret == err::FILE_IN_USE)
+        return err::OK;
+    return ret;
 }
 
 RC RecordBasedFileManager::printRecord(const vector<Attribute> &recordDescriptor, 
@@ -661,6 +1761,9 @@ unsigned Attribute::size(AttrType type, const void* value)
 
 RC RBFM_ScanIterator::close()
 {
+     _page.release();
+     if (_fileHandle)
+         _fileHandle->advise(ACCESS_NORMAL);
      free(_compValue);
      _compValue = NULL;
      _fileHandle = NULL;
@@ -684,10 +1787,10 @@ RC RBFM_ScanIterator::init(FileHandle& fileHandle,
 	_compOp = compOp;
 	_nextRID.pageNum = 0;
 	_nextRID.slotNum = 0;
-	
-    ret = _fileHandle->readPage(_nextRID.pageNum, _buffer);
-    if (ret != err::OK)
-        return ret;
+    _page.release();
+
+    // The scan walks the file front to back
+    _fileHandle->advise(ACCESS_SEQUENTIAL);
 
 	if (compOp != NO_OP) {
 		ret = lookupAttr(conditionAttribute, _compIndex);
@@ -716,59 +1819,65 @@ RC RBFM_ScanIterator::getNextRecord(RID& rid,
                                     void* data)
 {
     unsigned numPages = _fileHandle->getNumberOfPages();
-    if (_nextRID.pageNum >= numPages)
-        return RBFM_EOF;
-    
+    unsigned pageSize = _fileHandle->getPageSize();
     RC ret = err::OK;
 
-    PageIndex* index = RecordBasedFileManager::getPageIndex(_buffer);
-
-    unsigned currentNumSlots = index->numSlots;
-    PageNum currentPage = _nextRID.pageNum;
     while (_nextRID.pageNum < numPages) {
-        if (_nextRID.pageNum != currentPage) {
-            currentPage = _nextRID.pageNum;
-            RC ret = _fileHandle->readPage(_nextRID.pageNum, _buffer);
+        // Free-space map pages hold no records
+        if (RecordBasedFileManager::isMapPage(_nextRID.pageNum, pageSize)) {
+            _nextRID.pageNum++;
+            _nextRID.slotNum = 0;
+            continue;
+        }
+        // Keep the page being scanned pinned until we move past it
+        if (not _page.isPinned() or _page.getPageNum() != _nextRID.pageNum) {
+            ret = _page.pin(*_fileHandle, _nextRID.pageNum);
             if (ret != err::OK)
                 return ret;
-            currentNumSlots = index->numSlots;
+
+            // Keep the read-ahead window ahead of the scan
+            BufferPoolManager *bpm = BufferPoolManager::instance();
+            bpm->prefetch(*_fileHandle, _nextRID.pageNum + 1, bpm->getReadAheadWindow());
         }
+        const char* page = _page.data();
+        unsigned currentNumSlots = RecordBasedFileManager::getPageIndex(page, pageSize)->numSlots;
         if (_nextRID.slotNum >= currentNumSlots) {
             updateNextRecord(currentNumSlots);
             continue;
         }
         // To avoid duplicate return values, and so RID's stay consistent, only check ALIVE
-        // and TOMBSTONE records. If it is a TOMBSTONE then we must load buffer with the page
+        // and TOMBSTONE records. If it is a TOMBSTONE then we must pin the page
         // containing the actual record data
-        PageIndexEntry* entry = RecordBasedFileManager::getPageIndexEntry(_buffer, _nextRID.slotNum);
+        const PageIndexEntry* entry = RecordBasedFileManager::getPageIndexEntry(page, _nextRID.slotNum, pageSize);
+        PageGuard forwardPage;
         switch (entry->type) {
             case DEAD:
             case ANCHOR:
                 updateNextRecord(currentNumSlots);
                 continue;
-            case TOMBSTONE: {
-                RID newRID;
-                while (entry->type == TOMBSTONE) {
-                    newRID = entry->tombstoneRID;
-                    ret = _fileHandle->readPage(newRID.pageNum, _buffer);
-                    currentPage = newRID.pageNum;
-                    if (ret != err::OK)
-                        return ret;
-                    entry = RecordBasedFileManager::getPageIndexEntry(_buffer, newRID.slotNum);
-                }
-            }
+            case TOMBSTONE:
+                ret = RecordBasedFileManager::instance()->pinRecord(*_fileHandle, _nextRID, forwardPage, entry);
+                if (ret != err::OK)
+                    return ret;
+                page = forwardPage.data();
+                break;
             default: 
                 break;
         }
-        // Now entry points to an entry whose physical data is on buffer
+        // Now entry points to an entry whose physical data is on page
         // We are ready to test the scan condition
-        if (not testScan(_buffer + entry->recordOffset)) {
+        const char* record;
+        unsigned recLength;
+        ret = RecordBasedFileManager::instance()->getRecord(*_fileHandle, entry, page, _record, record, recLength);
+        if (ret != err::OK)
+            return ret;
+        if (not testScan(record, entry->flags)) {
             updateNextRecord(currentNumSlots);
             continue;
         }
         // If we are here, then we passed. Copy the desired attributes to the user buffer
         rid = _nextRID;
-        copyRecord((char*) data, _buffer + entry->recordOffset);
+        copyRecord((char*) data, record, entry->flags);
         updateNextRecord(currentNumSlots);
         return err::OK;
     }
@@ -794,34 +1903,37 @@ RC RBFM_ScanIterator::copyCompValue(AttrType attrType,
 {
     free(_compValue);
     unsigned attrSize = Attribute::size(attrType, value);
-    _compValue = malloc(attrSize);
+    // A varchar gets a NUL after it, for strcmp
+    _compValue = calloc(attrSize + 1, 1);
     if (not _compValue)
         return err::OUT_OF_MEMORY;
     memcpy(_compValue, value, attrSize);
     return err::OK;
 }
 
-bool RBFM_ScanIterator::testScan(const void* recData)
+bool RBFM_ScanIterator::testScan(const char* record, unsigned flags)
 {
     if (_compOp == NO_OP)
         return true;
 
-    unsigned* offsets = (unsigned*)recData;
+    const char* attrData;
+    unsigned length;
+    RecordBasedFileManager::locateAttribute(_recordDescriptor, record, flags, _compIndex, attrData, length);
     float floatVal;
     int intVal;
 
     switch (_compType)
     {
         case TypeInt:
-            intVal = *(int*) ((char *)recData + offsets[_compIndex]);
+            memcpy(&intVal, attrData, sizeof(int));
             return doComp(_compOp, &intVal, (int*) _compValue);
         case TypeReal:
-            floatVal = *(float*) ((char *)recData + offsets[_compIndex]);
+            memcpy(&floatVal, attrData, sizeof(float));
             return doComp(_compOp, &floatVal, (float*) _compValue);
         case TypeVarChar:
-            void* attrData = (char*)recData + (offsets[_compIndex] + sizeof(unsigned));
+            _attrString.assign(attrData, length);
             void* compStr = (char*)_compValue + sizeof(unsigned);
-            return doComp(_compOp, (char*) attrData, (char*) compStr);
+            return doComp(_compOp, _attrString.c_str(), (char*) compStr);
     }
     return false;
 }
@@ -875,27 +1987,20 @@ RC RBFM_ScanIterator::updateNextRecord(unsigned numSlots)
 	if (_nextRID.slotNum >= numSlots) {
 		_nextRID.pageNum++;
 		_nextRID.slotNum = 0;
-        return _fileHandle->readPage(_nextRID.pageNum, _buffer);
 	}
     return err::OK;
 }
 
 RC RBFM_ScanIterator::copyRecord(char* dest, 
-                                 const char* src)
+                                 const char* src,
+                                 unsigned flags)
 {
-	// The offset array is just after the number of attributes
-	unsigned* offsets = (unsigned*)((char*)src);
 	unsigned dataOffset = 0;
 
 	// Iterate through all of the columns we actually want to copy for the user
 	for (unsigned i = 0; i < _returnAttrIndices.size(); ++i) {
-		unsigned attrIndex = _returnAttrIndices[i];
-		unsigned recordOffset = offsets[attrIndex];
-		unsigned attributeSize = Attribute::size(_returnAttrTypes[i], src + recordOffset);
-
-		// Copy the data and then move forward in the user's buffer
-		memcpy(dest + dataOffset, src + recordOffset, attributeSize);
-		dataOffset += attributeSize;
+		dataOffset += RecordBasedFileManager::copyAttribute(_recordDescriptor, src, flags,
+		                                                    _returnAttrIndices[i], dest + dataOffset);
 	}
     return err::OK;
 }
@@ -5,11 +5,29 @@
 #include <vector>
 #include <climits>
 #include <cstdlib>
+#include <map>
 
 #include "pfm.h"
+#include "bpm.h"
 
 using namespace std;
 
+// Number of pages findSpace moves per I/O call
+#define RBFM_IO_BATCH 16
+
+// Number of pages reorganizeFile works through per batch when run in one go
+#define RBFM_REORGANIZE_BATCH 64
+
+// Free-space map (FSM). Page 0 of a record file, and every
+// (FSM_PAGES_PER_MAP + 1)th page after it, is a map page holding one byte
+// for each of the data pages that follow it: the page's free space in units
+// of FSM_BUCKET_SIZE bytes, rounded down. A zero byte means the page is full
+// or does not exist yet. The page LSN takes the end of the map page. Both
+// depend on the page size of the file.
+#define FSM_PAGES_PER_MAP(pageSize) ((pageSize) - sizeof(LSN))
+#define FSM_BUCKET_SIZE(pageSize) ((pageSize) / 256)
+#define FSM_MAX_BUCKET 255
+
 // Record ID
 struct RID {
     unsigned pageNum;	// page number
@@ -17,18 +35,39 @@ struct RID {
 };
 
 // Page Index
+// Kept at the end of each data page; lsn is the page LSN, so it comes last.
+// No slot before freeSlot is DEAD, so inserts look for a slot to reuse from
+// there on.
 struct PageIndex {
     unsigned pageNum;
     unsigned freeMemoryOffset;
     unsigned numSlots;
+    unsigned freeSlot;
+    LSN lsn;
 };
 
+// An ANCHOR holds a record moved off the page of its RID, which keeps a
+// TOMBSTONE pointing at it. It is only reached through the tombstone.
 enum PageIndexEntryType { ALIVE = 1, DEAD, TOMBSTONE, ANCHOR };
 
+// Flags of a page index entry
+enum PageIndexEntryFlags { ENTRY_OVERFLOW = 1, ENTRY_COMPACT = 2 };
+
+// Record formats. A record flagged ENTRY_COMPACT holds its int and real
+// attributes first, in schema order, so where each is follows from the
+// schema alone; then a 2-byte offset from the start of the record to the
+// end of each varchar attribute; then the characters of the varchars, in
+// order, without their lengths. Records that would not fit 2-byte offsets
+// (they can only be that large by overflowing) and those written by older
+// versions hold a 4-byte offset per attribute instead, followed by the
+// attributes as they are passed in.
+#define COMPACT_RECORD_MAX USHRT_MAX
+
 // Page Index Entry
 // Contains information for accessing record in page
 struct PageIndexEntry {
-    enum PageIndexEntryType type;
+    enum PageIndexEntryType type : 16;
+    unsigned flags : 16;
     union {
         struct {
             unsigned recordSize;
@@ -38,6 +77,39 @@ struct PageIndexEntry {
     };
 };
 
+// Overflow pages. A record too large for a page keeps its head on a data
+// page, in the slot of its RID, flagged ENTRY_OVERFLOW: an OverflowHeader
+// followed by the first bytes of the record. The rest fills numPages
+// overflow pages in a row from firstPage, map pages in between skipped, so
+// that they are read in one go. An overflow page ends in a PageIndex like a
+// data page, with no slots and freeSlot set to OVERFLOW_PAGE.
+struct OverflowHeader {
+    unsigned length;    // of the whole record
+    PageNum firstPage;
+    unsigned numPages;
+};
+#define OVERFLOW_PAGE UINT_MAX
+#define OVERFLOW_PAYLOAD(pageSize) ((pageSize) - sizeof(PageIndex))
+
+// A record that reorganizeFile gave a new RID
+struct RIDMove {
+    RID from;
+    RID to;
+};
+
+// How far an incremental reorganizeFile has got. The file is first walked
+// forward to collapse tombstones, then backward from its end to pack records
+// into earlier pages; empty pages left at the end are cut off.
+struct ReorganizeCursor {
+    enum Phase { COLLAPSE, PACK, DONE };
+
+    ReorganizeCursor() : phase(COLLAPSE), pageNum(1) {}
+    bool done() const { return phase == DONE; }
+
+    Phase phase;
+    PageNum pageNum; // next page to work on
+};
+
 // Attribute
 typedef enum { TypeInt = 0, TypeReal, TypeVarChar } AttrType;
 
@@ -100,16 +172,18 @@ private:
     AttrType _compType;
     vector<AttrType> _returnAttrTypes;
     vector<unsigned> _returnAttrIndices;
-    char _buffer[PAGE_SIZE] = {0};
+    PageGuard _page;
+    vector<char> _record;   // an overflowed record, read whole
+    string _attrString;     // the varchar being compared
 
     RC lookupAttr(const string& conditionAttribute, unsigned& index);
     RC copyCompValue(AttrType attrType, const void* value);
-    bool testScan(const void* recData);
+    bool testScan(const char* record, unsigned flags);
     bool doComp(const CompOp compOp, const int* attrData, const int* value);
     bool doComp(const CompOp compOp, const float* attrData, const float* value);
     bool doComp(const CompOp compOp, const char* attrData, const char* value);
     RC updateNextRecord(unsigned numSlots);
-    RC copyRecord(char* dest, const char* src);
+    RC copyRecord(char* dest, const char* src, unsigned flags);
 };
 
 
@@ -117,21 +191,56 @@ class RecordBasedFileManager
 {
 public:
   static RecordBasedFileManager* instance();
-  static PageIndex* getPageIndex(void* buffer);
-  static void writePageIndex(void* buffer, PageIndex* index);
-  static PageIndexEntry* getPageIndexEntry(void* buffer, unsigned slotNum);
-  static void writePageIndexEntry(void* buffer, unsigned slotNum, PageIndexEntry* entry);
-  static unsigned freeSpaceSize(void* pageData);
-  RC createFile(const string &fileName);
+  // Page layout helpers. pageSize is that of the file the page belongs to.
+  static PageIndex* getPageIndex(void* buffer, unsigned pageSize);
+  static const PageIndex* getPageIndex(const void* buffer, unsigned pageSize);
+  static void writePageIndex(void* buffer, PageIndex* index, unsigned pageSize);
+  static PageIndexEntry* getPageIndexEntry(void* buffer, unsigned slotNum, unsigned pageSize);
+  static const PageIndexEntry* getPageIndexEntry(const void* buffer, unsigned slotNum, unsigned pageSize);
+  static void writePageIndexEntry(void* buffer, unsigned slotNum, PageIndexEntry* entry, unsigned pageSize);
+  static unsigned freeSpaceSize(const void* pageData, unsigned pageSize);
+  // Free space once the page is compacted, taking in what deleted and
+  // shrunken records left behind
+  static unsigned usableSpaceSize(const void* pageData, unsigned pageSize);
+  // Largest record stored whole on a data page; larger ones overflow
+  static unsigned maxRecordSize(unsigned pageSize) { return pageSize - sizeof(PageIndex) - sizeof(PageIndexEntry); }
+  static bool isOverflowPage(const void* pageData, unsigned pageSize) { return getPageIndex(pageData, pageSize)->freeSlot == OVERFLOW_PAGE; }
+  static bool isMapPage(PageNum pageNum, unsigned pageSize) { return pageNum % (FSM_PAGES_PER_MAP(pageSize) + 1) == 0; }
+  static PageNum mapPageOf(PageNum pageNum, unsigned pageSize) { return pageNum - pageNum % (FSM_PAGES_PER_MAP(pageSize) + 1); }
+  static unsigned char freeSpaceBucket(unsigned numbytes, unsigned pageSize);
+  // Hops taken from a TOMBSTONE to the record it points at, by every kind
+  // of access. Each is a page pinned on top of the RID's own.
+  unsigned long long getTombstoneHops() const { return _tombstoneHops; }
+  void resetTombstoneHops() { _tombstoneHops = 0; }
+  // Pages of the new file are pageSize bytes; flags are CreateFlags
+  RC createFile(const string &fileName, unsigned pageSize = PAGE_SIZE,
+                unsigned flags = CREATE_DEFAULT);
   RC destroyFile(const string &fileName);
-  RC openFile(const string &fileName, FileHandle &fileHandle);
+  // Record files are always opened with OPEN_LOGGED
+  RC openFile(const string &fileName, FileHandle &fileHandle, unsigned flags = OPEN_DEFAULT);
   RC closeFile(FileHandle &fileHandle); 
 
   // Find somewhere to insert numbytes bytes of data.
   // If there is no room, append enough pages at the end of the file
   // to fit the data.
   RC findSpace(FileHandle &fileHandle, unsigned numbytes, PageNum& pageNum);
-  RC prepareRecord(const vector<Attribute> &recordDescriptor, const void* data, unsigned*& offsets, unsigned& recLength, unsigned& offsetFieldsSize);
+  // Record the free space left on a data page in the free-space map
+  RC updateFreeSpace(FileHandle &fileHandle, PageNum pageNum, const void* pageData);
+  // Lays data out in the record format it is stored in, and sets flags to
+  // the format's
+  static RC prepareRecord(const vector<Attribute> &recordDescriptor, const void* data,
+                          vector<char> &record, unsigned &flags);
+  // Points value at the bytes of attribute attrIndex of a stored record,
+  // the characters only for a varchar, and sets length to how many there are
+  static void locateAttribute(const vector<Attribute> &recordDescriptor, const char* record,
+                              unsigned flags, unsigned attrIndex, const char*& value, unsigned &length);
+  // Copies attribute attrIndex of a stored record to dest as it is passed
+  // in, and returns its size
+  static unsigned copyAttribute(const vector<Attribute> &recordDescriptor, const char* record,
+                                unsigned flags, unsigned attrIndex, char* dest);
+  // Copies a stored record of recLength bytes to data as it is passed in
+  static void decodeRecord(const vector<Attribute> &recordDescriptor, const char* record,
+                           unsigned recLength, unsigned flags, void* data);
   RC insertRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void* data, RID &rid);
   RC readRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, void* data);
   // This method will be mainly used for debugging/testing
@@ -141,6 +250,8 @@ public:
 IMPORTANT, PLEASE READ: All methods below this comment (other than the constructor and destructor) are NOT required to be implemented for part 1 of the project
 ***************************************************************************************************************************************************************/
   RC deleteRID(FileHandle& fileHandle, PageIndex* index, PageIndexEntry* entry, unsigned char* buffer, const RID& rid);
+  // Deletes every record by truncating the file. Fails with FILE_IN_USE
+  // while other handles are open on it.
   RC deleteRecords(FileHandle &fileHandle);
   RC deleteRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid);
   // Assume the rid does not change after update
@@ -155,15 +266,62 @@ IMPORTANT, PLEASE READ: All methods below this comment (other than the construct
       const void* value,                    // used in the comparison
       const vector<string> &attributeNames, // a list of projected attributes
       RBFM_ScanIterator &rbfm_ScanIterator);
+  // Reorganizes the whole file; records may get new RIDs
   RC reorganizeFile(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor);
+  // Does up to numPages pages of reorganizeFile, from where cursor is, and
+  // appends the records given a new RID to moves. The file stays usable
+  // between batches. Empty pages at the end are only cut off while no other
+  // handle is open on the file.
+  RC reorganizeFile(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor,
+                    ReorganizeCursor &cursor, unsigned numPages, vector<RIDMove> &moves);
 
 protected:
   RecordBasedFileManager();
   ~RecordBasedFileManager();
 
 private:
-  static RecordBasedFileManager* _rbf_manager;
+  static atomic<RecordBasedFileManager*> _rbf_manager;
+  static mutex _instanceMutex;
   PagedFileManager& _pfm;
+  atomic<unsigned long long> _tombstoneHops;
+
+  friend class RBFM_ScanIterator;
+
+  RC searchMap(FileHandle &fileHandle, PageNum mapPage, unsigned char bucket, PageNum& pageNum);
+  RC appendDataPages(FileHandle &fileHandle, unsigned numPages, PageNum& pageNum);
+  unsigned initPages(unsigned char* batch, PageNum first, unsigned count, unsigned pageSize);
+  void initMapPage(unsigned char* buffer, PageNum mapPage, unsigned numPages, unsigned pageSize);
+  void initDataPage(unsigned char* buffer, PageNum pageNum, unsigned pageSize);
+  RC setFreeSpace(FileHandle &fileHandle, PageNum pageNum, unsigned char bucket);
+  RC setFreeSpace(FileHandle &fileHandle, PageNum first, unsigned count, unsigned char bucket);
+  RC writeDataPage(FileHandle &fileHandle, PageNum pageNum, const void* pageData);
+  static void compactPage(unsigned char* buffer, unsigned pageSize);
+  static unsigned reserveSlot(unsigned char* buffer, unsigned pageSize, PageIndexEntryType type,
+                              unsigned recLength);
+  static unsigned placeRecord(unsigned char* buffer, unsigned pageSize, PageIndexEntryType type,
+                              const char* record, unsigned recLength, unsigned flags);
+  static void releaseSlot(unsigned char* buffer, unsigned slotNum, unsigned pageSize);
+  RC layoutRecord(FileHandle &fileHandle, vector<char> &record, vector<char> &stored, unsigned &flags);
+  void initOverflowPages(unsigned char* pages, PageNum first, unsigned span, const char* tail,
+                         unsigned length, OverflowHeader &header, unsigned pageSize);
+  RC writeOverflow(FileHandle &fileHandle, const char* tail, unsigned length, OverflowHeader &header);
+  RC readOverflow(FileHandle &fileHandle, const char* stored, unsigned storedLength, vector<char> &record);
+  RC freeOverflow(FileHandle &fileHandle, const char* stored);
+  RC getRecord(FileHandle &fileHandle, const PageIndexEntry* entry, const char* page,
+               vector<char> &buffer, const char*& record, unsigned &recLength);
+  RC moveRecord(FileHandle &fileHandle, const RID &rid, const RID* tombstone, unsigned char* buffer,
+                const vector<char> &stored, unsigned flags);
+  RC setTombstone(FileHandle &fileHandle, const RID &rid, const RID &anchor);
+  RC findSpaceBelow(FileHandle &fileHandle, PageNum limit, unsigned numbytes, PageNum& pageNum);
+  RC collapsePage(FileHandle &fileHandle, PageNum pageNum, vector<RIDMove> &moves);
+  RC packPage(FileHandle &fileHandle, PageNum pageNum, vector<RIDMove> &moves, bool &emptied);
+  RC truncateEmptyPages(FileHandle &fileHandle);
+  RC pinRecord(FileHandle &fileHandle, const RID &rid, PageGuard &page, const PageIndexEntry*& entry);
+  RC collapseChain(FileHandle &fileHandle, const RID &rid, RID &anchor);
+  // forwarded is set when rid was reached through a tombstone; updateRecord
+  // is given that tombstone's RID instead
+  RC deleteRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const RID &rid, bool forwarded);
+  RC updateRecord(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, const void* data, const RID &rid, const RID* tombstone);
 };
 
 #endif
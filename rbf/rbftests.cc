@@ -10,9 +10,16 @@
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "pfm.h"
+#include "log.h"
 #include "rbfm.h"
+#include "lz.h"
 #include "../util/errcodes.h"
 
 using namespace std;
@@ -36,6 +43,11 @@ bool FileExists(string fileName)
 #define TEST_FN_EQ(expected,fn,msg) TEST_FN_PREFIX if((rc=(fn)) == expected) TEST_FN_POSTFIX(msg)
 #define TEST_FN_NEQ(expected,fn,msg) TEST_FN_PREFIX if((rc=(fn)) != expected) TEST_FN_POSTFIX(msg)
 
+// Compares counts, page numbers and LSNs at their own type instead of through rc
+#define TEST_VAL_EQ(expected,val,msg) { TEST_FN_PREFIX auto testVal = (val); \
+    if(testVal == (expected)) { ++numPassed; cout << ' ' << numTests << ") OK: " << msg << endl; } \
+    else { cout << ' ' << numTests << ") FAIL: " << msg << "<" << testVal << ">" << endl; } }
+
 #define ALL_MIN_SKIP 3
 #define ALL_MAX_SKIP 50
 #define REORGANIZE_MIN_SKIP 2
@@ -1187,915 +1199,1980 @@ void fhTest()
     assert(numPassed == numTests);
 }
 
-int RBFTest_1(PagedFileManager *pfm)
+// Pages written through a mapped handle, including appends that outgrow
+// the initial mapping, must be visible through a regular handle and the
+// other way around.
+void mmapTest()
 {
-    // Functions Tested:
-    // 1. Create File
-    cout << "****In RBF Test Case 1****" << endl;
-
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test";
 
-    // Create a file named "test"
-    rc = pfm->createFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Mapped FileHandle tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
 
-    if(FileExists(fileName.c_str()))
-    {
-        cout << "File " << fileName << " has been created." << endl << endl;
-    }
-    else
+    string fileName = "mmap_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+
+    FileHandle mapped;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), mapped, OPEN_MMAP), "Open file mapped");
+    TEST_FN_EQ(true, mapped.isMapped(), "Handle is mapped");
+
+    unsigned char buffer[PAGE_SIZE];
+    unsigned char buffer_copy[PAGE_SIZE];
+    const unsigned numPages = 2 * MMAP_MIN_RESERVE / PAGE_SIZE;
+    for (unsigned i = 0; i < numPages; i++)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 1 Failed!" << endl << endl;
-        return -1;
+        memset(buffer, i % 256, PAGE_SIZE);
+        rc = mapped.appendPage(buffer);
+        assert(rc == success);
     }
+    TEST_FN_EQ(numPages, mapped.getNumberOfPages(), "Number of pages correct after remapping");
 
-    // Create "test" again, should fail
-    rc = pfm->createFile(fileName.c_str());
-    assert(rc != success);
-
-    cout << "Test Case 1 Passed!" << endl << endl;
-    return 0;
+    // A page pinned before the file grows stays readable
+    PageGuard page;
+    TEST_FN_EQ(success, page.pin(mapped, 1), "Pin mapped page");
+    memset(buffer, 0xAB, PAGE_SIZE);
+    rc = mapped.appendPage(buffer);
+    assert(rc == success);
+    TEST_FN_EQ(1, page.data()[0], "Pinned mapped page survives growth");
+    page.release();
+
+    FileHandle regular;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), regular), "Open second, regular handle");
+    memset(buffer, 0x5A, PAGE_SIZE);
+    TEST_FN_EQ(success, mapped.writePage(7, buffer), "Write through mapped handle");
+    TEST_FN_EQ(success, regular.readPage(7, buffer_copy), "Read through regular handle");
+    TEST_FN_EQ(0, memcmp(buffer, buffer_copy, PAGE_SIZE), "Regular handle sees mapped write");
+
+    memset(buffer, 0xC3, PAGE_SIZE);
+    TEST_FN_EQ(success, regular.writePage(numPages, buffer), "Write through regular handle");
+    TEST_FN_EQ(success, pfm->closeFile(regular), "Close regular handle");
+    TEST_FN_EQ(success, mapped.readPage(numPages, buffer_copy), "Read through mapped handle");
+    TEST_FN_EQ(0, memcmp(buffer, buffer_copy, PAGE_SIZE), "Mapped handle sees regular write");
+
+    TEST_FN_EQ(success, pfm->closeFile(mapped), "Close mapped handle");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    cout << "\nMapped FH Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-
-int RBFTest_2(PagedFileManager *pfm)
+// Pages must survive a round trip through a handle opened with OPEN_DIRECT,
+// whether or not the caller's buffers are aligned.
+void directTest()
 {
-    // Functions Tested:
-    // 1. Destroy File
-    cout << "****In RBF Test Case 2****" << endl;
-
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test";
 
-    rc = pfm->destroyFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Direct I/O FileHandle tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
 
-    if(!FileExists(fileName.c_str()))
+    string fileName = "direct_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle, OPEN_DIRECT), "Open file for direct I/O");
+    cout << " direct I/O " << (fileHandle.isDirect() ? "enabled" : "not supported here") << endl;
+
+    // Use a tiny pool, so that most pages actually go to disk and back
+    unsigned numFrames = bpm->getNumFrames();
+    TEST_FN_EQ(success, bpm->setNumFrames(4), "Shrink buffer pool");
+
+    // Stack buffers are not PAGE_SIZE aligned
+    unsigned char buffer[PAGE_SIZE];
+    unsigned char buffer_copy[PAGE_SIZE];
+    const unsigned numPages = 64;
+    for (unsigned i = 0; i < numPages; i++)
     {
-        cout << "File " << fileName << " has been destroyed." << endl << endl;
-        cout << "Test Case 2 Passed!" << endl << endl;
-        return 0;
+        memset(buffer, i, PAGE_SIZE);
+        rc = fileHandle.appendPage(buffer);
+        assert(rc == success);
     }
-    else
+    for (unsigned i = 0; i < numPages; i += 2)
     {
-        cout << "Failed to destroy file!" << endl;
-        cout << "Test Case 2 Failed!" << endl << endl;
-        return -1;
+        memset(buffer, 0xFF - i, PAGE_SIZE);
+        rc = fileHandle.writePage(i, buffer);
+        assert(rc == success);
     }
-}
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
 
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle, OPEN_DIRECT), "Reopen file for direct I/O");
+    TEST_FN_EQ(numPages, fileHandle.getNumberOfPages(), "Number of pages correct");
+    bool match = true;
+    PageBuffer aligned;
+    for (unsigned i = 0; i < numPages; i++)
+    {
+        unsigned char expected = (i % 2 == 0) ? 0xFF - i : i;
+        rc = fileHandle.readPage(i, (i % 3 == 0) ? (unsigned char*) aligned : buffer_copy);
+        assert(rc == success);
+        const unsigned char *read = (i % 3 == 0) ? (unsigned char*) aligned : buffer_copy;
+        for (unsigned j = 0; j < PAGE_SIZE; j++)
+            match = match and read[j] == expected;
+    }
+    TEST_FN_EQ(true, match, "Reading pages back");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, bpm->setNumFrames(numFrames), "Restore buffer pool");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
-int RBFTest_3(PagedFileManager *pfm)
-{
-    // Functions Tested:
-    // 1. Create File
-    // 2. Open File
-    // 3. Get Number Of Pages
-    // 4. Close File
-    cout << "****In RBF Test Case 3****" << endl;
+    cout << "\nDirect FH Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
+// Prefetched pages must read the same as pages loaded on demand, and a
+// file must close cleanly with prefetches still queued.
+void readAheadTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_1";
 
-    // Create a file named "test_1"
-    rc = pfm->createFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Read-ahead tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
 
-    if(FileExists(fileName.c_str()))
+    string fileName = "readahead_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+
+    unsigned char buffer[PAGE_SIZE];
+    const unsigned numPages = 256;
+    for (unsigned i = 0; i < numPages; i++)
     {
-        cout << "File " << fileName << " has been created." << endl;
+        memset(buffer, i % 256, PAGE_SIZE);
+        rc = fileHandle.appendPage(buffer);
+        assert(rc == success);
     }
-    else
+
+    unsigned numFrames = bpm->getNumFrames();
+    TEST_FN_EQ(success, bpm->setNumFrames(16), "Shrink buffer pool");
+
+    bool match = true;
+    for (unsigned i = 0; i < numPages; i++)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 3 Failed!" << endl << endl;
-        return -1;
+        bpm->prefetch(fileHandle, i + 1, 4);
+        PageGuard page;
+        rc = page.pin(fileHandle, i);
+        assert(rc == success);
+        for (unsigned j = 0; j < PAGE_SIZE; j++)
+            match = match and (unsigned char) page.data()[j] == i % 256;
     }
+    TEST_FN_EQ(true, match, "Reading pages with read-ahead");
 
-    // Open the file "test_1"
-    FileHandle fileHandle;
-    rc = pfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    bpm->prefetch(fileHandle, 0, numPages);
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file with prefetches queued");
+    TEST_FN_EQ(success, bpm->setNumFrames(numFrames), "Restore buffer pool");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
-    // Get the number of pages in the test file
-    unsigned count = fileHandle.getNumberOfPages();
-    assert(count == (unsigned)0);
+    cout << "\nRead-ahead Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    // Close the file "test_1"
-    rc = pfm->closeFile(fileHandle);
-    assert(rc == success);
+// Multi-page reads must see pages still dirty in the buffer pool, and
+// multi-page writes must not be undone by stale frames.
+void multiPageTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    cout << "Test Case 3 Passed!" << endl << endl;
+    cout << "Multi-page FileHandle tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
 
-    return 0;
-}
+    string fileName = "multipage_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
 
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
 
+    const unsigned numPages = 40;
+    PageBuffer pages(numPages);
+    for (unsigned i = 0; i < numPages; i++)
+        memset(pages + PAGE_SIZE * i, i, PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.appendPages(numPages, pages), "Append pages");
+    TEST_FN_EQ(numPages, fileHandle.getNumberOfPages(), "Number of pages correct");
+    TEST_FN_EQ(err::FILE_PAGE_NOT_FOUND, fileHandle.readPages(numPages - 1, 2, pages), "Reading past the last page");
 
-int RBFTest_4(PagedFileManager *pfm)
-{
-    // Functions Tested:
-    // 1. Open File
-    // 2. Append Page
-    // 3. Get Number Of Pages
-    // 3. Close File
-    cout << "****In RBF Test Case 4****" << endl;
+    // Dirty a page in the pool, then read it back as part of a range
+    unsigned char buffer[PAGE_SIZE];
+    memset(buffer, 0xEE, PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.writePage(10, buffer), "Write single page");
+    TEST_FN_EQ(success, fileHandle.readPages(0, numPages, pages), "Read all pages");
+    bool match = true;
+    for (unsigned i = 0; i < numPages; i++)
+        for (unsigned j = 0; j < PAGE_SIZE; j++)
+            match = match and pages[PAGE_SIZE * i + j] == (i == 10 ? 0xEE : i);
+    TEST_FN_EQ(true, match, "Range read sees pooled write");
+
+    // Overwrite pages, including the pooled one, through scatter/gather
+    unsigned char scattered[3][PAGE_SIZE];
+    vector<const void*> sources;
+    for (unsigned i = 0; i < 3; i++)
+    {
+        memset(scattered[i], 0x70 + i, PAGE_SIZE);
+        sources.push_back(scattered[i]);
+    }
+    TEST_FN_EQ(success, fileHandle.writePages(9, sources), "Gather write");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    vector<void*> targets;
+    for (unsigned i = 0; i < 3; i++)
+        targets.push_back(pages + PAGE_SIZE * i);
+    TEST_FN_EQ(success, fileHandle.readPages(9, targets), "Scatter read");
+    match = true;
+    for (unsigned i = 0; i < 3; i++)
+        for (unsigned j = 0; j < PAGE_SIZE; j++)
+            match = match and pages[PAGE_SIZE * i + j] == 0x70 + i;
+    TEST_FN_EQ(true, match, "Gathered pages persisted");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
+    cout << "\nMulti-page FH Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
+
+// Descriptors stay cached after close, within the bound, and a cached
+// descriptor is never used for a file that was replaced behind the PFM's back.
+void fileCacheTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_1";
 
-    // Open the file "test_1"
-    FileHandle fileHandle;
-    rc = pfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    cout << "File cache tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    pfm->setMaxOpenFiles(2);
 
-    // Append the first page
-    void *data = malloc(PAGE_SIZE);
-    for(unsigned i = 0; i < PAGE_SIZE; i++)
+    string fileNames[4] = { "fcache_test0", "fcache_test1", "fcache_test2", "fcache_test3" };
+    unsigned char buffer[PAGE_SIZE];
+    for (unsigned i = 0; i < 4; i++)
     {
-        *((char *)data+i) = i % 94 + 32;
+        rc = pfm->createFile(fileNames[i].c_str());
+        assert(rc == success);
+        FileHandle fileHandle;
+        rc = pfm->openFile(fileNames[i].c_str(), fileHandle);
+        assert(rc == success);
+        memset(buffer, i, PAGE_SIZE);
+        rc = fileHandle.appendPage(buffer);
+        assert(rc == success);
+        rc = pfm->closeFile(fileHandle);
+        assert(rc == success);
     }
-    rc = fileHandle.appendPage(data);
-    assert(rc == success);
-   
-    // Get the number of pages
-    unsigned count = fileHandle.getNumberOfPages();
-    printf("%d\n", count);
-    assert(count == (unsigned)1);
+    TEST_FN_EQ(2, pfm->getNumOpenFiles(), "Idle descriptors bounded");
 
-    // Close the file "test_1"
-    rc = pfm->closeFile(fileHandle);
+    FileHandle fileHandle;
+    FileHandle fileHandle2;
+    TEST_FN_EQ(success, pfm->openFile(fileNames[3].c_str(), fileHandle), "Open cached file");
+    TEST_FN_EQ(success, pfm->openFile(fileNames[3].c_str(), fileHandle2), "Open cached file twice");
+    TEST_FN_EQ(2, pfm->getNumOpenFiles(), "Handles share the cached descriptor");
+    TEST_FN_EQ(success, fileHandle2.readPage(0, buffer), "Read through second handle");
+    TEST_FN_EQ(3, buffer[0], "Contents correct");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle2), "Close second handle");
+    TEST_FN_EQ(success, fileHandle.readPage(0, buffer), "First handle still reads");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close first handle");
+
+    // Replace a file without going through the PFM
+    remove(fileNames[3].c_str());
+    rc = pfm->createFile(fileNames[3].c_str());
     assert(rc == success);
+    TEST_FN_EQ(success, pfm->openFile(fileNames[3].c_str(), fileHandle), "Open replaced file");
+    TEST_FN_EQ(0, fileHandle.getNumberOfPages(), "Replaced file is empty");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close replaced file");
 
-    free(data);
-
-    cout << "Test Case 4 Passed!" << endl << endl;
+    for (unsigned i = 0; i < 4; i++)
+    {
+        TEST_FN_EQ(success, pfm->destroyFile(fileNames[i].c_str()), "Destroy file");
+    }
+    pfm->setMaxOpenFiles(DEFAULT_MAX_OPEN_FILES);
 
-    return 0;
+    cout << "\nFile cache Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-
-int RBFTest_5(PagedFileManager *pfm)
+// Files grow a whole extent at a time, while the page count, kept in the
+// header, only covers the pages actually appended.
+void extentTest()
 {
-    // Functions Tested:
-    // 1. Open File
-    // 2. Read Page
-    // 3. Close File
-    cout << "****In RBF Test Case 5****" << endl;
-
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_1";
 
-    // Open the file "test_1"
-    FileHandle fileHandle;
-    rc = pfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    cout << "Extent allocation tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    pfm->setExtentSize(16);
 
-    // Read the first page
-    void *buffer = malloc(PAGE_SIZE);
-    rc = fileHandle.readPage(0, buffer);
-    assert(rc == success);
-  
-    // Check the integrity of the page    
-    void *data = malloc(PAGE_SIZE);
-    for(unsigned i = 0; i < PAGE_SIZE; i++)
-    {
-        *((char *)data+i) = i % 94 + 32;
-    }
-    rc = memcmp(data, buffer, PAGE_SIZE);
-    assert(rc == success);
- 
-    // Close the file "test_1"
-    rc = pfm->closeFile(fileHandle);
-    assert(rc == success);
+    string fileName = "extent_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
 
-    free(data);
-    free(buffer);
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    unsigned char buffer[PAGE_SIZE];
+    memset(buffer, 0x11, PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.appendPage(buffer), "Append page");
+
+    struct stat st;
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(FILE_HEADER_SIZE + 16 * PAGE_SIZE, st.st_size, "File grew by one extent");
+    TEST_FN_EQ(1, fileHandle.getNumberOfPages(), "Only the appended page counts");
+
+    // A handle opened meanwhile sees the page count in the header
+    FileHandle other;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), other), "Open second handle");
+    TEST_FN_EQ(1, other.getNumberOfPages(), "Second handle sees the appended page");
+    TEST_FN_EQ(err::FILE_PAGE_NOT_FOUND, other.readPage(1, buffer), "Preallocated page is not readable");
+    TEST_FN_EQ(success, pfm->closeFile(other), "Close second handle");
+
+    PageBuffer pages(20);
+    memset(pages, 0x22, PAGE_SIZE * 20);
+    TEST_FN_EQ(success, fileHandle.appendPages(20, pages), "Append pages across extents");
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(FILE_HEADER_SIZE + 32 * PAGE_SIZE, st.st_size, "File grew to whole extents");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
 
-    cout << "Test Case 5 Passed!" << endl << endl;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    TEST_FN_EQ(21, fileHandle.getNumberOfPages(), "Page count persisted");
+    TEST_FN_EQ(success, fileHandle.readPage(20, buffer), "Read last page");
+    TEST_FN_EQ(0x22, buffer[0], "Contents correct");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    pfm->setExtentSize(DEFAULT_EXTENT_PAGES);
 
-    return 0;
+    cout << "\nExtent allocation Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-
-int RBFTest_6(PagedFileManager *pfm)
+// Inserts find room through the free-space map: space freed on a page is
+// reused, map pages are never handed out for records and the map grows a
+// new page once the first one's range is full.
+void fsmTest()
 {
-    // Functions Tested:
-    // 1. Open File
-    // 2. Write Page
-    // 3. Read Page
-    // 4. Close File
-    // 5. Destroy File
-    cout << "****In RBF Test Case 6****" << endl;
-
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_1";
 
-    // Open the file "test_1"
+    cout << "Free-space map tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+    string fileName = "fsm_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+
     FileHandle fileHandle;
-    rc = pfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(2, fileHandle.getNumberOfPages(), "New file has a map page and a data page");
+    TEST_FN_EQ(true, RecordBasedFileManager::isMapPage(0, PAGE_SIZE), "Page 0 is a map page");
 
-    // Update the first page
-    void *data = malloc(PAGE_SIZE);
-    for(unsigned i = 0; i < PAGE_SIZE; i++)
-    {
-        *((char *)data+i) = i % 10 + 32;
-    }
-    rc = fileHandle.writePage(0, data);
-    assert(rc == success);
-
-    // Read the page
-    void *buffer = malloc(PAGE_SIZE);
-    rc = fileHandle.readPage(0, buffer);
-    assert(rc == success);
-
-    // Check the integrity
-    rc = memcmp(data, buffer, PAGE_SIZE);
-    assert(rc == success);
- 
-    // Close the file "test_1"
-    rc = pfm->closeFile(fileHandle);
-    assert(rc == success);
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 3000;
+    recordDescriptor.push_back(attr);
 
-    free(data);
-    free(buffer);
+    // Small records fill the first few data pages
+    char record[3004];
+    unsigned len = 200;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'f', len);
+    vector<RID> rids;
+    bool onDataPage = true;
+    for (unsigned i = 0; i < 100; i++)
+    {
+        RID rid;
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        onDataPage = onDataPage and not RecordBasedFileManager::isMapPage(rid.pageNum, PAGE_SIZE);
+        rids.push_back(rid);
+    }
+    TEST_FN_EQ(true, onDataPage, "Records never land on a map page");
+    TEST_FN_EQ(1, rids[0].pageNum, "First record goes to page 1");
+    unsigned numPages = fileHandle.getNumberOfPages();
 
-    // Destroy File
-    rc = pfm->destroyFile(fileName.c_str());
-    assert(rc == success);
-    
-    if(!FileExists(fileName.c_str()))
+    // Empty page 1 and compact it; the next insert goes back there
+    unsigned numDeleted = 0;
+    for (unsigned i = 0; i < rids.size(); i++)
     {
-        cout << "File " << fileName << " has been destroyed." << endl;
-        cout << "Test Case 6 Passed!" << endl << endl;
-        return 0;
+        if (rids[i].pageNum != 1)
+            continue;
+        rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+        assert(rc == success);
+        numDeleted++;
     }
-    else
+    TEST_FN_EQ(success, rbfm->reorganizePage(fileHandle, recordDescriptor, 1), "Reorganize page 1");
+    TEST_FN_EQ(err::PAGE_CANNOT_BE_ORGANIZED, rbfm->reorganizePage(fileHandle, recordDescriptor, 0), "Map page cannot be reorganized");
+    RID rid;
+
+    // A RID on a map page names no record
+    rid.pageNum = 0;
+    rid.slotNum = 0;
+    char data[3004];
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readRecord(fileHandle, recordDescriptor, rid, data), "Read from map page");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readAttribute(fileHandle, recordDescriptor, rid, "str", data), "Read attribute from map page");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->updateRecord(fileHandle, recordDescriptor, record, rid), "Update on map page");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->deleteRecord(fileHandle, recordDescriptor, rid), "Delete from map page");
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert after freeing space");
+    TEST_FN_EQ(1, rid.pageNum, "Freed space is reused");
+    TEST_VAL_EQ(numPages, fileHandle.getNumberOfPages(), "No page appended");
+
+    // The scan skips the map page
+    vector<string> names;
+    names.push_back("str");
+    RBFM_ScanIterator scanner;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_VAL_EQ(rids.size() - numDeleted + 1, count, "Scan sees every record");
+
+    // Page-sized records fill the rest of the first map's range
+    len = 3000;
+    memcpy(record, &len, sizeof(unsigned));
+    onDataPage = true;
+    while (fileHandle.getNumberOfPages() < FSM_PAGES_PER_MAP(PAGE_SIZE) + 3)
     {
-        cout << "Failed to destroy file!" << endl;
-        cout << "Test Case 6 Failed!" << endl << endl;
-        return -1;
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        onDataPage = onDataPage and not RecordBasedFileManager::isMapPage(rid.pageNum, PAGE_SIZE);
     }
-}
+    TEST_FN_EQ(true, onDataPage, "Records never land on the second map page");
+    TEST_FN_EQ(FSM_PAGES_PER_MAP(PAGE_SIZE) + 2, rid.pageNum, "Second map page precedes the next data page");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rid, data), "Read record past the second map page");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + len), "Contents correct");
 
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-int RBFTest_7(PagedFileManager *pfm)
+    cout << "\nFree-space map Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
+
+// Overwrites the page count kept in the header of fileName, behind the
+// PFM's back
+void pokePageCount(const string &fileName, unsigned pageCount)
 {
-    // Functions Tested:
-    // 1. Create File
-    // 2. Open File
-    // 3. Append Page
-    // 4. Get Number Of Pages
-    // 5. Read Page
-    // 6. Write Page
-    // 7. Close File
-    // 8. Destroy File
-    cout << "****In RBF Test Case 7****" << endl;
+    int fd = open(fileName.c_str(), O_WRONLY);
+    assert(fd >= 0);
+    ssize_t written = pwrite(fd, &pageCount, sizeof(unsigned), PAGE_COUNT_OFFSET);
+    assert(written == sizeof(unsigned));
+    close(fd);
+}
 
+// A child process changes pages of logged files, commits and dies without
+// closing them, so the changes only reach the files by being redone when
+// the log is opened again.
+void walTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_2";
-
-    // Create the file named "test_2"
-    rc = pfm->createFile(fileName.c_str());
-    assert(rc == success);
 
-    if(FileExists(fileName.c_str()))
-    {
-        cout << "File " << fileName << " has been created." << endl;
-    }
-    else
-    {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 7 Failed!" << endl << endl;
-        return -1;
-    }
+    cout << "Write-ahead log tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    LogManager *log = LogManager::instance();
 
-    // Open the file "test_2"
-    FileHandle fileHandle;
-    rc = pfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    string fileName = "wal_test";
+    string recordFileName = "wal_rbfm_test";
+    string logName = "wal_test.log";
 
-    // Append 50 pages
-    void *data = malloc(PAGE_SIZE);
-    for(unsigned j = 0; j < 50; j++)
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    int size;
+    prepareRecord(6, "walrec", 24, 170.1, 5000, record, &size);
+
+    // Only the forking thread carries over into the child, so no other
+    // thread may hold the pool's latch at the time
+    BufferPoolManager::instance()->setWriterInterval(0);
+    log->setCheckpointInterval(0);
+    pid_t pid = fork();
+    if (pid == 0)
     {
-        for(unsigned i = 0; i < PAGE_SIZE; i++)
+        if (log->open(logName) != success or pfm->createFile(fileName.c_str()) != success)
+            _exit(1);
+        FileHandle fileHandle;
+        if (pfm->openFile(fileName.c_str(), fileHandle, OPEN_LOGGED) != success)
+            _exit(1);
+        unsigned char buffer[PAGE_SIZE];
+        for (unsigned i = 0; i < 4; i++)
         {
-            *((char *)data+i) = i % (j+1) + 32;
+            memset(buffer, 'a' + i, PAGE_SIZE);
+            if (fileHandle.appendPage(buffer) != success)
+                _exit(1);
         }
-        rc = fileHandle.appendPage(data);
-        assert(rc == success);
+        memset(buffer, 'z', PAGE_SIZE);
+        if (fileHandle.writePage(0, buffer) != success)
+            _exit(1);
+
+        if (rbfm->createFile(recordFileName.c_str()) != success)
+            _exit(1);
+        FileHandle recordHandle;
+        if (rbfm->openFile(recordFileName.c_str(), recordHandle) != success)
+            _exit(1);
+        for (unsigned i = 0; i < 50; i++)
+        {
+            RID rid;
+            if (rbfm->insertRecord(recordHandle, recordDescriptor, record, rid) != success)
+                _exit(1);
+        }
+        _exit(log->commit() == success ? 0 : 1);
     }
-    cout << "50 Pages have been successfully appended!" << endl;
-   
-    // Get the number of pages
-    unsigned count = fileHandle.getNumberOfPages();
-    assert(count == (unsigned)50);
-
-    // Read the 25th page and check integrity
-    void *buffer = malloc(PAGE_SIZE);
-    rc = fileHandle.readPage(24, buffer);
-    assert(rc == success);
+    int status;
+    waitpid(pid, &status, 0);
+    TEST_FN_EQ(0, WEXITSTATUS(status), "Child logged its changes and crashed");
 
-    for(unsigned i = 0; i < PAGE_SIZE; i++)
+    TEST_FN_EQ(success, log->open(logName), "Open log and recover");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open recovered file");
+    TEST_FN_EQ(4, fileHandle.getNumberOfPages(), "Page count recovered");
+    unsigned char buffer[PAGE_SIZE];
+    unsigned char expected[PAGE_SIZE];
+    bool correct = true;
+    for (unsigned i = 0; i < 4; i++)
     {
-        *((char *)data + i) = i % 25 + 32;
+        memset(expected, i == 0 ? 'z' : 'a' + i, PAGE_SIZE);
+        rc = fileHandle.readPage(i, buffer);
+        correct = correct and rc == success and memcmp(buffer, expected, PAGE_LSN_OFFSET(PAGE_SIZE)) == 0;
     }
-    rc = memcmp(buffer, data, PAGE_SIZE);
-    assert(rc == success);
-    cout << "The data in 25th page is correct!" << endl;
+    TEST_FN_EQ(true, correct, "Latest page images redone");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close recovered file");
 
-    // Update the 25th page
-    for(unsigned i = 0; i < PAGE_SIZE; i++)
-    {
-        *((char *)data+i) = i % 60 + 32;
-    }
-    rc = fileHandle.writePage(24, data);
-    assert(rc == success);
+    FileHandle recordHandle;
+    TEST_FN_EQ(success, rbfm->openFile(recordFileName.c_str(), recordHandle), "Open recovered record file");
+    RBFM_ScanIterator scanner;
+    vector<string> names;
+    names.push_back("EmpName");
+    TEST_FN_EQ(success, rbfm->scan(recordHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    RID rid;
+    char data[PAGE_SIZE];
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_FN_EQ(50, count, "Inserted records recovered");
+    TEST_FN_EQ(success, rbfm->readRecord(recordHandle, recordDescriptor, rid, data), "Read recovered record");
+    TEST_FN_EQ(0, memcmp(record, data, size), "Contents correct");
+    TEST_FN_EQ(success, rbfm->closeFile(recordHandle), "Close recovered record file");
+
+    // Records logged before a commit are written and synced together
+    unsigned numSyncs = log->getNumSyncs();
+    LSN lsn = 0;
+    for (unsigned i = 0; i < 10; i++)
+        log->logPage("wal_missing", i, buffer, PAGE_SIZE, lsn);
+    TEST_FN_EQ(success, log->commit(), "Commit batch");
+    TEST_VAL_EQ(numSyncs + 1, log->getNumSyncs(), "One sync for the batch");
+    TEST_VAL_EQ(lsn, log->getFlushedLSN(), "Batch durable");
+
+    // Concurrent commits never sync more often than they commit
+    numSyncs = log->getNumSyncs();
+    vector<thread> threads;
+    for (unsigned t = 0; t < 8; t++)
+        threads.push_back(thread([log, t]() {
+            unsigned char page[PAGE_SIZE];
+            memset(page, t, PAGE_SIZE);
+            for (unsigned i = 0; i < 20; i++)
+            {
+                LSN pageLSN;
+                log->logPage("wal_missing", t, page, PAGE_SIZE, pageLSN);
+                log->commit();
+                assert(log->getFlushedLSN() >= pageLSN);
+            }
+        }));
+    for (unsigned t = 0; t < threads.size(); t++)
+        threads[t].join();
+    TEST_FN_EQ(true, log->getNumSyncs() - numSyncs <= 160, "Group commit");
+
+    // Records of files that no longer exist are skipped
+    TEST_FN_EQ(success, log->close(), "Close log");
+    TEST_FN_EQ(success, log->open(logName), "Reopen log");
+    TEST_FN_EQ(false, FileExists("wal_missing"), "Missing file not recreated");
+    TEST_FN_EQ(success, log->close(), "Close log");
+
+    // A file that is there but does not open fails recovery, and its
+    // records stay in the log for the next try. Here its header counts a
+    // page it does not have, as a crash before the page was written back
+    // leaves it.
+    string brokenName = "wal_broken";
+    TEST_FN_EQ(success, pfm->createFile(brokenName.c_str()), "Create file");
+    TEST_FN_EQ(success, log->open(logName), "Open log");
+    memset(buffer, 'w', PAGE_SIZE);
+    log->logPage(brokenName, 0, buffer, PAGE_SIZE, lsn);
+    TEST_FN_EQ(success, log->close(), "Close log");
+    pokePageCount(brokenName, 1);
+    TEST_FN_EQ(err::FILE_CORRUPT, log->open(logName), "Recovery fails");
+    pokePageCount(brokenName, 0);
+    TEST_FN_EQ(success, log->open(logName), "Recovery tried again");
+    TEST_FN_EQ(success, log->close(), "Close log");
+    TEST_FN_EQ(success, pfm->openFile(brokenName.c_str(), fileHandle), "Open recovered file");
+    TEST_FN_EQ(1, fileHandle.getNumberOfPages(), "Logged page redone");
+    TEST_FN_EQ(success, fileHandle.readPage(0, expected), "Read page");
+    TEST_FN_EQ(0, memcmp(buffer, expected, PAGE_LSN_OFFSET(PAGE_SIZE)), "Contents correct");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close recovered file");
+    TEST_FN_EQ(success, pfm->destroyFile(brokenName.c_str()), "Destroy file");
+
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    TEST_FN_EQ(success, rbfm->destroyFile(recordFileName.c_str()), "Destroy record file");
+    BufferPoolManager::instance()->setWriterInterval(DEFAULT_WRITER_INTERVAL_MS);
+    log->setCheckpointInterval(DEFAULT_CHECKPOINT_INTERVAL_MS);
+
+    cout << "\nWrite-ahead log Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    // Read the 25th page and check integrity
-    rc = fileHandle.readPage(24, buffer);
-    assert(rc == success);
-    
-    rc = memcmp(buffer, data, PAGE_SIZE);
-    assert(rc == success);
+// Reads a page straight from the file, bypassing the buffer pool
+bool readPageFromFile(const string &fileName, PageNum pageNum, void *data)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ok = pread(fd, data, PAGE_SIZE, FILE_HEADER_SIZE + (off_t) PAGE_SIZE * pageNum) == PAGE_SIZE;
+    close(fd);
+    return ok;
+}
 
-    // Close the file "test_2"
-    rc = pfm->closeFile(fileHandle);
-    assert(rc == success);
+// Dirty pages reach the file while it is still open, adjacent ones with a
+// single write
+void writerTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    // Destroy File
-    rc = pfm->destroyFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Background writer tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    bpm->setWriterInterval(0);
 
-    free(data);
-    free(buffer);
+    string fileName = "writer_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    PageBuffer pages(WRITER_MAX_RUN);
+    TEST_FN_EQ(success, fileHandle.appendPages(WRITER_MAX_RUN, pages), "Append pages");
 
-    if(!FileExists(fileName.c_str()))
+    unsigned char buffer[PAGE_SIZE];
+    for (unsigned i = 0; i < WRITER_MAX_RUN; i++)
     {
-        cout << "File " << fileName << " has been destroyed." << endl;
-        cout << "Test Case 7 Passed!" << endl << endl;
-        return 0;
+        memset(buffer, 'a' + i % 26, PAGE_SIZE);
+        rc = fileHandle.writePage(i, buffer);
+        assert(rc == success);
     }
-    else
+    readPageFromFile(fileName, 0, buffer);
+    TEST_FN_EQ(0, buffer[0], "Writes wait in the pool");
+
+    unsigned pagesBefore, writesBefore;
+    bpm->getWriteStats(pagesBefore, writesBefore);
+    bpm->setWriterInterval(10);
+    memset(buffer, 'a', PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.writePage(0, buffer), "Write starts the writer");
+
+    // Give the writer a second at most
+    bool written = false;
+    for (unsigned i = 0; i < 100 and not written; i++)
     {
-        cout << "Failed to destroy file!" << endl;
-        cout << "Test Case 7 Failed!" << endl << endl;
-        return -1;
+        this_thread::sleep_for(chrono::milliseconds(10));
+        written = readPageFromFile(fileName, WRITER_MAX_RUN - 1, buffer)
+                  and buffer[0] == 'a' + (WRITER_MAX_RUN - 1) % 26;
     }
+    TEST_FN_EQ(true, written, "Pages written in the background");
+    bool correct = true;
+    for (unsigned i = 0; i < WRITER_MAX_RUN; i++)
+        correct = correct and readPageFromFile(fileName, i, buffer) and buffer[0] == 'a' + i % 26;
+    TEST_FN_EQ(true, correct, "Contents correct");
+
+    unsigned pagesAfter, writesAfter;
+    bpm->getWriteStats(pagesAfter, writesAfter);
+    TEST_FN_EQ(WRITER_MAX_RUN, pagesAfter - pagesBefore, "Every page written once");
+    TEST_FN_EQ(1, writesAfter - writesBefore, "Adjacent pages coalesced");
+
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    bpm->setWriterInterval(DEFAULT_WRITER_INTERVAL_MS);
+
+    cout << "\nBackground writer Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-int RBFTest_8(RecordBasedFileManager *rbfm) {
-    // Functions tested
-    // 1. Create Record-Based File
-    // 2. Open Record-Based File
-    // 3. Insert Record
-    // 4. Read Record
-    // 5. Close Record-Based File
-    // 6. Destroy Record-Based File
-    cout << "****In RBF Test Case 8****" << endl;
-   
+// Closing a logged file leaves its dirty pages to the pool. A checkpoint
+// writes them out and empties the log, and one is taken by itself once the
+// log grows too large.
+void checkpointTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_3";
 
-    // Create a file named "test_3"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Checkpoint tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    LogManager *log = LogManager::instance();
+    bpm->setWriterInterval(0);
+    log->setCheckpointInterval(0);
 
-    if(FileExists(fileName.c_str()))
+    string fileName = "ckpt_test";
+    string logName = "ckpt_test.log";
+    TEST_FN_EQ(success, log->open(logName), "Open log");
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    int size;
+    prepareRecord(8, "ckptrecd", 30, 180.5, 7000, record, &size);
+
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    RID rid;
+    for (unsigned i = 0; i < 200; i++)
     {
-        cout << "File " << fileName << " has been created." << endl;
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
     }
-    else
+    unsigned numPages = fileHandle.getNumberOfPages();
+    TEST_FN_EQ(success, log->commit(), "Commit");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(true, bpm->hasHandle(fileName), "Dirty pages handed to the pool");
+
+    struct stat st;
+    stat(logName.c_str(), &st);
+    TEST_FN_EQ(true, st.st_size > (off_t) LOG_HEADER_SIZE, "Changes are in the log");
+    LSN lsn = log->getFlushedLSN();
+    TEST_FN_EQ(success, log->checkpoint(), "Checkpoint");
+    stat(logName.c_str(), &st);
+    TEST_FN_EQ(LOG_HEADER_SIZE, st.st_size, "Log emptied");
+    TEST_VAL_EQ(lsn, log->getBaseLSN(), "Log starts at the checkpoint");
+
+    // The file now holds what the pool does
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    unsigned char cached[PAGE_SIZE];
+    unsigned char onDisk[PAGE_SIZE];
+    bool correct = true;
+    for (unsigned i = 0; i < numPages; i++)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 8 Failed!" << endl << endl;
-        return -1;
+        correct = correct and fileHandle.readPage(i, cached) == success
+                  and readPageFromFile(fileName, i, onDisk)
+                  and memcmp(cached, onDisk, PAGE_SIZE) == 0;
     }
+    TEST_FN_EQ(true, correct, "Pages on disk match the pool");
 
-    // Open the file "test_3"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
-   
-      
-    RID rid; 
-    int recordSize = 0;
-    void *record = malloc(100);
-    void *returnedData = malloc(100);
+    // A log past the size limit brings the next checkpoint forward
+    log->setCheckpointSize(16 * PAGE_SIZE);
+    log->setCheckpointInterval(60000);
+    for (unsigned i = 0; i < 200; i++)
+    {
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+    }
+    TEST_FN_EQ(success, log->commit(), "Commit");
+    bool checkpointed = false;
+    for (unsigned i = 0; i < 200 and not checkpointed; i++)
+    {
+        this_thread::sleep_for(chrono::milliseconds(10));
+        checkpointed = log->getBaseLSN() > lsn;
+    }
+    TEST_FN_EQ(true, checkpointed, "Checkpoint taken as the log grew");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
 
-    vector<Attribute> recordDescriptor;
-    createRecordDescriptor(recordDescriptor);
-    
-    // Insert a record into a file
-    prepareRecord(6, "Peters", 24, 170.1f, 5000, record, &recordSize);
-    cout << "Insert Data:" << endl;
-    rbfm->printRecord(recordDescriptor, record);
-    
-    rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-    assert(rc == success);
-    
-    // Given the rid, read the record from file
-    rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returnedData);
-    assert(rc == success);
+    TEST_FN_EQ(success, log->close(), "Close log");
+    log->setCheckpointSize(DEFAULT_CHECKPOINT_SIZE);
+    log->setCheckpointInterval(DEFAULT_CHECKPOINT_INTERVAL_MS);
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+    TEST_FN_EQ(false, bpm->hasHandle(fileName), "Pool handle released");
+    bpm->setWriterInterval(DEFAULT_WRITER_INTERVAL_MS);
 
-#ifndef REDIRECT_PRINT_RECORD
-    // Ignore this spammy message when we're redirecting directly to file
-    cout << "Returned Data:" << endl;
-#endif
-    rbfm->printRecord(recordDescriptor, returnedData);
+    cout << "\nCheckpoint Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    // Compare whether the two memory blocks are the same
-    if(memcmp(record, returnedData, recordSize) != 0)
+// Files record their own page size. Pages of different sizes share the
+// buffer pool and the log, and a record file with large pages holds
+// records that would not fit a PAGE_SIZE page.
+void pageSizeTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
+
+    cout << "Page size tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    LogManager *log = LogManager::instance();
+    pfm->setExtentSize(4);
+
+    string fileName = "psize_test";
+    TEST_FN_EQ(err::FILE_INVALID_PAGE_SIZE, pfm->createFile(fileName.c_str(), 2048), "Page size below the minimum");
+    TEST_FN_EQ(err::FILE_INVALID_PAGE_SIZE, pfm->createFile(fileName.c_str(), 2 * MAX_PAGE_SIZE), "Page size above the maximum");
+    TEST_FN_EQ(err::FILE_INVALID_PAGE_SIZE, pfm->createFile(fileName.c_str(), 3 * PAGE_SIZE), "Page size not a power of two");
+
+    const unsigned pageSize = 4 * PAGE_SIZE;
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str(), pageSize), "Create file with 16K pages");
+    unsigned stored = 0;
+    int fd = open(fileName.c_str(), O_RDONLY);
+    pread(fd, &stored, sizeof(unsigned), PAGE_SIZE_OFFSET);
+    close(fd);
+    TEST_FN_EQ(pageSize, stored, "Page size recorded in the header");
+
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(pageSize, fileHandle.getPageSize(), "Handle uses the file's page size");
+    PageBuffer pages(3, pageSize);
+    for (unsigned i = 0; i < 3; i++)
+        memset(pages + pageSize * i, 0x30 + i, pageSize);
+    TEST_FN_EQ(success, fileHandle.appendPages(3, pages), "Append pages");
+    TEST_FN_EQ(success, fileHandle.appendPage(pages), "Append page");
+    struct stat st;
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(FILE_HEADER_SIZE + 4 * pageSize, st.st_size, "Extent counted in large pages");
+
+    // Mix pages of both sizes in the pool
+    FileHandle small;
+    TEST_FN_EQ(success, pfm->createFile("psize_small"), "Create file with default pages");
+    TEST_FN_EQ(success, pfm->openFile("psize_small", small), "Open file with default pages");
+    TEST_FN_EQ(PAGE_SIZE, small.getPageSize(), "Default page size");
+    unsigned char smallPage[PAGE_SIZE];
+    memset(smallPage, 0x5A, PAGE_SIZE);
+    TEST_FN_EQ(success, small.appendPage(smallPage), "Append default page");
+
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    PageBuffer buffer(1, pageSize);
+    bool correct = true;
+    for (unsigned round = 0; round < 3; round++)
     {
-       cout << "Test Case 8 Failed!" << endl << endl;
-        free(record);
-        free(returnedData);
-        return -1;
+        for (unsigned i = 0; i < 4; i++)
+        {
+            unsigned char expected = 0x30 + i % 3;
+            correct = correct and fileHandle.readPage(i, buffer) == success
+                      and buffer[0] == expected and buffer[pageSize - 1] == expected;
+            correct = correct and small.readPage(0, smallPage) == success
+                      and smallPage[PAGE_SIZE - 1] == 0x5A;
+        }
+        bpm->setNumFrames(2);
     }
-    
-    // Close the file "test_3"
-    rc = rbfm->closeFile(fileHandle);
-    assert(rc == success);
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
+    TEST_FN_EQ(true, correct, "Pages of both sizes read back through the pool");
 
-    // Destroy File
-    rc = rbfm->destroyFile(fileName.c_str());
-    assert(rc == success);
-    
-    free(record);
-    free(returnedData);
-    cout << "Test Case 8 Passed!" << endl << endl;
-    
-    return 0;
+    memset(buffer, 0x77, pageSize);
+    TEST_FN_EQ(success, fileHandle.writePage(2, buffer), "Write page");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->closeFile(small), "Close file with default pages");
+
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle, OPEN_MMAP), "Reopen file mapped");
+    TEST_FN_EQ(4, fileHandle.getNumberOfPages(), "Page count persisted");
+    TEST_FN_EQ(success, fileHandle.readPage(2, buffer), "Read mapped page");
+    TEST_FN_EQ(true, buffer[0] == 0x77 and buffer[pageSize - 1] == 0x77, "Mapped page correct");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    // Files written before page sizes were recorded have 0 in the header
+    unsigned zero = 0;
+    fd = open("psize_small", O_WRONLY);
+    pwrite(fd, &zero, sizeof(unsigned), PAGE_SIZE_OFFSET);
+    close(fd);
+    TEST_FN_EQ(success, pfm->openFile("psize_small", small), "Open file without a page size");
+    TEST_FN_EQ(PAGE_SIZE, small.getPageSize(), "Page size defaults to PAGE_SIZE");
+    TEST_FN_EQ(success, small.readPage(0, smallPage), "Read page");
+    TEST_FN_EQ(0x5A, smallPage[0], "Contents correct");
+    TEST_FN_EQ(success, pfm->closeFile(small), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile("psize_small"), "Destroy file");
+    pfm->setExtentSize(DEFAULT_EXTENT_PAGES);
+
+    // A record larger than a default page, logged and redone with 64K pages
+    TEST_FN_EQ(success, log->open("psize_test.log"), "Open log");
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str(), MAX_PAGE_SIZE), "Create record file with 64K pages");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open record file");
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "Blob";
+    attr.type = TypeVarChar;
+    attr.length = (AttrLength) (6 * PAGE_SIZE);
+    recordDescriptor.push_back(attr);
+
+    unsigned length = 6 * PAGE_SIZE;
+    vector<char> record(sizeof(unsigned) + length);
+    vector<char> returned(record.size());
+    memcpy(&record[0], &length, sizeof(unsigned));
+    for (unsigned i = 0; i < length; i++)
+        record[sizeof(unsigned) + i] = 'a' + i % 26;
+    RID rid;
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, &record[0], rid), "Insert record larger than PAGE_SIZE");
+    TEST_FN_EQ(1, rid.pageNum, "Record fits the first data page");
+    RID second;
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, &record[0], second), "Insert second record");
+    TEST_FN_EQ(1, second.pageNum, "Second record shares the page");
+    TEST_FN_EQ(success, log->commit(), "Commit");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, log->close(), "Close log");
+    TEST_FN_EQ(success, log->open("psize_test.log"), "Reopen log, redoing 64K pages");
+
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Reopen record file");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, second, &returned[0]), "Read record");
+    TEST_FN_EQ(0, memcmp(&record[0], &returned[0], record.size()), "Record intact");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, log->close(), "Close log");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy record file");
+
+    cout << "\nPage size Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-int RBFTest_9(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
-    // Functions tested
-    // 1. Create Record-Based File
-    // 2. Open Record-Based File
-    // 3. Insert Multiple Records
-    // 4. Close Record-Based File
-    cout << "****In RBF Test Case 9****" << endl;
-   
+void ioStatsTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_4";
-
-    // Create a file named "test_4"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == success);
 
-    if(FileExists(fileName.c_str()))
-    {
-        cout << "File " << fileName << " has been created." << endl;
-    }
-    else
-    {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 9 Failed!" << endl << endl;
-        return -1;
-    }
+    cout << "I/O statistics tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
 
-    // Open the file "test_4"
+    string fileName = "iostats_test";
+    IOCounters counters;
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
     FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, pfm->getIOStats(fileName, IO_APPEND, counters), "Stats started on open");
+    TEST_FN_EQ(0, counters.ops, "No appends yet");
+
+    PageBuffer pages(2);
+    memset(pages, 0x41, 2 * PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.appendPages(2, pages), "Append two pages");
+    pfm->getIOStats(fileName, IO_APPEND, counters);
+    TEST_FN_EQ(1, counters.ops, "One append operation");
+    TEST_FN_EQ(2, counters.pages, "Two pages appended");
+    TEST_FN_EQ(2 * PAGE_SIZE, counters.bytes, "Bytes appended");
+    unsigned long long bucketed = 0;
+    for (unsigned i = 0; i < IO_LATENCY_BUCKETS; i++)
+        bucketed += counters.latency[i];
+    TEST_VAL_EQ(counters.ops, bucketed, "Every append in a latency bucket");
+
+    // Start from an empty pool so the first read misses
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
+    pfm->resetIOStats();
+    pfm->getIOStats(fileName, IO_READ, counters);
+    TEST_FN_EQ(0, counters.ops, "Reset clears reads");
+    TEST_FN_EQ(success, fileHandle.readPage(0, pages), "Read page");
+    pfm->getIOStats(fileName, IO_READ, counters);
+    unsigned long long missReads = counters.ops;
+    TEST_FN_EQ(true, missReads >= 1 and counters.bytes == counters.pages * PAGE_SIZE, "Miss read from disk");
+    TEST_FN_EQ(success, fileHandle.readPage(0, pages), "Read page again");
+    pfm->getIOStats(fileName, IO_READ, counters);
+    TEST_VAL_EQ(missReads, counters.ops, "Pool hit not counted");
+
+    memset(pages, 0x42, PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.writePage(1, pages), "Write page");
+    TEST_FN_EQ(success, fileHandle.sync(), "Sync");
+    pfm->getIOStats(fileName, IO_WRITE, counters);
+    TEST_FN_EQ(true, counters.ops >= 1 and counters.pages >= 1, "Write reached the disk");
+    pfm->getIOStats(fileName, IO_SYNC, counters);
+    TEST_FN_EQ(1, counters.ops, "Sync counted");
+    TEST_FN_EQ(0, counters.bytes, "Sync moves no bytes");
+
+    IOCounters total;
+    pfm->getIOStats(fileName, IO_WRITE, counters);
+    pfm->getTotalIOStats(IO_WRITE, total);
+    TEST_FN_EQ(true, total.ops >= counters.ops and total.bytes >= counters.bytes, "Totals include the file");
+
+    ostringstream json;
+    pfm->dumpIOStats(json);
+    TEST_FN_EQ(true, json.str().find("\"" + fileName + "\": {\"read\"") != string::npos, "File listed in JSON");
+    TEST_FN_EQ(true, json.str().find("\"total\": {\"read\"") != string::npos, "Totals listed in JSON");
 
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->getIOStats(fileName, IO_SYNC, counters), "Stats kept after close");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    TEST_FN_EQ(err::FILE_NOT_FOUND, pfm->getIOStats(fileName, IO_SYNC, counters), "Stats dropped with the file");
 
-    RID rid; 
-    void *record = malloc(1000);
-    int numRecords = 2000;
-    // int numRecords = 500;
+    cout << "\nI/O statistics Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    vector<Attribute> recordDescriptor;
-    createLargeRecordDescriptor(recordDescriptor);
+void compressionTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    for(unsigned i = 0; i < recordDescriptor.size(); i++)
+    cout << "Compression tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+
+    // The codec on its own
+    vector<char> text(PAGE_SIZE), random(PAGE_SIZE), packed(2 * PAGE_SIZE), unpacked(PAGE_SIZE);
+    for (unsigned i = 0; i < PAGE_SIZE; i++)
     {
-        cout << "Attribute Name: " << recordDescriptor[i].name << endl;
-        cout << "Attribute Type: " << (AttrType)recordDescriptor[i].type << endl;
-        cout << "Attribute Length: " << recordDescriptor[i].length << endl << endl;
+        text[i] = "the quick brown fox jumps over the lazy dog "[i % 44];
+        random[i] = rand();
     }
+    size_t size = lzCompress(text.data(), PAGE_SIZE, packed.data(), PAGE_SIZE);
+    TEST_FN_EQ(true, size > 0 and size < PAGE_SIZE / 4, "Repetitive page compresses");
+    TEST_FN_EQ(true, lzDecompress(packed.data(), size, unpacked.data(), PAGE_SIZE), "Decompress");
+    TEST_FN_EQ(0, memcmp(text.data(), unpacked.data(), PAGE_SIZE), "Round trip");
+    TEST_FN_EQ(0, lzCompress(random.data(), PAGE_SIZE, packed.data(), PAGE_SIZE - 1), "Random page does not fit");
+    size = lzCompress(random.data(), PAGE_SIZE, packed.data(), PAGE_SIZE + PAGE_SIZE / 64 + 16);
+    TEST_FN_EQ(true, size > 0 and lzDecompress(packed.data(), size, unpacked.data(), PAGE_SIZE)
+                     and memcmp(random.data(), unpacked.data(), PAGE_SIZE) == 0, "Random page round trip");
+    TEST_FN_EQ(false, lzDecompress(packed.data(), size / 2, unpacked.data(), PAGE_SIZE), "Truncated input rejected");
+    packed[0] = 0x0F;
+    packed[1] = 0xFF;
+    packed[2] = 0xFF;
+    TEST_FN_EQ(false, lzDecompress(packed.data(), 3, unpacked.data(), PAGE_SIZE), "Match before the start rejected");
+
+    string fileName = "compress_test";
+    const unsigned numPages = 64;
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str(), PAGE_SIZE, CREATE_COMPRESSED), "Create compressed file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle, OPEN_MMAP), "Open compressed file");
+    TEST_FN_EQ(true, fileHandle.isCompressed() and not fileHandle.isMapped(), "Compressed file not mapped");
 
-    // Insert 2000 records into file
-    for(int i = 0; i < numRecords; i++)
+    PageBuffer pages(numPages);
+    for (unsigned i = 0; i < numPages; i++)
     {
-        // Test insert Record
-        int size = 0;
-        memset(record, 0, 1000);
-        prepareLargeRecord(i, record, &size);
+        memcpy(pages + PAGE_SIZE * i, text.data(), PAGE_SIZE);
+        memcpy(pages + PAGE_SIZE * i, &i, sizeof(unsigned));
+    }
+    TEST_FN_EQ(success, fileHandle.appendPages(numPages - 1, pages), "Append pages");
+    TEST_FN_EQ(success, fileHandle.appendPage(pages + PAGE_SIZE * (numPages - 1)), "Append page");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    struct stat st;
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(true, st.st_size < FILE_HEADER_SIZE + numPages * PAGE_SIZE / 4, "File a fraction of its pages");
+
+    // A full scan reads the compressed pages together
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    TEST_FN_EQ(numPages, fileHandle.getNumberOfPages(), "Page count persisted");
+    pfm->resetIOStats();
+    PageBuffer scanned(numPages);
+    TEST_FN_EQ(success, fileHandle.readPages(0, numPages, scanned), "Read all pages");
+    TEST_FN_EQ(0, memcmp(pages, scanned, numPages * PAGE_SIZE), "Pages decompressed");
+    IOCounters counters;
+    pfm->getIOStats(fileName, IO_READ, counters);
+    TEST_FN_EQ(numPages, counters.pages, "Every page read from disk");
+    TEST_FN_EQ(true, counters.ops <= 2 and counters.bytes < numPages * PAGE_SIZE / 4, "Scan reads compressed bytes");
+
+    // A page that no longer compresses moves
+    memcpy(pages + PAGE_SIZE * 5, random.data(), PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.writePage(5, pages + PAGE_SIZE * 5), "Rewrite page uncompressible");
+    memset(pages + PAGE_SIZE * 6, 0, PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.writePage(6, pages + PAGE_SIZE * 6), "Rewrite page smaller");
+    TEST_FN_EQ(success, fileHandle.sync(), "Sync");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
 
-        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle, OPEN_DIRECT), "Reopen file");
+    TEST_FN_EQ(false, fileHandle.isDirect(), "Compressed file not direct");
+    TEST_FN_EQ(success, fileHandle.readPages(0, numPages, scanned), "Read all pages");
+    TEST_FN_EQ(0, memcmp(pages, scanned, numPages * PAGE_SIZE), "Rewritten pages intact");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
+    // Records see whole pages
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str(), PAGE_SIZE, CREATE_COMPRESSED), "Create compressed record file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open record file");
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    char returned[PAGE_SIZE];
+    int recordSize;
+    vector<RID> rids;
+    bool inserted = true;
+    for (unsigned i = 0; i < 2000; i++)
+    {
+        RID rid;
+        prepareRecord(8, "Compress", i, 170.1f, 5000, record, &recordSize);
+        inserted = inserted and rbfm->insertRecord(fileHandle, recordDescriptor, record, rid) == success;
         rids.push_back(rid);
-        sizes.push_back(size);        
     }
-    // Close the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
-    assert(rc == success);
+    TEST_FN_EQ(true, inserted, "Insert records");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
 
-    free(record);    
-    cout << "Test Case 9 Passed!" << endl << endl;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Reopen record file");
+    bool correct = true;
+    for (unsigned i = 0; i < rids.size(); i++)
+    {
+        prepareRecord(8, "Compress", i, 170.1f, 5000, record, &recordSize);
+        correct = correct and rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returned) == success
+                  and memcmp(record, returned, recordSize) == 0;
+    }
+    TEST_FN_EQ(true, correct, "Records read back");
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(true, st.st_size < FILE_HEADER_SIZE + fileHandle.getNumberOfPages() * PAGE_SIZE / 2, "Record file compressed");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy record file");
 
-    return 0;
+    cout << "\nCompression Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-int RBFTest_10(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
-    // Functions tested
-    // 1. Open Record-Based File
-    // 2. Read Multiple Records
-    // 3. Close Record-Based File
-    // 4. Destroy Record-Based File
-    cout << "****In RBF Test Case 10****" << endl;
-   
+void tablespaceTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_4";
-
-    // Open the file "test_4"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
-    
-    int numRecords = 2000;
-    void *record = malloc(1000);
-    void *returnedData = malloc(1000);
 
-    vector<Attribute> recordDescriptor;
-    createLargeRecordDescriptor(recordDescriptor);
-    
-    for(int i = 0; i < numRecords; i++)
+    cout << "Tablespace tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+
+    string spaceName = "space_test";
+    TEST_FN_EQ(success, pfm->createTablespace(spaceName), "Create tablespace");
+    TEST_FN_EQ(err::FILE_ALREADY_EXISTS, pfm->createTablespace(spaceName), "Create tablespace again");
+    FileHandle plain;
+    TEST_FN_EQ(err::FILE_CORRUPT, pfm->openFile(spaceName, plain), "Tablespace is not a paged file");
+    TEST_FN_EQ(success, pfm->useTablespace(spaceName), "Use tablespace");
+    TEST_FN_EQ(true, pfm->inTablespace(), "In tablespace");
+    unsigned openFiles = pfm->getNumOpenFiles();
+
+    TEST_FN_EQ(success, pfm->createFile("seg_a"), "Create segment");
+    TEST_FN_EQ(success, pfm->createFile("seg_b"), "Create second segment");
+    TEST_FN_EQ(err::FILE_ALREADY_EXISTS, pfm->createFile("seg_a"), "Create segment again");
+    TEST_FN_EQ(err::FILE_INVALID_PAGE_SIZE, pfm->createFile("seg_c", 4 * PAGE_SIZE), "Segment of another page size");
+    TEST_FN_EQ(err::FEATURE_NOT_YET_IMPLEMENTED, pfm->createFile("seg_c", PAGE_SIZE, CREATE_COMPRESSED), "Compressed segment");
+    TEST_FN_EQ(true, pfm->fileExists("seg_a") and not FileExists("seg_a"), "Segment is not a file of its own");
+
+    // Grow the segments in turns, so that their extents interleave
+    FileHandle a, b;
+    TEST_FN_EQ(success, pfm->openFile("seg_a", a, OPEN_MMAP | OPEN_DIRECT), "Open segment");
+    TEST_FN_EQ(success, pfm->openFile("seg_b", b), "Open second segment");
+    TEST_FN_EQ(true, a.isSegment() and not a.isMapped() and not a.isDirect(), "Segment not mapped or direct");
+    TEST_VAL_EQ(openFiles, pfm->getNumOpenFiles(), "No descriptors of their own");
+    PageBuffer pages(40);
+    bool appended = true;
+    for (unsigned round = 0; round < 4; round++)
     {
-        memset(record, 0, 1000);
-        memset(returnedData, 0, 1000);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returnedData);
-        assert(rc == success);
-        
-#ifndef REDIRECT_PRINT_RECORD
-        // Ignore this spammy message when we're redirecting directly to file
-        cout << "Returned Data:" << endl;
-#endif
-        rbfm->printRecord(recordDescriptor, returnedData);
-
-        int size = 0;
-        prepareLargeRecord(i, record, &size);
-        if(memcmp(returnedData, record, sizes[i]) != 0)
+        for (unsigned i = 0; i < 10; i++)
         {
-            cout << "Test Case 10 Failed!" << endl << endl;
-            free(record);
-            free(returnedData);
-            return -1;
+            unsigned value = round * 10 + i;
+            memset(pages + PAGE_SIZE * i, 0, PAGE_SIZE);
+            memcpy(pages + PAGE_SIZE * i, &value, sizeof(unsigned));
+            appended = appended and a.appendPage(pages + PAGE_SIZE * i) == success;
         }
+        appended = appended and b.appendPages(10, pages) == success;
     }
-    
-    // Close the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
-    assert(rc == success);
-    
-    rc = rbfm->destroyFile(fileName.c_str());
-    assert(rc == success);
-
-    if(!FileExists(fileName.c_str())) {
-        cout << "File " << fileName << " has been destroyed." << endl << endl;
-        free(record);
-        free(returnedData);
-        cout << "Test Case 10 Passed!" << endl << endl;
-        return 0;
-    }
-    else {
-        cout << "Failed to destroy file!" << endl;
-        cout << "Test Case 10 Failed!" << endl << endl;
-        free(record);
-        free(returnedData);
-        return -1;
-    }
+    TEST_FN_EQ(true, appended, "Append to both segments");
+    TEST_FN_EQ(40, a.getNumberOfPages(), "Segment page count");
+
+    // A read across extents that are not next to each other
+    bpm->setNumFrames(DEFAULT_NUM_FRAMES);
+    TEST_FN_EQ(success, a.readPages(0, 40, pages), "Read across extents");
+    bool correct = true;
+    for (unsigned i = 0; i < 40; i++)
+        correct = correct and *(unsigned*) (pages + PAGE_SIZE * i) == i;
+    TEST_FN_EQ(true, correct, "Pages in order");
+    memset(pages, 0x5A, PAGE_SIZE);
+    TEST_FN_EQ(success, b.writePage(33, pages), "Write page");
+
+    TEST_FN_EQ(err::FILE_IN_USE, pfm->closeTablespace(), "Close tablespace in use");
+    TEST_FN_EQ(success, pfm->closeFile(a), "Close segment");
+    TEST_FN_EQ(success, pfm->closeFile(b), "Close second segment");
+
+    // Records stored in a segment
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    char returned[PAGE_SIZE];
+    int recordSize;
+    prepareRecord(5, "Space", 30, 180.5f, 7000, record, &recordSize);
+    FileHandle fileHandle;
+    RID rid;
+    TEST_FN_EQ(success, rbfm->createFile("seg_records"), "Create record segment");
+    TEST_FN_EQ(success, rbfm->openFile("seg_records", fileHandle), "Open record segment");
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record segment");
+
+    TEST_FN_EQ(success, pfm->closeTablespace(), "Close tablespace");
+    TEST_FN_EQ(false, pfm->inTablespace() or pfm->fileExists("seg_a"), "Back to plain files");
+
+    TEST_FN_EQ(success, pfm->useTablespace(spaceName), "Use tablespace again");
+    TEST_FN_EQ(success, pfm->openFile("seg_b", b), "Reopen segment");
+    TEST_FN_EQ(40, b.getNumberOfPages(), "Page count kept in the directory");
+    TEST_FN_EQ(success, b.readPage(33, pages), "Read page");
+    TEST_FN_EQ(0x5A, pages[PAGE_SIZE - 1], "Written page kept");
+    TEST_FN_EQ(success, b.readPage(39, pages), "Read last page");
+    unsigned value;
+    memcpy(&value, pages, sizeof(unsigned));
+    TEST_FN_EQ(39, value, "Appended page kept");
+    TEST_FN_EQ(success, pfm->closeFile(b), "Close segment");
+    TEST_FN_EQ(success, rbfm->openFile("seg_records", fileHandle), "Reopen record segment");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rid, returned), "Read record");
+    TEST_FN_EQ(0, memcmp(record, returned, recordSize), "Record intact");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record segment");
+
+    // The space of a destroyed segment is reused
+    struct stat st;
+    stat(spaceName.c_str(), &st);
+    off_t size = st.st_size;
+    TEST_FN_EQ(success, pfm->destroyFile("seg_a"), "Destroy segment");
+    TEST_FN_EQ(false, pfm->fileExists("seg_a"), "Segment gone");
+    TEST_FN_EQ(err::FILE_NOT_FOUND, pfm->openFile("seg_a", a), "Open destroyed segment");
+    TEST_FN_EQ(success, pfm->createFile("seg_c"), "Create segment");
+    TEST_FN_EQ(success, pfm->openFile("seg_c", fileHandle), "Open segment");
+    TEST_FN_EQ(success, fileHandle.appendPages(24, pages), "Append pages");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close segment");
+    stat(spaceName.c_str(), &st);
+    TEST_FN_EQ(size, st.st_size, "Tablespace did not grow");
+
+    TEST_FN_EQ(success, pfm->closeTablespace(), "Close tablespace");
+    TEST_FN_EQ(err::FILE_NOT_FOUND, pfm->useTablespace("space_missing"), "Missing tablespace");
+
+    cout << "\nTablespace Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-int RBFTest_11(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
-    // Functions tested
-    // 1. Create Record-Based File
-    // 2. Open Record-Based File
-    // 3. Insert Multiple Records
-    // 4. Close Record-Based File
-    cout << "****In RBF Test Case 11****" << endl;
-   
+void truncateTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
     RC rc;
-    string fileName = "test_5";
 
-    // Create a file named "our_test_4"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == success);
+    cout << "Truncate tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    LogManager *log = LogManager::instance();
 
-    if(FileExists(fileName.c_str()))
-    {
-        cout << "File " << fileName << " has been created." << endl;
-    }
-    else
+    string fileName = "trunc_test";
+    PageBuffer pages(64);
+    for (unsigned i = 0; i < 64; i++)
+        memcpy(pages + PAGE_SIZE * i, &i, sizeof(unsigned));
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle, other;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, fileHandle.appendPages(10, pages), "Append pages");
+    // Leaves a dirty frame behind for a page that is about to go
+    TEST_FN_EQ(success, fileHandle.writePage(3, pages + PAGE_SIZE * 9), "Write page");
+
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), other), "Open file again");
+    TEST_FN_EQ(err::FILE_IN_USE, fileHandle.truncate(3), "Truncate with another handle open");
+    TEST_FN_EQ(success, pfm->closeFile(other), "Close other handle");
+    PageGuard page;
+    TEST_FN_EQ(success, page.pin(fileHandle, 8), "Pin page");
+    TEST_FN_EQ(err::BUFFER_FRAME_PINNED, fileHandle.truncate(3), "Truncate past a pinned page");
+    page.release();
+    TEST_FN_EQ(err::FILE_PAGE_NOT_FOUND, fileHandle.truncate(11), "Truncate to more pages");
+
+    TEST_FN_EQ(success, fileHandle.truncate(3), "Truncate");
+    TEST_FN_EQ(3, fileHandle.getNumberOfPages(), "Page count");
+    struct stat st;
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(FILE_HEADER_SIZE + 3 * PAGE_SIZE, st.st_size, "File cut");
+    unsigned char buffer[PAGE_SIZE];
+    TEST_FN_EQ(err::FILE_PAGE_NOT_FOUND, fileHandle.readPage(3, buffer), "Dropped page gone");
+    TEST_FN_EQ(success, fileHandle.readPage(2, buffer), "Read kept page");
+    TEST_FN_EQ(0, memcmp(buffer, pages + PAGE_SIZE * 2, PAGE_SIZE), "Kept page intact");
+    TEST_FN_EQ(success, fileHandle.appendPage(pages + PAGE_SIZE * 20), "Append page");
+    TEST_FN_EQ(success, fileHandle.readPage(3, buffer), "Read appended page");
+    TEST_FN_EQ(0, memcmp(buffer, pages + PAGE_SIZE * 20, PAGE_SIZE), "No stale frame");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    TEST_FN_EQ(4, fileHandle.getNumberOfPages(), "Page count persisted");
+    TEST_FN_EQ(success, fileHandle.readPage(3, buffer), "Read appended page");
+    TEST_FN_EQ(0, memcmp(buffer, pages + PAGE_SIZE * 20, PAGE_SIZE), "Appended page persisted");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    // The page map of a compressed file shrinks with it
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str(), PAGE_SIZE, CREATE_COMPRESSED), "Create compressed file");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open compressed file");
+    TEST_FN_EQ(success, fileHandle.appendPages(64, pages), "Append pages");
+    TEST_FN_EQ(success, fileHandle.sync(), "Sync");
+    stat(fileName.c_str(), &st);
+    off_t size = st.st_size;
+    TEST_FN_EQ(success, fileHandle.truncate(5), "Truncate compressed file");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close compressed file");
+    stat(fileName.c_str(), &st);
+    TEST_FN_EQ(true, st.st_size < size, "Compressed file cut");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen compressed file");
+    TEST_FN_EQ(5, fileHandle.getNumberOfPages(), "Page count persisted");
+    PageBuffer scanned(5);
+    TEST_FN_EQ(success, fileHandle.readPages(0, 5, scanned), "Read kept pages");
+    TEST_FN_EQ(0, memcmp(scanned, pages, 5 * PAGE_SIZE), "Kept pages intact");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close compressed file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy compressed file");
+
+    // A segment gives its extents back to the tablespace
+    string spaceName = "trunc_space";
+    TEST_FN_EQ(success, pfm->createTablespace(spaceName), "Create tablespace");
+    TEST_FN_EQ(success, pfm->useTablespace(spaceName), "Use tablespace");
+    TEST_FN_EQ(success, pfm->createFile("seg_trunc"), "Create segment");
+    TEST_FN_EQ(success, pfm->openFile("seg_trunc", fileHandle), "Open segment");
+    TEST_FN_EQ(success, fileHandle.appendPages(64, pages), "Append pages");
+    stat(spaceName.c_str(), &st);
+    size = st.st_size;
+    TEST_FN_EQ(success, fileHandle.truncate(1), "Truncate segment");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close segment");
+    TEST_FN_EQ(success, pfm->createFile("seg_other"), "Create second segment");
+    TEST_FN_EQ(success, pfm->openFile("seg_other", other), "Open second segment");
+    TEST_FN_EQ(success, other.appendPages(32, pages), "Append pages");
+    TEST_FN_EQ(success, pfm->closeFile(other), "Close second segment");
+    stat(spaceName.c_str(), &st);
+    TEST_FN_EQ(size, st.st_size, "Freed extents reused");
+    TEST_FN_EQ(success, pfm->openFile("seg_trunc", fileHandle), "Reopen segment");
+    TEST_FN_EQ(1, fileHandle.getNumberOfPages(), "Page count in the directory");
+    TEST_FN_EQ(success, fileHandle.readPage(0, buffer), "Read kept page");
+    TEST_FN_EQ(0, memcmp(buffer, pages, PAGE_SIZE), "Kept page intact");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close segment");
+    TEST_FN_EQ(success, pfm->closeTablespace(), "Close tablespace");
+
+    // Deleting every record leaves what createFile does
+    string recordFileName = "trunc_records";
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    char returned[PAGE_SIZE];
+    int recordSize;
+    prepareRecord(8, "Truncate", 40, 175.5f, 6000, record, &recordSize);
+    TEST_FN_EQ(success, rbfm->createFile(recordFileName.c_str()), "Create record file");
+    TEST_FN_EQ(success, rbfm->openFile(recordFileName.c_str(), fileHandle), "Open record file");
+    RID rid, last;
+    bool inserted = true;
+    for (unsigned i = 0; i < 1000; i++)
+        inserted = inserted and rbfm->insertRecord(fileHandle, recordDescriptor, record, last) == success;
+    TEST_FN_EQ(true, inserted, "Insert records");
+    TEST_FN_EQ(success, rbfm->deleteRecords(fileHandle), "Delete every record");
+    TEST_FN_EQ(2, fileHandle.getNumberOfPages(), "Map page and one data page left");
+    TEST_FN_EQ(err::FILE_PAGE_NOT_FOUND, rbfm->readRecord(fileHandle, recordDescriptor, last, returned), "Old record gone");
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    TEST_FN_EQ(1, rid.pageNum, "Record on the first data page");
+    TEST_FN_EQ(0, rid.slotNum, "Record in the first slot");
+    RBFM_ScanIterator scanner;
+    vector<string> names;
+    names.push_back("EmpName");
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, returned) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_FN_EQ(1, count, "Only the new record scanned");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, rbfm->destroyFile(recordFileName.c_str()), "Destroy record file");
+
+    // Recovery does not bring truncated pages back
+    string logName = "trunc_test.log";
+    BufferPoolManager::instance()->setWriterInterval(0);
+    log->setCheckpointInterval(0);
+    pid_t pid = fork();
+    if (pid == 0)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case 9 Failed!" << endl << endl;
-        return -1;
+        if (log->open(logName) != success or pfm->createFile(fileName.c_str()) != success
+                or pfm->openFile(fileName.c_str(), fileHandle, OPEN_LOGGED) != success
+                or fileHandle.appendPages(10, pages) != success
+                or log->commit() != success
+                or fileHandle.truncate(2) != success
+                or fileHandle.appendPage(pages + PAGE_SIZE * 30) != success)
+            _exit(1);
+        _exit(log->commit() == success ? 0 : 1);
     }
+    int status;
+    waitpid(pid, &status, 0);
+    TEST_FN_EQ(0, WEXITSTATUS(status), "Child truncated a logged file and crashed");
+    TEST_FN_EQ(success, log->open(logName), "Open log and recover");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open recovered file");
+    TEST_FN_EQ(3, fileHandle.getNumberOfPages(), "Truncation redone");
+    TEST_FN_EQ(success, fileHandle.readPage(2, buffer), "Read page appended since");
+    TEST_FN_EQ(0, memcmp(buffer, pages + PAGE_SIZE * 30, sizeof(unsigned)), "Page appended since recovered");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close recovered file");
+    TEST_FN_EQ(success, log->close(), "Close log");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    BufferPoolManager::instance()->setWriterInterval(DEFAULT_WRITER_INTERVAL_MS);
+    log->setCheckpointInterval(DEFAULT_CHECKPOINT_INTERVAL_MS);
+
+    cout << "\nTruncate Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    // Open the file "our_test_4"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
+// Number of syncs counted for fileName so far
+unsigned long long countSyncs(const string &fileName)
+{
+    IOCounters counters;
+    PagedFileManager::instance()->getIOStats(fileName, IO_SYNC, counters);
+    return counters.ops;
+}
 
+void syncPolicyTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    RID rid; 
-    char record[1000];
-    char record_copy[1000];
-    int numRecords = 10;
+    cout << "Sync policy tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
-    vector<Attribute> recordDescriptor;
-    createLargeRecordDescriptor(recordDescriptor);
+    string fileName = "sync_test";
+    PageBuffer pages(16);
+    for (unsigned i = 0; i < 16; i++)
+        memset(pages + PAGE_SIZE * i, 'a' + i, PAGE_SIZE);
+    unsigned char buffer[PAGE_SIZE];
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
 
-    for(unsigned i = 0; i < recordDescriptor.size(); i++)
-    {
-        cout << "Attribute Name: " << recordDescriptor[i].name << endl;
-        cout << "Attribute Type: " << (AttrType)recordDescriptor[i].type << endl;
-        cout << "Attribute Length: " << recordDescriptor[i].length << endl << endl;
-    }
+    // By default, nothing is synced unless asked for
+    TEST_FN_EQ(SYNC_NONE, pfm->getSyncPolicy(fileName), "No syncing by default");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, fileHandle.appendPages(4, pages), "Append pages");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(0, countSyncs(fileName), "No sync");
 
-    // Insert 2000 records into file
-    for(int i = 0; i < numRecords; i++)
-    {
-        // Test insert Record
-        int size = 0;
-        memset(record, 0, 1000);
-        memset(record_copy, 0, 1000);
-        prepareLargeRecord(i, record, &size);
+    pfm->setSyncPolicy(fileName, SYNC_ON_CLOSE);
+    TEST_FN_EQ(SYNC_NONE, pfm->getSyncPolicy(), "Default policy unchanged");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(SYNC_ON_CLOSE, fileHandle.getSyncPolicy(), "Handle takes the file's policy");
+    TEST_FN_EQ(success, fileHandle.writePages(0, 4, pages + PAGE_SIZE * 4), "Write pages");
+    TEST_FN_EQ(0, countSyncs(fileName), "No sync before close");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(1, countSyncs(fileName), "One sync on close");
+    TEST_FN_EQ(true, readPageFromFile(fileName, 3, buffer) and buffer[0] == 'h', "Pages on disk");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close unchanged file");
+    TEST_FN_EQ(1, countSyncs(fileName), "Nothing to sync");
 
-        // Write, read, and then immediately compare the two
-        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
-        assert(rc == success);
-        assert(memcmp(record, record_copy, size) == 0);
-        rbfm->printRecord(recordDescriptor, record_copy);
+    // Every operation is on disk as it returns
+    pfm->setSyncPolicy(fileName, SYNC_PER_OPERATION);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    pfm->resetIOStats();
+    TEST_FN_EQ(success, fileHandle.writePage(1, pages + PAGE_SIZE * 10), "Write page");
+    TEST_FN_EQ(1, countSyncs(fileName), "Write synced");
+    TEST_FN_EQ(true, readPageFromFile(fileName, 1, buffer) and buffer[0] == 'k', "Written page on disk");
+    TEST_FN_EQ(success, fileHandle.appendPages(3, pages), "Append pages");
+    TEST_FN_EQ(2, countSyncs(fileName), "One sync for a multi-page append");
+    TEST_FN_EQ(success, fileHandle.truncate(5), "Truncate");
+    TEST_FN_EQ(3, countSyncs(fileName), "Truncate synced");
+    PageGuard page;
+    TEST_FN_EQ(success, page.pin(fileHandle, 2), "Pin page");
+    page.mutableData()[0] = 'z';
+    page.release();
+    TEST_FN_EQ(4, countSyncs(fileName), "Change through a guard synced");
+    TEST_FN_EQ(true, readPageFromFile(fileName, 2, buffer) and buffer[0] == 'z', "Changed page on disk");
+    fileHandle.setSyncPolicy(SYNC_NONE);
+    TEST_FN_EQ(success, fileHandle.writePage(0, pages), "Write page");
+    TEST_FN_EQ(4, countSyncs(fileName), "Handle policy overridden");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
 
-        rids.push_back(rid);
-        sizes.push_back(size);        
-    }
-    // Close the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
-    assert(rc == success);
+    // Changes made within an interval share one sync
+    pfm->setSyncPolicy(fileName, SYNC_GROUP);
+    pfm->setSyncInterval(20);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    pfm->resetIOStats();
+    bool written = true;
+    for (unsigned i = 0; i < 100; i++)
+        written = written and fileHandle.writePage(i % 5, pages + PAGE_SIZE * (i % 16)) == success;
+    TEST_FN_EQ(true, written, "Write pages");
+    this_thread::sleep_for(chrono::milliseconds(200));
+    unsigned long long syncs = countSyncs(fileName);
+    TEST_FN_EQ(true, syncs >= 1 and syncs < 10, "Writes synced in groups");
+    TEST_FN_EQ(true, readPageFromFile(fileName, 4, buffer) and buffer[0] == 'a' + 99 % 16, "Last write on disk");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_VAL_EQ(syncs, countSyncs(fileName), "Nothing left to sync on close");
 
-    cout << "Test Case 11 Passed!" << endl << endl;
+    // Without a syncer, grouped changes are synced on close
+    pfm->setSyncInterval(0);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, fileHandle.writePage(0, pages + PAGE_SIZE * 15), "Write page");
+    this_thread::sleep_for(chrono::milliseconds(50));
+    TEST_VAL_EQ(syncs, countSyncs(fileName), "No sync without a syncer");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_VAL_EQ(syncs + 1, countSyncs(fileName), "Synced on close");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
-    return 0;
+    // Records inserted under the default policy
+    pfm->setSyncPolicy(SYNC_PER_OPERATION);
+    string recordFileName = "sync_records";
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    int recordSize;
+    prepareRecord(4, "Sync", 33, 160.5f, 4000, record, &recordSize);
+    TEST_FN_EQ(success, rbfm->createFile(recordFileName.c_str()), "Create record file");
+    TEST_FN_EQ(success, rbfm->openFile(recordFileName.c_str(), fileHandle), "Open record file");
+    pfm->resetIOStats();
+    RID rid;
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    TEST_FN_EQ(true, countSyncs(recordFileName) > 0, "Insert synced");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, rbfm->destroyFile(recordFileName.c_str()), "Destroy record file");
+    pfm->setSyncPolicy(SYNC_NONE);
+    pfm->setSyncInterval(DEFAULT_SYNC_INTERVAL_MS);
+
+    cout << "\nSync policy Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-RC rbfmTestReadAttribute(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes)
+// The header is read once while the PFM keeps the file's descriptor, and
+// what the layers above learn about the file is shared by its handles.
+void fileInfoTest()
 {
-	RC rc = err::OK;
-    string fileName = "rbfmTestReadAttribute_file";
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    // Create a file named "rbfmTestReadAttribute_file"
-    rc = rbfm->createFile(fileName.c_str());
+    cout << "File info tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+    string fileName = "finfo_test";
+    string otherName = "finfo_other";
+    PageBuffer pages(4);
+    for (unsigned i = 0; i < 4; i++)
+        memset(pages + PAGE_SIZE * i, 'a' + i, PAGE_SIZE);
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle, other;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, fileHandle.appendPages(3, pages), "Append pages");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+
+    // A reopen takes the page count from memory, not from the header
+    pokePageCount(fileName, 1);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    TEST_FN_EQ(3, fileHandle.getNumberOfPages(), "Page count not reread");
+
+    // Handles opened later see pages appended by others
+    TEST_FN_EQ(success, fileHandle.appendPage(pages + PAGE_SIZE * 3), "Append page");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), other), "Open file again");
+    TEST_FN_EQ(4, other.getNumberOfPages(), "Page count shared");
+
+    // Handles appending in turn each get a page of their own
+    unsigned char page[PAGE_SIZE];
+    memset(page, 'e', PAGE_SIZE);
+    TEST_FN_EQ(success, other.appendPage(page), "Append through second handle");
+    memset(page, 'f', PAGE_SIZE);
+    TEST_FN_EQ(success, fileHandle.appendPage(page), "Append through first handle");
+    TEST_FN_EQ(6, fileHandle.getNumberOfPages(), "Both appends counted");
+    TEST_FN_EQ(success, fileHandle.readPage(4, page), "Read page");
+    TEST_FN_EQ('e', page[0], "First append kept");
+    TEST_FN_EQ(success, fileHandle.readPage(5, page), "Read page");
+    TEST_FN_EQ('f', page[0], "Second append after it");
+
+    TEST_VAL_EQ(NO_PAGE, fileHandle.getRootPage(), "No root page yet");
+    fileHandle.setRootPage(2);
+    TEST_FN_EQ(2, other.getRootPage(), "Root page shared");
+    TEST_FN_EQ(success, pfm->closeFile(other), "Close second handle");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    TEST_FN_EQ(2, fileHandle.getRootPage(), "Root page kept across opens");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+
+    // Once the descriptor leaves the cache, the header is read again
+    pokePageCount(fileName, 2);
+    pfm->setMaxOpenFiles(0);
+    pfm->setMaxOpenFiles(DEFAULT_MAX_OPEN_FILES);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen evicted file");
+    TEST_FN_EQ(2, fileHandle.getNumberOfPages(), "Page count reread");
+    TEST_VAL_EQ(NO_PAGE, fileHandle.getRootPage(), "Root page forgotten");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+
+    // A file replaced behind the PFM's back starts afresh
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Reopen file");
+    fileHandle.setRootPage(1);
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    remove(fileName.c_str());
+    rc = pfm->createFile(fileName.c_str());
     assert(rc == success);
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open replaced file");
+    TEST_FN_EQ(0, fileHandle.getNumberOfPages(), "Replaced file is empty");
+    TEST_VAL_EQ(NO_PAGE, fileHandle.getRootPage(), "Replaced file has no root page");
+    fileHandle.setRootPage(1);
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close replaced file");
+
+    // So does one destroyed and created again
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file again");
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open new file");
+    TEST_VAL_EQ(NO_PAGE, fileHandle.getRootPage(), "New file has no root page");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close new file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    // The free space hint of the RBFM is shared too
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    char record[PAGE_SIZE];
+    int recordSize;
+    prepareRecord(8, "FileInfo", 40, 175.5f, 6000, record, &recordSize);
+    TEST_FN_EQ(success, rbfm->createFile(otherName.c_str()), "Create record file");
+    TEST_FN_EQ(success, rbfm->openFile(otherName.c_str(), fileHandle), "Open record file");
+    TEST_FN_EQ(success, rbfm->openFile(otherName.c_str(), other), "Open record file again");
+    RID rid;
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    TEST_FN_EQ(0, other.getSpaceHint(), "Space hint shared");
+    TEST_FN_EQ(success, rbfm->closeFile(other), "Close second handle");
+    TEST_FN_EQ(success, rbfm->deleteRecords(fileHandle), "Delete every record");
+    TEST_VAL_EQ(NO_PAGE, fileHandle.getSpaceHint(), "Space hint dropped");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close record file");
+    TEST_FN_EQ(success, rbfm->destroyFile(otherName.c_str()), "Destroy record file");
+
+    cout << "\nFile info Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-    if(FileExists(fileName.c_str()))
+// Many threads open, read and close files at once, some of them the same
+// files, while descriptors are evicted from the cache under them.
+void concurrencyTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
+
+    cout << "Concurrency tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    TEST_FN_EQ(true, pfm == PagedFileManager::instance(), "Single instance");
+
+    const unsigned numFiles = 12;
+    string fileNames[numFiles];
+    unsigned char buffer[PAGE_SIZE];
+    for (unsigned i = 0; i < numFiles; i++)
     {
-        cout << "File " << fileName << " has been created." << endl;
+        fileNames[i] = "conc_test" + to_string(i);
+        rc = pfm->createFile(fileNames[i].c_str());
+        assert(rc == success);
+        FileHandle fileHandle;
+        rc = pfm->openFile(fileNames[i].c_str(), fileHandle);
+        assert(rc == success);
+        for (unsigned j = 0; j < 4; j++)
+        {
+            memset(buffer, i * 4 + j, PAGE_SIZE);
+            rc = fileHandle.appendPage(buffer);
+            assert(rc == success);
+        }
+        rc = pfm->closeFile(fileHandle);
+        assert(rc == success);
     }
-    else
+
+    pfm->setMaxOpenFiles(3);
+    atomic<unsigned> failures(0);
+    vector<thread> threads;
+    for (unsigned t = 0; t < 8; t++)
+        threads.push_back(thread([pfm, &fileNames, &failures, t]() {
+            unsigned char page[PAGE_SIZE];
+            for (unsigned i = 0; i < 200; i++)
+            {
+                unsigned file = (t * 7 + i * 5) % numFiles;
+                PageNum pageNum = (t + i) % 4;
+                FileHandle fileHandle;
+                if (pfm->openFile(fileNames[file].c_str(), fileHandle) != success)
+                {
+                    failures++;
+                    continue;
+                }
+                if (fileHandle.getNumberOfPages() != 4
+                        or fileHandle.readPage(pageNum, page) != success
+                        or page[0] != file * 4 + pageNum)
+                    failures++;
+                if (pfm->closeFile(fileHandle) != success)
+                    failures++;
+            }
+        }));
+    for (unsigned t = 0; t < threads.size(); t++)
+        threads[t].join();
+    TEST_FN_EQ(0, failures, "Every thread read its pages");
+    TEST_FN_EQ(3, pfm->getNumOpenFiles(), "Idle descriptors bounded");
+
+    for (unsigned i = 0; i < numFiles; i++)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case rbfmTestReadAttribute Failed!" << endl << endl;
-        return -1;
+        TEST_FN_EQ(success, pfm->destroyFile(fileNames[i].c_str()), "Destroy file");
     }
+    TEST_FN_EQ(0, pfm->getNumOpenFiles(), "No descriptors left");
+    pfm->setMaxOpenFiles(DEFAULT_MAX_OPEN_FILES);
 
-    // Open the file "rbfmTestReadAttribute_file"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    // Records inserted through two handles on one file, in turn, each get
+    // room of their own, and both handles see all of them
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 3000;
+    recordDescriptor.push_back(attr);
+    string fileName = "conc_rbfm";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle first, second;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), first), "Open file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), second), "Open file again");
+
+    const unsigned numRecords = 10;
+    char record[3004];
+    char data[3004];
+    unsigned len = 3000;
+    memcpy(record, &len, sizeof(unsigned));
+    vector<RID> rids(numRecords);
+    bool insertsSucceeded = true;
+    for (unsigned i = 0; i < numRecords; i++)
+    {
+        // Five through the first handle, then alternating
+        FileHandle &fileHandle = i < 5 or i % 2 == 0 ? first : second;
+        memset(record + sizeof(unsigned), 'a' + i, len);
+        insertsSucceeded = insertsSucceeded
+                           and rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]) == success;
+    }
+    TEST_FN_EQ(true, insertsSucceeded, "Insert through both handles");
+    TEST_FN_EQ(true, first.getNumberOfPages() == second.getNumberOfPages(), "Page count shared");
+
+    bool contentsCorrect = true;
+    for (unsigned i = 0; i < numRecords; i++)
+    {
+        memset(record + sizeof(unsigned), 'a' + i, len);
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(first, recordDescriptor, rids[i], data) == success
+                          and memcmp(record, data, sizeof(unsigned) + len) == 0
+                          and rbfm->readRecord(second, recordDescriptor, rids[i], data) == success
+                          and memcmp(record, data, sizeof(unsigned) + len) == 0;
+    }
+    TEST_FN_EQ(true, contentsCorrect, "Both handles read every record");
+
+    vector<string> names;
+    names.push_back("str");
+    RBFM_ScanIterator scanner;
+    TEST_FN_EQ(success, rbfm->scan(second, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    RID rid;
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_FN_EQ(true, count == numRecords, "Scan sees every record");
+
+    TEST_FN_EQ(success, rbfm->closeFile(first), "Close file");
+    TEST_FN_EQ(success, rbfm->closeFile(second), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    cout << "\nConcurrency Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
+
+// Number of slots in the directory of a data page
+unsigned countSlots(FileHandle &fileHandle, PageNum pageNum)
+{
+    unsigned char page[PAGE_SIZE];
+    RC rc = fileHandle.readPage(pageNum, page);
     assert(rc == success);
+    return RecordBasedFileManager::getPageIndex(page, PAGE_SIZE)->numSlots;
+}
 
-    RID rid; 
-    char record[1000];
-    char record_copy[1000];
-    int numRecords = 10;
+// Inserts take the slots, and the space, of deleted records before the
+// directory of a page grows.
+void slotReuseTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-    vector<Attribute> recordDescriptor;
-    createLargeRecordDescriptor(recordDescriptor);
+    cout << "Slot reuse tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
-    // Insert 'numRecords' records into file
-    for(int i = 0; i < numRecords; i++)
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 3000;
+    recordDescriptor.push_back(attr);
+    char record[3004];
+    char data[3004];
+    unsigned len = 200;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'a', len);
+
+    string fileName = "slot_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    vector<RID> rids;
+    for (unsigned i = 0; i < 10; i++)
     {
-        // Test insert Record
-        int size = 0;
-        memset(record, 0, 1000);
-        memset(record_copy, 0, 1000);
-        prepareLargeRecord(i, record, &size);
-
-        // Write, read, and then immediately compare the two
+        RID rid;
         rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
-        assert(rc == success);
-        assert(memcmp(record, record_copy, size) == 0);
-        rbfm->printRecord(recordDescriptor, record_copy);
+        assert(rc == success and rid.pageNum == 1);
+        rids.push_back(rid);
+    }
 
-        // Walk each attribute and extract/compare the expected value
-        for (int j = 0; j < numRecords * 3; j += 3) // each tuple has three attributes, and we're only getting the strings here
+    // A deleted record's slot goes to the next insert
+    RID rid;
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rids[3]), "Delete record");
+    memset(record + sizeof(unsigned), 'b', len);
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    TEST_FN_EQ(1, rid.pageNum, "Same page");
+    TEST_FN_EQ(3, rid.slotNum, "Slot reused");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rid, data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + len), "Contents correct");
+
+    // Free slots at the end of the directory are dropped
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rids[8]), "Delete record");
+    TEST_FN_EQ(10, countSlots(fileHandle, 1), "Directory kept");
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rids[9]), "Delete last record");
+    TEST_FN_EQ(8, countSlots(fileHandle, 1), "Directory shrunk");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readRecord(fileHandle, recordDescriptor, rids[9], data), "Dropped slot reads as deleted");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->deleteRecord(fileHandle, recordDescriptor, rids[9]), "Dropped slot cannot be deleted");
+
+    // Deleting and inserting the same records over and over does not grow
+    // the file
+    unsigned numPages = fileHandle.getNumberOfPages();
+    bool churned = true;
+    for (unsigned round = 0; round < 20; round++)
+    {
+        for (unsigned slot = 0; slot < 8; slot++)
         {
-        	const char* tempBuffer = (char*)malloc(i + 1);
-        	stringstream out;
-        	out << j;
-        	string attrName = "attr" + out.str();
-			rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, (void*)tempBuffer);
-
-        	// Rebuild the expected string
-        	char text = i % 26 + 97;
-        	int count = i % 50 + 1;
-        	char* charBuf = (char*)malloc(count);
-        	memcpy((char*)charBuf, &count, sizeof(int));
-        	for (int k = 4; k < count + 4; k++)
-        	{
-        		memcpy((char*)charBuf + k, &text, 1);
-        	}
-        	assert(strncmp(tempBuffer, charBuf, count) == 0);
+            rid.pageNum = 1;
+            rid.slotNum = slot;
+            churned = churned and rbfm->deleteRecord(fileHandle, recordDescriptor, rid) == success;
         }
-
-        // Walk the ints & floats now and compare equality
-        for (int j = 0; j < numRecords * 3; j += 3)
+        for (unsigned slot = 0; slot < 8; slot++)
         {
-        	unsigned intVal = 0;
-        	float floatVal = 0.0;
-        	stringstream out1;
-        	out1 << (j+1);
-        	string attrName = "attr" + out1.str();
-        	rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, &intVal);
-        	cout << "read (" << (j+1) << "): " << intVal << endl;
-        	assert(intVal == i);
-
-        	stringstream out2;
-        	out2 << (j+2);
-        	attrName = "attr" + out2.str();
-        	rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, &floatVal);
-        	cout << "read (" << (j+2) << "): " << floatVal << endl;
-        	assert(floatVal == (i+1));
+            memset(record + sizeof(unsigned), 'c' + round, len);
+            churned = churned and rbfm->insertRecord(fileHandle, recordDescriptor, record, rid) == success
+                      and rid.pageNum == 1 and rid.slotNum == slot;
         }
-
-        rids.push_back(rid);
-        sizes.push_back(size);        
     }
-    // Close the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
+    TEST_FN_EQ(true, churned, "Churn reuses the same slots");
+    TEST_VAL_EQ(numPages, fileHandle.getNumberOfPages(), "No page appended");
+    TEST_FN_EQ(8, countSlots(fileHandle, 1), "Directory did not grow");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rid, data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + len), "Contents correct");
+
+    // Fill the page, then free room in the middle of it: the free-space map
+    // counts it, and the next insert takes it without a reorganizePage
+    rids.clear();
+    do
+    {
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rids.push_back(rid);
+    } while (rid.pageNum == 1);
+    TEST_FN_EQ(2, rid.pageNum, "Page 1 full");
+    RID stale = rid;
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert record");
+    rids.push_back(rid);
+    rid.pageNum = 1;
+    rid.slotNum = 2;
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rid), "Delete record");
+    rid.slotNum = 5;
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rid), "Delete record");
+    len = 400;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'x', len);
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Insert larger record");
+    TEST_FN_EQ(1, rid.pageNum, "Freed space reused");
+    TEST_FN_EQ(2, rid.slotNum, "First free slot taken");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rid, data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + len), "Contents correct");
+
+    // A record moved off its page may land in a reused slot. The RID of the
+    // record deleted from that slot then no longer reaches anything.
+    RID moved = rids[0];
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, stale), "Delete record on page 2");
+    len = 3000;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'y', len);
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record, moved), "Grow record past its page");
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(moved.pageNum, page);
     assert(rc == success);
+    const PageIndexEntry *entry = RecordBasedFileManager::getPageIndexEntry(page, moved.slotNum, PAGE_SIZE);
+    TEST_FN_EQ(TOMBSTONE, entry->type, "Tombstone left behind");
+    TEST_VAL_EQ(stale.pageNum, entry->tombstoneRID.pageNum, "Record moved to page 2");
+    TEST_VAL_EQ(stale.slotNum, entry->tombstoneRID.slotNum, "Record moved into the freed slot");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, moved, data), "Read moved record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + len), "Contents correct");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readRecord(fileHandle, recordDescriptor, stale, data), "Stale RID reads as deleted");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->updateRecord(fileHandle, recordDescriptor, record, stale), "Stale RID cannot be updated");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->deleteRecord(fileHandle, recordDescriptor, stale), "Stale RID cannot be deleted");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, moved, data), "Moved record still there");
 
-	return rc;
+    vector<string> names;
+    names.push_back("str");
+    RBFM_ScanIterator scanner;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_VAL_EQ(rids.size() - 2 + 8, count, "Scan sees every record once");
+
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    cout << "\nSlot reuse Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-RC rbfmTestReorganizePage(RecordBasedFileManager *rbfm, int skip)
+int RBFTest_1(PagedFileManager *pfm)
 {
-	RC rc = err::OK;
-    string fileName = "rbfmTestReorganizePage_file";
+    // Functions Tested:
+    // 1. Create File
+    cout << "****In RBF Test Case 1****" << endl;
 
-    vector<RID> rids;
-    vector<int> sizes;
+    RC rc;
+    string fileName = "test";
 
-    // Create a file named "our_test_4"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == err::OK);
+    // Create a file named "test"
+    rc = pfm->createFile(fileName.c_str());
+    assert(rc == success);
 
     if(FileExists(fileName.c_str()))
     {
-        cout << "File " << fileName << " has been created." << endl;
+        cout << "File " << fileName << " has been created." << endl << endl;
     }
     else
     {
         cout << "Failed to create file!" << endl;
-        cout << "Test Case Failed!" << endl << endl;
+        cout << "Test Case 1 Failed!" << endl << endl;
         return -1;
     }
 
-    // Open the file "our_test_4"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(rc == success);
-
-    RID rid; 
-    char record[1000];
-    char record_copy[1000];
-    int numRecords = 50;
-
-    vector<Attribute> recordDescriptor;
-    createLargeRecordDescriptor(recordDescriptor);
+    // Create "test" again, should fail
+    rc = pfm->createFile(fileName.c_str());
+    assert(rc != success);
 
-    // Store references to records inserted so that they can be easily checked later
-    vector<char*> ridContentList;
+    cout << "Test Case 1 Passed!" << endl << endl;
+    return 0;
+}
 
-    // Insert some records into the file
-    for(int i = 0; i < numRecords; i++)
-    {
-        // Test insert Record
-        int size = 0;
-        memset(record, 0, 1000);
-        memset(record_copy, 0, 1000);
-        prepareLargeRecord(i, record, &size);
 
-        // Allocate space on the content list
-        ridContentList.push_back((char*)malloc(1000));
+int RBFTest_2(PagedFileManager *pfm)
+{
+    // Functions Tested:
+    // 1. Destroy File
+    cout << "****In RBF Test Case 2****" << endl;
 
-        // Write, read, and then immediately compare the two
-        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
-        assert(rc == success);
-        assert(memcmp(record, record_copy, size) == 0);
-        memcpy(ridContentList[i], record, size);
+    RC rc;
+    string fileName = "test";
 
-        // Record the RIDs
-        rids.push_back(rid);
-        sizes.push_back(size);        
-    }
+    rc = pfm->destroyFile(fileName.c_str());
+    assert(rc == success);
 
-    // Create and populate a vector of vectors that maps page numbers to all RIDs on that page
-    vector< vector<RID> > pageRIDs;
-    vector< vector<int> > pageRIDIndexes;
-    for (PageNum page = 0; page < fileHandle.getNumberOfPages(); page++)
+    if(!FileExists(fileName.c_str()))
     {
-    	vector<RID> tmp;
-    	pageRIDs.push_back(tmp);
-    	vector<int> tmpIndexes;
-    	pageRIDIndexes.push_back(tmpIndexes);
+        cout << "File " << fileName << " has been destroyed." << endl << endl;
+        cout << "Test Case 2 Passed!" << endl << endl;
+        return 0;
     }
-    for (unsigned int i = 0; i < rids.size(); i++)
+    else
     {
-    	RID rid = rids[i];
-    	pageRIDs[rid.pageNum].push_back(rid);
-    	pageRIDIndexes[rid.pageNum].push_back(i);
+        cout << "Failed to destroy file!" << endl;
+        cout << "Test Case 2 Failed!" << endl << endl;
+        return -1;
     }
+}
 
-    // Skip across and delete some records
-    for (int i = 0; i < numRecords; i += skip)
-    {
-    	rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
-    }
-
-    // Double-check deletion
-    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
-    {
-    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
-    	{
-    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
-    		if (ridIndex % skip != 0)
-    		{
-    			memset(record, 0, 1000);
-				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
-				assert(rc == success);
-		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
-    		}
-    	}
-    }
-
-    // Walk every page and do some reallocation
-    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
-    {
-    	rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
-    	assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
-    }
-
-    // Now check the contents again
-    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
-    {
-    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
-    	{
-    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
-    		if (ridIndex % skip != 0)
-    		{
-    			memset(record, 0, 1000);
-				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
-				assert(rc == success);
-		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
-    		}
-    	}
-    }
-
-    // Close & delete the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
-    assert(rc == success);
-    rc = rbfm->destroyFile(fileName.c_str());
-    assert(rc == success);
 
-	return rc;
-}
-
-RC rbfmTestUpdateRecord(RecordBasedFileManager *rbfm, int skip)
+int RBFTest_3(PagedFileManager *pfm)
 {
-	RC rc = err::OK;
-    string fileName = "rbfmTestUpdateRecord_file";
+    // Functions Tested:
+    // 1. Create File
+    // 2. Open File
+    // 3. Get Number Of Pages
+    // 4. Close File
+    cout << "****In RBF Test Case 3****" << endl;
 
-    vector<RID> rids;
-    vector<int> sizes;
+    RC rc;
+    string fileName = "test_1";
 
-    // Create a file named "our_test_4"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == err::OK);
+    // Create a file named "test_1"
+    rc = pfm->createFile(fileName.c_str());
+    assert(rc == success);
 
     if(FileExists(fileName.c_str()))
     {
@@ -2104,644 +3181,2440 @@ RC rbfmTestUpdateRecord(RecordBasedFileManager *rbfm, int skip)
     else
     {
         cout << "Failed to create file!" << endl;
-        cout << "Test Case Failed!" << endl << endl;
+        cout << "Test Case 3 Failed!" << endl << endl;
         return -1;
     }
 
-    // Open the file "our_test_4"
+    // Open the file "test_1"
     FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    rc = pfm->openFile(fileName.c_str(), fileHandle);
     assert(rc == success);
 
-    RID rid; 
-    char record[(PAGE_SIZE / 2) + sizeof(unsigned)];
-    char record_copy[(PAGE_SIZE / 2) + sizeof(unsigned)];
-    int numRecords = 50;
-    unsigned halfPageSize = PAGE_SIZE / 2;
-    unsigned quarterPageSize = PAGE_SIZE / 4;
-    unsigned eighthPageSize = PAGE_SIZE / 8;
-
-    // Create the record descriptor for a single, long string
-    vector<Attribute> recordDescriptor;
-    Attribute attr;
-    attr.name = "attr";
-    attr.type = TypeVarChar;
-    attr.length = (AttrLength)PAGE_SIZE;
-    recordDescriptor.push_back(attr);
+    // Get the number of pages in the test file
+    unsigned count = fileHandle.getNumberOfPages();
+    assert(count == (unsigned)0);
 
-    // Store references to records inserted so that they can be easily checked later
-    vector<char*> ridContentList;
+    // Close the file "test_1"
+    rc = pfm->closeFile(fileHandle);
+    assert(rc == success);
 
-    // Insert some records into the file
-    for(int i = 0; i < numRecords; i++)
-    {
-        // Test insert Record
-        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-        memset(record_copy, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+    cout << "Test Case 3 Passed!" << endl << endl;
 
-        memcpy((char*)record, &quarterPageSize, sizeof(unsigned));
-        unsigned offset = sizeof(unsigned);
-        for(int j = 0; j < quarterPageSize; j++)
-        {
-            memcpy((char *)record + offset, "a", 1);
-            offset += 1;
-        }
+    return 0;
+}
 
-        // Allocate space on the content list
-        ridContentList.push_back((char*)malloc(offset));
 
-        // Write, read, and then immediately compare the two
-        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
-        assert(rc == success);
-        assert(memcmp(record, record_copy, offset) == 0);
-        memcpy(ridContentList[i], record, offset);
 
-        // Record the RIDs
-        rids.push_back(rid);
-        sizes.push_back(offset);
-    }
+int RBFTest_4(PagedFileManager *pfm)
+{
+    // Functions Tested:
+    // 1. Open File
+    // 2. Append Page
+    // 3. Get Number Of Pages
+    // 3. Close File
+    cout << "****In RBF Test Case 4****" << endl;
 
-    // Expand every other "skipped" record
-    for (int i = 0; i < numRecords; i += skip)
-    {
-    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-	    memcpy((char*)record, &halfPageSize, sizeof(unsigned));
-	    unsigned offset = sizeof(unsigned);
-	    for(int j = 0; j < halfPageSize; j++)
-	    {
-	        memcpy((char *)record + offset, "a", 1);
-	        offset += 1;
-	    }
+    RC rc;
+    string fileName = "test_1";
 
-	    // Update the record
-	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
-	    assert(rc == success);
+    // Open the file "test_1"
+    FileHandle fileHandle;
+    rc = pfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
 
-	    // Read it back in and compare
-	    memset(record_copy, 0, PAGE_SIZE / 2);
-	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
-	    rbfm->printRecord(recordDescriptor, record);
-	    cout << endl;
-	    rbfm->printRecord(recordDescriptor, record_copy);
-	    assert(rc == success);
-	    assert(memcmp(record, record_copy, offset) == 0);
+    // Append the first page
+    void *data = malloc(PAGE_SIZE);
+    for(unsigned i = 0; i < PAGE_SIZE; i++)
+    {
+        *((char *)data+i) = i % 94 + 32;
     }
+    rc = fileHandle.appendPage(data);
+    assert(rc == success);
+   
+    // Get the number of pages
+    unsigned count = fileHandle.getNumberOfPages();
+    printf("%d\n", count);
+    assert(count == (unsigned)1);
 
-    // Shrink every other "skipped" record
-    for (int i = 0; i < numRecords; i += skip)
-    {
-    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-	    memcpy((char*)record, &eighthPageSize, sizeof(unsigned));
-	    unsigned offset = sizeof(unsigned);
-	    for(int j = 0; j < eighthPageSize; j++)
-	    {
-	        memcpy((char *)record + offset, "a", 1);
-	        offset += 1;
-	    }
+    // Close the file "test_1"
+    rc = pfm->closeFile(fileHandle);
+    assert(rc == success);
 
-	    // Update the record
-	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
-	    assert(rc == success);
+    free(data);
 
-	    // Read it back in and compare
-	    memset(record_copy, 0, PAGE_SIZE / 2);
-	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
-	    assert(rc == success);
-	    assert(memcmp(record, record_copy, offset) == 0);
-    }
+    cout << "Test Case 4 Passed!" << endl << endl;
 
-    return err::OK;
+    return 0;
 }
 
-RC rbfmTestReorganizeDeleteUpdate(RecordBasedFileManager *rbfm, int skip)
+
+int RBFTest_5(PagedFileManager *pfm)
 {
-	RC rc = err::OK;
-    string fileName = "rbfmTestReorganizeDeleteUpdate_file";
+    // Functions Tested:
+    // 1. Open File
+    // 2. Read Page
+    // 3. Close File
+    cout << "****In RBF Test Case 5****" << endl;
 
-    vector<RID> rids;
-    vector<int> sizes;
+    RC rc;
+    string fileName = "test_1";
 
-    // Create a file named "our_test_4"
-    rc = rbfm->createFile(fileName.c_str());
-    assert(rc == err::OK);
+    // Open the file "test_1"
+    FileHandle fileHandle;
+    rc = pfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
 
-    if(FileExists(fileName.c_str()))
-    {
-        cout << "File " << fileName << " has been created." << endl;
-    }
-    else
+    // Read the first page
+    void *buffer = malloc(PAGE_SIZE);
+    rc = fileHandle.readPage(0, buffer);
+    assert(rc == success);
+  
+    // Check the integrity of the page    
+    void *data = malloc(PAGE_SIZE);
+    for(unsigned i = 0; i < PAGE_SIZE; i++)
     {
-        cout << "Failed to create file!" << endl;
-        cout << "Test Case Failed!" << endl << endl;
-        return -1;
+        *((char *)data+i) = i % 94 + 32;
     }
-
-    // Open the file "our_test_4"
-    FileHandle fileHandle;
-    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    rc = memcmp(data, buffer, PAGE_SIZE);
+    assert(rc == success);
+ 
+    // Close the file "test_1"
+    rc = pfm->closeFile(fileHandle);
     assert(rc == success);
 
-    RID rid; 
-    char record[(PAGE_SIZE / 2) + sizeof(unsigned)];
-    char record_copy[(PAGE_SIZE / 2) + sizeof(unsigned)];
-    int numRecords = 10;
-    unsigned halfPageSize = PAGE_SIZE / 2;
-    unsigned quarterPageSize = PAGE_SIZE / 4;
-    unsigned eighthPageSize = PAGE_SIZE / 8;
+    free(data);
+    free(buffer);
 
-    // Create the record descriptor for a single, long string
-    vector<Attribute> recordDescriptor;
-    Attribute attr;
-    attr.name = "attr";
-    attr.type = TypeVarChar;
-    attr.length = (AttrLength)PAGE_SIZE;
-    recordDescriptor.push_back(attr);
+    cout << "Test Case 5 Passed!" << endl << endl;
 
-    // Store references to records inserted so that they can be easily checked later
-    vector<char*> ridContentList;
+    return 0;
+}
 
-    // Insert some records into the file
-    for(int i = 0; i < numRecords; i++)
+
+int RBFTest_6(PagedFileManager *pfm)
+{
+    // Functions Tested:
+    // 1. Open File
+    // 2. Write Page
+    // 3. Read Page
+    // 4. Close File
+    // 5. Destroy File
+    cout << "****In RBF Test Case 6****" << endl;
+
+    RC rc;
+    string fileName = "test_1";
+
+    // Open the file "test_1"
+    FileHandle fileHandle;
+    rc = pfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    // Update the first page
+    void *data = malloc(PAGE_SIZE);
+    for(unsigned i = 0; i < PAGE_SIZE; i++)
     {
-        // Test insert Record
-        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-        memset(record_copy, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+        *((char *)data+i) = i % 10 + 32;
+    }
+    rc = fileHandle.writePage(0, data);
+    assert(rc == success);
 
-        memcpy((char*)record, &quarterPageSize, sizeof(unsigned));
-        unsigned offset = sizeof(unsigned);
-        for(int j = 0; j < quarterPageSize; j++)
+    // Read the page
+    void *buffer = malloc(PAGE_SIZE);
+    rc = fileHandle.readPage(0, buffer);
+    assert(rc == success);
+
+    // Check the integrity
+    rc = memcmp(data, buffer, PAGE_SIZE);
+    assert(rc == success);
+ 
+    // Close the file "test_1"
+    rc = pfm->closeFile(fileHandle);
+    assert(rc == success);
+
+    free(data);
+    free(buffer);
+
+    // Destroy File
+    rc = pfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+    
+    if(!FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been destroyed." << endl;
+        cout << "Test Case 6 Passed!" << endl << endl;
+        return 0;
+    }
+    else
+    {
+        cout << "Failed to destroy file!" << endl;
+        cout << "Test Case 6 Failed!" << endl << endl;
+        return -1;
+    }
+}
+
+
+int RBFTest_7(PagedFileManager *pfm)
+{
+    // Functions Tested:
+    // 1. Create File
+    // 2. Open File
+    // 3. Append Page
+    // 4. Get Number Of Pages
+    // 5. Read Page
+    // 6. Write Page
+    // 7. Close File
+    // 8. Destroy File
+    cout << "****In RBF Test Case 7****" << endl;
+
+    RC rc;
+    string fileName = "test_2";
+
+    // Create the file named "test_2"
+    rc = pfm->createFile(fileName.c_str());
+    assert(rc == success);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case 7 Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "test_2"
+    FileHandle fileHandle;
+    rc = pfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    // Append 50 pages
+    void *data = malloc(PAGE_SIZE);
+    for(unsigned j = 0; j < 50; j++)
+    {
+        for(unsigned i = 0; i < PAGE_SIZE; i++)
         {
-            memcpy((char *)record + offset, "a", 1);
-            offset += 1;
+            *((char *)data+i) = i % (j+1) + 32;
         }
+        rc = fileHandle.appendPage(data);
+        assert(rc == success);
+    }
+    cout << "50 Pages have been successfully appended!" << endl;
+   
+    // Get the number of pages
+    unsigned count = fileHandle.getNumberOfPages();
+    assert(count == (unsigned)50);
 
-        // Allocate space on the content list
-        ridContentList.push_back((char*)malloc(offset));
+    // Read the 25th page and check integrity
+    void *buffer = malloc(PAGE_SIZE);
+    rc = fileHandle.readPage(24, buffer);
+    assert(rc == success);
 
-        // Write, read, and then immediately compare the two
-        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(rc == success);
-        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
-        assert(rc == success);
-        assert(memcmp(record, record_copy, offset) == 0);
-        memcpy(ridContentList[i], record, offset);
+    for(unsigned i = 0; i < PAGE_SIZE; i++)
+    {
+        *((char *)data + i) = i % 25 + 32;
+    }
+    rc = memcmp(buffer, data, PAGE_SIZE);
+    assert(rc == success);
+    cout << "The data in 25th page is correct!" << endl;
 
-        // Record the RIDs
-        cout << "Just inserted RID: " << rid.pageNum << ", " << rid.slotNum << endl;
-        rids.push_back(rid);
-        sizes.push_back(offset);
+    // Update the 25th page
+    for(unsigned i = 0; i < PAGE_SIZE; i++)
+    {
+        *((char *)data+i) = i % 60 + 32;
     }
+    rc = fileHandle.writePage(24, data);
+    assert(rc == success);
 
-    // Create and populate a vector of vectors that maps page numbers to all RIDs on that page
-    vector< vector<RID> > pageRIDs;
-    vector< vector<int> > pageRIDIndexes;
-    for (PageNum page = 0; page < fileHandle.getNumberOfPages(); page++)
+    // Read the 25th page and check integrity
+    rc = fileHandle.readPage(24, buffer);
+    assert(rc == success);
+    
+    rc = memcmp(buffer, data, PAGE_SIZE);
+    assert(rc == success);
+
+    // Close the file "test_2"
+    rc = pfm->closeFile(fileHandle);
+    assert(rc == success);
+
+    // Destroy File
+    rc = pfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+
+    free(data);
+    free(buffer);
+
+    if(!FileExists(fileName.c_str()))
     {
-    	vector<RID> tmp;
-    	pageRIDs.push_back(tmp);
-    	vector<int> tmpIndexes;
-    	pageRIDIndexes.push_back(tmpIndexes);
+        cout << "File " << fileName << " has been destroyed." << endl;
+        cout << "Test Case 7 Passed!" << endl << endl;
+        return 0;
     }
-    for (unsigned int i = 0; i < rids.size(); i++)
+    else
     {
-    	RID rid = rids[i];
-    	pageRIDs[rid.pageNum].push_back(rid);
-    	pageRIDIndexes[rid.pageNum].push_back(i);
+        cout << "Failed to destroy file!" << endl;
+        cout << "Test Case 7 Failed!" << endl << endl;
+        return -1;
+    }
+}
+
+int RBFTest_8(RecordBasedFileManager *rbfm) {
+    // Functions tested
+    // 1. Create Record-Based File
+    // 2. Open Record-Based File
+    // 3. Insert Record
+    // 4. Read Record
+    // 5. Close Record-Based File
+    // 6. Destroy Record-Based File
+    cout << "****In RBF Test Case 8****" << endl;
+   
+    RC rc;
+    string fileName = "test_3";
+
+    // Create a file named "test_3"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == success);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case 8 Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "test_3"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+   
+      
+    RID rid; 
+    int recordSize = 0;
+    void *record = malloc(100);
+    void *returnedData = malloc(100);
+
+    vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    
+    // Insert a record into a file
+    prepareRecord(6, "Peters", 24, 170.1f, 5000, record, &recordSize);
+    cout << "Insert Data:" << endl;
+    rbfm->printRecord(recordDescriptor, record);
+    
+    rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+    assert(rc == success);
+    
+    // Given the rid, read the record from file
+    rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, returnedData);
+    assert(rc == success);
+
+#ifndef REDIRECT_PRINT_RECORD
+    // Ignore this spammy message when we're redirecting directly to file
+    cout << "Returned Data:" << endl;
+#endif
+    rbfm->printRecord(recordDescriptor, returnedData);
+
+    // Compare whether the two memory blocks are the same
+    if(memcmp(record, returnedData, recordSize) != 0)
+    {
+       cout << "Test Case 8 Failed!" << endl << endl;
+        free(record);
+        free(returnedData);
+        return -1;
+    }
+    
+    // Close the file "test_3"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+
+    // Destroy File
+    rc = rbfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+    
+    free(record);
+    free(returnedData);
+    cout << "Test Case 8 Passed!" << endl << endl;
+    
+    return 0;
+}
+
+int RBFTest_9(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
+    // Functions tested
+    // 1. Create Record-Based File
+    // 2. Open Record-Based File
+    // 3. Insert Multiple Records
+    // 4. Close Record-Based File
+    cout << "****In RBF Test Case 9****" << endl;
+   
+    RC rc;
+    string fileName = "test_4";
+
+    // Create a file named "test_4"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == success);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case 9 Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+
+    RID rid; 
+    void *record = malloc(1000);
+    int numRecords = 2000;
+    // int numRecords = 500;
+
+    vector<Attribute> recordDescriptor;
+    createLargeRecordDescriptor(recordDescriptor);
+
+    for(unsigned i = 0; i < recordDescriptor.size(); i++)
+    {
+        cout << "Attribute Name: " << recordDescriptor[i].name << endl;
+        cout << "Attribute Type: " << (AttrType)recordDescriptor[i].type << endl;
+        cout << "Attribute Length: " << recordDescriptor[i].length << endl << endl;
+    }
+
+    // Insert 2000 records into file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        int size = 0;
+        memset(record, 0, 1000);
+        prepareLargeRecord(i, record, &size);
+
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+
+        rids.push_back(rid);
+        sizes.push_back(size);        
+    }
+    // Close the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+
+    free(record);    
+    cout << "Test Case 9 Passed!" << endl << endl;
+
+    return 0;
+}
+
+int RBFTest_10(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
+    // Functions tested
+    // 1. Open Record-Based File
+    // 2. Read Multiple Records
+    // 3. Close Record-Based File
+    // 4. Destroy Record-Based File
+    cout << "****In RBF Test Case 10****" << endl;
+   
+    RC rc;
+    string fileName = "test_4";
+
+    // Open the file "test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+    
+    int numRecords = 2000;
+    void *record = malloc(1000);
+    void *returnedData = malloc(1000);
+
+    vector<Attribute> recordDescriptor;
+    createLargeRecordDescriptor(recordDescriptor);
+    
+    for(int i = 0; i < numRecords; i++)
+    {
+        memset(record, 0, 1000);
+        memset(returnedData, 0, 1000);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], returnedData);
+        assert(rc == success);
+        
+#ifndef REDIRECT_PRINT_RECORD
+        // Ignore this spammy message when we're redirecting directly to file
+        cout << "Returned Data:" << endl;
+#endif
+        rbfm->printRecord(recordDescriptor, returnedData);
+
+        int size = 0;
+        prepareLargeRecord(i, record, &size);
+        if(memcmp(returnedData, record, sizes[i]) != 0)
+        {
+            cout << "Test Case 10 Failed!" << endl << endl;
+            free(record);
+            free(returnedData);
+            return -1;
+        }
+    }
+    
+    // Close the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+    
+    rc = rbfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+
+    if(!FileExists(fileName.c_str())) {
+        cout << "File " << fileName << " has been destroyed." << endl << endl;
+        free(record);
+        free(returnedData);
+        cout << "Test Case 10 Passed!" << endl << endl;
+        return 0;
+    }
+    else {
+        cout << "Failed to destroy file!" << endl;
+        cout << "Test Case 10 Failed!" << endl << endl;
+        free(record);
+        free(returnedData);
+        return -1;
+    }
+}
+
+int RBFTest_11(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes) {
+    // Functions tested
+    // 1. Create Record-Based File
+    // 2. Open Record-Based File
+    // 3. Insert Multiple Records
+    // 4. Close Record-Based File
+    cout << "****In RBF Test Case 11****" << endl;
+   
+    RC rc;
+    string fileName = "test_5";
+
+    // Create a file named "our_test_4"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == success);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case 9 Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "our_test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+
+    RID rid; 
+    char record[1000];
+    char record_copy[1000];
+    int numRecords = 10;
+
+    vector<Attribute> recordDescriptor;
+    createLargeRecordDescriptor(recordDescriptor);
+
+    for(unsigned i = 0; i < recordDescriptor.size(); i++)
+    {
+        cout << "Attribute Name: " << recordDescriptor[i].name << endl;
+        cout << "Attribute Type: " << (AttrType)recordDescriptor[i].type << endl;
+        cout << "Attribute Length: " << recordDescriptor[i].length << endl << endl;
+    }
+
+    // Insert 2000 records into file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        int size = 0;
+        memset(record, 0, 1000);
+        memset(record_copy, 0, 1000);
+        prepareLargeRecord(i, record, &size);
+
+        // Write, read, and then immediately compare the two
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
+        assert(rc == success);
+        assert(memcmp(record, record_copy, size) == 0);
+        rbfm->printRecord(recordDescriptor, record_copy);
+
+        rids.push_back(rid);
+        sizes.push_back(size);        
+    }
+    // Close the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+
+    cout << "Test Case 11 Passed!" << endl << endl;
+
+    return 0;
+}
+
+RC rbfmTestReadAttribute(RecordBasedFileManager *rbfm, vector<RID> &rids, vector<int> &sizes)
+{
+	RC rc = err::OK;
+    string fileName = "rbfmTestReadAttribute_file";
+
+    // Create a file named "rbfmTestReadAttribute_file"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == success);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case rbfmTestReadAttribute Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "rbfmTestReadAttribute_file"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    RID rid; 
+    char record[1000];
+    char record_copy[1000];
+    int numRecords = 10;
+
+    vector<Attribute> recordDescriptor;
+    createLargeRecordDescriptor(recordDescriptor);
+
+    // Insert 'numRecords' records into file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        int size = 0;
+        memset(record, 0, 1000);
+        memset(record_copy, 0, 1000);
+        prepareLargeRecord(i, record, &size);
+
+        // Write, read, and then immediately compare the two
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
+        assert(rc == success);
+        assert(memcmp(record, record_copy, size) == 0);
+        rbfm->printRecord(recordDescriptor, record_copy);
+
+        // Walk each attribute and extract/compare the expected value
+        for (int j = 0; j < numRecords * 3; j += 3) // each tuple has three attributes, and we're only getting the strings here
+        {
+        	const char* tempBuffer = (char*)malloc(i + 1);
+        	stringstream out;
+        	out << j;
+        	string attrName = "attr" + out.str();
+			rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, (void*)tempBuffer);
+
+        	// Rebuild the expected string
+        	char text = i % 26 + 97;
+        	int count = i % 50 + 1;
+        	char* charBuf = (char*)malloc(count);
+        	memcpy((char*)charBuf, &count, sizeof(int));
+        	for (int k = 4; k < count + 4; k++)
+        	{
+        		memcpy((char*)charBuf + k, &text, 1);
+        	}
+        	assert(strncmp(tempBuffer, charBuf, count) == 0);
+        }
+
+        // Walk the ints & floats now and compare equality
+        for (int j = 0; j < numRecords * 3; j += 3)
+        {
+        	unsigned intVal = 0;
+        	float floatVal = 0.0;
+        	stringstream out1;
+        	out1 << (j+1);
+        	string attrName = "attr" + out1.str();
+        	rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, &intVal);
+        	cout << "read (" << (j+1) << "): " << intVal << endl;
+        	assert(intVal == i);
+
+        	stringstream out2;
+        	out2 << (j+2);
+        	attrName = "attr" + out2.str();
+        	rbfm->readAttribute(fileHandle, recordDescriptor, rid, attrName, &floatVal);
+        	cout << "read (" << (j+2) << "): " << floatVal << endl;
+        	assert(floatVal == (i+1));
+        }
+
+        rids.push_back(rid);
+        sizes.push_back(size);        
+    }
+    // Close the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+
+	return rc;
+}
+
+RC rbfmTestReorganizePage(RecordBasedFileManager *rbfm, int skip)
+{
+	RC rc = err::OK;
+    string fileName = "rbfmTestReorganizePage_file";
+
+    vector<RID> rids;
+    vector<int> sizes;
+
+    // Create a file named "our_test_4"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == err::OK);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "our_test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    RID rid; 
+    char record[1000];
+    char record_copy[1000];
+    int numRecords = 50;
+
+    vector<Attribute> recordDescriptor;
+    createLargeRecordDescriptor(recordDescriptor);
+
+    // Store references to records inserted so that they can be easily checked later
+    vector<char*> ridContentList;
+
+    // Insert some records into the file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        int size = 0;
+        memset(record, 0, 1000);
+        memset(record_copy, 0, 1000);
+        prepareLargeRecord(i, record, &size);
+
+        // Allocate space on the content list
+        ridContentList.push_back((char*)malloc(1000));
+
+        // Write, read, and then immediately compare the two
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
+        assert(rc == success);
+        assert(memcmp(record, record_copy, size) == 0);
+        memcpy(ridContentList[i], record, size);
+
+        // Record the RIDs
+        rids.push_back(rid);
+        sizes.push_back(size);        
+    }
+
+    // Create and populate a vector of vectors that maps page numbers to all RIDs on that page
+    vector< vector<RID> > pageRIDs;
+    vector< vector<int> > pageRIDIndexes;
+    for (PageNum page = 0; page < fileHandle.getNumberOfPages(); page++)
+    {
+    	vector<RID> tmp;
+    	pageRIDs.push_back(tmp);
+    	vector<int> tmpIndexes;
+    	pageRIDIndexes.push_back(tmpIndexes);
+    }
+    for (unsigned int i = 0; i < rids.size(); i++)
+    {
+    	RID rid = rids[i];
+    	pageRIDs[rid.pageNum].push_back(rid);
+    	pageRIDIndexes[rid.pageNum].push_back(i);
+    }
+
+    // Skip across and delete some records
+    for (int i = 0; i < numRecords; i += skip)
+    {
+    	rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+    }
+
+    // Double-check deletion
+    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
+    {
+    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
+    	{
+    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
+    		if (ridIndex % skip != 0)
+    		{
+    			memset(record, 0, 1000);
+				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
+				assert(rc == success);
+		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
+    		}
+    	}
+    }
+
+    // Walk every page and do some reallocation
+    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    {
+    	rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
+    	assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+    }
+
+    // Now check the contents again
+    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
+    {
+    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
+    	{
+    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
+    		if (ridIndex % skip != 0)
+    		{
+    			memset(record, 0, 1000);
+				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
+				assert(rc == success);
+		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
+    		}
+    	}
+    }
+
+    // Close & delete the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+    rc = rbfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+
+	return rc;
+}
+
+RC rbfmTestUpdateRecord(RecordBasedFileManager *rbfm, int skip)
+{
+	RC rc = err::OK;
+    string fileName = "rbfmTestUpdateRecord_file";
+
+    vector<RID> rids;
+    vector<int> sizes;
+
+    // Create a file named "our_test_4"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == err::OK);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "our_test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    RID rid; 
+    char record[(PAGE_SIZE / 2) + sizeof(unsigned)];
+    char record_copy[(PAGE_SIZE / 2) + sizeof(unsigned)];
+    int numRecords = 50;
+    unsigned halfPageSize = PAGE_SIZE / 2;
+    unsigned quarterPageSize = PAGE_SIZE / 4;
+    unsigned eighthPageSize = PAGE_SIZE / 8;
+
+    // Create the record descriptor for a single, long string
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "attr";
+    attr.type = TypeVarChar;
+    attr.length = (AttrLength)PAGE_SIZE;
+    recordDescriptor.push_back(attr);
+
+    // Store references to records inserted so that they can be easily checked later
+    vector<char*> ridContentList;
+
+    // Insert some records into the file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+        memset(record_copy, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+
+        memcpy((char*)record, &quarterPageSize, sizeof(unsigned));
+        unsigned offset = sizeof(unsigned);
+        for(int j = 0; j < quarterPageSize; j++)
+        {
+            memcpy((char *)record + offset, "a", 1);
+            offset += 1;
+        }
+
+        // Allocate space on the content list
+        ridContentList.push_back((char*)malloc(offset));
+
+        // Write, read, and then immediately compare the two
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
+        assert(rc == success);
+        assert(memcmp(record, record_copy, offset) == 0);
+        memcpy(ridContentList[i], record, offset);
+
+        // Record the RIDs
+        rids.push_back(rid);
+        sizes.push_back(offset);
+    }
+
+    // Expand every other "skipped" record
+    for (int i = 0; i < numRecords; i += skip)
+    {
+    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+	    memcpy((char*)record, &halfPageSize, sizeof(unsigned));
+	    unsigned offset = sizeof(unsigned);
+	    for(int j = 0; j < halfPageSize; j++)
+	    {
+	        memcpy((char *)record + offset, "a", 1);
+	        offset += 1;
+	    }
+
+	    // Update the record
+	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
+	    assert(rc == success);
+
+	    // Read it back in and compare
+	    memset(record_copy, 0, PAGE_SIZE / 2);
+	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
+	    rbfm->printRecord(recordDescriptor, record);
+	    cout << endl;
+	    rbfm->printRecord(recordDescriptor, record_copy);
+	    assert(rc == success);
+	    assert(memcmp(record, record_copy, offset) == 0);
+    }
+
+    // Shrink every other "skipped" record
+    for (int i = 0; i < numRecords; i += skip)
+    {
+    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+	    memcpy((char*)record, &eighthPageSize, sizeof(unsigned));
+	    unsigned offset = sizeof(unsigned);
+	    for(int j = 0; j < eighthPageSize; j++)
+	    {
+	        memcpy((char *)record + offset, "a", 1);
+	        offset += 1;
+	    }
+
+	    // Update the record
+	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
+	    assert(rc == success);
+
+	    // Read it back in and compare
+	    memset(record_copy, 0, PAGE_SIZE / 2);
+	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
+	    assert(rc == success);
+	    assert(memcmp(record, record_copy, offset) == 0);
+    }
+
+    return err::OK;
+}
+
+RC rbfmTestReorganizeDeleteUpdate(RecordBasedFileManager *rbfm, int skip)
+{
+	RC rc = err::OK;
+    string fileName = "rbfmTestReorganizeDeleteUpdate_file";
+
+    vector<RID> rids;
+    vector<int> sizes;
+
+    // Create a file named "our_test_4"
+    rc = rbfm->createFile(fileName.c_str());
+    assert(rc == err::OK);
+
+    if(FileExists(fileName.c_str()))
+    {
+        cout << "File " << fileName << " has been created." << endl;
+    }
+    else
+    {
+        cout << "Failed to create file!" << endl;
+        cout << "Test Case Failed!" << endl << endl;
+        return -1;
+    }
+
+    // Open the file "our_test_4"
+    FileHandle fileHandle;
+    rc = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(rc == success);
+
+    RID rid; 
+    char record[(PAGE_SIZE / 2) + sizeof(unsigned)];
+    char record_copy[(PAGE_SIZE / 2) + sizeof(unsigned)];
+    int numRecords = 10;
+    unsigned halfPageSize = PAGE_SIZE / 2;
+    unsigned quarterPageSize = PAGE_SIZE / 4;
+    unsigned eighthPageSize = PAGE_SIZE / 8;
+
+    // Create the record descriptor for a single, long string
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "attr";
+    attr.type = TypeVarChar;
+    attr.length = (AttrLength)PAGE_SIZE;
+    recordDescriptor.push_back(attr);
+
+    // Store references to records inserted so that they can be easily checked later
+    vector<char*> ridContentList;
+
+    // Insert some records into the file
+    for(int i = 0; i < numRecords; i++)
+    {
+        // Test insert Record
+        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+        memset(record_copy, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+
+        memcpy((char*)record, &quarterPageSize, sizeof(unsigned));
+        unsigned offset = sizeof(unsigned);
+        for(int j = 0; j < quarterPageSize; j++)
+        {
+            memcpy((char *)record + offset, "a", 1);
+            offset += 1;
+        }
+
+        // Allocate space on the content list
+        ridContentList.push_back((char*)malloc(offset));
+
+        // Write, read, and then immediately compare the two
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success);
+        rc = rbfm->readRecord(fileHandle, recordDescriptor, rid, record_copy);
+        assert(rc == success);
+        assert(memcmp(record, record_copy, offset) == 0);
+        memcpy(ridContentList[i], record, offset);
+
+        // Record the RIDs
+        cout << "Just inserted RID: " << rid.pageNum << ", " << rid.slotNum << endl;
+        rids.push_back(rid);
+        sizes.push_back(offset);
+    }
+
+    // Create and populate a vector of vectors that maps page numbers to all RIDs on that page
+    vector< vector<RID> > pageRIDs;
+    vector< vector<int> > pageRIDIndexes;
+    for (PageNum page = 0; page < fileHandle.getNumberOfPages(); page++)
+    {
+    	vector<RID> tmp;
+    	pageRIDs.push_back(tmp);
+    	vector<int> tmpIndexes;
+    	pageRIDIndexes.push_back(tmpIndexes);
+    }
+    for (unsigned int i = 0; i < rids.size(); i++)
+    {
+    	RID rid = rids[i];
+    	pageRIDs[rid.pageNum].push_back(rid);
+    	pageRIDIndexes[rid.pageNum].push_back(i);
+    }
+
+    // Skip across and delete some records
+    for (int i = 0; i < numRecords; i += skip)
+    {
+    	cout << "Deleting " << rids[i].pageNum << "," << rids[i].slotNum << endl;
+    	rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+    	assert(rc == success);
+
+    	memset(record, 0, 1000);
+    	rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
+    	assert(rc == err::RECORD_DELETED);
+    }
+
+    // Double-check contents
+    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
+    {
+    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
+    	{
+    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
+    		if (ridIndex % skip != 0)
+    		{
+    			memset(record, 0, 1000);
+				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
+				assert(rc == success);
+		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
+    		}
+    	}
+    }
+
+    // Walk every page and do some reallocation
+    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    {
+        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
+        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+    }
+
+    // Double-check contents
+    for (int i = 0; i < numRecords; i++)
+    {
+		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
+		if (rc != err::RECORD_DELETED)
+		{
+			assert(rc == success);
+			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
+		}
+    }
+
+    // Expand every other "skipped" record
+    for (int i = 1; i < numRecords; i += skip)
+    {
+    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+	    memcpy((char*)record, &halfPageSize, sizeof(unsigned));
+	    unsigned offset = sizeof(unsigned);
+	    for(int j = 0; j < halfPageSize; j++)
+	    {
+	        memcpy((char *)record + offset, "a", 1);
+	        offset += 1;
+	    }
+
+	    cout << "Expanding " << rids[i].pageNum << "," << rids[i].slotNum << endl;
+	    free(ridContentList[i]);
+	    ridContentList[i] = (char*)malloc((PAGE_SIZE / 2) + sizeof(unsigned));
+		memcpy(ridContentList[i], record, offset);
+		sizes[i] = offset;
+
+	    // Update the record
+	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
+	    assert(rc == success);
+
+	    // Read it back in and compare
+	    memset(record_copy, 0, PAGE_SIZE / 2);
+	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
+	    assert(rc == success);
+	    assert(memcmp(record, record_copy, offset) == 0);
+	    assert(memcmp(ridContentList[i], record_copy, offset) == 0);
+    }
+
+    // Double-check contents
+    for (int i = 0; i < numRecords; i++)
+    {
+		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
+		if (rc != err::RECORD_DELETED)
+		{
+			assert(rc == success);
+			assert(strncmp(record, ridContentList[i], sizes[i]) == 0);
+		}
+    }
+
+    // Skip across and delete some more records
+    for (int i = numRecords / 4; i < numRecords; i += skip)
+    {
+    	cout << "Deleting " << rids[i].pageNum << "," << rids[i].slotNum << endl;
+    	RC this_ret = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+        cout << "Return code: " << err::errToString(this_ret) << ", errno: " << this_ret << endl; 
+    }
+
+    // Walk every page and do some reallocation
+    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    {
+        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
+        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+    }
+
+    // Shrink every other "skipped" record
+    for (int i = 2; i < numRecords; i += skip)
+    {
+        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+        memcpy((char*)record, &eighthPageSize, sizeof(unsigned));
+        unsigned offset = sizeof(unsigned);
+        for(int j = 0; j < eighthPageSize; j++)
+        {
+            memcpy((char *)record + offset, "a", 1);
+            offset += 1;
+        }
+
+        free(ridContentList[i]);
+        ridContentList[i] = (char*)malloc(offset);
+        memcpy(ridContentList[i], record, offset);
+        sizes[i] = offset;
+
+        // Update the record
+    	cout << "Shrinking " << rids[i].pageNum << "," << rids[i].slotNum << endl;
+        rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
+        if (rc != err::RECORD_DELETED)
+        {
+            assert(rc == success);
+
+            // Read it back in and compare
+            memset(record_copy, 0, PAGE_SIZE / 2);
+            rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
+            assert(rc == success);
+            assert(memcmp(record, record_copy, offset) == 0);
+        }
+    }
+
+    // Double-check contents
+    for (int i = 0; i < numRecords; i++)
+    {
+		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
+		if (rc != err::RECORD_DELETED)
+		{
+			assert(rc == success);
+            cout << "Double checking RID: "<< rids[i].pageNum << ", " << rids[i].slotNum << endl;
+			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
+		}
+    }
+
+    // Skip across and delete some more records
+    for (int i = numRecords / 2; i < numRecords; i += skip)
+    {
+    	rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+    }
+
+    // Walk every page and do some reallocation
+    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    {
+        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
+        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+    }
+
+	// Double-check contents
+    for (int i = 0; i < numRecords; i++)
+    {
+		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
+		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
+		if (rc != err::RECORD_DELETED)
+		{
+			assert(rc == success);
+			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
+		}
+    }
+
+    // Close & delete the file "test_4"
+    rc = rbfm->closeFile(fileHandle);
+    assert(rc == success);
+    rc = rbfm->destroyFile(fileName.c_str());
+    assert(rc == success);
+
+	return rc;
+}
+
+void rbfmTestRandomInsertDeleteUpdateReorganize(int numRecords)
+{
+	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+	RC rc = rbfm->createFile("rbfmTestRandomInsertDeleteUpdateReorganize_file");
+	assert(rc == success);
+
+	FileHandle file;
+	rc = rbfm->openFile("rbfmTestRandomInsertDeleteUpdateReorganize_file", file);
+	assert(rc == success);
+
+	char readData[PAGE_SIZE] = {0};
+	vector<char*> recordData;
+	vector<int> stringSizes;
+	vector<int> indexes;
+	vector<RID> rids;
+
+	// Allocate enough space for any sized record
+	for (int i=0; i<numRecords; ++i)
+	{
+		rids.push_back(RID());
+		indexes.push_back(i);
+		recordData.push_back((char*)malloc(PAGE_SIZE));
+		memset(recordData.back(), 0, PAGE_SIZE);
+	}
+
+	// Determine the size of the records
+	for (int i=0; i<numRecords; ++i)
+	{
+		int stringsize = 4 + (rand() % 4000);
+		stringSizes.push_back(stringsize);
+
+		int* pss = (int*)recordData[i];
+		*pss = stringsize;
+
+		// Fill out the data with random data
+		char* strdata = recordData[i] + 4;
+		for (int c=0; c<stringsize; ++c)
+		{
+			strdata[c] = 'a' + (rand()%50);
+		}
+	}
+
+	// Setup our simple record description
+	Attribute attr;
+	attr.length = 4000;
+	attr.name = "string";
+	attr.type = TypeVarChar;
+
+	vector<Attribute> recordDescriptor;
+	recordDescriptor.push_back(attr);
+
+	// Start adding in records
+	std::random_shuffle(indexes.begin(), indexes.end());
+	for (int i=0; i<numRecords; ++i)
+	{
+		int index = indexes[i];
+		rbfm->insertRecord(file, recordDescriptor, recordData[index], rids[index]);
+	}
+
+	// Check records are correct still
+	for (int i=0; i<numRecords; ++i)
+	{
+		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
+		memcmp(recordData[i], readData, 4 + stringSizes[i]);
+	}
+
+	// reduce the size of half of the records
+	std::random_shuffle(indexes.begin(), indexes.end());
+	for (int i=0; i<numRecords/2; ++i)
+	{
+		int index = indexes[i];
+		std::cout << "decreasing size of " << index;
+
+		char* data = recordData[index];
+		int* strsize = (int*)data;
+		assert(*strsize == stringSizes[index]);
+
+
+		std::cout << " oldsize=" << (*strsize) << " ";
+		if (stringSizes[index] > 1000)
+		{
+			stringSizes[index] /= (1 + (rand() % 31));
+		}
+		else if (stringSizes[index] > 100)
+		{
+			stringSizes[index] -= (1 + (rand() % 57));
+		}
+		else if (stringSizes[index] > 10)
+		{
+			stringSizes[index] -= 4;
+		}
+
+		*strsize = stringSizes[index];
+		std::cout << " newsize=" << (*strsize) << " ";
+		std::cout << std::endl;
+
+		// change the data again so we can recompare correctly
+		char* strdata = data + 4;
+		for (int c=0; c<stringSizes[index]; ++c)
+		{
+			strdata[c] = 'a' + (rand()%50);
+		}
+
+		// update record on disk
+		rbfm->updateRecord(file, recordDescriptor, data, rids[index]);
+	}
+
+	// Check records are correct still
+	for (int i=0; i<numRecords; ++i)
+	{
+		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
+		memcmp(recordData[i], readData, 4 + stringSizes[i]);
+	}
+
+	// increase the size of half of the records
+	std::random_shuffle(indexes.begin(), indexes.end());
+	for (int i=0; i<numRecords/2; ++i)
+	{
+		int index = indexes[i];
+		std::cout << "increasing size of " << index << "\n";
+
+		char* data = recordData[index];
+		int* strsize = (int*)data;
+		assert(*strsize == stringSizes[index]);
+
+		std::cout << " oldsize=" << (*strsize) << " ";
+
+		stringSizes[index] += (rand()%(4000 - stringSizes[index]));
+		if (stringSizes[index] > 4000)
+		{
+			stringSizes[index] = 4001;
+		}
+
+		*strsize = stringSizes[index];
+		std::cout << " newsize=" << (*strsize) << " ";
+		std::cout << std::endl;
+
+		// change the data again so we can recompare correctly
+		char* strdata = data + 4;
+		for (int c=0; c<stringSizes[index]; ++c)
+		{
+			strdata[c] = 'a' + (rand()%50);
+		}
+
+		// update record on disk
+		rbfm->updateRecord(file, recordDescriptor, data, rids[index]);
+	}
+
+	// Check records are correct still
+	for (int i=0; i<numRecords; ++i)
+	{
+		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
+		memcmp(recordData[i], readData, 4 + stringSizes[i]);
+	}
+
+	rbfm->closeFile(file);
+}
+
+string randomString(unsigned len) {
+    string retVal = "";
+    for (unsigned i = 0; i < len; i++) {
+        retVal.push_back((char)((rand() % (26)) + 'a'));
+    }
+    return retVal;
+}
+
+RC scanTest(RecordBasedFileManager *rbfm)
+{
+	// Our assortment of attributes
+	Attribute aInt; 	aInt.name = "aInt";	    aInt.type = TypeInt;		aInt.length = (AttrLength)4;
+	Attribute aFlt;	    aFlt.name = "aFlt"; 	aFlt.type = TypeReal;		aFlt.length = (AttrLength)4;
+    Attribute aStr;     aStr.name = "aStr";     aStr.type = TypeVarChar;    aStr.length = (AttrLength)10 + 1;
+    vector<Attribute> recordDescriptor;
+    recordDescriptor.push_back(aFlt); 
+    recordDescriptor.push_back(aInt); 
+    recordDescriptor.push_back(aStr); 
+
+    vector<string> names;
+    float compFloat = 0.1;
+    int compInt = 100;
+    const char* compStrData = "hhhsizipsi";
+    unsigned len = 11;
+    char compStr[20];
+    memcpy(compStr, &len, sizeof(unsigned));
+    memcpy(compStr + sizeof(unsigned), compStrData, len);
+    names.push_back("aFlt");
+
+	std::vector<RID> rids;
+	std::vector<int> sizes;
+
+    string fileName = "scan_test";
+	RC ret = rbfm->createFile(fileName.c_str());
+    assert(ret == 0 && "COULD NOT CREATE FILE");
+    FileHandle fileHandle;
+    ret = rbfm->openFile(fileName.c_str(), fileHandle);
+    assert(ret == 0 && "COULD NOT OPEN FILE");
+
+    RID rid;
+	const int numRecords = 1000;
+    void *record = malloc(200);
+    void *temp_data = malloc(200);
+    void *scan_data = malloc(200);
+	for (int i=0; i<numRecords; ++i) {
+        memset(record, 0, 200);
+        float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+        int n = rand() % 1000;
+        string s = randomString(10);
+        memcpy(record, &r, sizeof(float));
+        memcpy((char*)record + sizeof(float), &n, sizeof(int));
+        memcpy((char*)record + sizeof(float) + sizeof(int), &len, sizeof(unsigned));
+        memcpy((char*)record + sizeof(float) + sizeof(int) + sizeof(unsigned), s.c_str(), len);
+        ret = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(ret == 0 && "COULD NOT INSERT RECORD");
+		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aFlt", (void*)temp_data);
+        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
+        assert( *(float*)temp_data == r);
+		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aInt", (void*)temp_data);
+        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
+        assert( *(int*)temp_data == n);
+		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aStr", (void*)temp_data);
+        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
+        assert( strcmp((char*)temp_data + sizeof(int), s.c_str()) == 0 );
+        cout << s.c_str()<< endl;
+    }
+    RBFM_ScanIterator scan_it;
+    rbfm->scan(fileHandle, recordDescriptor, "aFlt", CompOp::LT_OP, &compFloat, names, scan_it);
+    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
+        cout << *((float*)scan_data) << endl;
+    }
+    names.pop_back();
+    names.push_back("aInt");
+    rbfm->scan(fileHandle, recordDescriptor, "aInt", CompOp::EQ_OP, &compInt, names, scan_it);
+    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
+        cout << *((int*)scan_data) << endl;
+    }
+    names.pop_back();
+    names.push_back("aStr");
+    rbfm->scan(fileHandle, recordDescriptor, "aStr", CompOp::GT_OP, compStr, names, scan_it);
+    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
+        cout << ((char*)scan_data + sizeof(int)) << endl;
+    }
+    ret = rbfm->closeFile(fileHandle);
+    assert(ret == 0 && "COULD NOT CLOSE FILE");
+    free(record);
+    return 0;
+}
+
+
+// Lays out a record of reorganizeFileTest: an int, then a string of len
+// copies of fill
+static void reorgRecord(char *record, int id, char fill, unsigned len)
+{
+    memcpy(record, &id, sizeof(int));
+    memcpy(record + sizeof(int), &len, sizeof(unsigned));
+    memset(record + sizeof(int) + sizeof(unsigned), fill, len);
+}
+
+// Whether any data page of a record file has a TOMBSTONE in its directory
+static bool hasTombstones(FileHandle &fileHandle)
+{
+    unsigned char page[PAGE_SIZE];
+    for (PageNum pageNum = 1; pageNum < fileHandle.getNumberOfPages(); pageNum++)
+    {
+        if (RecordBasedFileManager::isMapPage(pageNum, PAGE_SIZE))
+            continue;
+        RC rc = fileHandle.readPage(pageNum, page);
+        assert(rc == success);
+        unsigned numSlots = RecordBasedFileManager::getPageIndex(page, PAGE_SIZE)->numSlots;
+        for (unsigned slot = 0; slot < numSlots; slot++)
+        {
+            if (RecordBasedFileManager::getPageIndexEntry(page, slot, PAGE_SIZE)->type == TOMBSTONE)
+                return true;
+        }
+    }
+    return false;
+}
+
+// reorganizeFile collapses tombstones, packs records into the front of the
+// file and cuts off the pages that frees, in batches, reporting every
+// record that got a new RID.
+void reorganizeFileTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
+
+    cout << "Reorganize file tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "id";
+    attr.type = TypeInt;
+    attr.length = 4;
+    recordDescriptor.push_back(attr);
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 3000;
+    recordDescriptor.push_back(attr);
+    char record[3008];
+    char data[3008];
+
+    string fileName = "reorg_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+
+    // Every record's RID and length; a length of 0 marks it deleted
+    const unsigned numRecords = 200;
+    vector<RID> rids(numRecords);
+    vector<unsigned> lengths(numRecords, 300);
+    for (unsigned i = 0; i < numRecords; i++)
+    {
+        reorgRecord(record, i, 'a' + i % 26, lengths[i]);
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]);
+        assert(rc == success);
     }
 
-    // Skip across and delete some records
-    for (int i = 0; i < numRecords; i += skip)
+    // Grow some records past their page, then grow one of them again
+    for (unsigned i = 1; i < numRecords; i += 20)
     {
-    	cout << "Deleting " << rids[i].pageNum << "," << rids[i].slotNum << endl;
-    	rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
-    	assert(rc == success);
-
-    	memset(record, 0, 1000);
-    	rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
-    	assert(rc == err::RECORD_DELETED);
+        lengths[i] = 1500;
+        reorgRecord(record, i, 'a' + i % 26, lengths[i]);
+        rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
+        assert(rc == success);
     }
+    TEST_FN_EQ(true, hasTombstones(fileHandle), "Updates left tombstones");
+    lengths[21] = 3000;
+    reorgRecord(record, 21, 'a' + 21 % 26, lengths[21]);
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[21]), "Grow moved record");
+
+    // Moving an anchor again points the tombstone at the new place
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(rids[21].pageNum, page);
+    assert(rc == success);
+    RID anchor = RecordBasedFileManager::getPageIndexEntry(page, rids[21].slotNum, PAGE_SIZE)->tombstoneRID;
+    rc = fileHandle.readPage(anchor.pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(ANCHOR, RecordBasedFileManager::getPageIndexEntry(page, anchor.slotNum, PAGE_SIZE)->type, "Tombstone leads straight to the record");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[21], data), "Read moved record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(int) + sizeof(unsigned) + lengths[21]), "Contents correct");
 
-    // Double-check contents
-    for (unsigned int pageNum = 0; pageNum < pageRIDs.size(); pageNum++)
+    // Delete three records in four
+    unsigned numAlive = 0;
+    for (unsigned i = 0; i < numRecords; i++)
     {
-    	for (unsigned int pageRidIndex = 0; pageRidIndex < pageRIDs[pageNum].size(); pageRidIndex++)
-    	{
-    		int ridIndex = (pageRIDIndexes[pageNum])[pageRidIndex];
-    		if (ridIndex % skip != 0)
-    		{
-    			memset(record, 0, 1000);
-				rc = rbfm->readRecord(fileHandle, recordDescriptor, (pageRIDs[pageNum])[pageRidIndex], record);
-				assert(rc == success);
-		    	assert(memcmp(record, ridContentList[ridIndex], sizes[ridIndex]) == 0);
-    		}
-    	}
+        if (i % 4 == 1)
+        {
+            numAlive++;
+            continue;
+        }
+        rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+        assert(rc == success);
+        lengths[i] = 0;
     }
-
-    // Walk every page and do some reallocation
-    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    TEST_FN_EQ(true, hasTombstones(fileHandle), "Grown records kept");
+
+    // Reorganize a few pages at a time, following the records that move
+    unsigned numPages = fileHandle.getNumberOfPages();
+    ReorganizeCursor cursor;
+    vector<RIDMove> moves;
+    unsigned numBatches = 0;
+    bool movesValid = true;
+    while (not cursor.done())
     {
-        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
-        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+        moves.clear();
+        rc = rbfm->reorganizeFile(fileHandle, recordDescriptor, cursor, 4, moves);
+        assert(rc == success);
+        numBatches++;
+
+        // Each move is of a live record, named by the RID it had before
+        vector<bool> moved(numRecords, false);
+        for (unsigned m = 0; m < moves.size(); m++)
+        {
+            unsigned found = numRecords;
+            for (unsigned i = 0; i < numRecords; i++)
+            {
+                if (lengths[i] > 0 and not moved[i] and rids[i].pageNum == moves[m].from.pageNum
+                        and rids[i].slotNum == moves[m].from.slotNum)
+                    found = i;
+            }
+            movesValid = movesValid and found < numRecords;
+            if (found < numRecords)
+            {
+                rids[found] = moves[m].to;
+                moved[found] = true;
+            }
+        }
     }
+    TEST_FN_EQ(true, numBatches > 1, "Ran in batches");
+    TEST_FN_EQ(true, movesValid, "Moves name live records");
+    TEST_FN_EQ(true, fileHandle.getNumberOfPages() < numPages, "File shrunk");
+    TEST_FN_EQ(false, hasTombstones(fileHandle), "Tombstones collapsed");
 
-    // Double-check contents
-    for (int i = 0; i < numRecords; i++)
+    bool contentsCorrect = true;
+    for (unsigned i = 0; i < numRecords; i++)
     {
-		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
-		if (rc != err::RECORD_DELETED)
-		{
-			assert(rc == success);
-			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
-		}
+        if (lengths[i] == 0)
+            continue;
+        reorgRecord(record, i, 'a' + i % 26, lengths[i]);
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(fileHandle, recordDescriptor, rids[i], data) == success
+                          and memcmp(record, data, sizeof(int) + sizeof(unsigned) + lengths[i]) == 0;
     }
+    TEST_FN_EQ(true, contentsCorrect, "Records readable at their new RIDs");
 
-    // Expand every other "skipped" record
-    for (int i = 1; i < numRecords; i += skip)
+    vector<string> names;
+    names.push_back("id");
+    RBFM_ScanIterator scanner;
+    RID rid;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_VAL_EQ(numAlive, count, "Scan sees every record once");
+
+    // A packed file is left as it is
+    numPages = fileHandle.getNumberOfPages();
+    TEST_FN_EQ(success, rbfm->reorganizeFile(fileHandle, recordDescriptor), "Reorganize again");
+    TEST_VAL_EQ(numPages, fileHandle.getNumberOfPages(), "Nothing more to cut off");
+    reorgRecord(record, 1, 'a' + 1, lengths[1]);
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[1], data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(int) + sizeof(unsigned) + lengths[1]), "Contents correct");
+
+    // Pages stay in place while another handle is open on the file
+    FileHandle other;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), other), "Open second handle");
+    bool skip = false;
+    for (unsigned i = 0; i < numRecords; i++)
     {
-    	memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-	    memcpy((char*)record, &halfPageSize, sizeof(unsigned));
-	    unsigned offset = sizeof(unsigned);
-	    for(int j = 0; j < halfPageSize; j++)
-	    {
-	        memcpy((char *)record + offset, "a", 1);
-	        offset += 1;
-	    }
+        if (lengths[i] == 0)
+            continue;
+        skip = not skip;
+        if (skip)
+            continue;
+        rc = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+        assert(rc == success);
+        lengths[i] = 0;
+    }
+    numPages = fileHandle.getNumberOfPages();
+    TEST_FN_EQ(success, rbfm->reorganizeFile(fileHandle, recordDescriptor), "Reorganize with file in use");
+    TEST_VAL_EQ(numPages, fileHandle.getNumberOfPages(), "Pages kept");
+    TEST_FN_EQ(success, rbfm->closeFile(other), "Close second handle");
 
-	    cout << "Expanding " << rids[i].pageNum << "," << rids[i].slotNum << endl;
-	    free(ridContentList[i]);
-	    ridContentList[i] = (char*)malloc((PAGE_SIZE / 2) + sizeof(unsigned));
-		memcpy(ridContentList[i], record, offset);
-		sizes[i] = offset;
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-	    // Update the record
-	    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
-	    assert(rc == success);
+    cout << "\nReorganize file Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-	    // Read it back in and compare
-	    memset(record_copy, 0, PAGE_SIZE / 2);
-	    rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
-	    assert(rc == success);
-	    assert(memcmp(record, record_copy, offset) == 0);
-	    assert(memcmp(ridContentList[i], record_copy, offset) == 0);
-    }
+// A record is never more than one tombstone away from its RID, and chains
+// left by older versions are collapsed as they are read.
+static void chainRecord(char *record, char fill, unsigned len)
+{
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), fill, len);
+}
 
-    // Double-check contents
-    for (int i = 0; i < numRecords; i++)
+// Grows the first record on page 1 off the page and later back onto it, once
+// the page has room again, so that its anchor shares the page with its
+// tombstone. Returns the anchor.
+static RID moveAnchorHome(FileHandle &fileHandle, const vector<Attribute> &recordDescriptor, RID &grown)
+{
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    char record[3004];
+    RID rid;
+    vector<RID> others;
+    chainRecord(record, 'a', 900);
+    for (unsigned i = 0; i < 4; i++)
     {
-		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
-		if (rc != err::RECORD_DELETED)
-		{
-			assert(rc == success);
-			assert(strncmp(record, ridContentList[i], sizes[i]) == 0);
-		}
+        RC rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success and rid.pageNum == 1);
+        if (i == 0)
+            grown = rid;
+        else
+            others.push_back(rid);
     }
 
-    // Skip across and delete some more records
-    for (int i = numRecords / 4; i < numRecords; i += skip)
-    {
-    	cout << "Deleting " << rids[i].pageNum << "," << rids[i].slotNum << endl;
-    	RC this_ret = rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
-        cout << "Return code: " << err::errToString(this_ret) << ", errno: " << this_ret << endl; 
-    }
+    // Off to page 2, which a second record then almost fills
+    chainRecord(record, 'b', 1500);
+    RC rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, grown);
+    assert(rc == success);
+    chainRecord(record, 'z', 2000);
+    rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+    assert(rc == success and rid.pageNum == 2);
 
-    // Walk every page and do some reallocation
-    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    // Page 1 empties, and the record outgrows page 2
+    for (unsigned i = 0; i < others.size(); i++)
     {
-        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
-        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+        rc = rbfm->deleteRecord(fileHandle, recordDescriptor, others[i]);
+        assert(rc == success);
     }
+    chainRecord(record, 'c', 2100);
+    rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, grown);
+    assert(rc == success);
 
-    // Shrink every other "skipped" record
-    for (int i = 2; i < numRecords; i += skip)
-    {
-        memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-        memcpy((char*)record, &eighthPageSize, sizeof(unsigned));
-        unsigned offset = sizeof(unsigned);
-        for(int j = 0; j < eighthPageSize; j++)
-        {
-            memcpy((char *)record + offset, "a", 1);
-            offset += 1;
-        }
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(grown.pageNum, page);
+    assert(rc == success);
+    return RecordBasedFileManager::getPageIndexEntry(page, grown.slotNum, PAGE_SIZE)->tombstoneRID;
+}
 
-        free(ridContentList[i]);
-        ridContentList[i] = (char*)malloc(offset);
-        memcpy(ridContentList[i], record, offset);
-        sizes[i] = offset;
+void tombstoneChainTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-        // Update the record
-    	cout << "Shrinking " << rids[i].pageNum << "," << rids[i].slotNum << endl;
-        rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[i]);
-        if (rc != err::RECORD_DELETED)
-        {
-            assert(rc == success);
+    cout << "Tombstone chain tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
-            // Read it back in and compare
-            memset(record_copy, 0, PAGE_SIZE / 2);
-            rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record_copy);
-            assert(rc == success);
-            assert(memcmp(record, record_copy, offset) == 0);
-        }
-    }
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 3000;
+    recordDescriptor.push_back(attr);
+    char record[3004];
+    char data[3004];
 
-    // Double-check contents
-    for (int i = 0; i < numRecords; i++)
-    {
-		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
-		if (rc != err::RECORD_DELETED)
-		{
-			assert(rc == success);
-            cout << "Double checking RID: "<< rids[i].pageNum << ", " << rids[i].slotNum << endl;
-			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
-		}
-    }
+    string fileName = "chain_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
 
-    // Skip across and delete some more records
-    for (int i = numRecords / 2; i < numRecords; i += skip)
+    // Fill page 1, then grow one of its records again and again, each time
+    // past the page holding it
+    unsigned len = 900;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'a', len);
+    RID rid;
+    RID grown;
+    for (unsigned i = 0; i < 4; i++)
     {
-    	rbfm->deleteRecord(fileHandle, recordDescriptor, rids[i]);
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success and rid.pageNum == 1);
+        if (i == 0)
+            grown = rid;
     }
-
-    // Walk every page and do some reallocation
-    for (PageNum page = 1; page < fileHandle.getNumberOfPages(); page++)
+    unsigned lengths[] = { 1500, 2500, 3000 };
+    for (unsigned i = 0; i < 3; i++)
     {
-        rc = rbfm->reorganizePage(fileHandle, recordDescriptor, page);
-        assert(rc == err::OK || rc == err::PAGE_CANNOT_BE_ORGANIZED);
+        len = lengths[i];
+        memcpy(record, &len, sizeof(unsigned));
+        memset(record + sizeof(unsigned), 'b' + i, len);
+        rc = rbfm->updateRecord(fileHandle, recordDescriptor, record, grown);
+        assert(rc == success);
+        // Take up the rest of the page the record moved to
+        len = 1400;
+        memcpy(data, &len, sizeof(unsigned));
+        memset(data + sizeof(unsigned), 'z', len);
+        rc = rbfm->insertRecord(fileHandle, recordDescriptor, data, rid);
+        assert(rc == success);
     }
 
-	// Double-check contents
-    for (int i = 0; i < numRecords; i++)
-    {
-		memset(record, 0, (PAGE_SIZE / 2) + sizeof(unsigned));
-		rc = rbfm->readRecord(fileHandle, recordDescriptor, rids[i], record);
-		if (rc != err::RECORD_DELETED)
-		{
-			assert(rc == success);
-			assert(memcmp(record, ridContentList[i], sizes[i]) == 0);
-		}
-    }
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(grown.pageNum, page);
+    assert(rc == success);
+    RID anchor = RecordBasedFileManager::getPageIndexEntry(page, grown.slotNum, PAGE_SIZE)->tombstoneRID;
+    TEST_FN_EQ(true, anchor.pageNum > 2, "Record moved more than once");
+    rbfm->resetTombstoneHops();
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, grown, data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + 3000), "Contents correct");
+    TEST_FN_EQ(1, rbfm->getTombstoneHops(), "Read took one hop");
 
-    // Close & delete the file "test_4"
-    rc = rbfm->closeFile(fileHandle);
+    TEST_FN_EQ(success, rbfm->readAttribute(fileHandle, recordDescriptor, grown, "str", data), "Read attribute");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + 3000), "Attribute correct");
+    TEST_FN_EQ(2, rbfm->getTombstoneHops(), "Read attribute took one hop");
+
+    vector<string> names;
+    names.push_back("str");
+    RBFM_ScanIterator scanner;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    unsigned count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+        count++;
+    scanner.close();
+    TEST_FN_EQ(7, count, "Scan sees every record once");
+    TEST_FN_EQ(3, rbfm->getTombstoneHops(), "Scan took one hop");
+
+    // Make a chain the way older versions did: the anchor turned into a
+    // tombstone to another record, which becomes the anchor
+    RID other;
+    len = 100;
+    memcpy(record, &len, sizeof(unsigned));
+    memset(record + sizeof(unsigned), 'q', len);
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, other), "Insert record");
+    rc = fileHandle.readPage(anchor.pageNum, page);
     assert(rc == success);
-    rc = rbfm->destroyFile(fileName.c_str());
+    PageIndexEntry *entry = RecordBasedFileManager::getPageIndexEntry(page, anchor.slotNum, PAGE_SIZE);
+    entry->type = TOMBSTONE;
+    entry->tombstoneRID = other;
+    rc = fileHandle.writePage(anchor.pageNum, page);
+    assert(rc == success);
+    rc = fileHandle.readPage(other.pageNum, page);
+    assert(rc == success);
+    RecordBasedFileManager::getPageIndexEntry(page, other.slotNum, PAGE_SIZE)->type = ANCHOR;
+    rc = fileHandle.writePage(other.pageNum, page);
     assert(rc == success);
 
-	return rc;
+    rbfm->resetTombstoneHops();
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, grown, data), "Read through chain");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + 100), "Contents correct");
+    TEST_FN_EQ(true, rbfm->getTombstoneHops() > 1, "Chain took more than one hop");
+    rc = fileHandle.readPage(grown.pageNum, page);
+    assert(rc == success);
+    entry = RecordBasedFileManager::getPageIndexEntry(page, grown.slotNum, PAGE_SIZE);
+    TEST_VAL_EQ(other.pageNum, entry->tombstoneRID.pageNum, "Tombstone points at the end of the chain");
+    TEST_VAL_EQ(other.slotNum, entry->tombstoneRID.slotNum, "Tombstone points at the end of the chain");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readRecord(fileHandle, recordDescriptor, anchor, data), "Middle of the chain freed");
+
+    rbfm->resetTombstoneHops();
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, grown, data), "Read again");
+    TEST_FN_EQ(1, rbfm->getTombstoneHops(), "One hop left");
+
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    // An anchor that moves again from its tombstone's page keeps the
+    // tombstone pointing at it
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    anchor = moveAnchorHome(fileHandle, recordDescriptor, grown);
+    TEST_FN_EQ(true, anchor.pageNum == grown.pageNum, "Anchor back on the tombstone's page");
+    chainRecord(record, 'y', 1500);
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record, rid), "Fill the page");
+    TEST_FN_EQ(true, rid.pageNum == grown.pageNum, "Filler on the same page");
+    chainRecord(record, 'd', 3000);
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record, grown), "Grow off the page");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, grown, data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, sizeof(unsigned) + 3000), "Contents correct");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    // Deleting such a record frees its anchor too
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    anchor = moveAnchorHome(fileHandle, recordDescriptor, grown);
+    TEST_FN_EQ(true, anchor.pageNum == grown.pageNum, "Anchor back on the tombstone's page");
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, grown), "Delete record");
+    rc = fileHandle.readPage(grown.pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(true, anchor.slotNum >= RecordBasedFileManager::getPageIndex(page, PAGE_SIZE)->numSlots
+                     or RecordBasedFileManager::getPageIndexEntry(page, anchor.slotNum, PAGE_SIZE)->type == DEAD,
+               "Anchor freed");
+    TEST_FN_EQ(err::RECORD_DELETED, rbfm->readRecord(fileHandle, recordDescriptor, grown, data), "Record gone");
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
+
+    cout << "\nTombstone chain Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-void rbfmTestRandomInsertDeleteUpdateReorganize(int numRecords)
+// Lays out a record of overflowTest: an int, then a string of len bytes
+static void overflowRecord(char *record, int id, unsigned len)
 {
-	RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    memcpy(record, &id, sizeof(int));
+    memcpy(record + sizeof(int), &len, sizeof(unsigned));
+    for (unsigned i = 0; i < len; i++)
+        record[sizeof(int) + sizeof(unsigned) + i] = 'a' + (id + i) % 26;
+}
 
-	RC rc = rbfm->createFile("rbfmTestRandomInsertDeleteUpdateReorganize_file");
-	assert(rc == success);
+// Records too large for a page keep their head on a data page and the rest
+// in overflow pages, which are read in one go.
+void overflowTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-	FileHandle file;
-	rc = rbfm->openFile("rbfmTestRandomInsertDeleteUpdateReorganize_file", file);
-	assert(rc == success);
+    cout << "Overflow page tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
-	char readData[PAGE_SIZE] = {0};
-	vector<char*> recordData;
-	vector<int> stringSizes;
-	vector<int> indexes;
-	vector<RID> rids;
+    vector<Attribute> recordDescriptor;
+    Attribute attr;
+    attr.name = "id";
+    attr.type = TypeInt;
+    attr.length = 4;
+    recordDescriptor.push_back(attr);
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 50000;
+    recordDescriptor.push_back(attr);
+    vector<char> record(50016);
+    vector<char> data(50016);
 
-	// Allocate enough space for any sized record
-	for (int i=0; i<numRecords; ++i)
-	{
-		rids.push_back(RID());
-		indexes.push_back(i);
-		recordData.push_back((char*)malloc(PAGE_SIZE));
-		memset(recordData.back(), 0, PAGE_SIZE);
-	}
+    string fileName = "overflow_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
 
-	// Determine the size of the records
-	for (int i=0; i<numRecords; ++i)
-	{
-		int stringsize = 4 + (rand() % 4000);
-		stringSizes.push_back(stringsize);
+    unsigned lengths[] = { 100, 10000, 30000, 4080, 2 * OVERFLOW_PAYLOAD(PAGE_SIZE), 50000 };
+    const unsigned numRecords = sizeof(lengths) / sizeof(lengths[0]);
+    vector<RID> rids(numRecords);
+    for (unsigned i = 0; i < numRecords; i++)
+    {
+        overflowRecord(record.data(), i, lengths[i]);
+        TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, record.data(), rids[i]), "Insert record");
+    }
+    TEST_VAL_EQ(rids[0].pageNum, rids[1].pageNum, "Head shares a page with other records");
 
-		int* pss = (int*)recordData[i];
-		*pss = stringsize;
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(rids[1].pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(0, RecordBasedFileManager::getPageIndexEntry(page, rids[0].slotNum, PAGE_SIZE)->flags & ENTRY_OVERFLOW, "Small record stored whole");
+    TEST_FN_EQ(ENTRY_OVERFLOW, RecordBasedFileManager::getPageIndexEntry(page, rids[1].slotNum, PAGE_SIZE)->flags & ENTRY_OVERFLOW, "Large record overflowed");
 
-		// Fill out the data with random data
-		char* strdata = recordData[i] + 4;
-		for (int c=0; c<stringsize; ++c)
-		{
-			strdata[c] = 'a' + (rand()%50);
-		}
-	}
+    bool contentsCorrect = true;
+    for (unsigned i = 0; i < numRecords; i++)
+    {
+        overflowRecord(record.data(), i, lengths[i]);
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(fileHandle, recordDescriptor, rids[i], data.data()) == success
+                          and memcmp(record.data(), data.data(), 8 + lengths[i]) == 0;
+    }
+    TEST_FN_EQ(true, contentsCorrect, "Records read back whole");
+
+    // The overflow pages of a record take one read
+    IOCounters counters;
+    rc = BufferPoolManager::instance()->flushFile(fileHandle);
+    assert(rc == success);
+    pfm->resetIOStats();
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[2], data.data()), "Read record");
+    pfm->getIOStats(fileName, IO_READ, counters);
+    unsigned overflowPages = (30008 + OVERFLOW_PAYLOAD(PAGE_SIZE) - 1) / OVERFLOW_PAYLOAD(PAGE_SIZE);
+    TEST_FN_EQ(true, counters.ops <= 2, "Overflow pages read at once");
+    TEST_FN_EQ(true, counters.pages >= overflowPages - 1, "Every overflow page read");
+
+    overflowRecord(record.data(), 5, 50000);
+    TEST_FN_EQ(success, rbfm->readAttribute(fileHandle, recordDescriptor, rids[5], "str", data.data()), "Read attribute");
+    TEST_FN_EQ(0, memcmp(record.data() + 4, data.data(), 4 + 50000), "Attribute correct");
+
+    vector<string> names;
+    names.push_back("id");
+    names.push_back("str");
+    RBFM_ScanIterator scanner;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "", NO_OP, NULL, names, scanner), "Start scan");
+    RID rid;
+    unsigned count = 0;
+    bool scanCorrect = true;
+    while (scanner.getNextRecord(rid, data.data()) != RBFM_EOF)
+    {
+        int id;
+        memcpy(&id, data.data(), sizeof(int));
+        overflowRecord(record.data(), id, lengths[id]);
+        scanCorrect = scanCorrect and memcmp(record.data(), data.data(), 8 + lengths[id]) == 0;
+        count++;
+    }
+    scanner.close();
+    TEST_FN_EQ(numRecords, count, "Scan sees every record once");
+    TEST_FN_EQ(true, scanCorrect, "Scan returns records whole");
 
-	// Setup our simple record description
-	Attribute attr;
-	attr.length = 4000;
-	attr.name = "string";
-	attr.type = TypeVarChar;
+    // Shrinking a record frees its overflow pages for other records
+    rc = fileHandle.readPage(rids[1].pageNum, page);
+    assert(rc == success);
+    OverflowHeader header;
+    memcpy(&header, page + RecordBasedFileManager::getPageIndexEntry(page, rids[1].slotNum, PAGE_SIZE)->recordOffset,
+           sizeof(OverflowHeader));
+    lengths[1] = 200;
+    overflowRecord(record.data(), 1, lengths[1]);
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record.data(), rids[1]), "Shrink record");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[1], data.data()), "Read record");
+    TEST_FN_EQ(0, memcmp(record.data(), data.data(), 8 + lengths[1]), "Contents correct");
+    rc = fileHandle.readPage(header.firstPage, page);
+    assert(rc == success);
+    TEST_FN_EQ(false, RecordBasedFileManager::isOverflowPage(page, PAGE_SIZE), "Overflow page freed");
+    unsigned numPages = fileHandle.getNumberOfPages();
+    overflowRecord(data.data(), 1, 3500);
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, recordDescriptor, data.data(), rid), "Insert record");
+    TEST_VAL_EQ(numPages, fileHandle.getNumberOfPages(), "Record took a freed page");
+
+    // Growing one overflows it
+    lengths[0] = 20000;
+    overflowRecord(record.data(), 0, lengths[0]);
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record.data(), rids[0]), "Grow record");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[0], data.data()), "Read record");
+    TEST_FN_EQ(0, memcmp(record.data(), data.data(), 8 + lengths[0]), "Contents correct");
+
+    // Deleting one frees its overflow pages
+    rc = fileHandle.readPage(rids[5].pageNum, page);
+    assert(rc == success);
+    memcpy(&header, page + RecordBasedFileManager::getPageIndexEntry(page, rids[5].slotNum, PAGE_SIZE)->recordOffset,
+           sizeof(OverflowHeader));
+    TEST_FN_EQ(success, rbfm->deleteRecord(fileHandle, recordDescriptor, rids[5]), "Delete record");
+    rc = fileHandle.readPage(header.firstPage + 1, page);
+    assert(rc == success);
+    TEST_FN_EQ(false, RecordBasedFileManager::isOverflowPage(page, PAGE_SIZE), "Overflow pages freed");
 
-	vector<Attribute> recordDescriptor;
-	recordDescriptor.push_back(attr);
+    // Reorganizing leaves overflowed records whole
+    ReorganizeCursor cursor;
+    vector<RIDMove> moves;
+    while (not cursor.done())
+    {
+        rc = rbfm->reorganizeFile(fileHandle, recordDescriptor, cursor, 4, moves);
+        assert(rc == success);
+    }
+    for (unsigned m = 0; m < moves.size(); m++)
+    {
+        for (unsigned i = 0; i < numRecords; i++)
+        {
+            if (rids[i].pageNum == moves[m].from.pageNum and rids[i].slotNum == moves[m].from.slotNum)
+                rids[i] = moves[m].to;
+        }
+    }
+    contentsCorrect = true;
+    for (unsigned i = 0; i < 5; i++)
+    {
+        overflowRecord(record.data(), i, lengths[i]);
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(fileHandle, recordDescriptor, rids[i], data.data()) == success
+                          and memcmp(record.data(), data.data(), 8 + lengths[i]) == 0;
+    }
+    TEST_FN_EQ(true, contentsCorrect, "Records whole after reorganizing");
 
-	// Start adding in records
-	std::random_shuffle(indexes.begin(), indexes.end());
-	for (int i=0; i<numRecords; ++i)
-	{
-		int index = indexes[i];
-		rbfm->insertRecord(file, recordDescriptor, recordData[index], rids[index]);
-	}
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-	// Check records are correct still
-	for (int i=0; i<numRecords; ++i)
-	{
-		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
-		memcmp(recordData[i], readData, 4 + stringSizes[i]);
-	}
+    cout << "\nOverflow page Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
-	// reduce the size of half of the records
-	std::random_shuffle(indexes.begin(), indexes.end());
-	for (int i=0; i<numRecords/2; ++i)
-	{
-		int index = indexes[i];
-		std::cout << "decreasing size of " << index;
+// Fills record with the fields of compactTest's mixed schema for id, and
+// returns its length
+static unsigned compactRecord(char *record, int id)
+{
+    unsigned offset = 0;
+    float c = id * 0.5f;
+    unsigned len = id % 30;
+    memcpy(record + offset, &id, sizeof(int));
+    offset += sizeof(int);
+    memcpy(record + offset, &len, sizeof(unsigned));
+    offset += sizeof(unsigned);
+    for (unsigned i = 0; i < len; i++)
+        record[offset++] = 'a' + (id + i) % 26;
+    memcpy(record + offset, &c, sizeof(float));
+    offset += sizeof(float);
+    int d = -id;
+    memcpy(record + offset, &d, sizeof(int));
+    offset += sizeof(int);
+    return offset;
+}
 
-		char* data = recordData[index];
-		int* strsize = (int*)data;
-		assert(*strsize == stringSizes[index]);
+// Records are stored with their fixed-width fields first and 2-byte
+// offsets to their varchars; those written in the old format still read.
+void compactRecordTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
+    cout << "Compact record tests" << endl;
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
 
-		std::cout << " oldsize=" << (*strsize) << " ";
-		if (stringSizes[index] > 1000)
-		{
-			stringSizes[index] /= (1 + (rand() % 31));
-		}
-		else if (stringSizes[index] > 100)
-		{
-			stringSizes[index] -= (1 + (rand() % 57));
-		}
-		else if (stringSizes[index] > 10)
-		{
-			stringSizes[index] -= 4;
-		}
+    // A narrow integer table packs a row into 12 bytes and its slot
+    vector<Attribute> narrowDescriptor;
+    Attribute attr;
+    attr.type = TypeInt;
+    attr.length = 4;
+    attr.name = "x";
+    narrowDescriptor.push_back(attr);
+    attr.name = "y";
+    narrowDescriptor.push_back(attr);
+    attr.name = "z";
+    narrowDescriptor.push_back(attr);
+
+    string fileName = "compact_test";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    FileHandle fileHandle;
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
 
-		*strsize = stringSizes[index];
-		std::cout << " newsize=" << (*strsize) << " ";
-		std::cout << std::endl;
+    const unsigned numNarrow = 1000;
+    vector<RID> rids(numNarrow);
+    int row[3];
+    bool insertsSucceeded = true;
+    for (unsigned i = 0; i < numNarrow; i++)
+    {
+        row[0] = i;
+        row[1] = i * 2;
+        row[2] = i * 3;
+        insertsSucceeded = insertsSucceeded
+                           and rbfm->insertRecord(fileHandle, narrowDescriptor, row, rids[i]) == success;
+    }
+    TEST_FN_EQ(true, insertsSucceeded, "Insert narrow records");
 
-		// change the data again so we can recompare correctly
-		char* strdata = data + 4;
-		for (int c=0; c<stringSizes[index]; ++c)
-		{
-			strdata[c] = 'a' + (rand()%50);
-		}
+    unsigned char page[PAGE_SIZE];
+    rc = fileHandle.readPage(rids[0].pageNum, page);
+    assert(rc == success);
+    unsigned perPage = (PAGE_SIZE - sizeof(PageIndex)) / (3 * sizeof(int) + sizeof(PageIndexEntry));
+    TEST_VAL_EQ(perPage, RecordBasedFileManager::getPageIndex(page, PAGE_SIZE)->numSlots, "Rows packed without offsets");
+    TEST_FN_EQ(ENTRY_COMPACT, RecordBasedFileManager::getPageIndexEntry(page, rids[0].slotNum, PAGE_SIZE)->flags, "Record flagged compact");
+    TEST_FN_EQ(3 * sizeof(int), RecordBasedFileManager::getPageIndexEntry(page, rids[0].slotNum, PAGE_SIZE)->recordSize, "Record holds its fields only");
+
+    bool contentsCorrect = true;
+    int readRow[3];
+    for (unsigned i = 0; i < numNarrow; i++)
+    {
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(fileHandle, narrowDescriptor, rids[i], readRow) == success
+                          and readRow[0] == (int) i and readRow[1] == (int) i * 2 and readRow[2] == (int) i * 3;
+    }
+    TEST_FN_EQ(true, contentsCorrect, "Narrow records read back");
 
-		// update record on disk
-		rbfm->updateRecord(file, recordDescriptor, data, rids[index]);
-	}
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-	// Check records are correct still
-	for (int i=0; i<numRecords; ++i)
-	{
-		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
-		memcmp(recordData[i], readData, 4 + stringSizes[i]);
-	}
+    // A mixed schema, its varchar between fixed-width fields
+    vector<Attribute> recordDescriptor;
+    attr.name = "a";
+    attr.type = TypeInt;
+    attr.length = 4;
+    recordDescriptor.push_back(attr);
+    attr.name = "name";
+    attr.type = TypeVarChar;
+    attr.length = 30;
+    recordDescriptor.push_back(attr);
+    attr.name = "c";
+    attr.type = TypeReal;
+    attr.length = 4;
+    recordDescriptor.push_back(attr);
+    attr.name = "d";
+    attr.type = TypeInt;
+    attr.length = 4;
+    recordDescriptor.push_back(attr);
 
-	// increase the size of half of the records
-	std::random_shuffle(indexes.begin(), indexes.end());
-	for (int i=0; i<numRecords/2; ++i)
-	{
-		int index = indexes[i];
-		std::cout << "increasing size of " << index << "\n";
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
 
-		char* data = recordData[index];
-		int* strsize = (int*)data;
-		assert(*strsize == stringSizes[index]);
+    const unsigned numMixed = 200;
+    rids.resize(numMixed);
+    char record[100];
+    char data[100];
+    insertsSucceeded = true;
+    for (unsigned i = 0; i < numMixed; i++)
+    {
+        compactRecord(record, i);
+        insertsSucceeded = insertsSucceeded
+                           and rbfm->insertRecord(fileHandle, recordDescriptor, record, rids[i]) == success;
+    }
+    TEST_FN_EQ(true, insertsSucceeded, "Insert mixed records");
 
-		std::cout << " oldsize=" << (*strsize) << " ";
+    contentsCorrect = true;
+    for (unsigned i = 0; i < numMixed; i++)
+    {
+        unsigned length = compactRecord(record, i);
+        contentsCorrect = contentsCorrect
+                          and rbfm->readRecord(fileHandle, recordDescriptor, rids[i], data) == success
+                          and memcmp(record, data, length) == 0;
+    }
+    TEST_FN_EQ(true, contentsCorrect, "Mixed records read back");
 
-		stringSizes[index] += (rand()%(4000 - stringSizes[index]));
-		if (stringSizes[index] > 4000)
-		{
-			stringSizes[index] = 4001;
-		}
+    // Every attribute reads on its own
+    bool attributesCorrect = true;
+    for (unsigned i = 0; i < numMixed; i++)
+    {
+        unsigned length = compactRecord(record, i);
+        unsigned nameLength = i % 30;
+        attributesCorrect = attributesCorrect
+                            and rbfm->readAttribute(fileHandle, recordDescriptor, rids[i], "a", data) == success
+                            and memcmp(data, record, 4) == 0
+                            and rbfm->readAttribute(fileHandle, recordDescriptor, rids[i], "name", data) == success
+                            and memcmp(data, record + 4, 4 + nameLength) == 0
+                            and rbfm->readAttribute(fileHandle, recordDescriptor, rids[i], "c", data) == success
+                            and memcmp(data, record + length - 8, 4) == 0
+                            and rbfm->readAttribute(fileHandle, recordDescriptor, rids[i], "d", data) == success
+                            and memcmp(data, record + length - 4, 4) == 0;
+    }
+    TEST_FN_EQ(true, attributesCorrect, "Attributes read back");
+    TEST_FN_EQ(err::ATTRIBUTE_NOT_FOUND, rbfm->readAttribute(fileHandle, recordDescriptor, rids[0], "e", data), "Unknown attribute");
 
-		*strsize = stringSizes[index];
-		std::cout << " newsize=" << (*strsize) << " ";
-		std::cout << std::endl;
+    // Scans compare and project fields wherever they are stored
+    vector<string> names;
+    names.push_back("d");
+    names.push_back("name");
+    RBFM_ScanIterator scanner;
+    float limit = 90;
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "c", GT_OP, &limit, names, scanner), "Scan on real");
+    RID rid;
+    unsigned count = 0;
+    bool scanCorrect = true;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+    {
+        int d;
+        memcpy(&d, data, sizeof(int));
+        unsigned length = compactRecord(record, -d);
+        scanCorrect = scanCorrect and -d * 0.5f > limit
+                      and memcmp(data + 4, record + 4, length - 12) == 0;
+        count++;
+    }
+    scanner.close();
+    TEST_FN_EQ(numMixed - 181, count, "Scan sees matching records");
+    TEST_FN_EQ(true, scanCorrect, "Scan returns projected fields");
+
+    // Name of record 37: 7 characters from 'l'
+    char value[40];
+    compactRecord(record, 37);
+    memcpy(value, record + 4, 4 + 7);
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "name", EQ_OP, value, names, scanner), "Scan on varchar");
+    count = 0;
+    scanCorrect = true;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+    {
+        int d;
+        memcpy(&d, data, sizeof(int));
+        scanCorrect = scanCorrect and d == -37;
+        count++;
+    }
+    scanner.close();
+    TEST_FN_EQ(1, count, "Varchar matches one record");
+    TEST_FN_EQ(true, scanCorrect, "Right record matched");
+
+    // A record in the old format, written straight onto the page: a
+    // 4-byte offset per attribute, then the fields as they are passed in.
+    // The last record's page has room for it.
+    const unsigned old = numMixed - 1;
+    unsigned length = compactRecord(record, old);
+    unsigned nameLength = old % 30;
+    unsigned legacyOffsets[4] = { 16, 20, 24 + nameLength, 28 + nameLength };
+    rc = fileHandle.readPage(rids[old].pageNum, page);
+    assert(rc == success);
+    PageIndex* index = RecordBasedFileManager::getPageIndex(page, PAGE_SIZE);
+    PageIndexEntry* entry = RecordBasedFileManager::getPageIndexEntry(page, rids[old].slotNum, PAGE_SIZE);
+    assert(RecordBasedFileManager::freeSpaceSize(page, PAGE_SIZE) >= sizeof(legacyOffsets) + length);
+    entry->flags = 0;
+    entry->recordOffset = index->freeMemoryOffset;
+    entry->recordSize = sizeof(legacyOffsets) + length;
+    memcpy(page + entry->recordOffset, legacyOffsets, sizeof(legacyOffsets));
+    memcpy(page + entry->recordOffset + sizeof(legacyOffsets), record, length);
+    index->freeMemoryOffset += entry->recordSize;
+    rc = fileHandle.writePage(rids[old].pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[old], data), "Read old record");
+    TEST_FN_EQ(0, memcmp(record, data, length), "Old record correct");
+    TEST_FN_EQ(success, rbfm->readAttribute(fileHandle, recordDescriptor, rids[old], "c", data), "Read old attribute");
+    TEST_FN_EQ(0, memcmp(record + length - 8, data, 4), "Old attribute correct");
+    memcpy(value, record + 4, 4 + nameLength);
+    TEST_FN_EQ(success, rbfm->scan(fileHandle, recordDescriptor, "name", EQ_OP, value, names, scanner), "Scan old record");
+    count = 0;
+    while (scanner.getNextRecord(rid, data) != RBFM_EOF)
+    {
+        count++;
+    }
+    scanner.close();
+    TEST_FN_EQ(1, count, "Old record matched");
 
-		// change the data again so we can recompare correctly
-		char* strdata = data + 4;
-		for (int c=0; c<stringSizes[index]; ++c)
-		{
-			strdata[c] = 'a' + (rand()%50);
-		}
+    // Updating it stores it compact
+    TEST_FN_EQ(success, rbfm->updateRecord(fileHandle, recordDescriptor, record, rids[old]), "Update old record");
+    rc = fileHandle.readPage(rids[old].pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(ENTRY_COMPACT, RecordBasedFileManager::getPageIndexEntry(page, rids[old].slotNum, PAGE_SIZE)->flags, "Updated record compact");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, recordDescriptor, rids[old], data), "Read record");
+    TEST_FN_EQ(0, memcmp(record, data, length), "Contents correct");
 
-		// update record on disk
-		rbfm->updateRecord(file, recordDescriptor, data, rids[index]);
-	}
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-	// Check records are correct still
-	for (int i=0; i<numRecords; ++i)
-	{
-		rbfm->readRecord(file, recordDescriptor, rids[i], readData);
-		memcmp(recordData[i], readData, 4 + stringSizes[i]);
-	}
+    // A record beyond what 2-byte offsets reach keeps 4-byte ones
+    vector<Attribute> wideDescriptor;
+    attr.name = "id";
+    attr.type = TypeInt;
+    attr.length = 4;
+    wideDescriptor.push_back(attr);
+    attr.name = "str";
+    attr.type = TypeVarChar;
+    attr.length = 70000;
+    wideDescriptor.push_back(attr);
+    vector<char> wide(70008);
+    vector<char> wideData(70008);
+    overflowRecord(wide.data(), 7, 70000);
+
+    TEST_FN_EQ(success, rbfm->createFile(fileName.c_str()), "Create file");
+    TEST_FN_EQ(success, rbfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    TEST_FN_EQ(success, rbfm->insertRecord(fileHandle, wideDescriptor, wide.data(), rid), "Insert wide record");
+    rc = fileHandle.readPage(rid.pageNum, page);
+    assert(rc == success);
+    TEST_FN_EQ(ENTRY_OVERFLOW, RecordBasedFileManager::getPageIndexEntry(page, rid.slotNum, PAGE_SIZE)->flags, "Wide record not compact");
+    TEST_FN_EQ(success, rbfm->readRecord(fileHandle, wideDescriptor, rid, wideData.data()), "Read wide record");
+    TEST_FN_EQ(0, memcmp(wide.data(), wideData.data(), wide.size()), "Wide record correct");
+    TEST_FN_EQ(success, rbfm->readAttribute(fileHandle, wideDescriptor, rid, "str", wideData.data()), "Read wide attribute");
+    TEST_FN_EQ(0, memcmp(wide.data() + 4, wideData.data(), wide.size() - 4), "Wide attribute correct");
 
-	rbfm->closeFile(file);
-}
+    TEST_FN_EQ(success, rbfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, rbfm->destroyFile(fileName.c_str()), "Destroy file");
 
-string randomString(unsigned len) {
-    string retVal = "";
-    for (unsigned i = 0; i < len; i++) {
-        retVal.push_back((char)((rand() % (26)) + 'a'));
-    }
-    return retVal;
+    cout << "\nCompact record Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
 }
 
-RC scanTest(RecordBasedFileManager *rbfm)
+// Pins page pageNum and unpins it again, and returns whether that was done
+// without reading from disk
+static bool pinIsHit(FileHandle &fileHandle, const string &fileName, PageNum pageNum)
 {
-	// Our assortment of attributes
-	Attribute aInt; 	aInt.name = "aInt";	    aInt.type = TypeInt;		aInt.length = (AttrLength)4;
-	Attribute aFlt;	    aFlt.name = "aFlt"; 	aFlt.type = TypeReal;		aFlt.length = (AttrLength)4;
-    Attribute aStr;     aStr.name = "aStr";     aStr.type = TypeVarChar;    aStr.length = (AttrLength)10 + 1;
-    vector<Attribute> recordDescriptor;
-    recordDescriptor.push_back(aFlt); 
-    recordDescriptor.push_back(aInt); 
-    recordDescriptor.push_back(aStr); 
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    IOCounters before, after;
+    pfm->getIOStats(fileName, IO_READ, before);
+    unsigned frameNum;
+    RC rc = bpm->pinPage(fileHandle, pageNum, frameNum);
+    assert(rc == success);
+    rc = bpm->unpinPage(frameNum);
+    assert(rc == success);
+    pfm->getIOStats(fileName, IO_READ, after);
+    return after.ops == before.ops;
+}
 
-    vector<string> names;
-    float compFloat = 0.1;
-    int compInt = 100;
-    const char* compStrData = "hhhsizipsi";
-    unsigned len = 11;
-    char compStr[20];
-    memcpy(compStr, &len, sizeof(unsigned));
-    memcpy(compStr + sizeof(unsigned), compStrData, len);
-    names.push_back("aFlt");
+// Pins and unpins, clock eviction, running out of frames and writing
+// dirty frames back, on a pool of four frames
+void bufferPoolTest()
+{
+    unsigned numTests = 0;
+    unsigned numPassed = 0;
+    RC rc;
 
-	std::vector<RID> rids;
-	std::vector<int> sizes;
+    cout << "Buffer pool tests" << endl;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    BufferPoolManager *bpm = BufferPoolManager::instance();
+    unsigned poolSize = bpm->getNumFrames();
+    const unsigned numFrames = 4;
+    const unsigned numPages = 12;
 
-    string fileName = "scan_test";
-	RC ret = rbfm->createFile(fileName.c_str());
-    assert(ret == 0 && "COULD NOT CREATE FILE");
+    string fileName = "bpm_test";
+    TEST_FN_EQ(success, pfm->createFile(fileName.c_str()), "Create file");
     FileHandle fileHandle;
-    ret = rbfm->openFile(fileName.c_str(), fileHandle);
-    assert(ret == 0 && "COULD NOT OPEN FILE");
-
-    RID rid;
-	const int numRecords = 1000;
-    void *record = malloc(200);
-    void *temp_data = malloc(200);
-    void *scan_data = malloc(200);
-	for (int i=0; i<numRecords; ++i) {
-        memset(record, 0, 200);
-        float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-        int n = rand() % 1000;
-        string s = randomString(10);
-        memcpy(record, &r, sizeof(float));
-        memcpy((char*)record + sizeof(float), &n, sizeof(int));
-        memcpy((char*)record + sizeof(float) + sizeof(int), &len, sizeof(unsigned));
-        memcpy((char*)record + sizeof(float) + sizeof(int) + sizeof(unsigned), s.c_str(), len);
-        ret = rbfm->insertRecord(fileHandle, recordDescriptor, record, rid);
-        assert(ret == 0 && "COULD NOT INSERT RECORD");
-		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aFlt", (void*)temp_data);
-        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
-        assert( *(float*)temp_data == r);
-		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aInt", (void*)temp_data);
-        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
-        assert( *(int*)temp_data == n);
-		ret = rbfm->readAttribute(fileHandle, recordDescriptor, rid, "aStr", (void*)temp_data);
-        assert(ret == 0 && "COULD NOT READ ATTRIBUTE");
-        assert( strcmp((char*)temp_data + sizeof(int), s.c_str()) == 0 );
-        cout << s.c_str()<< endl;
-    }
-    RBFM_ScanIterator scan_it;
-    rbfm->scan(fileHandle, recordDescriptor, "aFlt", CompOp::LT_OP, &compFloat, names, scan_it);
-    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
-        cout << *((float*)scan_data) << endl;
+    TEST_FN_EQ(success, pfm->openFile(fileName.c_str(), fileHandle), "Open file");
+    unsigned char page[PAGE_SIZE];
+    for (unsigned i = 0; i < numPages; i++)
+    {
+        memset(page, 'a' + i, PAGE_SIZE);
+        rc = fileHandle.appendPage(page);
+        assert(rc == success);
     }
-    names.pop_back();
-    names.push_back("aInt");
-    rbfm->scan(fileHandle, recordDescriptor, "aInt", CompOp::EQ_OP, &compInt, names, scan_it);
-    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
-        cout << *((int*)scan_data) << endl;
+    TEST_FN_EQ(success, bpm->setNumFrames(numFrames), "Shrink pool");
+
+    // A pinned frame holds the page until it is unpinned, once
+    unsigned frameNum;
+    TEST_FN_EQ(success, bpm->pinPage(fileHandle, 0, frameNum), "Pin page");
+    TEST_FN_EQ('a', bpm->getFrameData(frameNum)[PAGE_SIZE - 1], "Frame holds page");
+    TEST_FN_EQ(success, bpm->unpinPage(frameNum), "Unpin page");
+    TEST_FN_EQ(err::BUFFER_FRAME_NOT_PINNED, bpm->unpinPage(frameNum), "Unpin twice");
+
+    // With every frame pinned there is nothing to evict
+    unsigned frames[numFrames];
+    for (unsigned i = 0; i < numFrames; i++)
+    {
+        rc = bpm->pinPage(fileHandle, i, frames[i]);
+        assert(rc == success);
     }
-    names.pop_back();
-    names.push_back("aStr");
-    rbfm->scan(fileHandle, recordDescriptor, "aStr", CompOp::GT_OP, compStr, names, scan_it);
-    while (scan_it.getNextRecord(rid, scan_data) != RBFM_EOF) {
-        cout << ((char*)scan_data + sizeof(int)) << endl;
+    TEST_FN_EQ(err::BUFFER_POOL_EXHAUSTED, bpm->pinPage(fileHandle, numFrames, frameNum), "Pool exhausted");
+    TEST_FN_EQ(err::BUFFER_FRAME_PINNED, bpm->setNumFrames(numFrames), "Resize refused while pinned");
+    for (unsigned i = 0; i < numFrames; i++)
+    {
+        rc = bpm->unpinPage(frames[i]);
+        assert(rc == success);
     }
-    ret = rbfm->closeFile(fileHandle);
-    assert(ret == 0 && "COULD NOT CLOSE FILE");
-    free(record);
-    return 0;
-}
+    TEST_FN_EQ(true, pinIsHit(fileHandle, fileName, 0), "Pinned pages stayed resident");
+
+    // The clock: pages 0-3 fill the pool with the hand back where it
+    // started, so page 4 takes the frame of page 0 once a sweep has cleared
+    // every referenced bit. Page 1, referenced again since, gets a second
+    // chance when page 5 comes in, and page 2 goes instead.
+    TEST_FN_EQ(success, bpm->setNumFrames(numFrames), "Empty pool");
+    for (unsigned i = 0; i < numFrames; i++)
+        pinIsHit(fileHandle, fileName, i);
+    TEST_FN_EQ(false, pinIsHit(fileHandle, fileName, 4), "Page 4 read");
+    TEST_FN_EQ(true, pinIsHit(fileHandle, fileName, 1), "Page 1 resident");
+    TEST_FN_EQ(false, pinIsHit(fileHandle, fileName, 5), "Page 5 read");
+    TEST_FN_EQ(true, pinIsHit(fileHandle, fileName, 1), "Referenced page kept");
+    TEST_FN_EQ(true, pinIsHit(fileHandle, fileName, 3), "Later page kept");
+    TEST_FN_EQ(false, pinIsHit(fileHandle, fileName, 2), "Unreferenced page evicted");
+    TEST_FN_EQ(false, pinIsHit(fileHandle, fileName, 0), "First page evicted");
+
+    // A dirty frame is written back when it is evicted; as many pages not
+    // read yet as there are frames evict every page there is
+    IOCounters counters;
+    TEST_FN_EQ(success, bpm->pinPage(fileHandle, 6, frameNum), "Pin page");
+    memset(bpm->getFrameData(frameNum), 'z', PAGE_SIZE);
+    bpm->markDirty(frameNum, fileHandle);
+    TEST_FN_EQ(success, bpm->unpinPage(frameNum), "Unpin page");
+    pfm->resetIOStats();
+    for (unsigned i = 0; i < numFrames; i++)
+        pinIsHit(fileHandle, fileName, numPages - numFrames + i);
+    pfm->getIOStats(fileName, IO_WRITE, counters);
+    TEST_FN_EQ(true, counters.pages == 1, "Dirty page written on eviction");
+    TEST_FN_EQ(false, pinIsHit(fileHandle, fileName, 6), "Page evicted");
+    TEST_FN_EQ(success, fileHandle.readPage(6, page), "Read page");
+    TEST_FN_EQ('z', page[0], "Write-back reached disk");
+
+    // A flush while a page is pinned does not lose changes made through
+    // the pin after it
+    PageGuard guard;
+    TEST_FN_EQ(success, guard.pin(fileHandle, 7), "Pin page");
+    guard.mutableData()[0] = 'x';
+    TEST_FN_EQ(success, bpm->flushFile(fileHandle), "Flush file");
+    guard.mutableData()[0] = 'y';
+    guard.release();
+    TEST_FN_EQ(success, bpm->flushFile(fileHandle), "Flush file");
+    TEST_FN_EQ(success, bpm->setNumFrames(numFrames), "Empty pool");
+    TEST_FN_EQ(success, fileHandle.readPage(7, page), "Read page");
+    TEST_FN_EQ('y', page[0], "Change after flush reached disk");
+
+    TEST_FN_EQ(success, bpm->setNumFrames(poolSize), "Restore pool");
+    TEST_FN_EQ(success, pfm->closeFile(fileHandle), "Close file");
+    TEST_FN_EQ(success, pfm->destroyFile(fileName.c_str()), "Destroy file");
 
+    cout << "\nBuffer pool Tests complete: " << numPassed << "/" << numTests << "\n\n" << endl;
+    assert(numPassed == numTests);
+}
 
 void cleanup()
 {
@@ -2758,6 +5631,46 @@ void cleanup()
     remove("testFile4.db");
     remove("testFile5.db");
     remove("fh_test");
+    remove("mmap_test");
+    remove("direct_test");
+    remove("readahead_test");
+    remove("multipage_test");
+    remove("fcache_test0");
+    remove("fcache_test1");
+    remove("fcache_test2");
+    remove("fcache_test3");
+    remove("extent_test");
+    remove("fsm_test");
+    remove("wal_test");
+    remove("wal_rbfm_test");
+    remove("wal_test.log");
+    remove("writer_test");
+    remove("ckpt_test");
+    remove("ckpt_test.log");
+    remove("psize_test");
+    remove("psize_small");
+    remove("psize_test.log");
+    remove("iostats_test");
+    remove("compress_test");
+    remove("space_test");
+    remove("trunc_test");
+    remove("trunc_space");
+    remove("trunc_records");
+    remove("trunc_test.log");
+    remove("sync_test");
+    remove("sync_records");
+    remove("finfo_test");
+    remove("finfo_other");
+    for (unsigned i = 0; i < 12; i++)
+        remove(("conc_test" + to_string(i)).c_str());
+    remove("slot_test");
+    remove("reorg_test");
+    remove("chain_test");
+    remove("overflow_test");
+    remove("compact_test");
+    remove("bpm_test");
+    remove("conc_rbfm");
+    remove("wal_broken");
     remove("rbfmTestReadAttribute_file");
     remove("rbfmTestReorganizePage_file");
     remove("rbfmTestUpdateRecord_file");
@@ -2815,6 +5728,30 @@ int main()
     // Finishing up
     //pfmTest();
     fhTest();
+    mmapTest();
+    directTest();
+    readAheadTest();
+    multiPageTest();
+    fileCacheTest();
+    extentTest();
+    fsmTest();
+    walTest();
+    writerTest();
+    checkpointTest();
+    pageSizeTest();
+    ioStatsTest();
+    compressionTest();
+    tablespaceTest();
+    truncateTest();
+    syncPolicyTest();
+    fileInfoTest();
+    concurrencyTest();
+    slotReuseTest();
+    reorganizeFileTest();
+    tombstoneChainTest();
+    overflowTest();
+    compactRecordTest();
+    bufferPoolTest();
     rbfmTest();
     scanTest(rbfm);
 
@@ -0,0 +1,88 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "pfm.h"
+#include "rbfm.h"
+#include "../util/errcodes.h"
+
+using namespace std;
+
+// Measures what each SyncPolicy costs: loads records into a file under
+// every policy, and reports the throughput and the number of syncs it
+// took.
+//
+//  ./syncbench [numRecords] [syncIntervalMs]
+
+static const char *policyNames[] = { "none", "on-close", "per-op", "group" };
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static vector<Attribute> benchDescriptor() {
+    Attribute id;   id.name = "id";     id.type = TypeInt;      id.length = 4;
+    Attribute name; name.name = "name"; name.type = TypeVarChar; name.length = 64;
+    vector<Attribute> descriptor;
+    descriptor.push_back(id);
+    descriptor.push_back(name);
+    return descriptor;
+}
+
+static const string benchFile = "syncbench_file";
+
+static RC loadFile(RecordBasedFileManager *rbfm, const string &fileName, unsigned numRecords) {
+    vector<Attribute> descriptor = benchDescriptor();
+    FileHandle fileHandle;
+    RC ret = rbfm->openFile(fileName, fileHandle);
+    RETURN_ON_ERR(ret);
+
+    char record[128];
+    for (unsigned i = 0; i < numRecords; i++) {
+        int id = i;
+        unsigned len = 20 + i % 40;
+        memcpy(record, &id, sizeof(int));
+        memcpy(record + 4, &len, sizeof(unsigned));
+        memset(record + 8, 'a' + i % 26, len);
+
+        RID rid;
+        ret = rbfm->insertRecord(fileHandle, descriptor, record, rid);
+        RETURN_ON_ERR(ret);
+    }
+    return rbfm->closeFile(fileHandle);
+}
+
+int main(int argc, char **argv) {
+    unsigned numRecords = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned interval = argc > 2 ? atoi(argv[2]) : DEFAULT_SYNC_INTERVAL_MS;
+    PagedFileManager *pfm = PagedFileManager::instance();
+    RecordBasedFileManager *rbfm = RecordBasedFileManager::instance();
+    pfm->setSyncInterval(interval);
+
+    printf("%u records, sync interval %u ms\n", numRecords, interval);
+    for (unsigned policy = SYNC_NONE; policy <= SYNC_GROUP; policy++) {
+        pfm->setSyncPolicy((SyncPolicy) policy);
+        remove(benchFile.c_str());
+        if (rbfm->createFile(benchFile) != err::OK)
+            return 1;
+        pfm->resetIOStats();
+
+        auto start = chrono::steady_clock::now();
+        if (loadFile(rbfm, benchFile, numRecords) != err::OK)
+            return 1;
+        double ms = elapsedMs(start);
+
+        IOCounters syncs;
+        pfm->getIOStats(benchFile, IO_SYNC, syncs);
+        printf("%-9s %10.2f ms  %10.0f records/s  %8llu syncs  %8.2f ms syncing\n",
+               policyNames[policy], ms, numRecords / (ms / 1000),
+               syncs.ops, syncs.totalNs / 1e6);
+    }
+
+    remove(benchFile.c_str());
+    return 0;
+}
@@ -3,13 +3,22 @@
 #include <iostream>
 #include <cstring>
 
-RelationManager* RelationManager::_rm = 0;
+atomic<RelationManager*> RelationManager::_rm(NULL);
+mutex RelationManager::_instanceMutex;
 
 RelationManager* RelationManager::instance() {
-	if (!_rm)
-		_rm = new RelationManager();
-
-	return _rm;
+	RelationManager *instance = _rm.load(memory_order_acquire);
+	if (instance)
+		return instance;
+
+	// Threads racing to get here first create a single instance
+	lock_guard<mutex> lock(_instanceMutex);
+	instance = _rm.load(memory_order_relaxed);
+	if (!instance) {
+		instance = new RelationManager();
+		_rm.store(instance, memory_order_release);
+	}
+	return instance;
 }
 
 RelationManager::RelationManager() :
@@ -95,6 +104,9 @@ RelationManager::RelationManager() :
 	attr.type = TypeVarChar;
 	indexVec.push_back(attr);
 
+	// Redo whatever a crash kept from reaching the files
+	LogManager::instance()->open(RM_LOG_FILE);
+
 	if (fexist("Tables.tbl")) {
 		loadSystem();
 	} else {
@@ -289,7 +301,7 @@ RC RelationManager::createTable(const string &tableName,
 	if (ret == err::OK) {
 		TABLE_ID_COUNTER += 1;
 	}
-	return rbfm->closeFile(fileHandle);
+	return commit(rbfm->closeFile(fileHandle));
 }
 
 void RelationManager::populateColumnsMap(RID &rid, int columnPosition) {
@@ -503,7 +515,7 @@ RC RelationManager::deleteTable(const string &tableName) {
 		string fileName = tableName + ".tbl";
 		ret = rbfm->destroyFile(fileName);
 
-		return ret;
+		return commit(ret);
 	}
 	return ret;
 }
@@ -625,7 +637,7 @@ RC RelationManager::insertTuple(const string &tableName, const void *data,
 
 	//added for index
 	if (indexMap.find(table_ID) == indexMap.end())
-		return ret;
+		return commit(ret);
 
 	for (map<int, RID>::iterator itr = indexMap[table_ID]->begin(); itr
 			!= indexMap[table_ID]->end(); ++itr) {
@@ -654,7 +666,7 @@ RC RelationManager::insertTuple(const string &tableName, const void *data,
 		}
 	}
 
-	return ret;
+	return commit(ret);
 
 }
 
@@ -688,7 +700,7 @@ RC RelationManager::deleteTuples(const string &tableName) {
 	int table_ID = tablesMap[tableName]->begin()->first;
 
 	if (indexMap.find(table_ID) == indexMap.end())
-		return ret;
+		return commit(ret);
 
 	vector<Attribute> recordDescriptor;
 	ret = getAttributes(tableName, recordDescriptor);
@@ -703,18 +715,26 @@ RC RelationManager::deleteTuples(const string &tableName) {
 		string columnName = recordDescriptor[position - 1].name;
 		string fileName = tableName + "_" + columnName + ".idx";
 
-		ret = ix->destroyFile(fileName);
+		// Truncated in place, like the table
+		FileHandle indexFileHandle;
+		ret = ix->openFile(fileName, indexFileHandle);
 		if (ret != err::OK) {
 			return ret;
 		}
 
-		ret = ix->createFile(fileName);
+		ret = ix->truncateFile(indexFileHandle);
+		if (ret != err::OK) {
+			ix->closeFile(indexFileHandle);
+			return ret;
+		}
+
+		ret = ix->closeFile(indexFileHandle);
 		if (ret != err::OK) {
 			return ret;
 		}
 	}
 
-	return ret;
+	return commit(ret);
 }
 
 RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
@@ -739,7 +759,7 @@ RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
 	}
 
 	//the data is needed for deleting indexes
-	void *data = malloc(PAGE_SIZE);
+	void *data = malloc(determineMemoryNeeded(recordDescriptor));
 	ret = rbfm->readRecord(fileHandle, recordDescriptor, rid, data);
 
 	if (ret != err::OK) {
@@ -765,7 +785,7 @@ RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
 	//added codes for index
 	if (indexMap.find(table_ID) == indexMap.end()) {
 		free(data);
-		return ret;
+		return commit(ret);
 	}
 
 	for (map<int, RID>::iterator itr = indexMap[table_ID]->begin(); itr
@@ -798,7 +818,7 @@ RC RelationManager::deleteTuple(const string &tableName, const RID &rid) {
 
 	free(data);
 
-	return ret;
+	return commit(ret);
 
 }
 
@@ -824,7 +844,7 @@ RC RelationManager::updateTuple(const string &tableName, const void *data,
 		return ret;
 	}
 
-	void *oldData = malloc(PAGE_SIZE);
+	void *oldData = malloc(determineMemoryNeeded(recordDescriptor));
 	ret = rbfm->readRecord(fileHandle, recordDescriptor, rid, oldData);
 	if (ret != err::OK) {
 		free(oldData);
@@ -850,7 +870,7 @@ RC RelationManager::updateTuple(const string &tableName, const void *data,
 	//added codes for index
 	if (indexMap.find(table_ID) == indexMap.end()) {
 		free(oldData);
-		return ret;//check valid table_ID
+		return commit(ret);//check valid table_ID
 	}
 
 	for (map<int, RID>::iterator itr = indexMap[table_ID]->begin(); itr
@@ -900,7 +920,7 @@ RC RelationManager::updateTuple(const string &tableName, const void *data,
 
 	free(oldData);
 
-	return ret;
+	return commit(ret);
 
 }
 
@@ -995,7 +1015,7 @@ RC RelationManager::reorganizePage(const string &tableName,
 		return ret;
 	}
 
-	return rbfm->closeFile(fileHandle);
+	return commit(rbfm->closeFile(fileHandle));
 
 }
 
@@ -1090,7 +1110,7 @@ RC RelationManager::createIndex(const string & tableName,
 	free(data);
 
 	ret = ix->closeFile(indexFileHandle);
-	return ret;
+	return commit(ret);
 }
 
 RC RelationManager::destroyIndex(const string & tableName,
@@ -1130,7 +1150,7 @@ RC RelationManager::destroyIndex(const string & tableName,
 	if (ret != err::OK) {
 		return ret;
 	}
-	return ix->destroyFile(indexFileName);
+	return commit(ix->destroyFile(indexFileName));
 
 }
 
@@ -1213,7 +1233,92 @@ RC RelationManager::addAttribute(const string &tableName, const Attribute &attr)
 
 // Extra credit
 RC RelationManager::reorganizeTable(const string &tableName) {
-	return -1;
+	if (isSystemTableRequest(tableName)) {
+		return -1;
+	}
+
+	vector<Attribute> recordDescriptor;
+	RC ret = getAttributes(tableName, recordDescriptor);
+	if (ret != err::OK) {
+		return ret;
+	}
+	int table_ID = tablesMap[tableName]->begin()->first;
+
+	FileHandle fileHandle;
+	string fileName = tableName + ".tbl";
+	ret = rbfm->openFile(fileName, fileHandle);
+	if (ret != err::OK) {
+		return ret;
+	}
+
+	// Work through the file a batch at a time, committing each batch with
+	// the index entries of the records it moved
+	ReorganizeCursor cursor;
+	vector<RIDMove> moves;
+	while (not cursor.done()) {
+		moves.clear();
+		ret = rbfm->reorganizeFile(fileHandle, recordDescriptor, cursor,
+				RBFM_REORGANIZE_BATCH, moves);
+		if (ret == err::OK) {
+			ret = moveIndexEntries(tableName, table_ID, recordDescriptor,
+					fileHandle, moves);
+		}
+		if (ret == err::OK) {
+			ret = commit(ret);
+		}
+		if (ret != err::OK) {
+			rbfm->closeFile(fileHandle);
+			return ret;
+		}
+	}
+
+	return commit(rbfm->closeFile(fileHandle));
+}
+
+// Points the index entries of records that reorganizeTable moved at their
+// new RIDs
+RC RelationManager::moveIndexEntries(const string &tableName, int table_ID,
+		const vector<Attribute> &recordDescriptor, FileHandle &fileHandle,
+		const vector<RIDMove> &moves) {
+	if (moves.empty() || indexMap.find(table_ID) == indexMap.end())
+		return err::OK;
+
+	RC ret = err::OK;
+	char *data = (char *) malloc(determineMemoryNeeded(recordDescriptor));
+	for (map<int, RID>::iterator itr = indexMap[table_ID]->begin(); itr
+			!= indexMap[table_ID]->end() && ret == err::OK; ++itr) {
+		int position = itr->first;
+		Attribute keyAttribute = recordDescriptor[position - 1];
+
+		string indexFileName = tableName + "_" + keyAttribute.name + ".idx";
+		FileHandle indexFileHandle;
+		ret = ix->openFile(indexFileName, indexFileHandle);
+		if (ret != err::OK) {
+			break;
+		}
+
+		for (vector<RIDMove>::const_iterator move = moves.begin(); move
+				!= moves.end() && ret == err::OK; ++move) {
+			ret = rbfm->readRecord(fileHandle, recordDescriptor, move->to, data);
+			if (ret != err::OK) {
+				break;
+			}
+			int startOffset = readFieldOffset(data, position, recordDescriptor);
+			ret = ix->deleteEntry(indexFileHandle, keyAttribute,
+					data + startOffset, move->from);
+			if (ret == err::OK) {
+				ret = ix->insertEntry(indexFileHandle, keyAttribute,
+						data + startOffset, move->to);
+			}
+		}
+
+		RC closeRet = ix->closeFile(indexFileHandle);
+		if (ret == err::OK) {
+			ret = closeRet;
+		}
+	}
+	free(data);
+	return ret;
 }
 
 void RelationManager::appendData(int fieldLength, int &offset,
@@ -1228,9 +1333,9 @@ void RelationManager::appendData(int fieldLength, int &offset,
 	offset += fieldLength;
 }
 
-short RelationManager::determineMemoryNeeded(
+unsigned RelationManager::determineMemoryNeeded(
 		const vector<Attribute> &attributes) {
-	short size = 0;
+	unsigned size = 0;
 
 	for (int i = 0; i < (int) attributes.size(); i++) {
 		if (attributes[i].type == TypeVarChar) {
@@ -1316,12 +1421,15 @@ bool RelationManager::isFieldEqual(const char *a, const char *b, AttrType type)
 	}
 }
 
+// Asks the PFM, since tables may live in a tablespace
 bool RelationManager::fexist(string filename) {
-	struct stat buffer;
-	if (stat(filename.c_str(), &buffer)) {
-		return false;
-	}
-	return true;
+	return PagedFileManager::instance()->fileExists(filename);
+}
+
+RC RelationManager::commit(RC ret) {
+	if (ret != err::OK)
+		return ret;
+	return LogManager::instance()->commit();
 }
 
 RM_ScanIterator::RM_ScanIterator() {
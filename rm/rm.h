@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 
 #include "../rbf/rbfm.h"
+#include "../rbf/log.h"
 #include "../ix/ix.h"
 
 using namespace std;
@@ -15,6 +16,7 @@ using namespace std;
 # define MAX_COLUMNS_RECORD_SIZE 784
 # define RM_EOF (-1)  // end of a scan operator
 # define MAX_ATTRIBUTE_LENGTH 260
+# define RM_LOG_FILE "rm.log"  // write-ahead log of the catalog and tables
 
 // RM_ScanIterator is an iteratr to go through tuples
 class RM_ScanIterator {
@@ -112,7 +114,8 @@ protected:
 	~RelationManager();
 
 private:
-	static RelationManager *_rm;
+	static atomic<RelationManager*> _rm;
+	static mutex _instanceMutex;
 
 	RecordBasedFileManager * rbfm;
 	IndexManager * ix;
@@ -140,7 +143,8 @@ private:
 	RC insertIndexEntry(string tableName, string columnName, int tableID,
 			int columnPos, FileHandle & fileHandle, RID &rid);
 
-	short determineMemoryNeeded(const vector<Attribute> &attributes);
+	// Largest a tuple of attributes can be, as passed in
+	unsigned determineMemoryNeeded(const vector<Attribute> &attributes);
 
 	void populateColumnsMap(RID &rid, int columnIndex);
 
@@ -152,6 +156,13 @@ private:
 	bool isSystemTableRequest(string tableName);
 	bool fexist(string filename);
 
+	// Makes an operation that returned ret durable, if it succeeded
+	RC commit(RC ret);
+
+	RC moveIndexEntries(const string &tableName, int table_ID,
+			const vector<Attribute> &recordDescriptor, FileHandle &fileHandle,
+			const vector<RIDMove> &moves);
+
 	int readFieldOffset(const void *data, int attrPosition,
 			vector<Attribute> recordDescriptor);
 
@@ -0,0 +1,98 @@
+#include "test_util.h"
+
+// Prepares a tuple (Id, Text) whose text is textLength copies of letter
+void prepareWideTuple(const int id, const int textLength, const char letter, void *buffer, int *tupleSize)
+{
+    int offset = 0;
+
+    memcpy((char *)buffer + offset, &id, sizeof(int));
+    offset += sizeof(int);
+
+    memcpy((char *)buffer + offset, &textLength, sizeof(int));
+    offset += sizeof(int);
+    memset((char *)buffer + offset, letter, textLength);
+    offset += textLength;
+
+    *tupleSize = offset;
+}
+
+void TEST_RM_17(const string &tableName)
+{
+    // Functions Tested
+    // 1. Insert Tuple larger than a page **
+    // 2. Update Tuple **
+    // 3. Delete Tuple **
+    // 4. Read Tuple
+    cout << "****In Test Case 17****" << endl;
+
+    vector<Attribute> attrs;
+    Attribute attr;
+    attr.name = "Id";
+    attr.type = TypeInt;
+    attr.length = (AttrLength)4;
+    attrs.push_back(attr);
+
+    attr.name = "Text";
+    attr.type = TypeVarChar;
+    attr.length = (AttrLength)(3 * PAGE_SIZE);
+    attrs.push_back(attr);
+
+    RC rc = rm->createTable(tableName, attrs);
+    assert(rc == success);
+
+    // The index makes update and delete read the old tuple back
+    rc = rm->createIndex(tableName, "Id");
+    assert(rc == success);
+
+    RID rid;
+    int tupleSize = 0;
+    int updatedTupleSize = 0;
+    void *tuple = malloc(3 * PAGE_SIZE + 8);
+    void *updatedTuple = malloc(3 * PAGE_SIZE + 8);
+    void *returnedData = malloc(3 * PAGE_SIZE + 8);
+
+    // Insert Tuple
+    prepareWideTuple(1, 2 * PAGE_SIZE, 'a', tuple, &tupleSize);
+    rc = rm->insertTuple(tableName, tuple, rid);
+    assert(rc == success);
+
+    rc = rm->readTuple(tableName, rid, returnedData);
+    assert(rc == success);
+    assert(memcmp(tuple, returnedData, tupleSize) == 0);
+
+    // Update Tuple, to a larger one with a new key
+    prepareWideTuple(2, 3 * PAGE_SIZE, 'b', updatedTuple, &updatedTupleSize);
+    rc = rm->updateTuple(tableName, updatedTuple, rid);
+    assert(rc == success);
+
+    rc = rm->readTuple(tableName, rid, returnedData);
+    assert(rc == success);
+    assert(memcmp(updatedTuple, returnedData, updatedTupleSize) == 0);
+
+    // Delete Tuple
+    rc = rm->deleteTuple(tableName, rid);
+    assert(rc == success);
+
+    rc = rm->readTuple(tableName, rid, returnedData);
+    assert(rc != success);
+
+    rc = rm->deleteTable(tableName);
+    assert(rc == success);
+
+    free(tuple);
+    free(updatedTuple);
+    free(returnedData);
+
+    cout << "****Test case 17 passed****" << endl << endl;
+    return;
+}
+
+int main()
+{
+    cout << endl << "Test Tuples Larger Than A Page .." << endl;
+
+    // Insert, update and delete a tuple larger than a page
+    TEST_RM_17("tbl_wide");
+
+    return 0;
+}
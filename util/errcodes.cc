@@ -19,6 +19,17 @@ namespace err
             case FILE_HANDLE_NOT_INITIALIZED:           return "FILE_HANDLE_NOT_INITIALIZED";
             case FILE_HANDLE_UNKNOWN:                   return "FILE_HANDLE_UNKNOWN";
             case FILE_NOT_OPENED:                       return "FILE_NOT_OPENED";
+            case FILE_MAP_FAILED:                       return "FILE_MAP_FAILED";
+            case FILE_COULD_NOT_EXTEND:                 return "FILE_COULD_NOT_EXTEND";
+            case FILE_INVALID_PAGE_SIZE:                return "FILE_INVALID_PAGE_SIZE";
+            case FILE_IN_USE:                           return "FILE_IN_USE";
+            case FILE_COULD_NOT_TRUNCATE:               return "FILE_COULD_NOT_TRUNCATE";
+            case BUFFER_POOL_EXHAUSTED:                 return "BUFFER_POOL_EXHAUSTED";
+            case BUFFER_FRAME_PINNED:                   return "BUFFER_FRAME_PINNED";
+            case BUFFER_FRAME_NOT_PINNED:               return "BUFFER_FRAME_NOT_PINNED";
+            case LOG_NOT_OPEN:                          return "LOG_NOT_OPEN";
+            case LOG_CORRUPT:                           return "LOG_CORRUPT";
+            case LOG_WRITE_FAILED:                      return "LOG_WRITE_FAILED";
             case HEADER_SIZE_CORRUPT:                   return "HEADER_SIZE_CORRUPT";
             case HEADER_PAGESIZE_MISMATCH:              return "HEADER_PAGESIZE_MISMATCH";
             case HEADER_VERSION_MISMATCH:               return "HEADER_VERSION_MISMATCH";
@@ -51,7 +51,22 @@ namespace err {
 
         INDEX_FILE_EXISTS,
 
-        OUT_OF_MEMORY
+        OUT_OF_MEMORY,
+
+        // Codes are only ever added here, so existing ones keep their values
+        FILE_MAP_FAILED,
+        FILE_COULD_NOT_EXTEND,
+        FILE_INVALID_PAGE_SIZE,
+        FILE_IN_USE,
+        FILE_COULD_NOT_TRUNCATE,
+
+        BUFFER_POOL_EXHAUSTED,
+        BUFFER_FRAME_PINNED,
+        BUFFER_FRAME_NOT_PINNED,
+
+        LOG_NOT_OPEN,
+        LOG_CORRUPT,
+        LOG_WRITE_FAILED
     };
     const char* errToString(int errnum);
 }